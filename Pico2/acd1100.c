@@ -1,8 +1,16 @@
 #include "acd1100.h"
 #include "mqtt_driver.h"
-#include "EMA_filter.h"
+#include "filter_pipeline.h"
+#include "fmt_utils.h"
+#include "log_buffer.h"
+#include "power_manager.h"
+#include "sensor_record.h"
+#include "store_forward.h"
 #include <stdio.h>
+#include <string.h>
 #include "hardware/i2c.h"
+#include "hardware/sync.h"
+#include "i2c_dma.h"
 #include "pico/stdlib.h"
 #include "secrets.h"
 
@@ -99,17 +107,10 @@ size_t acd1100_format_ppm(char *buf,
         return 0;
     }
 
-    int written = snprintf(buf, buf_len, "%lu", (unsigned long)ppm);
-    if (written < 0) {
-        buf[0] = '\0';
-        return 0;
-    }
-
-    if ((size_t)written >= buf_len) {
-        return buf_len - 1;
-    }
-
-    return (size_t)written;
+    fmt_buf_t f;
+    fmt_init(&f, buf, buf_len);
+    fmt_put_u32(&f, ppm);
+    return fmt_finish(&f);
 }
 
 // bool acd1100_read_ppm_string(i2c_inst_t *i2c,
@@ -138,6 +139,45 @@ size_t acd1100_format_ppm(char *buf,
 //     return true;
 // }
 
+// Validate the 9-byte frame and extract PPM / raw temperature
+static acd1100_status_t acd1100_decode_frame(const uint8_t buf[9],
+                                             uint32_t *ppm_out,
+                                             uint16_t *t_raw_out) {
+    const uint8_t ppm_hi[2] = {buf[0], buf[1]};
+    const uint8_t ppm_lo[2] = {buf[3], buf[4]};
+    const uint8_t t_raw_b[2] = {buf[6], buf[7]};
+
+    if (crc8_poly31_initFF(ppm_hi, 2) != buf[2]) {
+        LOG_ERROR("[ACD1100 ERROR] CRC1 mismatch\n");
+        return ACD1100_ERR_CRC;
+    }
+    if (crc8_poly31_initFF(ppm_lo, 2) != buf[5]) {
+        LOG_ERROR("[ACD1100 ERROR] CRC2 mismatch\n");
+        return ACD1100_ERR_CRC;
+    }
+    if (crc8_poly31_initFF(t_raw_b, 2) != buf[8]) {
+        LOG_ERROR("[ACD1100 ERROR] CRC3 mismatch\n");
+        return ACD1100_ERR_CRC;
+    }
+
+    uint32_t ppm =
+        ((uint32_t)buf[0] << 24) |
+        ((uint32_t)buf[1] << 16) |
+        ((uint32_t)buf[3] << 8)  |
+        ((uint32_t)buf[4]);
+
+    // Above FILTER_UINT_MAX the Q16.16 filter and record values would clamp
+    if (ppm == 0 || ppm > FILTER_UINT_MAX) {
+        LOG_ERROR("[ACD1100 ERROR] Invalid PPM value: %lu\n", ppm);
+        return ACD1100_ERR_RANGE;
+    }
+
+    if (ppm_out)     *ppm_out = ppm;
+    if (t_raw_out)   *t_raw_out = (uint16_t)((buf[6] << 8) | buf[7]);
+
+    return ACD1100_OK;
+}
+
 acd1100_status_t acd1100_read_ppm_string(
     i2c_inst_t *i2c,
     uint8_t addr,
@@ -158,7 +198,7 @@ acd1100_status_t acd1100_read_ppm_string(
     int w = i2c_write_blocking(i2c, addr, cmd, 2, false);
 
     if (w != 2) {
-        printf("[ACD1100 ERROR] I2C write failed\n");
+        LOG_ERROR("[ACD1100 ERROR] I2C write failed\n");
         return ACD1100_ERR_I2C;
     }
 
@@ -169,57 +209,262 @@ acd1100_status_t acd1100_read_ppm_string(
     // ----------------------------
     int r = i2c_read_blocking(i2c, addr, buf, 9, false);
     if (r != 9) {
-        printf("[ACD1100 ERROR] Short read: got %d bytes\n", r);
+        LOG_ERROR("[ACD1100 ERROR] Short read: got %d bytes\n", r);
         return ACD1100_ERR_I2C;
     }
 
     // ----------------------------
-    // 3. CRC checks
+    // 3. CRC checks + extract PPM
     // ----------------------------
-    const uint8_t ppm_hi[2] = {buf[0], buf[1]};
-    const uint8_t ppm_lo[2] = {buf[3], buf[4]};
-    const uint8_t t_raw_b[2] = {buf[6], buf[7]};
+    uint32_t ppm = 0;
+    acd1100_status_t status = acd1100_decode_frame(buf, &ppm, t_raw_out);
+    if (status != ACD1100_OK) {
+        return status;
+    }
 
-    if (crc8_poly31_initFF(ppm_hi, 2) != buf[2]) {
-        printf("[ACD1100 ERROR] CRC1 mismatch\n");
-        return ACD1100_ERR_CRC;
+    // ----------------------------
+    // 4. Format output string
+    // ----------------------------
+    acd1100_format_ppm(ppm_str, ppm_str_len, ppm);
+
+    if (ppm_out)     *ppm_out = ppm;
+
+    return ACD1100_OK;
+}
+
+/* ==========================================================
+   Ports
+   ========================================================== */
+static acd1100_done_cb_t port_timer_cb = NULL;
+static acd1100_done_cb_t port_xfer_cb = NULL;
+static alarm_pool_t *port_alarm_pool = NULL;   // NULL → default pool
+
+void acd1100_set_alarm_pool(alarm_pool_t *pool) {
+    port_alarm_pool = pool;
+}
+
+static int64_t acd1100_port_alarm_cb(alarm_id_t id, void *user_data) {
+    if (port_timer_cb) {
+        port_timer_cb(true);
     }
-    if (crc8_poly31_initFF(ppm_lo, 2) != buf[5]) {
-        printf("[ACD1100 ERROR] CRC2 mismatch\n");
-        return ACD1100_ERR_CRC;
+    return 0;   // one-shot
+}
+
+static bool acd1100_port_start_timer(uint32_t delay_ms, acd1100_done_cb_t expired) {
+    port_timer_cb = expired;
+    if (port_alarm_pool) {
+        return alarm_pool_add_alarm_in_ms(port_alarm_pool, delay_ms,
+                                          acd1100_port_alarm_cb, NULL, true) >= 0;
     }
-    if (crc8_poly31_initFF(t_raw_b, 2) != buf[8]) {
-        printf("[ACD1100 ERROR] CRC3 mismatch\n");
-        return ACD1100_ERR_CRC;
+    return add_alarm_in_ms(delay_ms, acd1100_port_alarm_cb, NULL, true) >= 0;
+}
+
+// --- Blocking SDK transfers (completion reported before returning) ---
+// The write is started from the caller. The read is requested from the
+// conversion alarm, i.e. in IRQ context, so it is only recorded there and
+// done by acd1100_blocking_poll() from the caller's polling loop.
+static struct {
+    i2c_inst_t *i2c;
+    uint8_t address;
+    uint8_t *dst;
+    size_t len;
+    acd1100_done_cb_t done;
+} blocking_read;
+static volatile bool blocking_read_pending = false;
+
+static bool acd1100_blocking_write(i2c_inst_t *i2c, uint8_t address,
+                                   const uint8_t *src, size_t len,
+                                   acd1100_done_cb_t done) {
+    int w = i2c_write_blocking(i2c, address, src, len, false);
+    if (w != (int)len) {
+        return false;
     }
+    done(true);
+    return true;
+}
 
-    // ----------------------------
-    // 4. Extract PPM
-    // ----------------------------
-    uint32_t ppm =
-        ((uint32_t)buf[0] << 24) |
-        ((uint32_t)buf[1] << 16) |
-        ((uint32_t)buf[3] << 8)  |
-        ((uint32_t)buf[4]);
+static bool acd1100_blocking_read(i2c_inst_t *i2c, uint8_t address,
+                                  uint8_t *dst, size_t len,
+                                  acd1100_done_cb_t done) {
+    blocking_read.i2c = i2c;
+    blocking_read.address = address;
+    blocking_read.dst = dst;
+    blocking_read.len = len;
+    blocking_read.done = done;
+    blocking_read_pending = true;
+    __sev();    // wake a caller waiting in __wfe() to run the read
+    return true;
+}
 
-    if (ppm == 0 || ppm > 50000) {
-        printf("[ACD1100 ERROR] Invalid PPM value: %lu\n", ppm);
-        return ACD1100_ERR_RANGE;
+static void acd1100_blocking_poll(void) {
+    if (!blocking_read_pending) {
+        return;
     }
+    blocking_read_pending = false;
+    int r = i2c_read_blocking(blocking_read.i2c, blocking_read.address,
+                              blocking_read.dst, blocking_read.len, false);
+    blocking_read.done(r == (int)blocking_read.len);
+}
 
-    uint16_t t_raw = (buf[6] << 8) | buf[7];
+const acd1100_port_t acd1100_blocking_port = {
+    .write = acd1100_blocking_write,
+    .read = acd1100_blocking_read,
+    .start_timer = acd1100_port_start_timer,
+    .poll = acd1100_blocking_poll,
+};
+
+// --- DMA transfers (completion from the I2C interrupt) ---
+static void acd1100_dma_done(i2c_dma_result_t result, void *user_data) {
+    if (port_xfer_cb) {
+        port_xfer_cb(result == I2C_DMA_OK);
+    }
+}
 
-    // ----------------------------
-    // 5. Format output string
-    // ----------------------------
-    snprintf(ppm_str, ppm_str_len, "%lu", ppm);
+static bool acd1100_dma_write(i2c_inst_t *i2c, uint8_t address,
+                              const uint8_t *src, size_t len,
+                              acd1100_done_cb_t done) {
+    port_xfer_cb = done;
+    return i2c_dma_write(i2c, address, src, len, acd1100_dma_done, NULL) == I2C_DMA_OK;
+}
 
-    if (ppm_out)     *ppm_out = ppm;
-    if (t_raw_out)   *t_raw_out = t_raw;
+static bool acd1100_dma_read(i2c_inst_t *i2c, uint8_t address,
+                             uint8_t *dst, size_t len,
+                             acd1100_done_cb_t done) {
+    port_xfer_cb = done;
+    return i2c_dma_read(i2c, address, dst, len, acd1100_dma_done, NULL) == I2C_DMA_OK;
+}
+
+const acd1100_port_t acd1100_dma_port = {
+    .write = acd1100_dma_write,
+    .read = acd1100_dma_read,
+    .start_timer = acd1100_port_start_timer,
+};
+
+/* ==========================================================
+   Non-blocking measurement
+   The state machine below only talks to the hardware through an
+   acd1100_port_t, so the bus and the conversion timer can be
+   swapped (DMA, blocking SDK calls, or a host-side mock).
+
+   IDLE -> WRITING -> CONVERTING -> READING -> READY
+                 \________________________\-> ERROR
+   ========================================================== */
+static volatile acd1100_state_t acd_state = ACD1100_STATE_IDLE;
+static const acd1100_port_t *acd_port = &acd1100_blocking_port;
+static i2c_inst_t *acd_i2c = NULL;
+static uint8_t acd_addr = ACD1100_I2C_ADDR;
+static uint64_t acd_cmd_us = 0;
+static uint8_t acd_frame[9];
+
+static void acd1100_fail(void) {
+    acd_state = ACD1100_STATE_ERROR;
+    __sev();    // wake a caller waiting in __wfe()
+}
+
+static void acd1100_read_done(bool ok) {
+    if (!ok) {
+        acd1100_fail();
+        return;
+    }
+    acd_state = ACD1100_STATE_READY;
+    __sev();
+}
+
+static void acd1100_conversion_done(bool ok) {
+    if (!ok) {
+        acd1100_fail();
+        return;
+    }
+    acd_state = ACD1100_STATE_READING;
+    if (!acd_port->read(acd_i2c, acd_addr, acd_frame, sizeof(acd_frame),
+                        acd1100_read_done)) {
+        acd1100_fail();
+    }
+}
+
+static void acd1100_write_done(bool ok) {
+    if (!ok) {
+        acd1100_fail();
+        return;
+    }
+    acd_state = ACD1100_STATE_CONVERTING;
+    if (!acd_port->start_timer(ACD1100_REQUEST_DELAY_MS,
+                               acd1100_conversion_done)) {
+        acd1100_fail();
+    }
+}
+
+void acd1100_set_port(const acd1100_port_t *port) {
+    if (port && !acd1100_is_busy()) {
+        acd_port = port;
+    }
+}
+
+bool acd1100_is_busy(void) {
+    acd1100_state_t s = acd_state;
+    return s == ACD1100_STATE_WRITING ||
+           s == ACD1100_STATE_CONVERTING ||
+           s == ACD1100_STATE_READING;
+}
+
+acd1100_status_t acd1100_start_measurement(i2c_inst_t *i2c, uint8_t address) {
+    static const uint8_t cmd[2] = {0x03, 0x00};
+
+    if (!i2c) {
+        return ACD1100_ERR_INVAL;
+    }
+    if (acd1100_is_busy()) {
+        return ACD1100_ERR_BUSY;
+    }
+
+    acd_i2c = i2c;
+    acd_addr = address;
+    acd_cmd_us = time_us_64();
+    acd_state = ACD1100_STATE_WRITING;
+
+    if (!acd_port->write(i2c, address, cmd, sizeof(cmd), acd1100_write_done)) {
+        LOG_ERROR("[ACD1100 ERROR] I2C write failed\n");
+        acd_state = ACD1100_STATE_IDLE;
+        return ACD1100_ERR_I2C;
+    }
 
     return ACD1100_OK;
 }
 
+bool acd1100_poll_measurement(void) {
+    if (acd_port->poll) {
+        acd_port->poll();
+    }
+    return !acd1100_is_busy();
+}
+
+acd1100_status_t acd1100_complete_measurement(uint32_t *ppm_out,
+                                              uint16_t *t_raw_out) {
+    switch (acd_state) {
+        case ACD1100_STATE_READY:
+            acd_state = ACD1100_STATE_IDLE;
+            return acd1100_decode_frame(acd_frame, ppm_out, t_raw_out);
+
+        case ACD1100_STATE_ERROR:
+            acd_state = ACD1100_STATE_IDLE;
+            LOG_ERROR("[ACD1100 ERROR] Transfer failed\n");
+            return ACD1100_ERR_I2C;
+
+        case ACD1100_STATE_IDLE:
+            return ACD1100_ERR_INVAL;
+
+        default:
+            return ACD1100_ERR_BUSY;
+    }
+}
+
+acd1100_state_t acd1100_get_state(void) {
+    return acd_state;
+}
+
+uint64_t acd1100_last_command_us(void) {
+    return acd_cmd_us;
+}
 
 void acd1100_init(i2c_inst_t *i2c,
                   uint sda_pin,
@@ -235,7 +480,14 @@ void acd1100_init(i2c_inst_t *i2c,
     gpio_pull_up(sda_pin);
     gpio_pull_up(scl_pin);
 
-    printf("ACD1100 CO2 reader (I2C addr 0x%02X)\n", ACD1100_I2C_ADDR);
+    if (i2c_dma_init(i2c)) {
+        acd1100_set_port(&acd1100_dma_port);
+    } else {
+        LOG_WARN("ACD1100: DMA unavailable, using blocking I2C\n");
+        acd1100_set_port(&acd1100_blocking_port);
+    }
+
+    LOG_INFO("ACD1100 CO2 reader (I2C addr 0x%02X)\n", ACD1100_I2C_ADDR);
 }
 
 void acd1100_run_loop(i2c_inst_t *i2c,
@@ -268,65 +520,154 @@ void acd1100_run_loop(i2c_inst_t *i2c,
     }
 }
 
-bool read_and_publish_ppm(void) {
-    uint32_t ppm = 0;
-    uint16_t t_raw = 0;
-    char payload[16];
+// CO₂ channel filter; acd1100_set_filter() replaces the default chain
+static const filter_config_t ACD1100_DEFAULT_FILTER = {
+    .stages    = FILTER_STAGE_EMA,
+    .median_n  = 1,
+    .ema_alpha = Q16_FROM_FRAC(1, 4),
+    .slew_max  = 0
+};
 
-    acd1100_status_t status = acd1100_read_ppm_string(
-        I2C_PORT,
-        ACD1100_I2C_ADDR,
-        payload,
-        sizeof(payload),
-        &ppm,
-        &t_raw
-    );
+static filter_t co2_filter;
+static bool co2_filter_ready = false;
 
-    // ------------------------------
-    // Handle error conditions
-    // ------------------------------
+void acd1100_set_filter(const filter_config_t *cfg) {
+    filter_init(&co2_filter, cfg);
+    co2_filter_ready = true;
+}
+
+// Print a readable message for a failed measurement
+static bool acd1100_report_status(acd1100_status_t status) {
     switch (status) {
 
         case ACD1100_OK:
-            break;  // success → move on
+            return true;  // success → move on
 
         case ACD1100_ERR_INVAL:
-            printf("[ACD1100] ERROR: Invalid parameters.\n");
+            LOG_ERROR("[ACD1100] ERROR: Invalid parameters.\n");
             return false;
 
         case ACD1100_ERR_I2C:
-            printf("[ACD1100] ERROR: I2C communication failed.\n");
+            LOG_ERROR("[ACD1100] ERROR: I2C communication failed.\n");
             return false;
 
         case ACD1100_ERR_CRC:
-            printf("[ACD1100] ERROR: CRC mismatch.\n");
+            LOG_ERROR("[ACD1100] ERROR: CRC mismatch.\n");
             return false;
 
         case ACD1100_ERR_RANGE:
-            printf("[ACD1100] ERROR: PPM value out of valid range.\n");
+            LOG_ERROR("[ACD1100] ERROR: PPM value out of valid range.\n");
             return false;
 
         case ACD1100_ERR_FORMAT:
-            printf("[ACD1100] ERROR: Sensor frame format error.\n");
+            LOG_ERROR("[ACD1100] ERROR: Sensor frame format error.\n");
+            return false;
+
+        case ACD1100_ERR_BUSY:
+            LOG_ERROR("[ACD1100] ERROR: Measurement already in progress.\n");
             return false;
 
         default:
-            printf("[ACD1100] ERROR: Unknown error code (%d).\n", status);
+            LOG_ERROR("[ACD1100] ERROR: Unknown error code (%d).\n", status);
             return false;
     }
+}
+
+bool start_ppm_measurement(void) {
+    return acd1100_report_status(
+        acd1100_start_measurement(I2C_PORT, ACD1100_I2C_ADDR));
+}
+
+bool complete_ppm_measurement(uint32_t *filtered_out) {
+    uint32_t ppm = 0;
+    uint16_t t_raw = 0;
 
+    acd1100_status_t status = acd1100_complete_measurement(&ppm, &t_raw);
+
+    // ------------------------------
+    // Handle error conditions
+    // ------------------------------
+    if (!acd1100_report_status(status)) {
+        return false;
+    }
 
     // ---------------------------------------
-    // If OK → apply filter & publish normally
+    // If OK → apply filter
     // ---------------------------------------
-    float filtered = ema_process((float)ppm);
+    if (!co2_filter_ready) {
+        acd1100_set_filter(&ACD1100_DEFAULT_FILTER);
+    }
+    q16_t filtered = filter_process(&co2_filter, filter_from_uint(ppm));
+
+    // One decimal place without going through float printf
+    int32_t tenths = (int32_t)(((int64_t)filtered * 10 + Q16_ONE / 2) >> 16);
+    LOG_INFO("CO2: raw=%lu ppm, filtered=%ld.%ld ppm\n",
+             ppm, tenths / 10, tenths % 10);
+
+    if (filtered_out) {
+        *filtered_out = filter_to_uint_round(filtered);
+    }
+    return true;
+}
 
-    printf("CO2: raw=%lu ppm, filtered=%.1f ppm\n",
-           (unsigned long)ppm, filtered);
+bool publish_ppm(uint32_t timestamp_ms, uint32_t filtered) {
+#if SR_PAYLOAD_BINARY
+    static uint16_t seq = 0;
+    uint8_t payload[SR_MAX_LEN];
+    sensor_record_t rec = {
+        .type   = SR_TYPE_CO2,
+        .count  = 1,
+        .seq    = seq,
+        .ts_ms  = timestamp_ms,
+        .values = { filter_from_uint(filtered) }
+    };
+    size_t len = sr_encode(&rec, payload, sizeof(payload));
+
+    sf_result_t r = (len == 0) ? SF_FAILED : sf_publish(TOPIC_CO2, payload, (uint16_t)len);
+    if (r == SF_FAILED) {
+        return false;
+    }
+    seq++;
+#else
+    char payload[16];
 
-    snprintf(payload, sizeof(payload), "%.0f", filtered);
-    mqtt_publish_message(TOPIC_CO2, payload, 0, 0);
+    acd1100_format_ppm(payload, sizeof(payload), filtered);
+    sf_result_t r = sf_publish(TOPIC_CO2, payload, (uint16_t)strlen(payload));
+    if (r == SF_FAILED) {
+        return false;
+    }
+#endif
+
+    if (r == SF_QUEUED) {
+        return false;   // kept in flash until the broker is back
+    }
+
+    // From the read command to the hand-off to lwIP: conversion, transfer,
+    // filter and publish path. With PICO2_ACQ_CORE1 core1 may already have
+    // written the next command if core0 fell behind, so this reads short.
+    printf("[ACD1100] Command-to-publish: %lu ms\n",
+           (unsigned long)((time_us_64() - acd1100_last_command_us()) / 1000));
 
     return true;
 }
 
+bool complete_and_publish_ppm(void) {
+    uint32_t filtered = 0;
+
+    if (!complete_ppm_measurement(&filtered)) {
+        return false;
+    }
+    return publish_ppm(power_uptime_ms(), filtered);
+}
+
+bool read_and_publish_ppm(void) {
+    if (!start_ppm_measurement()) {
+        return false;
+    }
+
+    while (!acd1100_poll_measurement()) {
+        __wfe();
+    }
+
+    return complete_and_publish_ppm();
+}
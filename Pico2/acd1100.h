@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "hardware/i2c.h"
+#include "pico/time.h"
+#include "filter_pipeline.h"
 
 #define ACD1100_I2C_ADDR 0x2A
 #define ACD1100_REQUEST_DELAY_MS 100u
@@ -29,7 +31,6 @@
 #define I2C_SDA_PIN        26      
 #define I2C_SCL_PIN        27      
 #define I2C_FREQ_HZ        100000 // 100 kHz
-#define ACD1100_I2C_ADDR   0x2A
 
 #define ACD1100_PIN_DEFAULT ((uint)(-1))
 
@@ -39,9 +40,53 @@ typedef enum {
     ACD1100_ERR_I2C     = -2,
     ACD1100_ERR_CRC     = -3,
     ACD1100_ERR_RANGE   = -4,
-    ACD1100_ERR_FORMAT  = -5
+    ACD1100_ERR_FORMAT  = -5,
+    ACD1100_ERR_BUSY    = -6
 } acd1100_status_t;
 
+// Non-blocking measurement state
+typedef enum {
+    ACD1100_STATE_IDLE = 0,     // no measurement in progress
+    ACD1100_STATE_WRITING,      // read command on the bus
+    ACD1100_STATE_CONVERTING,   // command sent, waiting for the conversion alarm
+    ACD1100_STATE_READING,      // 9-byte frame on the bus
+    ACD1100_STATE_READY,        // frame received, ready to decode
+    ACD1100_STATE_ERROR         // a transfer failed
+} acd1100_state_t;
+
+// Completion callback used by ports (may run in interrupt context)
+typedef void (*acd1100_done_cb_t)(bool ok);
+
+// Bus and timer back-end for the non-blocking state machine.
+// write/read return false if the transfer could not be started, otherwise
+// they report the outcome through done(); start_timer calls expired(true)
+// after delay_ms. poll (optional) runs work the port deferred out of
+// interrupt context; acd1100_poll_measurement() calls it.
+typedef struct {
+    bool (*write)(i2c_inst_t *i2c, uint8_t address,
+                  const uint8_t *src, size_t len, acd1100_done_cb_t done);
+    bool (*read)(i2c_inst_t *i2c, uint8_t address,
+                 uint8_t *dst, size_t len, acd1100_done_cb_t done);
+    bool (*start_timer)(uint32_t delay_ms, acd1100_done_cb_t expired);
+    void (*poll)(void);
+} acd1100_port_t;
+
+// DMA transfers, selected by acd1100_init() when channels are available
+extern const acd1100_port_t acd1100_dma_port;
+
+// Blocking i2c_*_blocking() transfers. The frame read runs from
+// acd1100_poll_measurement(), not from the alarm IRQ.
+extern const acd1100_port_t acd1100_blocking_port;
+
+// Select the port (ignored while a measurement is in flight)
+void acd1100_set_port(const acd1100_port_t *port);
+
+// Alarm pool for the conversion timer (NULL = default pool). Set this when
+// measurements are driven from core1 so the alarm IRQ fires on that core.
+void acd1100_set_alarm_pool(alarm_pool_t *pool);
+
+bool acd1100_is_busy(void);
+
 bool acd1100_read_measurement(i2c_inst_t *i2c,
                               uint8_t address,
                               uint32_t *ppm_out,
@@ -60,6 +105,24 @@ acd1100_status_t acd1100_read_ppm_string(
     uint16_t *t_raw_out
 );
 
+// Start the read command; the port then arms a hardware alarm for
+// ACD1100_REQUEST_DELAY_MS and reads the frame when it fires.
+// Returns immediately so the caller can keep servicing the network stack.
+acd1100_status_t acd1100_start_measurement(i2c_inst_t *i2c, uint8_t address);
+
+// Returns true once the measurement has finished (READY or ERROR). Call
+// it from the wait loop: it also runs the port's deferred work.
+bool acd1100_poll_measurement(void);
+
+// Validate the frame of the measurement started earlier and return to IDLE
+acd1100_status_t acd1100_complete_measurement(uint32_t *ppm_out,
+                                              uint16_t *t_raw_out);
+
+acd1100_state_t acd1100_get_state(void);
+
+// Time (us since boot) at which the last read command was written
+uint64_t acd1100_last_command_us(void);
+
 void acd1100_init(i2c_inst_t *i2c,
                   uint sda_pin,
                   uint scl_pin,
@@ -71,4 +134,21 @@ void acd1100_run_loop(i2c_inst_t *i2c,
 
 bool read_and_publish_ppm(void);
 
+// Split form of read_and_publish_ppm() for callers with their own wait loop
+bool start_ppm_measurement(void);
+bool complete_and_publish_ppm(void);
+
+// Filter chain for the CO₂ channel (default: EMA, alpha 0.25)
+void acd1100_set_filter(const filter_config_t *cfg);
+
+// Finish the measurement and run it through the filter (no publish)
+bool complete_ppm_measurement(uint32_t *filtered_out);
+
+// Publish one filtered value on TOPIC_CO2, stamped with the time the
+// sample was taken (power_uptime_ms() clock, as used for batches and
+// summaries). Goes out ahead of any queued backlog, which replays on its
+// own topic. Returns false if it could not go out now; while the broker is
+// unreachable it is queued in flash (store_forward.h) rather than lost.
+bool publish_ppm(uint32_t timestamp_ms, uint32_t filtered);
+
 #endif
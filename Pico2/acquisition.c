@@ -0,0 +1,170 @@
+#include "acquisition.h"
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+#include "acd1100.h"
+#include "power_manager.h"
+#include "log_buffer.h"
+#include "phase_stats.h"
+#include "sample_schedule.h"
+
+// ----------------------------------------------------------------------
+// SPSC queue: core1 only writes tail, core0 only writes head
+// ----------------------------------------------------------------------
+static sample_t queue[ACQ_QUEUE_LEN];
+static volatile uint32_t q_head = 0;
+static volatile uint32_t q_tail = 0;
+
+static bool queue_push(const sample_t *s) {
+    uint32_t tail = q_tail;
+    if (tail - q_head == ACQ_QUEUE_LEN) {
+        return false;
+    }
+    queue[tail % ACQ_QUEUE_LEN] = *s;
+    __mem_fence_release();   // entry visible before the new tail
+    q_tail = tail + 1;
+    return true;
+}
+
+bool acquisition_pop(sample_t *out) {
+    uint32_t head = q_head;
+    if (head == q_tail) {
+        return false;
+    }
+    __mem_fence_acquire();   // tail read before the entry
+    *out = queue[head % ACQ_QUEUE_LEN];
+    __mem_fence_release();   // entry copied before the slot is handed back
+    q_head = head + 1;
+    return true;
+}
+
+bool acquisition_pending(void) {
+    return q_head != q_tail;
+}
+
+// ----------------------------------------------------------------------
+// Core1
+// ----------------------------------------------------------------------
+static acq_interval_fn_t acq_interval_ms = NULL;
+static volatile acq_stats_t stats;
+static volatile bool slot_due = false;
+
+static int64_t acq_slot_alarm_cb(alarm_id_t id, void *user_data) {
+    slot_due = true;
+    __sev();
+    return 0;
+}
+
+// Wait for the next slot on core1's own alarm, so nothing core0 does with
+// its interrupts delays the wake-up. Returns false if a safety-level
+// change (generation != gen) cut the wait short.
+static bool acq_wait_until(alarm_pool_t *pool, absolute_time_t t, uint32_t gen) {
+    slot_due = false;
+    alarm_id_t id = alarm_pool_add_alarm_at(pool, t, acq_slot_alarm_cb, NULL, true);
+    if (id <= 0) {
+        return true;   // already due (0) or no alarm slot (<0): run now
+    }
+    while (!slot_due) {
+        if (sched_generation() != gen) {
+            alarm_pool_cancel_alarm(pool, id);
+            return false;
+        }
+        __wfe();
+    }
+    return true;
+}
+
+static bool acq_measure(uint32_t *filtered) {
+    uint64_t t = phase_begin();
+    if (!start_ppm_measurement()) {
+        return false;
+    }
+    while (!acd1100_poll_measurement()) {
+        __wfe();
+    }
+    phase_end(PHASE_SENSOR, t);
+    return complete_ppm_measurement(filtered);
+}
+
+static void acquisition_core1_entry(void) {
+    // Let core0 park us while it programs flash (flash_queue.h)
+    multicore_lockout_victim_init();
+
+    // Alarm pool and I2C IRQ are registered on the calling core
+    alarm_pool_t *pool = alarm_pool_create_with_unused_hardware_alarm(4);
+    acd1100_set_alarm_pool(pool);
+    acd1100_init(I2C_PORT, I2C_SDA_PIN, I2C_SCL_PIN, I2C_FREQ_HZ);
+
+    uint64_t jitter_total_us = 0;
+    uint32_t slots = 0;
+    absolute_time_t slot = get_absolute_time();   // start of the last sample
+    absolute_time_t next = slot;
+    uint32_t gen = sched_generation();
+
+    while (true) {
+        if (!acq_wait_until(pool, next, gen)) {
+            // Level changed mid-wait: re-plan from the last slot with the
+            // new interval (possibly due right away)
+            gen = sched_generation();
+            next = sched_next_slot(slot, acq_interval_ms());
+            continue;
+        }
+        gen = sched_generation();
+
+        int64_t late_us = absolute_time_diff_us(next, get_absolute_time());
+        uint32_t jitter_us = late_us > 0 ? (uint32_t)late_us : 0;
+        slots++;
+        jitter_total_us += jitter_us;
+        if (jitter_us > stats.jitter_max_us) {
+            stats.jitter_max_us = jitter_us;
+        }
+        stats.jitter_avg_us = (uint32_t)(jitter_total_us / slots);
+
+        slot = next;
+        sched_sample_started();
+
+        sample_t s = { .timestamp_ms = power_uptime_ms(), .ppm = 0 };
+        if (!acq_measure(&s.ppm)) {
+            stats.failed++;
+        } else if (!queue_push(&s)) {
+            stats.queue_full++;
+        } else {
+            stats.samples++;
+            __sev();   // wake core0
+        }
+
+        // Schedule from the slot, not from now, so errors don't accumulate;
+        // slots that have already passed are counted and skipped
+        uint32_t interval = acq_interval_ms();
+        next = delayed_by_ms(slot, interval);
+        while (time_reached(next)) {
+            next = delayed_by_ms(next, interval);
+            stats.missed++;
+        }
+    }
+}
+
+void acquisition_start(acq_interval_fn_t interval_ms) {
+    acq_interval_ms = interval_ms;
+    multicore_launch_core1(acquisition_core1_entry);
+}
+
+void acquisition_get_stats(acq_stats_t *out) {
+    out->samples       = stats.samples;
+    out->missed        = stats.missed;
+    out->failed        = stats.failed;
+    out->queue_full    = stats.queue_full;
+    out->jitter_max_us = stats.jitter_max_us;
+    out->jitter_avg_us = stats.jitter_avg_us;
+}
+
+void acquisition_report(void) {
+    acq_stats_t s;
+    acquisition_get_stats(&s);
+    printf("[ACQ] samples=%lu missed=%lu failed=%lu queue_full=%lu "
+           "jitter avg=%lu us max=%lu us\n",
+           (unsigned long)s.samples, (unsigned long)s.missed,
+           (unsigned long)s.failed, (unsigned long)s.queue_full,
+           (unsigned long)s.jitter_avg_us, (unsigned long)s.jitter_max_us);
+}
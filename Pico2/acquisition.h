@@ -0,0 +1,38 @@
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sample_buffer.h"
+
+// CO2 acquisition on core1. Core1 owns the ACD1100 (I2C IRQ, DMA and its
+// own alarm pool) and samples on a fixed schedule; filtered samples reach
+// core0 through a lock-free single-producer/single-consumer queue, so
+// Wi-Fi/MQTT stalls on core0 no longer shift sample times.
+
+#define ACQ_QUEUE_LEN  16   // power of two; ~16 samples of slack for core0
+
+typedef uint32_t (*acq_interval_fn_t)(void);
+
+typedef struct {
+    uint32_t samples;          // pushed to the queue
+    uint32_t missed;           // schedule slots skipped because core1 ran late
+    uint32_t failed;           // measurements that returned an error
+    uint32_t queue_full;       // samples lost because core0 fell behind
+    uint32_t jitter_max_us;    // worst start time vs. schedule
+    uint32_t jitter_avg_us;    // mean start time vs. schedule
+} acq_stats_t;
+
+// Launch core1. interval_ms() is called from core1 before each sample to
+// pick the next period (e.g. from the current safety level).
+void acquisition_start(acq_interval_fn_t interval_ms);
+
+// Core0: take the oldest sample. Returns false when the queue is empty.
+bool acquisition_pop(sample_t *out);
+
+bool acquisition_pending(void);
+
+void acquisition_get_stats(acq_stats_t *out);
+void acquisition_report(void);
+
+#endif
@@ -0,0 +1,53 @@
+#include "deadband.h"
+
+void deadband_init(deadband_t *db, const deadband_config_t *cfg) {
+    db->cfg = *cfg;
+    db->has_last = false;
+    db->force_next = false;
+    db->last_value = 0;
+    db->last_report_ms = 0;
+    db->reported = 0;
+    db->suppressed = 0;
+}
+
+void deadband_force_next(deadband_t *db) {
+    db->force_next = true;
+}
+
+static bool deadband_moved(const deadband_t *db, uint32_t value) {
+    uint32_t delta = (value > db->last_value) ? value - db->last_value
+                                              : db->last_value - value;
+
+    if (db->cfg.abs_delta == 0 && db->cfg.rel_permille == 0) {
+        return true;
+    }
+    if (db->cfg.abs_delta != 0 && delta > db->cfg.abs_delta) {
+        return true;
+    }
+    // delta * 1000 > permille * last, widened so large readings can't wrap
+    if (db->cfg.rel_permille != 0 &&
+        (uint64_t)delta * 1000u > (uint64_t)db->cfg.rel_permille * db->last_value) {
+        return true;
+    }
+    return false;
+}
+
+bool deadband_check(deadband_t *db, uint32_t now_ms, uint32_t value) {
+    bool report = !db->has_last
+               || db->force_next
+               || deadband_moved(db, value)
+               || (db->cfg.heartbeat_ms != 0 &&
+                   now_ms - db->last_report_ms >= db->cfg.heartbeat_ms);
+
+    if (!report) {
+        db->suppressed++;
+        return false;
+    }
+
+    db->has_last = true;
+    db->force_next = false;
+    db->last_value = value;
+    db->last_report_ms = now_ms;
+    db->reported++;
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Report-by-exception: a value is reported only when it has moved far
+// enough from the last reported value, or when the channel has been quiet
+// for too long (heartbeat). Consumers reconstruct the series by holding
+// each reported value until the next one. Pure logic, no SDK dependencies.
+
+typedef struct {
+    uint32_t abs_delta;       // report when |change| > this (0 = unused)
+    uint16_t rel_permille;    // report when |change| > this ‰ of last (0 = unused)
+    uint32_t heartbeat_ms;    // report at least this often (0 = never forced)
+} deadband_config_t;
+
+typedef struct {
+    deadband_config_t cfg;
+    bool     has_last;
+    bool     force_next;
+    uint32_t last_value;
+    uint32_t last_report_ms;
+    uint32_t reported;
+    uint32_t suppressed;
+} deadband_t;
+
+void deadband_init(deadband_t *db, const deadband_config_t *cfg);
+
+// Decide whether value (taken at now_ms) should be reported. On true the
+// value becomes the new reference; on false the suppressed counter grows.
+// With both thresholds unused, every value is reported.
+bool deadband_check(deadband_t *db, uint32_t now_ms, uint32_t value);
+
+// Report the next value regardless (e.g. after a mode change)
+void deadband_force_next(deadband_t *db);
+
+#endif
@@ -0,0 +1,56 @@
+#include "excursion.h"
+
+void excursion_init(excursion_t *ex, const excursion_config_t *cfg) {
+    ex->cfg = *cfg;
+    ex->active = false;
+    ex->count = 0;
+    ex->head = 0;
+    ex->trips = 0;
+}
+
+// Lowest value in the history that is still inside the rise window
+static bool excursion_window_min(const excursion_t *ex, uint32_t now_ms, uint32_t *min_out) {
+    bool found = false;
+
+    for (uint8_t i = 0; i < ex->count; i++) {
+        if (now_ms - ex->hist_ms[i] > ex->cfg.rise_window_ms) {
+            continue;
+        }
+        if (!found || ex->hist_value[i] < *min_out) {
+            *min_out = ex->hist_value[i];
+            found = true;
+        }
+    }
+    return found;
+}
+
+excursion_event_t excursion_check(excursion_t *ex, uint32_t now_ms, uint32_t value) {
+    uint32_t min_value = 0;
+    bool rising = ex->cfg.rise_ppm != 0
+               && excursion_window_min(ex, now_ms, &min_value)
+               && value > min_value
+               && value - min_value >= ex->cfg.rise_ppm;
+
+    ex->hist_ms[ex->head] = now_ms;
+    ex->hist_value[ex->head] = value;
+    ex->head = (uint8_t)((ex->head + 1) % EXCURSION_HISTORY);
+    if (ex->count < EXCURSION_HISTORY) {
+        ex->count++;
+    }
+
+    if (!ex->active) {
+        bool high = ex->cfg.level_ppm != 0 && value >= ex->cfg.level_ppm;
+        if (high || rising) {
+            ex->active = true;
+            ex->trips++;
+            return EXCURSION_START;
+        }
+        return EXCURSION_NONE;
+    }
+
+    if (!rising && value < ex->cfg.clear_ppm) {
+        ex->active = false;
+        return EXCURSION_CLEAR;
+    }
+    return EXCURSION_NONE;
+}
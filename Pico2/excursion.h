@@ -0,0 +1,47 @@
+#ifndef EXCURSION_H
+#define EXCURSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Local CO2 excursion detector for edge sampling with the radio off. An
+// excursion starts when the filtered value crosses an absolute threshold
+// or rises by more than rise_ppm within rise_window_ms, and clears once the
+// value is back below clear_ppm and no longer rising. Pure logic, no SDK
+// dependencies.
+
+#define EXCURSION_HISTORY 12  // samples kept for the rate-of-rise check
+
+typedef struct {
+    uint32_t level_ppm;        // start when value >= this (0 = unused)
+    uint32_t clear_ppm;        // clear when value < this (hysteresis)
+    uint32_t rise_ppm;         // start when value - window minimum >= this (0 = unused)
+    uint32_t rise_window_ms;   // look-back for the rate-of-rise check
+} excursion_config_t;
+
+typedef enum {
+    EXCURSION_NONE = 0,        // no state change
+    EXCURSION_START,
+    EXCURSION_CLEAR
+} excursion_event_t;
+
+typedef struct {
+    excursion_config_t cfg;
+    bool     active;
+    uint8_t  count;
+    uint8_t  head;
+    uint32_t hist_ms[EXCURSION_HISTORY];
+    uint32_t hist_value[EXCURSION_HISTORY];
+    uint32_t trips;            // excursions started
+} excursion_t;
+
+void excursion_init(excursion_t *ex, const excursion_config_t *cfg);
+
+// Feed one filtered sample taken at now_ms
+excursion_event_t excursion_check(excursion_t *ex, uint32_t now_ms, uint32_t value);
+
+static inline bool excursion_active(const excursion_t *ex) {
+    return ex->active;
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include "filter_pipeline.h"
+#include <string.h>
+
+static q16_t q16_saturate(int64_t v) {
+    if (v > Q16_MAX) return Q16_MAX;
+    if (v < Q16_MIN) return Q16_MIN;
+    return (q16_t)v;
+}
+
+void filter_init(filter_t *f, const filter_config_t *cfg) {
+    f->cfg = *cfg;
+
+    if (f->cfg.median_n < 1) {
+        f->cfg.median_n = 1;
+    }
+    if (f->cfg.median_n > FILTER_MEDIAN_MAX) {
+        f->cfg.median_n = FILTER_MEDIAN_MAX;
+    }
+    if ((f->cfg.median_n & 1u) == 0) {
+        f->cfg.median_n--;   // even windows have no single middle sample
+    }
+
+    if (f->cfg.ema_alpha < 0) {
+        f->cfg.ema_alpha = 0;
+    }
+    if (f->cfg.ema_alpha > Q16_ONE) {
+        f->cfg.ema_alpha = Q16_ONE;
+    }
+
+    if (f->cfg.slew_max <= 0) {
+        f->cfg.stages &= (uint8_t)~FILTER_STAGE_SLEW;
+    }
+
+    filter_reset(f);
+}
+
+void filter_reset(filter_t *f) {
+    memset(f->window, 0, sizeof(f->window));
+    f->window_count = 0;
+    f->window_pos = 0;
+    f->ema_prev = 0;
+    f->out_prev = 0;
+    f->started = false;
+}
+
+// Median of the samples seen so far (up to median_n). Insertion sort on a
+// copy: N is tiny, so this beats anything cleverer on the M0+.
+static q16_t stage_median(filter_t *f, q16_t x) {
+    f->window[f->window_pos] = x;
+    f->window_pos = (uint8_t)((f->window_pos + 1) % f->cfg.median_n);
+    if (f->window_count < f->cfg.median_n) {
+        f->window_count++;
+    }
+
+    q16_t sorted[FILTER_MEDIAN_MAX];
+    uint8_t n = f->window_count;
+
+    for (uint8_t i = 0; i < n; i++) {
+        q16_t v = f->window[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[n / 2];
+}
+
+static q16_t stage_ema(filter_t *f, q16_t x) {
+    // prev + alpha * (x - prev), widened so the difference can't overflow
+    int64_t diff = (int64_t)x - f->ema_prev;
+    f->ema_prev = q16_saturate(f->ema_prev + ((diff * f->cfg.ema_alpha) >> 16));
+    return f->ema_prev;
+}
+
+static q16_t stage_slew(filter_t *f, q16_t x) {
+    int64_t step = (int64_t)x - f->out_prev;
+
+    if (step > f->cfg.slew_max) {
+        return f->out_prev + f->cfg.slew_max;
+    }
+    if (step < -(int64_t)f->cfg.slew_max) {
+        return f->out_prev - f->cfg.slew_max;
+    }
+    return x;
+}
+
+q16_t filter_process(filter_t *f, q16_t x) {
+    q16_t v = x;
+
+    if (f->cfg.stages & FILTER_STAGE_MEDIAN) {
+        v = stage_median(f, v);
+    }
+
+    if (!f->started) {
+        // First sample → no smoothing or slew limiting
+        f->ema_prev = v;
+        f->out_prev = v;
+        f->started = true;
+        return v;
+    }
+
+    if (f->cfg.stages & FILTER_STAGE_EMA) {
+        v = stage_ema(f, v);
+    }
+    if (f->cfg.stages & FILTER_STAGE_SLEW) {
+        v = stage_slew(f, v);
+    }
+
+    f->out_prev = v;
+    return v;
+}
+
+q16_t filter_from_uint(uint32_t x) {
+    return q16_saturate((int64_t)x << 16);
+}
+
+uint32_t filter_to_uint_round(q16_t x) {
+    if (x <= 0) {
+        return 0;
+    }
+    return (uint32_t)(((int64_t)x + (Q16_ONE / 2)) >> 16);
+}
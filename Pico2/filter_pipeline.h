@@ -0,0 +1,60 @@
+#ifndef FILTER_PIPELINE_H
+#define FILTER_PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-channel Q16.16 filter chain: median-of-N spike rejection → EMA →
+// slew-rate limit. Integer only (the M0+ has no FPU), no SDK dependencies.
+// Values saturate at the Q16.16 range of roughly ±32767.
+
+typedef int32_t q16_t;
+
+// Largest reading filter_from_uint() converts exactly. Anything above
+// would saturate, so sensor drivers reject it as out of range instead.
+#define FILTER_UINT_MAX  32767u
+
+#define Q16_ONE                 ((q16_t)1 << 16)
+#define Q16_MAX                 INT32_MAX
+#define Q16_MIN                 INT32_MIN
+#define Q16_FROM_INT(x)         ((q16_t)(x) * Q16_ONE)
+#define Q16_FROM_FRAC(num, den) ((q16_t)(((int64_t)(num) << 16) / (den)))
+
+// Stage enable bits for filter_config_t.stages
+#define FILTER_STAGE_MEDIAN  (1u << 0)
+#define FILTER_STAGE_EMA     (1u << 1)
+#define FILTER_STAGE_SLEW    (1u << 2)
+
+#define FILTER_MEDIAN_MAX    7    // largest supported median window
+
+typedef struct {
+    uint8_t stages;       // FILTER_STAGE_* bits
+    uint8_t median_n;     // median window, odd, 1..FILTER_MEDIAN_MAX
+    q16_t   ema_alpha;    // smoothing factor, 0..Q16_ONE
+    q16_t   slew_max;     // largest output step per sample (> 0)
+} filter_config_t;
+
+typedef struct {
+    filter_config_t cfg;
+    q16_t   window[FILTER_MEDIAN_MAX];
+    uint8_t window_count;
+    uint8_t window_pos;
+    q16_t   ema_prev;
+    q16_t   out_prev;
+    bool    started;
+} filter_t;
+
+// Apply cfg (invalid median/alpha values are clamped) and reset state
+void filter_init(filter_t *f, const filter_config_t *cfg);
+
+// Drop history; the next sample passes through unfiltered
+void filter_reset(filter_t *f);
+
+// Push one sample through the chain and return the filtered value
+q16_t filter_process(filter_t *f, q16_t x);
+
+// Convert an integer reading and back with round-half-up
+q16_t filter_from_uint(uint32_t x);
+uint32_t filter_to_uint_round(q16_t x);
+
+#endif
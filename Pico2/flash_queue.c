@@ -0,0 +1,409 @@
+#include "flash_queue.h"
+#include <stdio.h>
+#include <string.h>
+#include "sensor_record.h"   // sr_crc16()
+
+#define FQ_SLOTS_PER_SECTOR  (FQ_SECTOR_SIZE / FQ_SLOT_SIZE)   // slot 0 is the header
+#define FQ_SECTOR_MAGIC      0x51465150u   // "PQFQ"
+
+_Static_assert(FQ_PAGE_SIZE % FQ_SLOT_SIZE == 0, "slots must not straddle pages");
+
+typedef struct {
+    bool     valid;          // header present and intact
+    uint32_t seq;            // order in which sectors were opened
+    uint32_t erase_count;
+    uint16_t pending;        // pending records in this sector
+} fq_sector_t;
+
+static fq_sector_t sectors[FQ_SECTORS];
+static bool     head_open = false;   // a sector is open for appends
+static uint8_t  head_sector = 0;
+static uint16_t head_slot = 1;       // next free slot in head_sector
+static uint8_t  tail_sector = 0;     // oldest pending record, valid if pending > 0
+static uint16_t tail_slot = 1;
+static uint32_t next_seq = 0;
+static fq_stats_t stats;
+
+// ----------------------------------------------------------------------
+// On-chip flash: the last FQ_REGION_SIZE bytes
+// ----------------------------------------------------------------------
+#if PICO_ON_DEVICE
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+#define FQ_REGION_OFFSET     (PICO_FLASH_SIZE_BYTES - FQ_REGION_SIZE)
+#define FQ_FLASH_TIMEOUT_MS  100
+
+_Static_assert(FQ_SECTOR_SIZE == FLASH_SECTOR_SIZE, "FQ_SECTOR_SIZE must be the erase sector");
+_Static_assert(FQ_PAGE_SIZE == FLASH_PAGE_SIZE, "FQ_PAGE_SIZE must be the program page");
+
+extern char __flash_binary_end;   // from the SDK linker script
+
+typedef struct {
+    uint32_t       offset;
+    const uint8_t *page;
+} fq_program_t;
+
+static void fq_do_erase(void *param) {
+    flash_range_erase(*(const uint32_t *)param, FQ_SECTOR_SIZE);
+}
+
+static void fq_do_program(void *param) {
+    const fq_program_t *p = param;
+    flash_range_program(p->offset, p->page, FQ_PAGE_SIZE);
+}
+
+static bool fq_onchip_erase(uint32_t offset) {
+    offset += FQ_REGION_OFFSET;
+    return flash_safe_execute(fq_do_erase, &offset, FQ_FLASH_TIMEOUT_MS) == PICO_OK;
+}
+
+static bool fq_onchip_program(uint32_t offset, const uint8_t *page) {
+    fq_program_t p = { .offset = FQ_REGION_OFFSET + offset, .page = page };
+    return flash_safe_execute(fq_do_program, &p, FQ_FLASH_TIMEOUT_MS) == PICO_OK;
+}
+
+static const uint8_t *fq_onchip_read(uint32_t offset) {
+    return (const uint8_t *)(XIP_BASE + FQ_REGION_OFFSET + offset);
+}
+
+static const fq_flash_ops_t fq_onchip_ops = {
+    .erase   = fq_onchip_erase,
+    .program = fq_onchip_program,
+    .read    = fq_onchip_read,
+};
+
+// Nothing reserves the region in the linker script, so make sure the
+// image hasn't grown into it before the first erase does
+static bool fq_onchip_region_free(void) {
+    return (uintptr_t)&__flash_binary_end <= XIP_BASE + FQ_REGION_OFFSET;
+}
+
+static const fq_flash_ops_t *flash_ops = &fq_onchip_ops;
+#else
+static const fq_flash_ops_t *flash_ops = NULL;   // host: flash_queue_set_ops()
+#endif
+
+void flash_queue_set_ops(const fq_flash_ops_t *ops) {
+    flash_ops = ops;
+}
+
+// ----------------------------------------------------------------------
+// Flash access
+// ----------------------------------------------------------------------
+static uint32_t fq_offset(uint8_t sector, uint16_t slot) {
+    return (uint32_t)sector * FQ_SECTOR_SIZE + (uint32_t)slot * FQ_SLOT_SIZE;
+}
+
+static const uint8_t *fq_read(uint8_t sector, uint16_t slot) {
+    return flash_ops->read(fq_offset(sector, slot));
+}
+
+static bool fq_erase(uint8_t sector) {
+    return flash_ops->erase(fq_offset(sector, 0));
+}
+
+// Program len bytes at slot+at. The rest of the page is written as 0xFF,
+// which leaves the bits already programmed there untouched.
+static bool fq_program(uint8_t sector, uint16_t slot, uint8_t at, const uint8_t *data, size_t len) {
+    static uint8_t page[FQ_PAGE_SIZE];
+    uint32_t offset = fq_offset(sector, slot) + at;
+    uint32_t page_offset = offset & ~(uint32_t)(FQ_PAGE_SIZE - 1);
+
+    memset(page, 0xFF, sizeof(page));
+    memcpy(&page[offset - page_offset], data, len);
+    return flash_ops->program(page_offset, page);
+}
+
+// ----------------------------------------------------------------------
+// Encoding
+// ----------------------------------------------------------------------
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// CRC over everything but the state byte, which changes on consumption
+static uint16_t fq_record_crc(const uint8_t *slot) {
+    uint8_t buf[FQ_SLOT_SIZE];
+    uint8_t len = slot[2];
+
+    buf[0] = slot[1];
+    buf[1] = slot[2];
+    memcpy(&buf[2], &slot[4], 4);
+    memcpy(&buf[6], &slot[FQ_RECORD_HDR_LEN], len);
+    return sr_crc16(buf, 6u + len);
+}
+
+static bool fq_record_valid(const uint8_t *slot) {
+    return slot[2] <= FQ_PAYLOAD_MAX &&
+           (uint16_t)(slot[8] | (slot[9] << 8)) == fq_record_crc(slot);
+}
+
+static bool fq_slot_blank(const uint8_t *slot) {
+    for (int i = 0; i < FQ_SLOT_SIZE; i++) {
+        if (slot[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool fq_read_header(uint8_t sector, fq_sector_t *out) {
+    const uint8_t *h = fq_read(sector, 0);
+
+    out->valid = get_u32(&h[0]) == FQ_SECTOR_MAGIC &&
+                 (uint16_t)(h[12] | (h[13] << 8)) == sr_crc16(h, 12);
+    out->seq = out->valid ? get_u32(&h[4]) : 0;
+    out->erase_count = out->valid ? get_u32(&h[8]) : 0;
+    out->pending = 0;
+    return out->valid;
+}
+
+// ----------------------------------------------------------------------
+// Recovery
+// ----------------------------------------------------------------------
+void flash_queue_init(void) {
+    int newest = -1;
+
+    stats = (fq_stats_t){ 0 };
+    head_open = false;
+    next_seq = 0;
+
+#if PICO_ON_DEVICE
+    if (flash_ops == &fq_onchip_ops && !fq_onchip_region_free()) {
+        printf("[FQ] Firmware reaches into the queue region, queue disabled\n");
+        flash_ops = NULL;
+    }
+#endif
+    if (!flash_ops) {
+        return;
+    }
+
+    for (uint8_t s = 0; s < FQ_SECTORS; s++) {
+        if (!fq_read_header(s, &sectors[s])) {
+            continue;
+        }
+        if (sectors[s].erase_count > stats.erase_max) {
+            stats.erase_max = sectors[s].erase_count;
+        }
+        if (newest < 0 || (int32_t)(sectors[s].seq - sectors[newest].seq) > 0) {
+            newest = s;
+        }
+    }
+
+    if (newest < 0) {
+        printf("[FQ] No queue in flash, starting empty\n");
+        return;
+    }
+
+    head_open = true;
+    head_sector = (uint8_t)newest;
+    head_slot = FQ_SLOTS_PER_SECTOR;   // narrowed below
+
+    // Sectors are opened in ring order, so oldest to newest is the ring
+    // walk that ends at the head
+    bool have_tail = false;
+    for (uint8_t i = 1; i <= FQ_SECTORS; i++) {
+        uint8_t s = (uint8_t)((head_sector + i) % FQ_SECTORS);
+        if (!sectors[s].valid) {
+            continue;
+        }
+
+        uint16_t last_used = 0;
+        for (uint16_t slot = 1; slot < FQ_SLOTS_PER_SECTOR; slot++) {
+            const uint8_t *r = fq_read(s, slot);
+            if (fq_slot_blank(r)) {
+                continue;
+            }
+            last_used = slot;
+
+            if (!fq_record_valid(r)) {
+                stats.corrupt++;
+                continue;
+            }
+            uint32_t seq = get_u32(&r[4]);
+            if ((int32_t)(seq + 1 - next_seq) > 0) {
+                next_seq = seq + 1;
+            }
+            if (r[0] == FQ_STATE_PENDING) {
+                sectors[s].pending++;
+                stats.pending++;
+                if (!have_tail) {
+                    have_tail = true;
+                    tail_sector = s;
+                    tail_slot = slot;
+                }
+            }
+        }
+
+        if (s == head_sector) {
+            head_slot = (uint16_t)(last_used + 1);
+        }
+    }
+
+    printf("[FQ] Recovered %lu pending record(s), %lu corrupt slot(s) skipped\n",
+           (unsigned long)stats.pending, (unsigned long)stats.corrupt);
+}
+
+// ----------------------------------------------------------------------
+// Queue operations
+// ----------------------------------------------------------------------
+
+// Move the tail to the next pending record after (sector, slot)
+static void fq_advance_tail(uint8_t sector, uint16_t slot) {
+    if (stats.pending == 0) {
+        return;
+    }
+
+    for (uint8_t i = 0; i <= FQ_SECTORS; i++) {
+        uint8_t s = (uint8_t)((sector + i) % FQ_SECTORS);
+        if (!sectors[s].valid || sectors[s].pending == 0) {
+            slot = 0;
+            continue;
+        }
+        for (uint16_t n = (uint16_t)(slot + 1); n < FQ_SLOTS_PER_SECTOR; n++) {
+            const uint8_t *r = fq_read(s, n);
+            if (r[0] == FQ_STATE_PENDING && fq_record_valid(r)) {
+                tail_sector = s;
+                tail_slot = n;
+                return;
+            }
+        }
+        slot = 0;
+    }
+}
+
+// Erase the next sector in the ring and make it the head
+static bool fq_open_next_sector(void) {
+    uint8_t next = head_open ? (uint8_t)((head_sector + 1) % FQ_SECTORS) : 0;
+    uint32_t seq = head_open ? sectors[head_sector].seq + 1 : 0;
+    fq_sector_t *sec = &sectors[next];
+
+    if (sec->pending > 0) {
+        // Ring full: the oldest records go
+        stats.dropped += sec->pending;
+        stats.pending -= sec->pending;
+        sec->pending = 0;
+        fq_advance_tail(next, FQ_SLOTS_PER_SECTOR);
+        printf("[FQ] Queue full, dropped oldest sector\n");
+    }
+
+    uint32_t erase_count = sec->erase_count + 1;
+    sec->valid = false;
+    if (!fq_erase(next)) {
+        return false;
+    }
+
+    uint8_t hdr[14];
+    put_u32(&hdr[0], FQ_SECTOR_MAGIC);
+    put_u32(&hdr[4], seq);
+    put_u32(&hdr[8], erase_count);
+    uint16_t crc = sr_crc16(hdr, 12);
+    hdr[12] = (uint8_t)crc;
+    hdr[13] = (uint8_t)(crc >> 8);
+    if (!fq_program(next, 0, 0, hdr, sizeof(hdr))) {
+        return false;
+    }
+
+    *sec = (fq_sector_t){ .valid = true, .seq = seq, .erase_count = erase_count };
+    if (erase_count > stats.erase_max) {
+        stats.erase_max = erase_count;
+    }
+    head_open = true;
+    head_sector = next;
+    head_slot = 1;
+    return true;
+}
+
+fq_status_t flash_queue_append(uint8_t tag, const void *data, size_t len) {
+    if ((!data && len) || len > FQ_PAYLOAD_MAX) {
+        return FQ_ERR_INVAL;
+    }
+    if (!flash_ops) {
+        return FQ_ERR_FLASH;
+    }
+    if ((!head_open || head_slot >= FQ_SLOTS_PER_SECTOR) && !fq_open_next_sector()) {
+        return FQ_ERR_FLASH;
+    }
+
+    uint8_t rec[FQ_SLOT_SIZE];
+    memset(rec, 0xFF, sizeof(rec));
+    rec[0] = FQ_STATE_PENDING;
+    rec[1] = tag;
+    rec[2] = (uint8_t)len;
+    put_u32(&rec[4], next_seq);
+    memcpy(&rec[FQ_RECORD_HDR_LEN], data, len);
+    uint16_t crc = fq_record_crc(rec);
+    rec[8] = (uint8_t)crc;
+    rec[9] = (uint8_t)(crc >> 8);
+
+    uint8_t sector = head_sector;
+    uint16_t slot = head_slot++;   // a failed write burns the slot either way
+    if (!fq_program(sector, slot, 0, rec, FQ_RECORD_HDR_LEN + len)) {
+        return FQ_ERR_FLASH;
+    }
+
+    next_seq++;
+    if (stats.pending == 0) {
+        tail_sector = sector;
+        tail_slot = slot;
+    }
+    sectors[sector].pending++;
+    stats.pending++;
+    stats.appended++;
+    return FQ_OK;
+}
+
+fq_status_t flash_queue_peek(uint8_t *tag, uint8_t *data, size_t *len) {
+    if (stats.pending == 0) {
+        return FQ_ERR_EMPTY;
+    }
+
+    const uint8_t *r = fq_read(tail_sector, tail_slot);
+    *tag = r[1];
+    *len = r[2];
+    memcpy(data, &r[FQ_RECORD_HDR_LEN], r[2]);
+    return FQ_OK;
+}
+
+fq_status_t flash_queue_pop(void) {
+    static const uint8_t done = FQ_STATE_DONE;
+
+    if (stats.pending == 0) {
+        return FQ_ERR_EMPTY;
+    }
+    if (!fq_program(tail_sector, tail_slot, 0, &done, 1)) {
+        return FQ_ERR_FLASH;
+    }
+
+    sectors[tail_sector].pending--;
+    stats.pending--;
+    stats.consumed++;
+    fq_advance_tail(tail_sector, tail_slot);
+    return FQ_OK;
+}
+
+uint32_t flash_queue_pending(void) {
+    return stats.pending;
+}
+
+void flash_queue_get_stats(fq_stats_t *out) {
+    *out = stats;
+}
+
+void flash_queue_report(void) {
+    printf("[FQ] pending=%lu appended=%lu forwarded=%lu dropped=%lu corrupt=%lu "
+           "max erases=%lu\n",
+           (unsigned long)stats.pending, (unsigned long)stats.appended,
+           (unsigned long)stats.consumed, (unsigned long)stats.dropped,
+           (unsigned long)stats.corrupt, (unsigned long)stats.erase_max);
+}
@@ -0,0 +1,93 @@
+#ifndef FLASH_QUEUE_H
+#define FLASH_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Persistent FIFO of small records in a reserved region at the end of
+// flash, used to hold publishes while the broker is unreachable.
+//
+// The region is a ring of FQ_SECTORS erase sectors written strictly in
+// order. Each sector starts with a header slot (magic, sector sequence,
+// erase count, CRC) followed by fixed-size record slots:
+//
+//   off  size  field
+//   0    1     state    0xFF free, FQ_STATE_PENDING, FQ_STATE_DONE
+//   1    1     tag      caller-defined (e.g. topic id)
+//   2    1     len      payload length, <= FQ_PAYLOAD_MAX
+//   3    1     reserved 0xFF
+//   4    4     seq      record sequence number, little-endian
+//   8    2     crc      CRC-16/CCITT-FALSE over tag, len, seq and payload
+//   10   len   payload
+//
+// A record is programmed in one page write and consumed by clearing its
+// state byte, which NOR flash allows without an erase. Records with a bad
+// CRC (power cut mid-write) are skipped. When the ring is full the oldest
+// sector is erased and its pending records are counted as dropped, so
+// every sector is erased once per trip round the ring.
+//
+// Not thread-safe: call from core0 only. Flash writes go through
+// flash_safe_execute(), which parks core1 (it must have called
+// multicore_lockout_victim_init()) and masks interrupts for the duration.
+// flash_queue_init() leaves the queue disabled if the firmware image has
+// grown into the region.
+
+#define FQ_SECTOR_SIZE     4096u   // NOR erase sector
+#define FQ_PAGE_SIZE       256u    // NOR program page
+#define FQ_SECTORS         8
+#define FQ_REGION_SIZE     (FQ_SECTORS * FQ_SECTOR_SIZE)
+#define FQ_SLOT_SIZE       64
+#define FQ_RECORD_HDR_LEN  10
+#define FQ_PAYLOAD_MAX     (FQ_SLOT_SIZE - FQ_RECORD_HDR_LEN)
+
+#define FQ_STATE_PENDING   0xA5
+#define FQ_STATE_DONE      0x00
+
+typedef enum {
+    FQ_OK          =  0,
+    FQ_ERR_INVAL   = -1,
+    FQ_ERR_EMPTY   = -2,
+    FQ_ERR_FLASH   = -3
+} fq_status_t;
+
+typedef struct {
+    uint32_t pending;        // records waiting to be forwarded
+    uint32_t appended;       // since boot
+    uint32_t consumed;       // since boot
+    uint32_t dropped;        // lost to ring overflow since boot
+    uint32_t corrupt;        // slots skipped at boot (bad CRC / torn write)
+    uint32_t erase_max;      // highest sector erase count seen
+} fq_stats_t;
+
+// Raw access to the region, offsets relative to its start. erase clears
+// one FQ_SECTOR_SIZE sector to 0xFF; program writes one FQ_PAGE_SIZE
+// page, which can only clear bits; read returns a view of the region that
+// reflects both. The device build uses on-chip flash; host tests install
+// a simulator.
+typedef struct {
+    bool (*erase)(uint32_t offset);
+    bool (*program)(uint32_t offset, const uint8_t *page);
+    const uint8_t *(*read)(uint32_t offset);
+} fq_flash_ops_t;
+
+// Before flash_queue_init()
+void flash_queue_set_ops(const fq_flash_ops_t *ops);
+
+// Scan the region and rebuild the queue state. Never erases anything.
+void flash_queue_init(void);
+
+fq_status_t flash_queue_append(uint8_t tag, const void *data, size_t len);
+
+// Oldest pending record; data must hold FQ_PAYLOAD_MAX bytes
+fq_status_t flash_queue_peek(uint8_t *tag, uint8_t *data, size_t *len);
+
+// Mark the oldest pending record as forwarded
+fq_status_t flash_queue_pop(void);
+
+uint32_t flash_queue_pending(void);
+
+void flash_queue_get_stats(fq_stats_t *out);
+void flash_queue_report(void);
+
+#endif
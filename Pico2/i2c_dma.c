@@ -0,0 +1,184 @@
+#include "i2c_dma.h"
+#include <stdio.h>
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "pico/stdlib.h"
+
+/*
+ * DMA-driven I2C master transfers (RP2040 DW_apb_i2c)
+ *
+ * TX channel: streams 16-bit IC_DATA_CMD words (data byte or read command,
+ *             STOP set on the last word) from cmd_words into the TX FIFO.
+ * RX channel: (reads only) drains the RX FIFO into the caller's buffer.
+ *
+ * Completion is taken from the I2C STOP_DET / TX_ABRT interrupts rather than
+ * the DMA IRQ, because the TX channel finishes as soon as the last word is in
+ * the FIFO, not when it has left the bus. The I2C interrupt sources are only
+ * unmasked while a DMA transfer is in flight, so the blocking SDK calls can
+ * still be used on the same bus in between.
+ */
+
+static i2c_inst_t *dma_i2c = NULL;
+static int tx_chan = -1;
+static int rx_chan = -1;
+
+static uint16_t cmd_words[I2C_DMA_MAX_LEN];
+static volatile bool xfer_busy = false;
+static bool xfer_is_read = false;
+static i2c_dma_callback_t xfer_cb = NULL;
+static void *xfer_arg = NULL;
+
+static void i2c_dma_finish(i2c_dma_result_t result) {
+    i2c_get_hw(dma_i2c)->intr_mask = 0;
+    xfer_busy = false;
+
+    if (xfer_cb) {
+        xfer_cb(result, xfer_arg);
+    }
+}
+
+static void i2c_dma_irq_handler(void) {
+    i2c_hw_t *hw = i2c_get_hw(dma_i2c);
+    uint32_t stat = hw->intr_stat;
+
+    if (!xfer_busy) {
+        hw->intr_mask = 0;
+        return;
+    }
+
+    if (stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        (void)hw->clr_tx_abrt;
+        (void)hw->clr_stop_det;
+        dma_channel_abort(tx_chan);
+        dma_channel_abort(rx_chan);
+        i2c_dma_finish(I2C_DMA_ERR_ABORT);
+        return;
+    }
+
+    if (stat & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+        (void)hw->clr_stop_det;
+
+        // The last byte is already in the RX FIFO; let DMA drain it
+        if (xfer_is_read) {
+            while (dma_channel_is_busy(rx_chan)) {
+                tight_loop_contents();
+            }
+        }
+        i2c_dma_finish(I2C_DMA_OK);
+    }
+}
+
+bool i2c_dma_init(i2c_inst_t *i2c) {
+    if (!i2c) {
+        return false;
+    }
+    if (dma_i2c) {
+        return dma_i2c == i2c;   // one bus per engine
+    }
+
+    tx_chan = dma_claim_unused_channel(false);
+    rx_chan = dma_claim_unused_channel(false);
+    if (tx_chan < 0 || rx_chan < 0) {
+        if (tx_chan >= 0) dma_channel_unclaim(tx_chan);
+        if (rx_chan >= 0) dma_channel_unclaim(rx_chan);
+        tx_chan = rx_chan = -1;
+        printf("[I2C DMA] No free DMA channels\n");
+        return false;
+    }
+
+    dma_i2c = i2c;
+
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    hw->intr_mask = 0;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+
+    uint irq = I2C0_IRQ + i2c_hw_index(i2c);
+    irq_set_exclusive_handler(irq, i2c_dma_irq_handler);
+    irq_set_enabled(irq, true);
+
+    printf("[I2C DMA] Ready (tx ch %d, rx ch %d)\n", tx_chan, rx_chan);
+    return true;
+}
+
+static i2c_dma_result_t i2c_dma_start(i2c_inst_t *i2c,
+                                      uint8_t address,
+                                      const uint8_t *src,
+                                      uint8_t *dst,
+                                      size_t len,
+                                      i2c_dma_callback_t cb,
+                                      void *user_data) {
+    if (!i2c || i2c != dma_i2c || len == 0 || len > I2C_DMA_MAX_LEN) {
+        return I2C_DMA_ERR_INVAL;
+    }
+    if (xfer_busy) {
+        return I2C_DMA_ERR_BUSY;
+    }
+
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+
+    // Target address can only be changed while the block is disabled
+    hw->enable = 0;
+    hw->tar = address;
+    hw->enable = 1;
+    (void)hw->clr_tx_abrt;
+    (void)hw->clr_stop_det;
+
+    for (size_t i = 0; i < len; i++) {
+        cmd_words[i] = dst ? I2C_IC_DATA_CMD_CMD_BITS : src[i];
+    }
+    cmd_words[len - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    xfer_is_read = (dst != NULL);
+    xfer_cb = cb;
+    xfer_arg = user_data;
+    xfer_busy = true;
+
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS |
+                    I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+
+    if (dst) {
+        dma_channel_config rc = dma_channel_get_default_config(rx_chan);
+        channel_config_set_transfer_data_size(&rc, DMA_SIZE_8);
+        channel_config_set_read_increment(&rc, false);
+        channel_config_set_write_increment(&rc, true);
+        channel_config_set_dreq(&rc, i2c_get_dreq(i2c, false));
+        dma_channel_configure(rx_chan, &rc, dst, &hw->data_cmd, len, true);
+    }
+
+    dma_channel_config tc = dma_channel_get_default_config(tx_chan);
+    channel_config_set_transfer_data_size(&tc, DMA_SIZE_16);
+    channel_config_set_read_increment(&tc, true);
+    channel_config_set_write_increment(&tc, false);
+    channel_config_set_dreq(&tc, i2c_get_dreq(i2c, true));
+    dma_channel_configure(tx_chan, &tc, &hw->data_cmd, cmd_words, len, true);
+
+    return I2C_DMA_OK;
+}
+
+i2c_dma_result_t i2c_dma_write(i2c_inst_t *i2c,
+                               uint8_t address,
+                               const uint8_t *src,
+                               size_t len,
+                               i2c_dma_callback_t cb,
+                               void *user_data) {
+    if (!src) {
+        return I2C_DMA_ERR_INVAL;
+    }
+    return i2c_dma_start(i2c, address, src, NULL, len, cb, user_data);
+}
+
+i2c_dma_result_t i2c_dma_read(i2c_inst_t *i2c,
+                              uint8_t address,
+                              uint8_t *dst,
+                              size_t len,
+                              i2c_dma_callback_t cb,
+                              void *user_data) {
+    if (!dst) {
+        return I2C_DMA_ERR_INVAL;
+    }
+    return i2c_dma_start(i2c, address, NULL, dst, len, cb, user_data);
+}
+
+bool i2c_dma_busy(void) {
+    return xfer_busy;
+}
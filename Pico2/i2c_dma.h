@@ -0,0 +1,44 @@
+#ifndef I2C_DMA_H
+#define I2C_DMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "hardware/i2c.h"
+
+// Longest frame a single transfer can carry (ACD1100 needs 9)
+#define I2C_DMA_MAX_LEN 16u
+
+typedef enum {
+    I2C_DMA_OK          = 0,
+    I2C_DMA_ERR_INVAL   = -1,
+    I2C_DMA_ERR_BUSY    = -2,
+    I2C_DMA_ERR_ABORT   = -3     // NACK / arbitration loss
+} i2c_dma_result_t;
+
+// Completion callback, runs in the I2C interrupt handler
+typedef void (*i2c_dma_callback_t)(i2c_dma_result_t result, void *user_data);
+
+// Claim two DMA channels and the I2C IRQ for this bus.
+// Call after i2c_init(). Returns false if no DMA channels are free.
+bool i2c_dma_init(i2c_inst_t *i2c);
+
+// Start a write of len bytes followed by STOP. Returns immediately.
+i2c_dma_result_t i2c_dma_write(i2c_inst_t *i2c,
+                               uint8_t address,
+                               const uint8_t *src,
+                               size_t len,
+                               i2c_dma_callback_t cb,
+                               void *user_data);
+
+// Start a read of len bytes followed by STOP. Returns immediately.
+i2c_dma_result_t i2c_dma_read(i2c_inst_t *i2c,
+                              uint8_t address,
+                              uint8_t *dst,
+                              size_t len,
+                              i2c_dma_callback_t cb,
+                              void *user_data);
+
+bool i2c_dma_busy(void);
+
+#endif
@@ -0,0 +1,152 @@
+#include "log_buffer.h"
+#include <stdio.h>
+#include "hardware/sync.h"
+
+#ifdef LOG_MEASURE_COST
+#include "hardware/structs/systick.h"
+#endif
+
+typedef struct {
+    const char *fmt;
+    uint32_t    args[LOG_MAX_ARGS];
+    uint8_t     level;
+    uint8_t     nargs;
+} log_record_t;
+
+static log_record_t ring[LOG_RING_RECORDS];
+static uint32_t head = 0;       // next record to drain
+static uint32_t count = 0;
+static spin_lock_t *log_lock = NULL;
+static log_stats_t stats;
+
+#ifdef LOG_MEASURE_COST
+static uint64_t cost_total = 0;
+#endif
+
+static const char *const LEVEL_TAGS[] = { "", "E ", "W ", "", "D " };
+
+static uint32_t log_lock_take(void) {
+    if (log_lock) {
+        return spin_lock_blocking(log_lock);
+    }
+    return save_and_disable_interrupts();   // before log_init(): single core
+}
+
+static void log_lock_give(uint32_t irq) {
+    if (log_lock) {
+        spin_unlock(log_lock, irq);
+    } else {
+        restore_interrupts(irq);
+    }
+}
+
+void log_init(void) {
+    if (!log_lock) {
+        log_lock = spin_lock_instance((uint)spin_lock_claim_unused(true));
+    }
+
+#ifdef LOG_MEASURE_COST
+    // Free-running 24-bit SysTick at the CPU clock, used as a cycle counter
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;   // CLKSOURCE = processor, ENABLE, no interrupt
+#endif
+}
+
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+#ifdef LOG_MEASURE_COST
+    uint32_t t0 = systick_hw->cvr;
+#endif
+
+    uint32_t irq = log_lock_take();
+
+    if (count == LOG_RING_RECORDS) {
+        stats.dropped++;   // keep the older records; they explain what led here
+    } else {
+        log_record_t *r = &ring[(head + count) % LOG_RING_RECORDS];
+        r->fmt = fmt;
+        r->level = level;
+        r->nargs = nargs;
+        r->args[0] = a0;
+        r->args[1] = a1;
+        r->args[2] = a2;
+        r->args[3] = a3;
+        count++;
+        stats.written++;
+        if (count > stats.high_water) {
+            stats.high_water = count;
+        }
+    }
+
+#ifdef LOG_MEASURE_COST
+    // SysTick counts down; mask handles the 24-bit wrap
+    uint32_t cycles = (t0 - systick_hw->cvr) & 0x00FFFFFF;
+    cost_total += cycles;
+    if (cycles > stats.cost_cycles_max) {
+        stats.cost_cycles_max = cycles;
+    }
+#endif
+
+    log_lock_give(irq);
+}
+
+size_t log_drain(size_t max_records) {
+    size_t printed = 0;
+
+    while (max_records == 0 || printed < max_records) {
+        uint32_t irq = log_lock_take();
+        if (count == 0) {
+            log_lock_give(irq);
+            break;
+        }
+        log_record_t r = ring[head];
+        head = (head + 1) % LOG_RING_RECORDS;
+        count--;
+        log_lock_give(irq);
+
+        // Blocking stdio happens here, outside the lock and off the hot path
+        const char *tag = (r.level < sizeof(LEVEL_TAGS) / sizeof(LEVEL_TAGS[0]))
+                              ? LEVEL_TAGS[r.level] : "";
+        fputs(tag, stdout);
+        printf(r.fmt, r.args[0], r.args[1], r.args[2], r.args[3]);
+        printed++;
+    }
+
+    static uint32_t last_reported_drops = 0;
+    uint32_t reported_drops = stats.dropped;
+    if (reported_drops != last_reported_drops) {
+        printf("[LOG] %lu record(s) dropped\n",
+               (unsigned long)(reported_drops - last_reported_drops));
+        last_reported_drops = reported_drops;
+    }
+
+    return printed;
+}
+
+size_t log_pending(void) {
+    return count;
+}
+
+void log_get_stats(log_stats_t *out) {
+    uint32_t irq = log_lock_take();
+    *out = stats;
+#ifdef LOG_MEASURE_COST
+    uint32_t calls = stats.written + stats.dropped;
+    out->cost_cycles_avg = calls ? (uint32_t)(cost_total / calls) : 0;
+#endif
+    log_lock_give(irq);
+}
+
+void log_print_stats(void) {
+    log_stats_t s;
+    log_get_stats(&s);
+    printf("[LOG] written=%lu dropped=%lu high_water=%lu/%u",
+           (unsigned long)s.written, (unsigned long)s.dropped,
+           (unsigned long)s.high_water, (unsigned)LOG_RING_RECORDS);
+#ifdef LOG_MEASURE_COST
+    printf(" cost avg=%lu max=%lu cycles",
+           (unsigned long)s.cost_cycles_avg, (unsigned long)s.cost_cycles_max);
+#endif
+    printf("\n");
+}
@@ -0,0 +1,92 @@
+#ifndef LOG_BUFFER_H
+#define LOG_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Deferred logging. LOG_* calls store a compact binary record (format
+// pointer + up to four 32-bit args) in a RAM ring; log_drain() does the
+// actual printf later, from idle time. Levels above LOG_LEVEL compile to
+// nothing. Identical copies live in Pico2/3/4.
+//
+// Because formatting is deferred, arguments must be integers (≤ 32 bits)
+// or pointers to strings that outlive the record, i.e. string literals.
+// The format string itself must be a literal.
+
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_MAX_ARGS      4
+#define LOG_RING_RECORDS  64    // 24 bytes each
+
+typedef struct {
+    uint32_t written;         // records stored
+    uint32_t dropped;         // records lost to a full ring
+    uint32_t high_water;      // most records ever queued at once
+    uint32_t cost_cycles_max; // worst log_write() cost (LOG_MEASURE_COST)
+    uint32_t cost_cycles_avg; // mean log_write() cost (LOG_MEASURE_COST)
+} log_stats_t;
+
+// Claim the ring's spin lock (and SysTick when LOG_MEASURE_COST is set)
+void log_init(void);
+
+// Store one record; safe from IRQ context and either core
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+// Print up to max_records queued records (0 = all). Returns the number printed.
+size_t log_drain(size_t max_records);
+
+size_t log_pending(void);
+void log_get_stats(log_stats_t *out);
+void log_print_stats(void);
+
+// ----------------------------------------------------------------------
+// Call-site macros
+// ----------------------------------------------------------------------
+
+#define LOG_ARG_(x) ((uint32_t)(uintptr_t)(x))
+
+#define log_emit0_(l, f)             log_write((l), (f), 0, 0, 0, 0, 0)
+#define log_emit1_(l, f, a)          log_write((l), (f), 1, LOG_ARG_(a), 0, 0, 0)
+#define log_emit2_(l, f, a, b)       log_write((l), (f), 2, LOG_ARG_(a), LOG_ARG_(b), 0, 0)
+#define log_emit3_(l, f, a, b, c)    log_write((l), (f), 3, LOG_ARG_(a), LOG_ARG_(b), LOG_ARG_(c), 0)
+#define log_emit4_(l, f, a, b, c, d) log_write((l), (f), 4, LOG_ARG_(a), LOG_ARG_(b), LOG_ARG_(c), LOG_ARG_(d))
+
+#define LOG_SELECT_(_1, _2, _3, _4, _5, name, ...) name
+#define LOG_EMIT_(l, ...) \
+    LOG_SELECT_(__VA_ARGS__, log_emit4_, log_emit3_, log_emit2_, log_emit1_, log_emit0_)(l, __VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_EMIT_(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_EMIT_(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_EMIT_(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_EMIT_(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#endif
@@ -62,6 +62,7 @@
 
 // MQTT Application settings
 #define LWIP_MQTT                   1     // Enable MQTT
+#define MQTT_OUTPUT_RINGBUF_SIZE    512   // room for a batched sample publish
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
@@ -7,13 +7,24 @@
 #include "hardware/i2c.h"
 #include "hardware/vreg.h"
 #include "hardware/clocks.h"
+#include "hardware/sync.h"
 #include "pico/cyw43_arch.h"
 
 #include "acd1100.h"
-#include "ema_filter.h"
 #include "mqtt_driver.h"
 #include "wifi_driver.h"
 #include "power_manager.h"
+#include "sample_buffer.h"
+#include "log_buffer.h"
+#include "acquisition.h"
+#include "deadband.h"
+#include "excursion.h"
+#include "phase_stats.h"
+#include "sample_schedule.h"
+#include "window_stats.h"
+#include "sensor_record.h"
+#include "fmt_utils.h"
+#include "store_forward.h"
 #include "secrets.h"
 
 static const uint32_t INTERVALS[] = {
@@ -24,52 +35,487 @@ static const uint32_t INTERVALS[] = {
 
 volatile int safety_level = 0;
 
+// 1: sample on core1 with fixed timing (see acquisition.h). Core0 waits at
+//    full clock between samples: no clock scaling or deep sleep.
+// 0: single-core loop with clock scaling and deep sleep between samples
+#ifndef PICO2_ACQ_CORE1
+#define PICO2_ACQ_CORE1 0
+#endif
+
+// 1: in NORMAL, sample every EDGE_SAMPLE_INTERVAL_MS with the radio off and
+//    bring it up early on a local excursion (see excursion.h); only one
+//    sample per INTERVAL_NORMAL goes into the batch
+// 0: sample every INTERVAL_NORMAL
+#ifndef PICO2_EDGE_MODE
+#define PICO2_EDGE_MODE 1
+#endif
+
+#define EDGE_SAMPLE_INTERVAL_MS  5000
+
+// 1: NORMAL publishes one summary record (count/min/max/mean/stddev/slope)
+//    per SUMMARY_WINDOW_MS over every sample taken; raw values only in
+//    alert levels
+// 0: NORMAL publishes the deadbanded raw samples as a batch
+#ifndef PICO2_NORMAL_SUMMARY
+#define PICO2_NORMAL_SUMMARY 1
+#endif
+
+#define SUMMARY_WINDOW_MS  (SAMPLE_BATCH_SIZE * INTERVAL_NORMAL)   // same radio cadence as a batch
+
+#define ALERT_REPORT_INTERVAL_MS  60000   // scheduler stats while in an alert level
+
+// Radio handling while asleep, per safety level
+static const radio_mode_t RADIO_MODES[] = {
+    RADIO_MODE_OFF,               // NORMAL: radio only up to flush a batch
+    RADIO_MODE_KEEP_ASSOCIATED,   // WARNING
+    RADIO_MODE_KEEP_ASSOCIATED    // HIGH
+};
+
+static bool radio_awake = false;
+
+static void radio_up(void) {
+    if (radio_awake) {
+        return;
+    }
+    if (power_radio_wake()) {
+        mqtt_subscribe_topic(TOPIC_SAFETY_LEVEL, 1);   // QoS1: broker queues changes while we sleep
+    }
+    radio_awake = true;
+}
+
+static void radio_down(radio_mode_t mode) {
+    if (!radio_awake) {
+        return;
+    }
+    power_radio_sleep(mode);
+    radio_awake = false;
+}
+
+#if !PICO2_ACQ_CORE1
+// Take one sample, servicing the network stack while the sensor converts
+static bool sample_ppm(uint32_t *filtered_out) {
+    uint64_t t = phase_begin();
+    if (!start_ppm_measurement()) {
+        return false;
+    }
+    while (!acd1100_poll_measurement()) {
+        cyw43_arch_poll();
+        mqtt_poll();
+        __wfe();
+    }
+    phase_end(PHASE_SENSOR, t);
+    return complete_ppm_measurement(filtered_out);
+}
+#endif
+
+// Publish everything buffered in one message on TOPIC_CO2_BATCH
+static bool publish_sample_batch(void) {
+    bool published = false;
+    char payload[SAMPLE_BATCH_PAYLOAD_MAX];
+
+    while (sample_buffer_count() > 0) {
+        uint32_t now_ms = power_uptime_ms();
+        size_t n = sample_buffer_format_batch(payload, sizeof(payload),
+                                              now_ms, SAMPLE_BUFFER_CAPACITY);
+        if (n == 0 || mqtt_publish_message(TOPIC_CO2_BATCH, payload, 0, 0) != MQTT_OK) {
+            printf("[BATCH] Publish failed, keeping %u samples\n",
+                   (unsigned)sample_buffer_count());
+            break;
+        }
+        sample_buffer_consume(n);
+        published = true;
+        printf("[BATCH] Published %u samples\n", (unsigned)n);
+    }
+    return published;
+}
+
+static window_stats_t co2_window;
+
+// Summarise and publish the current window on TOPIC_CO2_SUMMARY. The window
+// is restarted either way; returns true if a record went out.
+static bool publish_window_summary(void) {
+    static uint16_t seq = 0;
+    window_summary_t sum;
+    uint32_t end_ms = co2_window.last_ms;
+
+    if (!window_stats_summary(&co2_window, &sum)) {
+        return false;
+    }
+    window_stats_reset(&co2_window);
+
+#if SR_PAYLOAD_BINARY
+    uint8_t payload[SR_MAX_LEN];
+    sensor_record_t rec = {
+        .type  = SR_TYPE_CO2_SUMMARY,
+        .count = SR_SUMMARY_VALUES,
+        .seq   = seq,
+        .ts_ms = end_ms
+    };
+    rec.values[SR_SUMMARY_COUNT]  = filter_from_uint(sum.count);
+    rec.values[SR_SUMMARY_MIN]    = sum.min;
+    rec.values[SR_SUMMARY_MAX]    = sum.max;
+    rec.values[SR_SUMMARY_MEAN]   = sum.mean;
+    rec.values[SR_SUMMARY_STDDEV] = sum.stddev;
+    rec.values[SR_SUMMARY_SLOPE]  = sum.slope_per_min;
+    rec.values[SR_SUMMARY_SPAN_S] = filter_from_uint(sum.span_ms / 1000u);
+    size_t len = sr_encode(&rec, payload, sizeof(payload));
+#else
+    // "count,min,max,mean,stddev,slope_per_min,span_s"
+    char payload[96];
+    fmt_buf_t f;
+    fmt_init(&f, payload, sizeof(payload));
+    fmt_put_u32(&f, sum.count);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, sum.min, 0);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, sum.max, 0);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, sum.mean, 1);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, sum.stddev, 1);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, sum.slope_per_min, 2);
+    fmt_put_char(&f, ',');
+    fmt_put_u32(&f, sum.span_ms / 1000u);
+    size_t len = fmt_finish(&f);
+    (void)end_ms;
+#endif
+
+    sf_result_t r = (len == 0) ? SF_FAILED : sf_publish(TOPIC_CO2_SUMMARY, payload, (uint16_t)len);
+    if (r == SF_FAILED) {
+        printf("[SUMMARY] Publish failed, window of %lu samples dropped\n",
+               (unsigned long)sum.count);
+        return false;
+    }
+    seq++;
+    if (r == SF_QUEUED) {
+        printf("[SUMMARY] Broker unreachable, window queued in flash\n");
+        return false;
+    }
+    printf("[SUMMARY] Published window of %lu samples over %lu s\n",
+           (unsigned long)sum.count, (unsigned long)(sum.span_ms / 1000u));
+    return true;
+}
+
+// Service the broker after publishing (pending acks, level changes)
+static void listen_for_updates(void) {
+    uint64_t t = phase_begin();
+    mqtt_drain_updates(2000, MQTT_DRAIN_IDLE_MS);
+    phase_end(PHASE_LISTEN, t);
+}
+
+// Per-phase timing record on TOPIC_DIAG_PHASES, only while the radio is up
+static void publish_phase_stats(void) {
+    char payload[PHASE_STATS_PAYLOAD_MAX];
+
+    if (!phase_stats_due()) {
+        return;
+    }
+    size_t n = phase_stats_format(payload, sizeof(payload));
+    if (n == 0 || mqtt_publish_data(TOPIC_DIAG_PHASES, payload, n, 0, 0) != MQTT_OK) {
+        printf("[PHASE] Stats publish failed\n");
+    }
+}
+
+static uint32_t sample_interval_ms(void) {
+#if PICO2_EDGE_MODE
+    if (safety_level == 0) {
+        return EDGE_SAMPLE_INTERVAL_MS;
+    }
+#endif
+    return INTERVALS[safety_level];
+}
+
+// Local alarm: 1000 ppm absolute (clears below 900), or +150 ppm in 45 s
+static const excursion_config_t CO2_EXCURSION = {
+    .level_ppm      = 1000,
+    .clear_ppm      = 900,
+    .rise_ppm       = 150,
+    .rise_window_ms = 45 * 1000
+};
+
+static excursion_t co2_excursion;
+
+// Safety level to act on: a local excursion is handled like WARNING until
+// Pico4 (or the excursion clearing) says otherwise
+static int effective_level(void) {
+    if (safety_level == 0 && excursion_active(&co2_excursion)) {
+        return 1;
+    }
+    return safety_level;
+}
+
+// Report-by-exception for CO2: ±25 ppm or ±3 %, and at least every 5 min
+static const deadband_config_t CO2_DEADBAND = {
+    .abs_delta    = 25,
+    .rel_permille = 30,
+    .heartbeat_ms = 5 * 60 * 1000
+};
+
+static deadband_t co2_deadband;
+
+static void resync_report(void) {
+    mqtt_resync_stats_t r;
+    mqtt_get_resync_stats(&r);
+    printf("[RESYNC] drains=%lu retained=%lu avg=%lu ms saved=%lu ms\n",
+           (unsigned long)r.drains, (unsigned long)r.by_retained,
+           (unsigned long)(r.drains ? r.total_ms / r.drains : 0),
+           (unsigned long)r.saved_ms);
+}
+
+static void deadband_report(void) {
+    printf("[DEADBAND] reported=%lu suppressed=%lu\n",
+           (unsigned long)co2_deadband.reported,
+           (unsigned long)co2_deadband.suppressed);
+}
+
+// Alert levels never reach the NORMAL flush, where the diagnostics are
+// printed, yet that is where the change-to-sample latency matters
+static bool alert_report_due(uint32_t timestamp_ms) {
+    static bool started = false;
+    static uint32_t last_ms = 0;
+
+    if (started && timestamp_ms - last_ms < ALERT_REPORT_INTERVAL_MS) {
+        return false;
+    }
+    started = true;
+    last_ms = timestamp_ms;
+    return true;
+}
+
+#if PICO2_EDGE_MODE && !PICO2_NORMAL_SUMMARY
+// Edge samples only feed the excursion check; one per INTERVAL_NORMAL is
+// offered to the batch, as without edge mode
+static bool edge_batch_slot(uint32_t timestamp_ms) {
+    static bool started = false;
+    static uint32_t last_ms = 0;
+
+    if (started && timestamp_ms - last_ms < INTERVAL_NORMAL - EDGE_SAMPLE_INTERVAL_MS / 2) {
+        return false;
+    }
+    started = true;
+    last_ms = timestamp_ms;
+    return true;
+}
+#endif
+
+// Buffer or publish one sample according to the current safety level
+static void handle_sample(bool have_sample, uint32_t timestamp_ms, uint32_t filtered) {
+    static int last_level = -1;
+
+    phase_stats_cycle_done();
+
+    if (have_sample) {
+        excursion_event_t ev = excursion_check(&co2_excursion, timestamp_ms, filtered);
+        if (ev == EXCURSION_START) {
+            LOG_WARN("[EDGE] Excursion at %lu ppm, reporting live\n", filtered);
+        } else if (ev == EXCURSION_CLEAR) {
+            LOG_INFO("[EDGE] Excursion cleared at %lu ppm\n", filtered);
+        }
+    }
+
+    int level = effective_level();
+    if (level != last_level) {
+        deadband_force_next(&co2_deadband);   // first sample in a new mode always goes out
+        last_level = level;
+    }
+#if PICO2_NORMAL_SUMMARY
+    if (have_sample && level == 0) {
+        window_stats_add(&co2_window, timestamp_ms, filtered);
+        have_sample = false;   // NORMAL reports the window, not raw values
+    }
+#elif PICO2_EDGE_MODE
+    if (have_sample && level == 0 && !edge_batch_slot(timestamp_ms)) {
+        have_sample = false;   // local-only sample between batch slots
+    }
+#endif
+    if (have_sample && !deadband_check(&co2_deadband, timestamp_ms, filtered)) {
+        have_sample = false;   // inside the deadband: nothing to report
+    }
+
+    if (level == 0) {
+        // Radio stays off; only come up once a window or full batch is stored
+#if PICO2_NORMAL_SUMMARY
+        bool flush = window_stats_age_ms(&co2_window, timestamp_ms) >= SUMMARY_WINDOW_MS;
+#else
+        if (have_sample) {
+            sample_buffer_push(timestamp_ms, filtered);
+        }
+        // While CO2 is steady only heartbeats get buffered; don't let one
+        // sit behind a batch that takes ten heartbeats to fill
+        sample_t oldest;
+        bool flush = sample_buffer_count() >= SAMPLE_BATCH_SIZE ||
+                     (sample_buffer_peek(0, &oldest) &&
+                      timestamp_ms - oldest.timestamp_ms >= CO2_DEADBAND.heartbeat_ms);
+#endif
+
+        if (flush) {
+            radio_up();
+            bool published = publish_window_summary();
+            if (publish_sample_batch()) {
+                published = true;
+            }
+            sf_forward(SF_FORWARD_PER_CALL);   // backlog topic, after the live data
+            if (published) {
+                power_record_publish();
+            }
+            publish_phase_stats();
+            listen_for_updates();
+            power_report_latency();
+            deadband_report();
+            resync_report();
+            flash_queue_report();
+            printf("[EDGE] excursions=%lu\n", (unsigned long)co2_excursion.trips);
+#if PICO2_ACQ_CORE1
+            acquisition_report();
+#endif
+            sched_report();
+            log_print_stats();
+        }
+    }
+    else {
+        radio_up();
+        // The live value first, before anything else can fill lwIP's
+        // output buffer; an outage backlog replays behind it a few
+        // records per sample
+        bool published = have_sample && publish_ppm(timestamp_ms, filtered);
+        if (publish_window_summary()) {              // partial NORMAL window
+            published = true;
+        }
+        if (publish_sample_batch()) {                // stored before the level changed
+            published = true;
+        }
+        sf_forward(SF_FORWARD_PER_CALL);
+        if (published) {
+            power_record_publish();
+        }
+        publish_phase_stats();
+        listen_for_updates();
+        if (alert_report_due(timestamp_ms)) {
+            sched_report();
+        }
+    }
+}
+
 int main() {
     stdio_init_all();
+    log_init();
     sleep_ms(1500);
+    phase_stats_init();
+
+    // Reject single-sample spikes, smooth, and cap steps at 500 ppm/sample
+    static const filter_config_t co2_filter = {
+        .stages    = FILTER_STAGE_MEDIAN | FILTER_STAGE_EMA | FILTER_STAGE_SLEW,
+        .median_n  = 3,
+        .ema_alpha = Q16_FROM_FRAC(1, 4),
+        .slew_max  = Q16_FROM_INT(500)
+    };
+    acd1100_set_filter(&co2_filter);
 
+    sample_buffer_init();
+    store_forward_init();   // before core1 starts: no flash writes yet
+    deadband_init(&co2_deadband, &CO2_DEADBAND);
+    excursion_init(&co2_excursion, &CO2_EXCURSION);
+    window_stats_reset(&co2_window);
+
+    // Stable client ID + persistent session so level changes published while
+    // we are offline are queued by the broker and delivered on reconnect
+    mqtt_set_clean_session(false);
+    radio_up();
+    listen_for_updates();
+
+#if PICO2_ACQ_CORE1
+    // Core1 samples on its own schedule; core0 only handles the network.
+    // No clock scaling or deep sleep here: both would stall core1's I2C
+    // transfers and timers.
+    acquisition_start(sample_interval_ms);
+
+    uint64_t idle_start = 0;
+
+    while (true) {
+        sample_t s;
+
+        if (!acquisition_pop(&s)) {
+            // Idle point: flush deferred log records, then wait for core1
+            log_drain(0);
+            if (idle_start == 0) {
+                idle_start = phase_begin();
+            }
+            if (!acquisition_pending()) {
+                __wfe();
+            }
+            continue;
+        }
+
+        // One sleep record per gap between samples, not per wake-up
+        if (idle_start != 0) {
+            phase_end(PHASE_SLEEP, idle_start);
+            idle_start = 0;
+        }
+
+        handle_sample(true, s.timestamp_ms, s.ppm);
+
+        if (!acquisition_pending()) {
+            radio_down(RADIO_MODES[effective_level()]);
+        }
+    }
+#else
     acd1100_init(I2C_PORT, I2C_SDA_PIN, I2C_SCL_PIN, I2C_FREQ_HZ);
-    ema_init(0.25f);
 
-    setup_wifi();
-    setup_mqtt();
-    mqtt_subscribe_topic(TOPIC_SAFETY_LEVEL, 0);
-    listen_for_mqtt_updates(1000);
+    absolute_time_t slot = get_absolute_time();   // start of the last sample
+    bool due = true;
 
     while (true) {
+        uint32_t gen = sched_generation();
 
-        read_and_publish_ppm();
-        sleep_ms(1000);
-        cyw43_arch_poll();
+        if (due) {
+            slot = get_absolute_time();
+            sched_sample_started();
 
-        uint32_t interval_ms = INTERVALS[safety_level];
+            uint32_t filtered = 0;
+            bool have_sample = sample_ppm(&filtered);
 
-        if (safety_level == 0) {
+            handle_sample(have_sample, power_uptime_ms(), filtered);
+        }
+        due = true;
+
+        uint32_t interval_ms = sample_interval_ms();
+
+        // Idle point: flush deferred log records before sleeping
+        log_drain(0);
 
-            printf("[NORMAL] Low-power sleep %u ms\n", interval_ms);
+        if (effective_level() == 0) {
 
-            mqtt_disconnect_client();
-            wifi_deinit();
+            printf("[NORMAL] Low-power sleep %u ms (%u samples buffered)\n",
+                   interval_ms, (unsigned)sample_buffer_count());
 
+            radio_down(RADIO_MODES[0]);
+
+            // Uptime rather than the system timer, which stops in deep sleep
+            uint32_t slept_from = power_uptime_ms();
             enter_low_power_mode();
-            sleep_ms(interval_ms);
+            power_sleep_ms(interval_ms, !power_radio_is_up());
             exit_low_power_mode();
-
-            // Reconnect fully once
-            setup_wifi();
-            setup_mqtt();
-            mqtt_subscribe_topic(TOPIC_SAFETY_LEVEL, 0);
-            listen_for_mqtt_updates(2000);
+            phase_record(PHASE_SLEEP, (power_uptime_ms() - slept_from) * 1000u);
         }
 
         else {
-            printf("[ALERT MODE] Staying awake for %u ms\n", interval_ms);
-
-            listen_for_mqtt_updates(2000);
+            // The radio stays associated, so a level change can arrive while
+            // we wait; it wakes us and the slot is re-planned from the top
+            absolute_time_t next = sched_next_slot(slot, interval_ms);
+            printf("[ALERT MODE] Next sample in %lu ms\n",
+                   (unsigned long)(absolute_time_diff_us(get_absolute_time(), next) / 1000));
 
-            sleep_ms(interval_ms);
+            radio_down(RADIO_MODES[effective_level()]);
+            uint64_t t = phase_begin();
+            if (sched_wait_until(next, gen)) {
+                LOG_INFO("[SCHED] Level changed, re-planning next sample\n");
+                due = false;
+            }
+            phase_end(PHASE_SLEEP, t);
         }
     }
+#endif
 
     return 0;
 }
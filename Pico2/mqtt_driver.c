@@ -1,13 +1,57 @@
 #include "mqtt_driver.h"
+#include "lwip/apps/mqtt_priv.h"
+#include "lwip/init.h"
+#include "log_buffer.h"
+#include "sensor_record.h"
+#include "sample_schedule.h"
 #include "secrets.h"
 #include <stdio.h>
 #include <string.h>
 #include "pico/stdlib.h"
 #include "pico/cyw43_arch.h"
 
+// One client for the lifetime of the program, wiped and reused on every
+// reconnect instead of mqtt_client_new()/mqtt_client_free() per wake cycle
+static mqtt_client_t mqtt_client_storage;
 static mqtt_client_t *mqtt_client = NULL;
 static mqtt_status_t mqtt_status = MQTT_STATUS_DISCONNECTED;
 static mqtt_message_callback_t user_callback = NULL;
+static uint16_t keep_alive_s = MQTT_KEEP_ALIVE_S;
+static bool clean_session = true;
+
+// Drain tracking: outstanding sub/unsub/publish requests and last inbound data.
+// pending_requests only changes under the lwIP lock; the request callbacks
+// already run under it.
+static volatile uint16_t pending_requests = 0;
+static volatile uint32_t last_rx_ms = 0;
+static volatile uint32_t rx_messages = 0;
+
+// Completion callbacks of mqtt_publish_data_acked(), at most one per
+// request lwIP can have in flight. Only touched under the lwIP lock.
+typedef struct {
+    mqtt_publish_done_t done;
+    void *arg;
+} mqtt_pub_wait_t;
+
+static mqtt_pub_wait_t pub_waits[MQTT_REQ_MAX_IN_FLIGHT];
+
+// lwIP drops the requests still in flight when the connection closes,
+// without their callbacks: report those publishes as failed instead
+static void mqtt_fail_pub_waits(void) {
+    for (int i = 0; i < MQTT_REQ_MAX_IN_FLIGHT; i++) {
+        mqtt_publish_done_t done = pub_waits[i].done;
+        if (done) {
+            pub_waits[i].done = NULL;
+            done(pub_waits[i].arg, false);
+        }
+    }
+}
+
+// Resync: the broker sends the retained prediction right after SUBACK, and
+// after any messages queued for the session, so its arrival means we are
+// up to date without waiting for the line to go quiet
+static volatile bool retained_seen = false;
+static mqtt_resync_stats_t resync_stats;
 
 // // Callback for incoming MQTT messages
 // void mqtt_message_received(const char* topic, const char* payload, uint16_t payload_len) {
@@ -16,84 +60,189 @@ static mqtt_message_callback_t user_callback = NULL;
 
 extern volatile int safety_level;
 
-void mqtt_message_received(const char* topic, const char* payload, uint16_t len) {
-    char msg[32];
-    memcpy(msg, payload, len);
-    msg[len] = '\0';
-
-    if (strcmp(msg, "NORMAL") == 0) {
-        safety_level = 0;
+// Safety level from a prediction payload: binary record or text label
+static int mqtt_parse_prediction(const char* payload, uint16_t len) {
+    if (sr_is_binary(payload, len)) {
+        sensor_record_t rec;
+        if (sr_decode((const uint8_t *)payload, len, &rec) != SR_OK ||
+            rec.type != SR_TYPE_PREDICTION) {
+            return -1;
+        }
+        return (int)(rec.values[0] >> 16);
     }
-    else if (strcmp(msg, "WARNING") == 0) {
-        safety_level = 1;
+
+    for (int cls = 0; sr_prediction_label(cls); cls++) {
+        const char *label = sr_prediction_label(cls);
+        if (strlen(label) == len && memcmp(payload, label, len) == 0) {
+            return cls;
+        }
     }
-    else if (strcmp(msg, "HIGH") == 0) {
-        safety_level = 2;
+    return -1;
+}
+
+void mqtt_message_received(const char* topic, const char* payload, uint16_t len) {
+    int level = mqtt_parse_prediction(payload, len);
+    const char *label = sr_prediction_label(level);
+
+    if (!label) {
+        LOG_WARN("[MQTT] Unknown safety level (%u bytes)\n", len);
+        return;
     }
 
-    printf("[MQTT] Safety level updated: %s\n", msg);
+    if (level != safety_level) {
+        safety_level = level;
+        sched_level_changed();   // cut the current sample wait short
+    }
+    LOG_INFO("[MQTT] Safety level updated: %s\n", label);
 }
 
 // MQTT connection callback
 static void mqtt_connection_cb(mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
     if (status == MQTT_CONNECT_ACCEPTED) {
-        printf("MQTT connected\n");
+        LOG_INFO("MQTT connected\n");
         mqtt_status = MQTT_STATUS_CONNECTED;
     } else {
-        printf("MQTT connection failed (status=%d)\n", status);
+        LOG_ERROR("MQTT connection failed (status=%d)\n", status);
         mqtt_status = MQTT_STATUS_ERROR;
+        mqtt_fail_pub_waits();
     }
 }
 
+// lwIP's client neither reports the retain flag of an incoming PUBLISH nor
+// lets Clean Session be turned off, so the two helpers below reach into
+// mqtt_client_t. Both were checked against the mqtt.c of lwIP 2.1 and 2.2;
+// any other release has to be re-checked before this builds.
+#if LWIP_VERSION_MAJOR != 2 || LWIP_VERSION_MINOR < 1 || LWIP_VERSION_MINOR > 2
+#error "mqtt_driver.c relies on lwIP MQTT client internals; re-check them for this lwIP version"
+#endif
+_Static_assert(sizeof(((mqtt_client_t *)0)->rx_buffer) == MQTT_VAR_HEADER_BUFFER_LEN,
+               "lwIP mqtt_client_t receive buffer changed");
+_Static_assert(sizeof(((mqtt_client_t *)0)->output.buf) == MQTT_OUTPUT_RINGBUF_SIZE,
+               "lwIP mqtt_client_t output ring changed");
+
+#define MQTT_FIXED_HEADER_TYPE_MASK  0xF0
+#define MQTT_FIXED_HEADER_PUBLISH    0x30   // packet type 3
+#define MQTT_PUBLISH_FLAG_RETAIN     0x01   // fixed header byte 0, bit 0
+
+// Only valid inside the incoming-publish callback: lwIP's parser still
+// holds the PUBLISH fixed header at the start of rx_buffer then
+static bool mqtt_publish_is_retained(const mqtt_client_t *client) {
+    uint8_t hdr = client->rx_buffer[0];
+    return (hdr & MQTT_FIXED_HEADER_TYPE_MASK) == MQTT_FIXED_HEADER_PUBLISH &&
+           (hdr & MQTT_PUBLISH_FLAG_RETAIN) != 0;
+}
+
 static void mqtt_incoming_publish_cb(void *arg, const char *topic, u32_t tot_len) {
-    printf("[MQTT] Incoming publish on topic: %s (%lu bytes)\n",
-           topic, (unsigned long)tot_len);
+    if (mqtt_client && mqtt_publish_is_retained(mqtt_client)) {
+        retained_seen = true;
+    }
+    // topic belongs to lwIP and is gone by the time the log drains
+    LOG_DEBUG("[MQTT] Incoming publish (%lu bytes)\n", tot_len);
 }
 
 static void mqtt_incoming_data_cb(void *arg, const u8_t *data, u16_t len, u8_t flags) {
 
     char payload[64];
+    if (len >= sizeof(payload)) {
+        len = sizeof(payload) - 1;
+    }
     memcpy(payload, data, len);
     payload[len] = '\0';
 
+    last_rx_ms = to_ms_since_boot(get_absolute_time());
+    if (flags & MQTT_DATA_FLAG_LAST) {
+        rx_messages++;
+    }
+
     // ALWAYS call the user callback
     if (user_callback) {
         user_callback("", payload, len);
     }
+}
 
-    printf("[MQTT] Payload: %s\n", payload);
+static void mqtt_request_done(void) {
+    if (pending_requests > 0) {
+        pending_requests--;
+    }
 }
 
 // MQTT subscribe callback
 static void mqtt_sub_request_cb(void *arg, err_t result) {
+    mqtt_request_done();
     if (result == ERR_OK) {
-        printf("Subscribe successful\n");
+        LOG_DEBUG("Subscribe successful\n");
     } else {
-        printf("Subscribe failed (err=%d)\n", result);
+        LOG_WARN("Subscribe failed (err=%d)\n", result);
     }
 }
 
-// MQTT publish callback
+// MQTT publish callback; arg is the mqtt_pub_wait_t of an acked publish
 static void mqtt_pub_request_cb(void *arg, err_t result) {
+    mqtt_pub_wait_t *wait = (mqtt_pub_wait_t *)arg;
+
+    mqtt_request_done();
     if (result == ERR_OK) {
-        printf("Publish successful\n");
+        LOG_DEBUG("Publish successful\n");
     } else {
-        printf("Publish failed (err=%d)\n", result);
+        LOG_WARN("Publish failed (err=%d)\n", result);
+    }
+
+    if (wait && wait->done) {
+        mqtt_publish_done_t done = wait->done;
+        wait->done = NULL;
+        done(wait->arg, result == ERR_OK);
     }
 }
 
 int mqtt_init(const char* client_id) {
-    mqtt_client = mqtt_client_new();
-    if (!mqtt_client) {
-        printf("Failed to create MQTT client\n");
-        return MQTT_ERROR;
+    cyw43_arch_lwip_begin();
+    if (mqtt_client) {
+        // Still set up from the last cycle: close it before wiping
+        mqtt_disconnect(mqtt_client);
     }
-    
+    // Same state mqtt_client_new() hands out, without the heap
+    memset(&mqtt_client_storage, 0, sizeof(mqtt_client_storage));
+    mqtt_client = &mqtt_client_storage;
+    cyw43_arch_lwip_end();
+
     mqtt_status = MQTT_STATUS_DISCONNECTED;
     printf("MQTT client initialized (ID: %s)\n", client_id);
     return MQTT_OK;
 }
 
+void mqtt_set_keep_alive(uint16_t seconds) {
+    keep_alive_s = seconds;
+}
+
+void mqtt_set_clean_session(bool clean) {
+    clean_session = clean;
+}
+
+// lwIP's client always sets Clean Session in CONNECT. The packet waits in
+// the output ring buffer until the TCP handshake completes, so for a
+// persistent session the flag is cleared there before it goes out.
+// Must run under cyw43_arch_lwip_begin() together with the connect call.
+#define MQTT_CONNECT_FLAG_CLEAN_SESSION 0x02   // private to lwIP's mqtt.c
+
+static bool mqtt_clear_clean_session_flag(mqtt_client_t *client) {
+    static const uint8_t proto[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04};
+    struct mqtt_ringbuf_t *rb = &client->output;
+
+    // Fixed header (1 byte) + remaining length (1..4 bytes) precede the name
+    for (uint16_t off = 2; off <= 5; off++) {
+        bool match = true;
+        for (uint16_t i = 0; i < sizeof(proto) && match; i++) {
+            match = rb->buf[(rb->get + off + i) % MQTT_OUTPUT_RINGBUF_SIZE] == proto[i];
+        }
+        if (match) {
+            uint16_t flags_idx = (rb->get + off + sizeof(proto)) % MQTT_OUTPUT_RINGBUF_SIZE;
+            rb->buf[flags_idx] &= (uint8_t)~MQTT_CONNECT_FLAG_CLEAN_SESSION;
+            return true;
+        }
+    }
+    return false;
+}
+
 int mqtt_connect(const char* broker_ip, uint16_t port, mqtt_message_callback_t callback) {
     if (!mqtt_client) {
         printf("MQTT client not initialized\n");
@@ -106,7 +255,7 @@ int mqtt_connect(const char* broker_ip, uint16_t port, mqtt_message_callback_t c
     struct mqtt_connect_client_info_t ci;
     memset(&ci, 0, sizeof(ci));
     ci.client_id = MQTT_CLIENT_ID;
-    ci.keep_alive = 60;
+    ci.keep_alive = keep_alive_s;
     ci.will_topic = NULL;
     ci.will_msg = NULL;
     
@@ -117,20 +266,27 @@ int mqtt_connect(const char* broker_ip, uint16_t port, mqtt_message_callback_t c
         return MQTT_ERROR;
     }
     
-    // Set callbacks
+    // Connect to broker. lwIP asserts its core lock in
+    // mqtt_set_inpub_callback() too, so both go under it.
+    mqtt_status = MQTT_STATUS_CONNECTING;
+    cyw43_arch_lwip_begin();
     mqtt_set_inpub_callback(mqtt_client, 
                            mqtt_incoming_publish_cb, 
                            mqtt_incoming_data_cb, 
                            NULL);
-    
-    // Connect to broker
-    mqtt_status = MQTT_STATUS_CONNECTING;
+    pending_requests = 0;
+    mqtt_fail_pub_waits();   // any left belong to the previous connection
     err_t err = mqtt_client_connect(mqtt_client, 
                                     &broker_addr, 
                                     port, 
                                     mqtt_connection_cb, 
                                     NULL, 
                                     &ci);
+    if (err == ERR_OK && !clean_session &&
+        !mqtt_clear_clean_session_flag(mqtt_client)) {
+        printf("MQTT: could not request a persistent session\n");
+    }
+    cyw43_arch_lwip_end();
     
     if (err != ERR_OK) {
         printf("MQTT connect failed (err=%d)\n", err);
@@ -142,20 +298,43 @@ int mqtt_connect(const char* broker_ip, uint16_t port, mqtt_message_callback_t c
     return MQTT_OK;
 }
 
-int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, uint8_t retain) {
+int mqtt_publish_data(const char* topic, const void* data, uint16_t len, uint8_t qos, uint8_t retain) {
+    return mqtt_publish_data_acked(topic, data, len, qos, retain, NULL, NULL);
+}
+
+int mqtt_publish_data_acked(const char* topic, const void* data, uint16_t len, uint8_t qos,
+                            uint8_t retain, mqtt_publish_done_t done, void* arg) {
     if (mqtt_status != MQTT_STATUS_CONNECTED) {
         printf("MQTT not connected\n");
         return MQTT_ERROR;
     }
     
-    err_t err = mqtt_publish(mqtt_client, 
+    // Count the request under the same lock its callback runs under, so
+    // the callback's decrement can neither come first nor be lost
+    cyw43_arch_lwip_begin();
+    mqtt_pub_wait_t *wait = NULL;
+    for (int i = 0; done && !wait && i < MQTT_REQ_MAX_IN_FLIGHT; i++) {
+        if (!pub_waits[i].done) {
+            wait = &pub_waits[i];
+        }
+    }
+    err_t err = (done && !wait) ? ERR_MEM :
+                mqtt_publish(mqtt_client, 
                             topic, 
-                            payload, 
-                            strlen(payload), 
+                            data, 
+                            len, 
                             qos, 
                             retain, 
                             mqtt_pub_request_cb, 
-                            NULL);
+                            wait);
+    if (err == ERR_OK) {
+        pending_requests++;
+        if (wait) {
+            wait->done = done;
+            wait->arg = arg;
+        }
+    }
+    cyw43_arch_lwip_end();
     
     if (err != ERR_OK) {
         printf("MQTT publish failed (err=%d)\n", err);
@@ -165,17 +344,27 @@ int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, ui
     return MQTT_OK;
 }
 
+int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, uint8_t retain) {
+    return mqtt_publish_data(topic, payload, (uint16_t)strlen(payload), qos, retain);
+}
+
 int mqtt_subscribe_topic(const char* topic, uint8_t qos) {
     if (mqtt_status != MQTT_STATUS_CONNECTED) {
         printf("MQTT not connected\n");
         return MQTT_ERROR;
     }
     
+    cyw43_arch_lwip_begin();
     err_t err = mqtt_subscribe(mqtt_client, 
                               topic, 
                               qos, 
                               mqtt_sub_request_cb, 
                               NULL);
+    if (err == ERR_OK) {
+        pending_requests++;
+        retained_seen = false;   // a (re)subscription is answered with the retained message
+    }
+    cyw43_arch_lwip_end();
     
     if (err != ERR_OK) {
         printf("MQTT subscribe failed (err=%d)\n", err);
@@ -191,8 +380,17 @@ int mqtt_unsubscribe_topic(const char* topic) {
         return MQTT_ERROR;
     }
     
+    cyw43_arch_lwip_begin();
     err_t err = mqtt_unsubscribe(mqtt_client, topic, mqtt_sub_request_cb, NULL);
-    return (err == ERR_OK) ? MQTT_OK : MQTT_ERROR;
+    if (err == ERR_OK) {
+        pending_requests++;
+    }
+    cyw43_arch_lwip_end();
+    
+    if (err != ERR_OK) {
+        return MQTT_ERROR;
+    }
+    return MQTT_OK;
 }
 
 mqtt_status_t mqtt_get_status(void) {
@@ -201,8 +399,10 @@ mqtt_status_t mqtt_get_status(void) {
 
 void mqtt_disconnect_client(void) {
     if (mqtt_client) {
-        mqtt_disconnect(mqtt_client);
-        mqtt_client_free(mqtt_client);
+        cyw43_arch_lwip_begin();
+        mqtt_disconnect(mqtt_client);   // storage is static, nothing to free
+        mqtt_fail_pub_waits();
+        cyw43_arch_lwip_end();
         mqtt_client = NULL;
         mqtt_status = MQTT_STATUS_DISCONNECTED;
         printf("MQTT disconnected\n");
@@ -251,3 +451,57 @@ void listen_for_mqtt_updates(uint32_t ms) {
         sleep_ms(50);
     }
 }
+
+uint32_t mqtt_drain_updates(uint32_t max_ms, uint32_t idle_ms) {
+    uint32_t start_ms = to_ms_since_boot(get_absolute_time());
+    uint32_t start_count = rx_messages;
+    bool by_retained = false;
+    last_rx_ms = start_ms;
+
+    while (mqtt_get_status() == MQTT_STATUS_CONNECTED) {
+        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+
+        // Done once every request is acknowledged and either the retained
+        // message arrived or the broker has gone quiet, i.e. anything it
+        // queued for us while we slept has arrived
+        if (pending_requests == 0 && retained_seen) {
+            by_retained = true;
+            break;
+        }
+        if (pending_requests == 0 && now_ms - last_rx_ms >= idle_ms) {
+            break;
+        }
+        if (now_ms - start_ms >= max_ms) {
+            printf("[MQTT] Drain window expired (%u requests pending)\n",
+                   (unsigned)pending_requests);
+            break;
+        }
+
+        cyw43_arch_poll();
+        mqtt_poll();
+        sleep_ms(10);
+    }
+
+    uint32_t received = rx_messages - start_count;
+    uint32_t took_ms = to_ms_since_boot(get_absolute_time()) - start_ms;
+    retained_seen = false;
+
+    resync_stats.drains++;
+    resync_stats.total_ms += took_ms;
+    if (by_retained) {
+        resync_stats.by_retained++;
+        // Measured against the fixed max_ms listen window this replaces
+        if (took_ms < max_ms) {
+            resync_stats.saved_ms += max_ms - took_ms;
+        }
+    }
+
+    printf("[MQTT] Drained %lu message(s) in %lu ms%s\n",
+           (unsigned long)received, (unsigned long)took_ms,
+           by_retained ? " (retained resync)" : "");
+    return received;
+}
+
+void mqtt_get_resync_stats(mqtt_resync_stats_t *out) {
+    *out = resync_stats;
+}
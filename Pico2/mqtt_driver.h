@@ -3,6 +3,7 @@
 
 #include "lwip/apps/mqtt.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 // Return codes
 #define MQTT_OK     0
@@ -20,18 +21,44 @@ typedef enum {
 #define INTERVAL_WARNING   10000   // 10 seconds
 #define INTERVAL_HIGH       5000   // 5 seconds
 
+#define MQTT_KEEP_ALIVE_S         60    // default keep-alive
+#define MQTT_KEEP_ALIVE_LONG_S   900    // session kept across radio power-save sleeps
+#define MQTT_DRAIN_IDLE_MS       150    // broker quiet this long → queue drained
+
 // Callback type for incoming messages
 typedef void (*mqtt_message_callback_t)(const char* topic, const char* payload, uint16_t payload_len);
 
 // Initialize MQTT client
 int mqtt_init(const char* client_id);
 
+// Keep-alive used by the next mqtt_connect(), in seconds
+void mqtt_set_keep_alive(uint16_t seconds);
+
+// Clean (default) or persistent session for the next mqtt_connect().
+// With a persistent session the broker keeps our QoS1 subscriptions and
+// queues messages for them while we are disconnected.
+void mqtt_set_clean_session(bool clean);
+
 // Connect to MQTT broker
 int mqtt_connect(const char* broker_ip, uint16_t port, mqtt_message_callback_t callback);
 
 // Publish message (renamed to avoid conflict)
 int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, uint8_t retain);
 
+// Publish len raw bytes (binary payloads may contain NULs)
+int mqtt_publish_data(const char* topic, const void* data, uint16_t len, uint8_t qos, uint8_t retain);
+
+// Runs in lwIP's context when an acked publish completes: ok once the
+// broker has acknowledged it (QoS1) or it was sent (QoS0); false on an
+// error or lwIP's request timeout. lwIP drops requests still in flight
+// without their callbacks when the connection closes; the driver then
+// reports those as failed once it notices the loss or reconnects.
+typedef void (*mqtt_publish_done_t)(void* arg, bool ok);
+
+// mqtt_publish_data() that reports its completion to done(arg, ok)
+int mqtt_publish_data_acked(const char* topic, const void* data, uint16_t len, uint8_t qos,
+                            uint8_t retain, mqtt_publish_done_t done, void* arg);
+
 // Subscribe to topic (renamed to avoid conflict)
 int mqtt_subscribe_topic(const char* topic, uint8_t qos);
 
@@ -55,4 +82,19 @@ void mqtt_set_callback(mqtt_message_callback_t callback);
 
 void listen_for_mqtt_updates(uint32_t ms);
 
+typedef struct {
+    uint32_t drains;        // mqtt_drain_updates() calls
+    uint32_t by_retained;   // ended early by a retained message
+    uint64_t total_ms;      // time spent draining
+    uint64_t saved_ms;      // cut from the max_ms window by retained exits
+} mqtt_resync_stats_t;
+
+// Service MQTT until all requests are acknowledged and either a retained
+// message has arrived since the last (re)subscription or nothing has
+// arrived for idle_ms (or max_ms has passed). Returns the number of
+// messages received.
+uint32_t mqtt_drain_updates(uint32_t max_ms, uint32_t idle_ms);
+
+void mqtt_get_resync_stats(mqtt_resync_stats_t *out);
+
 #endif
@@ -0,0 +1,123 @@
+#include "phase_stats.h"
+#include "pico/stdlib.h"
+#include "pico/critical_section.h"
+#include "fmt_utils.h"
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint16_t hist[PHASE_HIST_BUCKETS];
+} phase_window_t;
+
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+    "wifi", "mqtt", "listen", "sensor", "sleep"
+};
+
+static phase_window_t windows[PHASE_COUNT];
+static uint32_t cycles = 0;
+static critical_section_t lock;
+
+void phase_stats_init(void) {
+    critical_section_init(&lock);
+}
+
+uint64_t phase_begin(void) {
+    return time_us_64();
+}
+
+static uint8_t phase_bucket(uint32_t us) {
+    uint32_t bound = 1000;   // 1 ms
+    uint8_t b = 0;
+
+    while (b < PHASE_HIST_BUCKETS - 1 && us >= bound) {
+        bound *= 4;
+        b++;
+    }
+    return b;
+}
+
+void phase_end(phase_t p, uint64_t start_us) {
+    uint64_t elapsed = time_us_64() - start_us;
+    phase_record(p, elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed);
+}
+
+void phase_record(phase_t p, uint32_t us) {
+    if (p >= PHASE_COUNT) {
+        return;
+    }
+
+    uint8_t b = phase_bucket(us);
+
+    critical_section_enter_blocking(&lock);
+    phase_window_t *w = &windows[p];
+    if (w->count == 0 || us < w->min_us) w->min_us = us;
+    if (us > w->max_us) w->max_us = us;
+    w->total_us += us;
+    w->count++;
+    if (w->hist[b] < UINT16_MAX) {
+        w->hist[b]++;
+    }
+    critical_section_exit(&lock);
+}
+
+bool phase_stats_cycle_done(void) {
+    cycles++;
+    return phase_stats_due();
+}
+
+bool phase_stats_due(void) {
+    return cycles >= PHASE_STATS_PUBLISH_CYCLES;
+}
+
+size_t phase_stats_format(char *buf, size_t buf_len) {
+    phase_window_t snap[PHASE_COUNT];
+
+    critical_section_enter_blocking(&lock);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        snap[p] = windows[p];
+    }
+    critical_section_exit(&lock);
+
+    fmt_buf_t f;
+    fmt_init(&f, buf, buf_len);
+    fmt_put_str(&f, "cycles=");
+    fmt_put_u32(&f, cycles);
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const phase_window_t *w = &snap[p];
+        if (w->count == 0) {
+            continue;
+        }
+        fmt_put_char(&f, ';');
+        fmt_put_str(&f, PHASE_NAMES[p]);
+        fmt_put_char(&f, '=');
+        fmt_put_u32(&f, w->count);
+        fmt_put_char(&f, ',');
+        fmt_put_u32(&f, w->min_us);
+        fmt_put_char(&f, ',');
+        fmt_put_u32(&f, (uint32_t)(w->total_us / w->count));
+        fmt_put_char(&f, ',');
+        fmt_put_u32(&f, w->max_us);
+        for (int b = 0; b < PHASE_HIST_BUCKETS; b++) {
+            fmt_put_char(&f, b ? '/' : ',');
+            fmt_put_u32(&f, w->hist[b]);
+        }
+    }
+
+    size_t len = fmt_finish(&f);
+    if (len == 0) {
+        return 0;
+    }
+
+    // Start a new window; samples recorded since the snapshot are dropped
+    critical_section_enter_blocking(&lock);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        windows[p] = (phase_window_t){ 0 };
+    }
+    cycles = 0;
+    critical_section_exit(&lock);
+
+    return len;
+}
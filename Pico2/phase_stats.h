@@ -0,0 +1,50 @@
+#ifndef PHASE_STATS_H
+#define PHASE_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-phase time accounting for the Pico2 duty cycle. Each phase keeps
+// min/mean/max and a histogram of durations (µs timer). Statistics cover
+// the window since the last phase_stats_format() reset and can be
+// recorded from either core.
+
+typedef enum {
+    PHASE_WIFI = 0,     // setup_wifi(): join + address
+    PHASE_MQTT,         // setup_mqtt(): broker connect
+    PHASE_LISTEN,       // mqtt_drain_updates() after publishing
+    PHASE_SENSOR,       // ACD1100 command → frame decoded
+    PHASE_SLEEP,        // idle/sleep between samples
+    PHASE_COUNT
+} phase_t;
+
+// Histogram bucket upper bounds grow ×4 from 1 ms: <1, <4, <16, <64,
+// <256 ms, <1 s, <4 s, ≥4 s
+#define PHASE_HIST_BUCKETS        8
+#define PHASE_STATS_PUBLISH_CYCLES 20   // publish a record every N samples
+#define PHASE_STATS_PAYLOAD_MAX   384
+
+void phase_stats_init(void);
+
+// Start timestamp for phase_end()
+uint64_t phase_begin(void);
+
+// Record the time since start_us against phase p
+void phase_end(phase_t p, uint64_t start_us);
+
+// Record a duration measured some other way (e.g. across deep sleep)
+void phase_record(phase_t p, uint32_t us);
+
+// Count one duty cycle; true once PHASE_STATS_PUBLISH_CYCLES have passed
+// since the last report
+bool phase_stats_cycle_done(void);
+bool phase_stats_due(void);
+
+// Format the window as
+//   "cycles=<n>;<phase>=<n>,<min>,<mean>,<max>,<h0>/<h1>/.../<h7>;..."
+// (times in µs, phases with no samples omitted) and start a new window.
+// Returns the length, 0 if buf was too small (window kept).
+size_t phase_stats_format(char *buf, size_t buf_len);
+
+#endif
@@ -1,7 +1,40 @@
 #include "power_manager.h"
+#include <stdio.h>
 #include "hardware/vreg.h"
 #include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/xosc.h"
+#include "hardware/structs/rosc.h"
+#include "hardware/structs/scb.h"
+#include "hardware/sync.h"
 #include "pico/stdlib.h"
+#include "pico/aon_timer.h"
+#include "pico/runtime_init.h"
+#include "sleep_planner.h"
+#include "wifi_driver.h"
+#include "mqtt_driver.h"
+#include "phase_stats.h"
+
+static const char *const RADIO_MODE_NAMES[RADIO_MODE_COUNT] = {
+    "off",
+    "keep-associated"
+};
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t min_us;
+    uint32_t max_us;
+} latency_stats_t;
+
+static bool radio_up = false;          // cyw43 initialised and MQTT set up
+static radio_mode_t sleep_mode = RADIO_MODE_OFF;
+static uint64_t wake_us = 0;
+static bool wake_pending = false;
+static latency_stats_t latency[RADIO_MODE_COUNT];
+
+static uint64_t deep_slept_ms = 0;     // time the system timer was gated
+static volatile bool rtc_alarm_fired = false;
 
 void enter_low_power_mode(void) {
     vreg_set_voltage(VREG_VOLTAGE_1_10);
@@ -14,3 +47,201 @@ void exit_low_power_mode(void) {
     sleep_ms(10);
     set_sys_clock_khz(125000, true);
 }
+
+/* ==========================================================
+   Deep sleep (RP2040 SLEEP state)
+   ========================================================== */
+#define RTC_CLOCK_HZ 46875u   // XOSC / 256, RTC divides this down to 1 Hz
+
+static void power_rtc_alarm_cb(void) {
+    rtc_alarm_fired = true;
+}
+
+// Switch everything onto the XOSC and stop what the RTC doesn't need
+static void power_clocks_to_xosc(void) {
+    clock_configure(clk_ref, CLOCKS_CLK_REF_CTRL_SRC_VALUE_XOSC_CLKSRC,
+                    0, XOSC_HZ, XOSC_HZ);
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF,
+                    0, XOSC_HZ, XOSC_HZ);
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
+                    XOSC_HZ, XOSC_HZ);
+    clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_XOSC_CLKSRC,
+                    XOSC_HZ, RTC_CLOCK_HZ);
+    clock_stop(clk_usb);
+    clock_stop(clk_adc);
+
+    pll_deinit(pll_sys);
+    pll_deinit(pll_usb);
+
+    // Nothing runs from the ROSC any more
+    uint32_t ctrl = rosc_hw->ctrl & ~ROSC_CTRL_ENABLE_BITS;
+    rosc_hw->ctrl = ctrl | (ROSC_CTRL_ENABLE_VALUE_DISABLE << ROSC_CTRL_ENABLE_LSB);
+}
+
+static void power_clocks_restore(uint32_t sys_khz) {
+    uint32_t ctrl = rosc_hw->ctrl & ~ROSC_CTRL_ENABLE_BITS;
+    rosc_hw->ctrl = ctrl | (ROSC_CTRL_ENABLE_VALUE_ENABLE << ROSC_CTRL_ENABLE_LSB);
+
+    clocks_hw->sleep_en0 = ~0u;
+    clocks_hw->sleep_en1 = ~0u;
+
+    // PLLs and the default clock tree (clk_sys, clk_usb, clk_peri, clk_adc, clk_rtc)
+    runtime_init_clocks();
+
+    // Back to whatever the caller was running at (e.g. 48 MHz low-power)
+    if (clock_get_hz(clk_sys) / 1000 != sys_khz) {
+        set_sys_clock_khz(sys_khz, true);
+    }
+}
+
+static void power_deep_sleep_s(uint32_t seconds) {
+    uint32_t sys_khz = clock_get_hz(clk_sys) / 1000;
+
+    stdio_flush();
+    power_clocks_to_xosc();
+
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
+    aon_timer_start(&ts);
+    ts.tv_sec = seconds;
+    rtc_alarm_fired = false;
+    aon_timer_enable_alarm(&ts, power_rtc_alarm_cb, true);
+
+    // Only the RTC keeps its clock while the core sleeps
+    clocks_hw->sleep_en0 = CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS;
+    clocks_hw->sleep_en1 = 0x0;
+
+    scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+    while (!rtc_alarm_fired) {
+        __wfi();
+    }
+    scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+
+    aon_timer_disable_alarm();
+    aon_timer_stop();
+
+    power_clocks_restore(sys_khz);
+    deep_slept_ms += (uint64_t)seconds * 1000u;
+}
+
+void power_sleep_ms(uint32_t interval_ms, bool allow_deep) {
+    absolute_time_t deadline = make_timeout_time_ms(interval_ms);
+    sleep_plan_t plan = sleep_plan(interval_ms, allow_deep);
+
+    if (plan.deep_s > 0) {
+        printf("[POWER] Deep sleep %lu s + %lu ms\n",
+               (unsigned long)plan.deep_s, (unsigned long)plan.shallow_ms);
+        power_deep_sleep_s(plan.deep_s);
+
+        // The system timer was gated while asleep, so the deadline on the
+        // timer's time base moved earlier by the time spent in deep sleep
+        deadline = from_us_since_boot(to_us_since_boot(deadline) -
+                                      (uint64_t)plan.deep_s * 1000000u);
+    }
+
+    sleep_until(deadline);
+}
+
+uint32_t power_uptime_ms(void) {
+    return (uint32_t)(to_ms_since_boot(get_absolute_time()) + deep_slept_ms);
+}
+
+static void radio_teardown(void) {
+    mqtt_disconnect_client();
+    wifi_deinit();
+    radio_up = false;
+}
+
+static void radio_bringup(void) {
+    // Lease ageing has to include the time spent in deep sleep
+    wifi_set_clock(power_uptime_ms);
+
+    // Long keep-alive so pings don't wake a power-saving radio every minute
+    mqtt_set_keep_alive(sleep_mode == RADIO_MODE_KEEP_ASSOCIATED
+                        ? MQTT_KEEP_ALIVE_LONG_S : MQTT_KEEP_ALIVE_S);
+    uint64_t t = phase_begin();
+    setup_wifi();
+    phase_end(PHASE_WIFI, t);
+
+    t = phase_begin();
+    setup_mqtt();
+    phase_end(PHASE_MQTT, t);
+    if (mqtt_get_status() != MQTT_STATUS_CONNECTED) {
+        // A stale reused address is the likely culprit; redo DHCP next time
+        wifi_forget_lease();
+    }
+    radio_up = true;
+}
+
+void power_radio_sleep(radio_mode_t mode) {
+    if (mode >= RADIO_MODE_COUNT) {
+        mode = RADIO_MODE_OFF;
+    }
+    sleep_mode = mode;
+
+    if (!radio_up) {
+        return;
+    }
+
+    if (mode == RADIO_MODE_KEEP_ASSOCIATED) {
+        wifi_enter_power_save();
+    } else {
+        radio_teardown();
+    }
+}
+
+bool power_radio_wake(void) {
+    wake_us = time_us_64();
+    wake_pending = true;
+
+    if (radio_up) {
+        wifi_exit_power_save();
+
+        if (wifi_is_connected() && mqtt_get_status() == MQTT_STATUS_CONNECTED) {
+            wifi_maintain_lease();   // the link may outlive a reused lease
+            return false;            // session survived the sleep
+        }
+
+        printf("[POWER] Link lost while sleeping, reconnecting\n");
+        radio_teardown();
+    }
+
+    radio_bringup();
+    return true;
+}
+
+bool power_radio_is_up(void) {
+    return radio_up;
+}
+
+void power_record_publish(void) {
+    if (!wake_pending) {
+        return;
+    }
+    wake_pending = false;
+
+    uint32_t us = (uint32_t)(time_us_64() - wake_us);
+    latency_stats_t *st = &latency[sleep_mode];
+
+    if (st->count == 0 || us < st->min_us) st->min_us = us;
+    if (us > st->max_us) st->max_us = us;
+    st->total_us += us;
+    st->count++;
+
+    printf("[POWER] Wake-to-publish (%s): %lu ms\n",
+           RADIO_MODE_NAMES[sleep_mode], (unsigned long)(us / 1000));
+}
+
+void power_report_latency(void) {
+    for (int m = 0; m < RADIO_MODE_COUNT; m++) {
+        const latency_stats_t *st = &latency[m];
+        if (st->count == 0) {
+            continue;
+        }
+        printf("[POWER] %-15s n=%lu min=%lu avg=%lu max=%lu ms\n",
+               RADIO_MODE_NAMES[m],
+               (unsigned long)st->count,
+               (unsigned long)(st->min_us / 1000),
+               (unsigned long)(st->total_us / st->count / 1000),
+               (unsigned long)(st->max_us / 1000));
+    }
+}
@@ -1,7 +1,43 @@
 #ifndef POWER_MANAGER_H
 #define POWER_MANAGER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// How the radio is handled while the node sleeps
+typedef enum {
+    RADIO_MODE_OFF = 0,           // MQTT + cyw43 torn down, full reconnect on wake
+    RADIO_MODE_KEEP_ASSOCIATED,   // link kept in CYW43 power-save, MQTT session kept
+    RADIO_MODE_COUNT
+} radio_mode_t;
+
 void enter_low_power_mode(void);
 void exit_low_power_mode(void);
 
-#endif
\ No newline at end of file
+// Sleep for interval_ms. When allow_deep is set (radio off, nothing else
+// needing the fast clocks) whole seconds are spent in deep sleep: clocks
+// run from the XOSC, the PLLs are stopped, everything but the RTC is gated
+// and the RTC alarm wakes the core. The rest is a normal timer sleep.
+void power_sleep_ms(uint32_t interval_ms, bool allow_deep);
+
+// ms since boot including time spent in deep sleep (the system timer is
+// gated while in deep sleep, so to_ms_since_boot() falls behind)
+uint32_t power_uptime_ms(void);
+
+// Put the radio into the given mode before sleeping
+void power_radio_sleep(radio_mode_t mode);
+
+// Bring the radio back to full power after sleeping and start the
+// wake-to-publish timer. Returns true if a full (re)connect was done,
+// i.e. subscriptions have to be renewed.
+bool power_radio_wake(void);
+
+bool power_radio_is_up(void);
+
+// Call after the first publish following power_radio_wake()
+void power_record_publish(void);
+
+// Print wake-to-publish latency statistics for each radio mode
+void power_report_latency(void);
+
+#endif
@@ -0,0 +1,89 @@
+#include "sample_buffer.h"
+#include "fmt_utils.h"
+
+static sample_t samples[SAMPLE_BUFFER_CAPACITY];
+static size_t head = 0;       // index of the oldest sample
+static size_t count = 0;
+static uint32_t dropped = 0;
+
+void sample_buffer_init(void) {
+    head = 0;
+    count = 0;
+    dropped = 0;
+}
+
+bool sample_buffer_push(uint32_t timestamp_ms, uint32_t ppm) {
+    bool kept_all = true;
+
+    if (count == SAMPLE_BUFFER_CAPACITY) {
+        // Full: overwrite the oldest, the freshest data matters most
+        head = (head + 1) % SAMPLE_BUFFER_CAPACITY;
+        count--;
+        dropped++;
+        kept_all = false;
+    }
+
+    size_t tail = (head + count) % SAMPLE_BUFFER_CAPACITY;
+    samples[tail].timestamp_ms = timestamp_ms;
+    samples[tail].ppm = ppm;
+    count++;
+
+    return kept_all;
+}
+
+size_t sample_buffer_count(void) {
+    return count;
+}
+
+uint32_t sample_buffer_dropped(void) {
+    return dropped;
+}
+
+bool sample_buffer_peek(size_t idx, sample_t *out) {
+    if (idx >= count || !out) {
+        return false;
+    }
+    *out = samples[(head + idx) % SAMPLE_BUFFER_CAPACITY];
+    return true;
+}
+
+void sample_buffer_consume(size_t n) {
+    if (n > count) {
+        n = count;
+    }
+    head = (head + n) % SAMPLE_BUFFER_CAPACITY;
+    count -= n;
+}
+
+size_t sample_buffer_format_batch(char *buf,
+                                  size_t buf_len,
+                                  uint32_t now_ms,
+                                  size_t max_samples) {
+    if (!buf || buf_len == 0) {
+        return 0;
+    }
+
+    fmt_buf_t f;
+    size_t n = 0;
+    fmt_init(&f, buf, buf_len);
+
+    while (n < count && n < max_samples) {
+        const sample_t *s = &samples[(head + n) % SAMPLE_BUFFER_CAPACITY];
+        size_t mark = f.len;
+
+        if (n) {
+            fmt_put_char(&f, ',');
+        }
+        fmt_put_u32(&f, now_ms - s->timestamp_ms);
+        fmt_put_char(&f, ':');
+        fmt_put_u32(&f, s->ppm);
+
+        if (f.overflow) {
+            fmt_rewind(&f, mark);   // drop the partial entry
+            break;
+        }
+        n++;
+    }
+
+    return n;
+}
@@ -0,0 +1,44 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// RAM ring buffer of timestamped CO2 samples, used to keep sampling while
+// the radio is off and flush many readings in one publish.
+
+#define SAMPLE_BUFFER_CAPACITY  32   // oldest sample is overwritten when full
+#define SAMPLE_BATCH_SIZE       10   // radio comes up every N samples in NORMAL
+#define SAMPLE_BATCH_PAYLOAD_MAX 256  // fits SAMPLE_BATCH_SIZE entries with headroom
+
+typedef struct {
+    uint32_t timestamp_ms;   // ms since boot when the sample was taken
+    uint32_t ppm;            // filtered CO2 value
+} sample_t;
+
+void sample_buffer_init(void);
+
+// Store a sample. Returns false if the oldest sample had to be dropped.
+bool sample_buffer_push(uint32_t timestamp_ms, uint32_t ppm);
+
+size_t sample_buffer_count(void);
+
+// Number of samples overwritten because the buffer was full
+uint32_t sample_buffer_dropped(void);
+
+// Copy the idx-th oldest sample without removing it
+bool sample_buffer_peek(size_t idx, sample_t *out);
+
+// Remove the n oldest samples (after a successful publish)
+void sample_buffer_consume(size_t n);
+
+// Format up to max_samples oldest samples as "age_ms:ppm,age_ms:ppm,..."
+// where age is relative to now_ms, oldest first.
+// Returns the number of samples written into buf (NUL terminated).
+size_t sample_buffer_format_batch(char *buf,
+                                  size_t buf_len,
+                                  uint32_t now_ms,
+                                  size_t max_samples);
+
+#endif
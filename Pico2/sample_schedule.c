@@ -0,0 +1,66 @@
+#include "sample_schedule.h"
+#include <stdio.h>
+#include "hardware/sync.h"
+
+static volatile uint32_t generation = 0;
+static volatile uint64_t changed_us = 0;
+
+// Sampler side only (a single core)
+static uint32_t seen_generation = 0;
+static sched_stats_t stats;
+
+void sched_level_changed(void) {
+    changed_us = time_us_64();
+    __mem_fence_release();   // timestamp visible before the new generation
+    generation = generation + 1;
+    __sev();                 // wake a sampler parked in __wfe on either core
+}
+
+uint32_t sched_generation(void) {
+    return generation;
+}
+
+absolute_time_t sched_next_slot(absolute_time_t last_slot, uint32_t interval_ms) {
+    absolute_time_t next = delayed_by_ms(last_slot, interval_ms);
+    absolute_time_t now = get_absolute_time();
+    return absolute_time_diff_us(now, next) > 0 ? next : now;
+}
+
+bool sched_wait_until(absolute_time_t deadline, uint32_t gen) {
+    while (generation == gen) {
+        if (best_effort_wfe_or_timeout(deadline)) {
+            return generation != gen;
+        }
+    }
+    return true;
+}
+
+void sched_sample_started(void) {
+    uint32_t gen = generation;
+    if (gen == seen_generation) {
+        return;
+    }
+    __mem_fence_acquire();
+
+    uint64_t elapsed = time_us_64() - changed_us;
+    uint32_t us = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+
+    seen_generation = gen;
+    stats.changes++;
+    stats.latency_last_us = us;
+    if (us > stats.latency_max_us) {
+        stats.latency_max_us = us;
+    }
+}
+
+void sched_get_stats(sched_stats_t *out) {
+    *out = stats;
+}
+
+void sched_report(void) {
+    sched_stats_t s;
+    sched_get_stats(&s);
+    printf("[SCHED] level changes=%lu, change->sample last=%lu us max=%lu us\n",
+           (unsigned long)s.changes, (unsigned long)s.latency_last_us,
+           (unsigned long)s.latency_max_us);
+}
@@ -0,0 +1,42 @@
+#ifndef SAMPLE_SCHEDULE_H
+#define SAMPLE_SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+// Deadline scheduling for CO2 samples. Each sample slot is planned from
+// the start of the previous one; a safety-level change bumps a generation
+// counter and sends an event, so a sampler blocked until the next slot
+// wakes at once and re-plans with the new interval instead of finishing
+// a wait sized for the old level.
+
+typedef struct {
+    uint32_t changes;          // level changes seen by the sampler
+    uint32_t latency_last_us;  // level change → first sample started
+    uint32_t latency_max_us;
+} sched_stats_t;
+
+// Any context (MQTT callback): safety_level has just changed
+void sched_level_changed(void);
+
+// Current generation; compare with a saved value to detect a change
+uint32_t sched_generation(void);
+
+// Next slot for a sample that started at last_slot. A slot that has
+// already passed (shorter new interval) is returned as now.
+absolute_time_t sched_next_slot(absolute_time_t last_slot, uint32_t interval_ms);
+
+// Block with __wfe until deadline or until the generation differs from
+// gen. Returns true if woken by a level change. Uses the default alarm
+// pool, so core0 only; core1 runs the same check on its own pool.
+bool sched_wait_until(absolute_time_t deadline, uint32_t gen);
+
+// Sampler: a sample is starting now. Records change-to-sample latency for
+// the first sample after each level change.
+void sched_sample_started(void);
+
+void sched_get_stats(sched_stats_t *out);
+void sched_report(void);
+
+#endif
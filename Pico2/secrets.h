@@ -12,7 +12,12 @@
 
 // MQTT Topics
 #define TOPIC_CO2 "pico2/sensor/data"  
+#define TOPIC_CO2_BATCH "pico2/sensor/batch"   // "age_ms:ppm,..." oldest first
+#define TOPIC_CO2_SUMMARY "pico2/sensor/summary"   // one record per NORMAL window
+#define TOPIC_CO2_BACKLOG "pico2/backlog/data"   // "age_ms:" + a TOPIC_CO2 payload queued offline
+#define TOPIC_CO2_SUMMARY_BACKLOG "pico2/backlog/summary"   // same for TOPIC_CO2_SUMMARY
 #define TOPIC_SAFETY_LEVEL "pico4/prediction"
+#define TOPIC_DIAG_PHASES "pico2/diag/phases"   // phase_stats_format() record
 //Each Pico should have its own unique topic to avoid message conflicts
 
 #endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef SENSOR_RECORD_H
+#define SENSOR_RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary sensor record shared by all nodes (identical copies in Pico2/3/4).
+// Fixed little-endian layout:
+//
+//   off  size  field
+//   0    1     magic    SR_MAGIC (never a valid first byte of a text payload)
+//   1    1     version  SR_VERSION
+//   2    1     type     sr_type_t
+//   3    1     count    number of values, 1..SR_MAX_VALUES
+//   4    2     seq      per-producer sequence number, wraps
+//   6    4     ts_ms    source timestamp, ms since the producer booted
+//   10   4*n   values   signed Q16.16
+//   10+4n 2    crc      CRC-16/CCITT-FALSE over all preceding bytes
+//
+// Text payloads remain valid: receivers check sr_is_binary() and fall back
+// to the old ASCII parsing, and producers pick the format at build time
+// (SR_PAYLOAD_BINARY).
+//
+// Receivers only accept their own SR_VERSION, so every node has to be
+// rebuilt when it changes. Version 2: SR_MAX_VALUES 4 -> 8 and
+// SR_TYPE_CO2_SUMMARY.
+
+#define SR_MAGIC       0xA5
+#define SR_VERSION     2
+#define SR_MAX_VALUES  8
+#define SR_HEADER_LEN  10
+#define SR_MAX_LEN     (SR_HEADER_LEN + 4 * SR_MAX_VALUES + 2)
+
+#ifndef SR_PAYLOAD_BINARY
+#define SR_PAYLOAD_BINARY 0
+#endif
+
+typedef enum {
+    SR_TYPE_GAS        = 1,   // pico1: LPG, CO, NH3
+    SR_TYPE_CO2        = 2,   // pico2: filtered CO2 ppm
+    SR_TYPE_PREDICTION = 3,   // pico4: class index (0 NORMAL, 1 WARNING, 2 HIGH)
+    SR_TYPE_CO2_SUMMARY = 4   // pico2: CO2 window, see SR_SUMMARY_* for the value order
+} sr_type_t;
+
+// Value index in an SR_TYPE_CO2_SUMMARY record (all Q16.16)
+enum {
+    SR_SUMMARY_COUNT = 0,     // samples in the window
+    SR_SUMMARY_MIN,
+    SR_SUMMARY_MAX,
+    SR_SUMMARY_MEAN,
+    SR_SUMMARY_STDDEV,
+    SR_SUMMARY_SLOPE,         // ppm per minute
+    SR_SUMMARY_SPAN_S,        // first to last sample, seconds
+    SR_SUMMARY_VALUES
+};
+
+typedef enum {
+    SR_OK          =  0,
+    SR_ERR_INVAL   = -1,
+    SR_ERR_LENGTH  = -2,
+    SR_ERR_MAGIC   = -3,
+    SR_ERR_VERSION = -4,
+    SR_ERR_CRC     = -5
+} sr_status_t;
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  count;
+    uint16_t seq;
+    uint32_t ts_ms;
+    int32_t  values[SR_MAX_VALUES];   // Q16.16
+} sensor_record_t;
+
+// Encode rec into buf. Returns the encoded length, or 0 if rec is invalid
+// or buf is too small.
+size_t sr_encode(const sensor_record_t *rec, uint8_t *buf, size_t buf_len);
+
+sr_status_t sr_decode(const uint8_t *buf, size_t len, sensor_record_t *out);
+
+// True if the payload looks like a binary record (magic byte check only)
+bool sr_is_binary(const void *payload, size_t len);
+
+uint16_t sr_crc16(const uint8_t *data, size_t len);
+
+// "NORMAL" / "WARNING" / "HIGH" for a prediction class, NULL if out of range
+const char *sr_prediction_label(int cls);
+
+// Number of records lost between the last seen seq and this one (0 for
+// the first record or an in-order one). Updates *last.
+uint16_t sr_seq_gap(int32_t *last, uint16_t seq);
+
+#endif
@@ -0,0 +1,17 @@
+#include "sleep_planner.h"
+
+sleep_plan_t sleep_plan(uint32_t remaining_ms, bool deep_allowed) {
+    sleep_plan_t plan = { .deep_s = 0, .shallow_ms = remaining_ms };
+
+    if (!deep_allowed || remaining_ms < SLEEP_DEEP_MIN_MS) {
+        return plan;
+    }
+
+    // Leave room for the wake overhead so we never overshoot the deadline,
+    // then round down to what the RTC alarm can express
+    uint32_t usable_ms = remaining_ms - SLEEP_DEEP_WAKE_OVERHEAD_MS;
+    plan.deep_s = usable_ms / SLEEP_DEEP_RESOLUTION_MS;
+    plan.shallow_ms = remaining_ms - plan.deep_s * SLEEP_DEEP_RESOLUTION_MS;
+
+    return plan;
+}
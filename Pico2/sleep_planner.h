@@ -0,0 +1,24 @@
+#ifndef SLEEP_PLANNER_H
+#define SLEEP_PLANNER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decides how a sleep interval is split between deep sleep (XOSC only,
+// PLLs stopped, RTC alarm wake) and a normal timer sleep. Pure logic, no
+// SDK dependencies, so it can be exercised on a host.
+
+#define SLEEP_DEEP_MIN_MS           3000u   // below this the clock switch isn't worth it
+#define SLEEP_DEEP_WAKE_OVERHEAD_MS   50u   // PLL relock + clock restore after wake
+#define SLEEP_DEEP_RESOLUTION_MS    1000u   // RP2040 RTC alarm granularity
+
+typedef struct {
+    uint32_t deep_s;        // whole seconds to spend in deep sleep
+    uint32_t shallow_ms;    // remainder for a normal timer sleep
+} sleep_plan_t;
+
+// Plan the next sleep for remaining_ms. deep_allowed is false whenever
+// something still needs the fast clocks (radio up, USB transfer, ...).
+sleep_plan_t sleep_plan(uint32_t remaining_ms, bool deep_allowed);
+
+#endif
@@ -0,0 +1,250 @@
+#include "store_forward.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "mqtt_driver.h"
+#include "power_manager.h"
+#include "fmt_utils.h"
+#include "log_buffer.h"
+#include "secrets.h"
+
+typedef struct {
+    const char *live;
+    const char *backlog;
+} sf_topic_t;
+
+// Record tag = index into this table; append only, tags live in flash
+static const sf_topic_t SF_TOPICS[] = {
+    { TOPIC_CO2,         TOPIC_CO2_BACKLOG },
+    { TOPIC_CO2_SUMMARY, TOPIC_CO2_SUMMARY_BACKLOG }
+};
+
+#define SF_TOPIC_COUNT (sizeof(SF_TOPICS) / sizeof(SF_TOPICS[0]))
+
+// Set in the tag of records whose payload starts with the
+// power_uptime_ms() they were queued at (older builds stored it bare)
+#define SF_TAG_STAMPED  0x80
+#define SF_STAMP_LEN    4
+
+// Records recovered from flash at boot: their stamps are from an earlier
+// uptime, so their age is unknown. They are the oldest, so they go first.
+static uint32_t stale_records;
+static uint32_t dropped_seen;
+
+// One backlog record is in flight at a time, published QoS1, and it only
+// leaves flash once the broker has acknowledged it. The ack arrives in
+// lwIP's context, an IRQ with threadsafe_background where flash can't be
+// written, so sf_ack() only records it and sf_forward() pops.
+typedef enum {
+    SF_IDLE = 0,
+    SF_IN_FLIGHT,
+    SF_ACKED,
+    SF_REJECTED
+} sf_flight_t;
+
+static volatile uint8_t  flight = SF_IDLE;
+static volatile uint32_t flight_token;   // tells a late ack from the current one
+static uint32_t flight_sent_ms;
+static uint32_t flight_dropped;          // dropped_seen when it was sent
+
+static void sf_ack(void *arg, bool ok) {
+    if ((uint32_t)(uintptr_t)arg == flight_token && flight == SF_IN_FLIGHT) {
+        flight = ok ? SF_ACKED : SF_REJECTED;
+    }
+}
+
+static int sf_topic_tag(const char *topic) {
+    for (size_t i = 0; i < SF_TOPIC_COUNT; i++) {
+        if (strcmp(topic, SF_TOPICS[i].live) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void store_forward_init(void) {
+    fq_stats_t st;
+
+    flash_queue_init();
+    flash_queue_get_stats(&st);
+    stale_records = st.pending;
+    dropped_seen = st.dropped;
+}
+
+// Ring overflow drops the oldest records, stale ones first
+static void sf_account_drops(void) {
+    fq_stats_t st;
+    flash_queue_get_stats(&st);
+    uint32_t dropped = st.dropped - dropped_seen;
+    dropped_seen = st.dropped;
+    stale_records = dropped >= stale_records ? 0 : stale_records - dropped;
+}
+
+static void sf_consumed(void) {
+    flash_queue_pop();
+    if (stale_records > 0) {
+        stale_records--;
+    }
+}
+
+sf_result_t sf_publish(const char *topic, const void *data, uint16_t len) {
+    if (mqtt_get_status() == MQTT_STATUS_CONNECTED &&
+        mqtt_publish_data(topic, data, len, 0, 0) == MQTT_OK) {
+        return SF_PUBLISHED;
+    }
+
+    int tag = sf_topic_tag(topic);
+    if (tag < 0 || len > FQ_PAYLOAD_MAX - SF_STAMP_LEN) {
+        return SF_FAILED;
+    }
+
+    uint8_t rec[FQ_PAYLOAD_MAX];
+    uint32_t now_ms = power_uptime_ms();
+    rec[0] = (uint8_t)now_ms;
+    rec[1] = (uint8_t)(now_ms >> 8);
+    rec[2] = (uint8_t)(now_ms >> 16);
+    rec[3] = (uint8_t)(now_ms >> 24);
+    memcpy(&rec[SF_STAMP_LEN], data, len);
+
+    if (flash_queue_append((uint8_t)(tag | SF_TAG_STAMPED), rec, SF_STAMP_LEN + len) != FQ_OK) {
+        LOG_WARN("[SF] Could not queue %u bytes\n", len);
+        return SF_FAILED;
+    }
+    sf_account_drops();
+    return SF_QUEUED;
+}
+
+// "age_ms:" + the queued payload, age empty if unknown. Returns the
+// length, 0 if the record is malformed.
+static size_t sf_backlog_payload(uint8_t tag, const uint8_t *rec, size_t len,
+                                 char *out, size_t size) {
+    fmt_buf_t f;
+    fmt_init(&f, out, size);
+
+    if (tag & SF_TAG_STAMPED) {
+        if (len < SF_STAMP_LEN) {
+            return 0;
+        }
+        uint32_t queued_ms = (uint32_t)rec[0] | (uint32_t)rec[1] << 8 |
+                             (uint32_t)rec[2] << 16 | (uint32_t)rec[3] << 24;
+        if (stale_records == 0) {
+            fmt_put_u32(&f, power_uptime_ms() - queued_ms);
+        }
+        rec += SF_STAMP_LEN;
+        len -= SF_STAMP_LEN;
+    }
+    fmt_put_char(&f, ':');
+    fmt_put_mem(&f, (const char *)rec, len);
+    return fmt_finish(&f);
+}
+
+// Publish the oldest queued record on its backlog topic and mark it in
+// flight. False if there is nothing to send or it can't go out now.
+static bool sf_send_head(void) {
+    uint8_t data[FQ_PAYLOAD_MAX];
+    char payload[FQ_PAYLOAD_MAX + 12];
+
+    while (mqtt_get_status() == MQTT_STATUS_CONNECTED) {
+        uint8_t tag;
+        size_t len;
+
+        if (flash_queue_peek(&tag, data, &len) != FQ_OK) {
+            return false;
+        }
+        uint8_t index = tag & (uint8_t)~SF_TAG_STAMPED;
+        size_t n = sf_backlog_payload(tag, data, len, payload, sizeof(payload));
+        if (index >= SF_TOPIC_COUNT || n == 0) {
+            sf_consumed();   // written by a newer build; nothing to send it to
+            continue;
+        }
+
+        // In flight before the publish: the ack may come before it returns
+        flight_token++;
+        flight_sent_ms = power_uptime_ms();
+        flight_dropped = dropped_seen;
+        flight = SF_IN_FLIGHT;
+        if (mqtt_publish_data_acked(SF_TOPICS[index].backlog, payload, (uint16_t)n, 1, 0,
+                                    sf_ack, (void *)(uintptr_t)flight_token) != MQTT_OK) {
+            flight = SF_IDLE;
+            return false;   // output buffer full or link dropped: retry next cycle
+        }
+        return true;
+    }
+    return false;
+}
+
+// Service the connection until the record in flight is settled, for at
+// most SF_ACK_WAIT_MS; a slower ack is picked up by the next call
+static void sf_wait_ack(void) {
+    uint32_t start_ms = to_ms_since_boot(get_absolute_time());
+
+    while (flight == SF_IN_FLIGHT && mqtt_get_status() == MQTT_STATUS_CONNECTED &&
+           to_ms_since_boot(get_absolute_time()) - start_ms < SF_ACK_WAIT_MS) {
+        cyw43_arch_poll();
+        mqtt_poll();
+        sleep_ms(10);
+    }
+}
+
+// Act on the outcome of the record in flight. Returns true if the broker
+// acknowledged it and it was removed from flash; otherwise it is still at
+// the head of the queue, in flight or to be sent again.
+static bool sf_settle(void) {
+    bool popped = false;
+
+    switch (flight) {
+    case SF_ACKED:
+        sf_account_drops();
+        if (dropped_seen == flight_dropped) {
+            sf_consumed();
+            popped = true;
+        }
+        // else the ring dropped it meanwhile; the new head was never sent
+        break;
+    case SF_REJECTED:
+        LOG_WARN("[SF] Backlog record not acknowledged, will resend\n");
+        break;
+    case SF_IN_FLIGHT:
+        // Lost with the connection, or no answer from lwIP's own timeout
+        if (mqtt_get_status() == MQTT_STATUS_CONNECTED &&
+            power_uptime_ms() - flight_sent_ms < SF_ACK_TIMEOUT_MS) {
+            return false;
+        }
+        LOG_WARN("[SF] No ack for backlog record, will resend\n");
+        break;
+    default:
+        return false;
+    }
+
+    flight_token++;   // a late ack for this one is ignored
+    flight = SF_IDLE;
+    return popped;
+}
+
+uint32_t sf_forward(uint32_t max) {
+    uint32_t forwarded = 0;
+
+    // Failed since the last call (e.g. the connection was lost): send again
+    if (flight == SF_REJECTED) {
+        sf_settle();
+    }
+
+    while (forwarded < max) {
+        // A record still in flight from the last call is waited for, not resent
+        if (flight == SF_IDLE && !sf_send_head()) {
+            break;   // nothing queued, link down or lwIP busy
+        }
+        sf_wait_ack();
+        if (!sf_settle()) {
+            break;   // no ack yet, or refused: the record stays at the head
+        }
+        forwarded++;
+    }
+
+    if (forwarded > 0) {
+        printf("[SF] Forwarded %lu queued record(s), %lu left\n",
+               (unsigned long)forwarded, (unsigned long)flash_queue_pending());
+    }
+    return forwarded;
+}
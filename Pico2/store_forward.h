@@ -0,0 +1,44 @@
+#ifndef STORE_FORWARD_H
+#define STORE_FORWARD_H
+
+#include <stdint.h>
+#include "flash_queue.h"
+
+// Publish with a flash-backed fallback. While the broker is unreachable
+// records for the known data topics go into flash_queue instead of being
+// lost; once the link is back sf_forward() replays them oldest first, a
+// bounded number per call so a long outage doesn't flood lwIP's output
+// buffer or delay the current cycle.
+//
+// Replays go to the matching backlog topic (TOPIC_CO2_BACKLOG,
+// TOPIC_CO2_SUMMARY_BACKLOG), never the live one: Pico4 acts on whatever
+// arrived last and must not see an old reading after the current value.
+// The payload is the queued one behind "age_ms:", the time since it was
+// queued, so Pico3 can back-date its row. The age is left empty (":...")
+// for records queued before the last reboot, whose age is unknown.
+
+#define SF_FORWARD_PER_CALL  6       // records acknowledged per sf_forward()
+#define SF_ACK_WAIT_MS       500     // wait per record before leaving it to the next call
+#define SF_ACK_TIMEOUT_MS    60000   // resend after this with no answer (lwIP's own is 30 s)
+
+typedef enum {
+    SF_PUBLISHED = 0,
+    SF_QUEUED,
+    SF_FAILED        // not publishable and not queueable (unknown topic, too long, flash error)
+} sf_result_t;
+
+// Recover the queue from flash; call once at boot
+void store_forward_init(void);
+
+// Straight out while connected, even with a backlog queued: the backlog
+// has its own topics, so a live value is never held behind it
+sf_result_t sf_publish(const char *topic, const void *data, uint16_t len);
+
+// Replay up to max queued records while connected, one at a time as
+// QoS1. A record is removed from flash only once the broker has
+// acknowledged it; on a failure or timeout it stays at the head and is
+// sent again, so a subscriber may see it twice. Returns the number
+// acknowledged.
+uint32_t sf_forward(uint32_t max);
+
+#endif
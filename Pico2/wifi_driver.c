@@ -1,12 +1,193 @@
 #include "wifi_driver.h"
 #include "secrets.h"
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
 #include "pico/stdlib.h"
 #include "lwip/netif.h"
 #include "lwip/ip4_addr.h"
+#include "lwip/dhcp.h"
+
+/* ==========================================================
+   Fast rejoin cache
+   BSSID/channel of the last AP and the DHCP lease we got from it.
+   Kept in uninitialised RAM so it also survives a soft reset; the
+   address is only reused for a lease obtained during this boot.
+   ========================================================== */
+#define WIFI_CACHE_MAGIC 0x57434143u   // "WCAC"
+
+typedef struct {
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint16_t reserved;
+    uint32_t channel;
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    uint32_t lease_s;          // DHCP lease length
+    uint32_t obtained_ms;      // wifi clock when the lease was obtained
+    uint32_t check;
+} wifi_rejoin_cache_t;
+
+static wifi_rejoin_cache_t __uninitialized_ram(rejoin_cache);
+static bool lease_from_this_boot = false;
+static bool dhcp_skipped = false;   // cached address applied, no DHCP client running
+
+static wifi_connect_timing_t timing;
+static uint32_t (*wifi_clock_ms)(void) = NULL;
+
+static uint32_t wifi_now_ms(void) {
+    return wifi_clock_ms ? wifi_clock_ms() : to_ms_since_boot(get_absolute_time());
+}
+
+static uint32_t wifi_cache_checksum(const wifi_rejoin_cache_t *c) {
+    const uint8_t *p = (const uint8_t *)c;
+    uint32_t sum = 0x811C9DC5u;   // FNV-1a over everything before 'check'
+    for (size_t i = 0; i < offsetof(wifi_rejoin_cache_t, check); i++) {
+        sum = (sum ^ p[i]) * 0x01000193u;
+    }
+    return sum;
+}
+
+static bool wifi_cache_valid(void) {
+    return rejoin_cache.magic == WIFI_CACHE_MAGIC &&
+           rejoin_cache.check == wifi_cache_checksum(&rejoin_cache);
+}
+
+static void wifi_cache_invalidate(void) {
+    rejoin_cache.magic = 0;
+    lease_from_this_boot = false;
+}
+
+// Reuse the address only until T1 (half the lease), when DHCP would renew.
+// A link that stays up past T1 hands over to DHCP in wifi_maintain_lease().
+static bool wifi_lease_reusable(void) {
+    if (!lease_from_this_boot || rejoin_cache.lease_s == 0 ||
+        ip4_addr_isany_val(rejoin_cache.ip)) {
+        return false;
+    }
+    uint32_t age_ms = wifi_now_ms() - rejoin_cache.obtained_ms;
+    return age_ms < (rejoin_cache.lease_s / 2) * 1000u;
+}
+
+// Remember the AP and, if DHCP just ran, the lease
+static void wifi_cache_link(bool from_dhcp) {
+    wifi_rejoin_cache_t c = rejoin_cache;
+    uint8_t chan_info[12] = {0};
+
+    cyw43_arch_lwip_begin();
+    int err = cyw43_wifi_get_bssid(&cyw43_state, c.bssid);
+    if (err == 0) {
+        err = cyw43_ioctl(&cyw43_state, CYW43_IOCTL_GET_CHANNEL,
+                          sizeof(chan_info), chan_info, CYW43_ITF_STA);
+    }
+    if (from_dhcp) {
+        struct netif *n = netif_default;
+        struct dhcp *d = n ? netif_dhcp_data(n) : NULL;
+        if (n && d) {
+            c.ip = *netif_ip4_addr(n);
+            c.netmask = *netif_ip4_netmask(n);
+            c.gw = *netif_ip4_gw(n);
+            c.lease_s = d->offered_t0_lease;
+            c.obtained_ms = wifi_now_ms();
+            lease_from_this_boot = true;
+        }
+    }
+    cyw43_arch_lwip_end();
+
+    if (err != 0) {
+        return;
+    }
+
+    // First word of channel_info_t is the hardware channel
+    c.channel = (uint32_t)chan_info[0] | ((uint32_t)chan_info[1] << 8);
+    if (c.channel == 0) {
+        c.channel = CYW43_CHANNEL_NONE;   // let the join scan all channels
+    }
+    c.magic = WIFI_CACHE_MAGIC;
+    c.reserved = 0;
+    c.check = wifi_cache_checksum(&c);
+    rejoin_cache = c;
+}
+
+// Directed join to the cached BSSID/channel, no scan
+static int wifi_fast_rejoin(const char *ssid, const char *pass) {
+    cyw43_arch_lwip_begin();
+    int err = cyw43_wifi_join(&cyw43_state,
+                              strlen(ssid), (const uint8_t *)ssid,
+                              strlen(pass), (const uint8_t *)pass,
+                              CYW43_AUTH_WPA2_AES_PSK,
+                              rejoin_cache.bssid, rejoin_cache.channel);
+    cyw43_arch_lwip_end();
+    if (err != 0) {
+        return WIFI_ERROR;
+    }
+
+    absolute_time_t deadline = make_timeout_time_ms(WIFI_FAST_JOIN_TIMEOUT_MS);
+    int status;
+    while ((status = cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA)) != CYW43_LINK_JOIN) {
+        if (status < 0 || time_reached(deadline)) {
+            cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+            return WIFI_ERROR;
+        }
+        cyw43_arch_poll();
+        sleep_ms(5);
+    }
+    timing.join_us = time_us_64() - timing.start_us;
+
+    if (wifi_lease_reusable()) {
+        // Skip DISCOVER/OFFER/REQUEST/ACK and put the old address back
+        cyw43_arch_lwip_begin();
+        dhcp_stop(netif_default);
+        netif_set_addr(netif_default, &rejoin_cache.ip,
+                       &rejoin_cache.netmask, &rejoin_cache.gw);
+        cyw43_arch_lwip_end();
+        timing.ip_reused = true;
+        dhcp_skipped = true;
+    } else {
+        if (wifi_wait_for_ip(WIFI_FAST_JOIN_TIMEOUT_MS) != WIFI_OK) {
+            cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+            return WIFI_ERROR;
+        }
+        wifi_cache_link(true);
+    }
+    timing.ip_us = time_us_64() - timing.start_us;
+    return WIFI_OK;
+}
+
+void wifi_set_clock(uint32_t (*now_ms)(void)) {
+    wifi_clock_ms = now_ms;
+}
+
+void wifi_forget_lease(void) {
+    lease_from_this_boot = false;
+}
+
+void wifi_maintain_lease(void) {
+    if (!dhcp_skipped || wifi_lease_reusable()) {
+        return;
+    }
+    // Past T1 on a reused address: start the DHCP client, which keeps the
+    // address while it negotiates and renews from here on like any lease
+    cyw43_arch_lwip_begin();
+    err_t err = netif_default ? dhcp_start(netif_default) : ERR_IF;
+    cyw43_arch_lwip_end();
+    if (err != ERR_OK) {
+        printf("[WIFI] DHCP restart failed (%d), retrying next wake\n", err);
+        return;
+    }
+    dhcp_skipped = false;
+    lease_from_this_boot = false;   // cache holds the old lease's times
+    printf("[WIFI] Reused lease at T1, DHCP restarted\n");
+}
+
+const wifi_connect_timing_t *wifi_get_connect_timing(void) {
+    return &timing;
+}
 
 bool wifi_is_connected(void) {
-    return cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP;
+    // Link status from the lwIP side: joined *and* holding an address
+    return cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP;
 }
 
 int wifi_init(void) {
@@ -20,12 +201,33 @@ int wifi_init(void) {
 }
 
 int wifi_connect(const char *ssid, const char *pass, uint32_t timeout_ms) {
+    timing.start_us = time_us_64();
+    timing.join_us = timing.ip_us = 0;
+    timing.fast_path = false;
+    timing.ip_reused = false;
+    dhcp_skipped = false;
+
+    if (wifi_cache_valid()) {
+        if (wifi_fast_rejoin(ssid, pass) == WIFI_OK) {
+            timing.fast_path = true;
+            printf("Rejoined Wi-Fi on cached BSSID (channel %lu%s)\n",
+                   (unsigned long)rejoin_cache.channel,
+                   timing.ip_reused ? ", address reused" : "");
+            return WIFI_OK;
+        }
+        printf("Fast rejoin failed, falling back to full connect\n");
+        wifi_cache_invalidate();
+    }
+
     const int MAX_RETRIES = 5;
     for (int i = 1; i <= MAX_RETRIES; i++) {
         int ret = cyw43_arch_wifi_connect_timeout_ms(
             ssid, pass, CYW43_AUTH_WPA2_AES_PSK, timeout_ms
         );
         if (ret == 0) {
+            // connect_timeout_ms only returns once DHCP is done
+            timing.join_us = timing.ip_us = time_us_64() - timing.start_us;
+            wifi_cache_link(true);
             printf("Connected to Wi-Fi on attempt %d\n", i);
             return WIFI_OK;
         }
@@ -36,6 +238,38 @@ int wifi_connect(const char *ssid, const char *pass, uint32_t timeout_ms) {
     return WIFI_ERROR;
 }
 
+int wifi_wait_for_ip(uint32_t timeout_ms) {
+    absolute_time_t deadline = make_timeout_time_ms(timeout_ms);
+
+    while (!netif_default || ip4_addr_isany_val(*netif_ip4_addr(netif_default))) {
+        if (time_reached(deadline)) {
+            printf("No IP address after %lu ms\n", (unsigned long)timeout_ms);
+            return WIFI_ERROR;
+        }
+        cyw43_arch_poll();
+        sleep_ms(10);
+    }
+    return WIFI_OK;
+}
+
+int wifi_enter_power_save(void) {
+    // PM2 with a long return-to-sleep delay: the radio only wakes for
+    // beacons and our own traffic, the AP keeps the association
+    if (cyw43_wifi_pm(&cyw43_state, CYW43_AGGRESSIVE_PM) != 0) {
+        printf("Wi-Fi power-save enable failed\n");
+        return WIFI_ERROR;
+    }
+    printf("Wi-Fi power-save on (link kept)\n");
+    return WIFI_OK;
+}
+
+int wifi_exit_power_save(void) {
+    if (cyw43_wifi_pm(&cyw43_state, CYW43_PERFORMANCE_PM) != 0) {
+        printf("Wi-Fi power-save disable failed\n");
+        return WIFI_ERROR;
+    }
+    return WIFI_OK;
+}
 
 void wifi_deinit(void) {
     cyw43_arch_deinit();
@@ -44,16 +278,27 @@ void wifi_deinit(void) {
 
 void setup_wifi(void) {
     printf("\n1. Connecting to WiFi...\n");
+    uint64_t init_start_us = time_us_64();
     if (wifi_init() != WIFI_OK) {
         printf("WiFi init failed\n");
         return;
     }
+    uint32_t init_us = (uint32_t)(time_us_64() - init_start_us);
+
     if (wifi_connect(WIFI_SSID, WIFI_PASSWORD, 10000) != WIFI_OK) {
         printf("WiFi connect failed\n");
         return;
     }
 
-    // Wait for IP assignment
-    sleep_ms(2000);
+    // Wait for IP assignment (usually already done once the link is up)
+    if (wifi_wait_for_ip(5000) != WIFI_OK) {
+        return;
+    }
     printf("Pico W IP Address: %s\n", ip4addr_ntoa(netif_ip4_addr(netif_default)));
+    printf("[WIFI] %s: init=%lu join=%lu ip=%lu total=%lu ms\n",
+           timing.fast_path ? (timing.ip_reused ? "fast+reuse" : "fast") : "full",
+           (unsigned long)(init_us / 1000),
+           (unsigned long)(timing.join_us / 1000),
+           (unsigned long)((timing.ip_us - timing.join_us) / 1000),
+           (unsigned long)((init_us + timing.ip_us) / 1000));
 }
@@ -7,14 +7,48 @@
 #define WIFI_OK     0
 #define WIFI_ERROR -1
 
+#define WIFI_FAST_JOIN_TIMEOUT_MS 3000   // directed join before falling back to scan
+
+// Where the time of the last wifi_connect() went (us from its start)
+typedef struct {
+    uint64_t start_us;
+    uint64_t join_us;      // associated + keys installed
+    uint64_t ip_us;        // address configured
+    bool fast_path;        // directed join to the cached BSSID/channel
+    bool ip_reused;        // cached lease reapplied, DHCP skipped
+} wifi_connect_timing_t;
+
 bool wifi_is_connected(void);
 
 // Initialise WiFi 
 int wifi_init(void);
 
-// Connect to SSID with password, timeout in ms
+// Connect to SSID with password, timeout in ms.
+// Tries a directed join to the cached AP (and reuses the cached address
+// while the lease is fresh) before the full scan + DHCP path.
 int wifi_connect(const char *ssid, const char *pass, uint32_t timeout_ms);
 
+// Clock used for lease ageing (defaults to ms since boot)
+void wifi_set_clock(uint32_t (*now_ms)(void));
+
+// Stop reusing the cached address, e.g. after the broker was unreachable
+void wifi_forget_lease(void);
+
+// Call while the link stays up (radio kept associated). Once a reused
+// address reaches T1 of its lease, starts DHCP so it gets renewed.
+void wifi_maintain_lease(void);
+
+const wifi_connect_timing_t *wifi_get_connect_timing(void);
+
+// Wait until DHCP has assigned an address, timeout in ms
+int wifi_wait_for_ip(uint32_t timeout_ms);
+
+// Stay associated but let the CYW43 sleep between DTIM beacons
+int wifi_enter_power_save(void);
+
+// Back to full-performance power management before talking to the broker
+int wifi_exit_power_save(void);
+
 // Disconnect WiFi
 void wifi_deinit(void);
 
@@ -0,0 +1,97 @@
+#include "window_stats.h"
+
+void window_stats_reset(window_stats_t *w) {
+    *w = (window_stats_t){ 0 };
+}
+
+void window_stats_add(window_stats_t *w, uint32_t now_ms, uint32_t value) {
+    if (w->count == 0) {
+        w->start_ms = now_ms;
+        w->min = value;
+        w->max = value;
+    }
+
+    uint64_t t = (now_ms - w->start_ms) / 1000u;
+
+    w->count++;
+    w->last_ms = now_ms;
+    if (value < w->min) w->min = value;
+    if (value > w->max) w->max = value;
+    w->sum    += value;
+    w->sum_sq += (uint64_t)value * value;
+    w->sum_t  += t;
+    w->sum_tt += t * t;
+    w->sum_tv += t * value;
+}
+
+uint32_t window_stats_age_ms(const window_stats_t *w, uint32_t now_ms) {
+    return w->count ? now_ms - w->start_ms : 0;
+}
+
+static uint32_t isqrt64(uint64_t v) {
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+static q16_t q16_clamp(int64_t v) {
+    if (v > INT32_MAX) return INT32_MAX;
+    if (v < INT32_MIN) return INT32_MIN;
+    return (q16_t)v;
+}
+
+bool window_stats_summary(const window_stats_t *w, window_summary_t *out) {
+    if (w->count == 0) {
+        return false;
+    }
+
+    uint64_t n = w->count;
+
+    out->count   = w->count;
+    out->span_ms = w->last_ms - w->start_ms;
+    out->min     = filter_from_uint(w->min);
+    out->max     = filter_from_uint(w->max);
+    out->mean    = q16_clamp((int64_t)(((w->sum << 16) + n / 2) / n));
+
+    // var = (n*Σv² - (Σv)²) / n², kept as quotient + remainder so the
+    // Q16 shift can't overflow. n*Σv² ≤ (n*32767)² fits below ~130k
+    // samples; var itself is at most 16384², so var << 32 always fits.
+    uint64_t nn = n * n;
+    uint64_t spread = n * w->sum_sq - w->sum * w->sum;
+    uint64_t var_q16 = ((spread / nn) << 16) + (((spread % nn) << 16) / nn);
+    uint64_t sd_q16 = isqrt64(var_q16 << 16);
+    out->stddev = q16_clamp((int64_t)sd_q16);
+
+    // slope = (n*Σtv - Σt*Σv) / (n*Σtt - (Σt)²) per second. num and den are
+    // n² times the covariance and the variance of t; they, and the Σ terms
+    // behind them, fit in 63 bits for a day of 32767-unit samples every 5 s.
+    // den is brought under 2^47 (num with it, the ratio barely moves) so
+    // the remainder survives the Q16 shift; per-minute scaling comes last.
+    int64_t num = (int64_t)(n * w->sum_tv) - (int64_t)(w->sum_t * w->sum);
+    int64_t den = (int64_t)(n * w->sum_tt) - (int64_t)(w->sum_t * w->sum_t);
+    if (den > 0) {
+        while (den > (INT64_MAX >> 16)) {
+            num /= 2;
+            den /= 2;
+        }
+        int64_t slope_q16 = num / den * 65536 + num % den * 65536 / den;
+        out->slope_per_min = q16_clamp(slope_q16 * 60);
+    } else {
+        out->slope_per_min = 0;
+    }
+
+    return true;
+}
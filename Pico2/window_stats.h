@@ -0,0 +1,48 @@
+#ifndef WINDOW_STATS_H
+#define WINDOW_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "filter_pipeline.h"
+
+// Streaming summary of one reporting window: count, min, max, mean,
+// standard deviation and least-squares trend, all in integer/Q16.16
+// arithmetic (no FPU on the RP2040). Every sample taken in the window is
+// included, so short spikes between publishes still show up in max and
+// stddev. Pure logic, no SDK dependencies.
+
+typedef struct {
+    uint32_t count;
+    uint32_t start_ms;        // first sample
+    uint32_t last_ms;         // latest sample
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint64_t sum_sq;
+    // Trend fit, t in whole seconds since start_ms
+    uint64_t sum_t;
+    uint64_t sum_tt;
+    uint64_t sum_tv;
+} window_stats_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t span_ms;         // first to last sample
+    q16_t    min;
+    q16_t    max;
+    q16_t    mean;
+    q16_t    stddev;          // population standard deviation
+    q16_t    slope_per_min;   // units per minute, 0 with fewer than two distinct times
+} window_summary_t;
+
+void window_stats_reset(window_stats_t *w);
+
+void window_stats_add(window_stats_t *w, uint32_t now_ms, uint32_t value);
+
+// Time since the first sample of the window, 0 when empty
+uint32_t window_stats_age_ms(const window_stats_t *w, uint32_t now_ms);
+
+// Summarise the window. Returns false if it holds no samples.
+bool window_stats_summary(const window_stats_t *w, window_summary_t *out);
+
+#endif
@@ -0,0 +1,146 @@
+#include "fmt_utils.h"
+#include <string.h>
+
+void fmt_init(fmt_buf_t *f, char *buf, size_t size) {
+    f->buf = buf;
+    f->size = size;
+    f->len = 0;
+    f->overflow = (buf == NULL || size == 0);
+    if (!f->overflow) {
+        buf[0] = '\0';
+    }
+}
+
+void fmt_put_mem(fmt_buf_t *f, const char *s, size_t n) {
+    if (f->overflow) {
+        return;
+    }
+    if (n >= f->size - f->len) {
+        f->overflow = true;
+        return;
+    }
+    memcpy(f->buf + f->len, s, n);
+    f->len += n;
+    f->buf[f->len] = '\0';
+}
+
+void fmt_put_char(fmt_buf_t *f, char c) {
+    fmt_put_mem(f, &c, 1);
+}
+
+void fmt_put_str(fmt_buf_t *f, const char *s) {
+    fmt_put_mem(f, s, strlen(s));
+}
+
+size_t fmt_u32_digits(char out[10], uint32_t v) {
+    char tmp[10];
+    size_t n = 0;
+
+    // RP2040 routes / and % through the SIO hardware divider
+    do {
+        tmp[n++] = (char)('0' + (v % 10u));
+        v /= 10u;
+    } while (v != 0);
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+void fmt_put_u32(fmt_buf_t *f, uint32_t v) {
+    char digits[10];
+    fmt_put_mem(f, digits, fmt_u32_digits(digits, v));
+}
+
+void fmt_put_u64(fmt_buf_t *f, uint64_t v) {
+    if (v <= UINT32_MAX) {
+        fmt_put_u32(f, (uint32_t)v);
+        return;
+    }
+
+    // One 64-bit divide splits off the low 9 digits, the rest is 32-bit
+    // code. The upper part only needs a second divide above ~4.3e18, far
+    // beyond any ms timestamp.
+    uint64_t hi = v / 1000000000u;
+    uint32_t lo = (uint32_t)(v - hi * 1000000000u);
+
+    size_t mark = f->len;
+    fmt_put_u64(f, hi);
+
+    char digits[10];
+    size_t d = fmt_u32_digits(digits, lo);
+    for (size_t pad = d; pad < 9; pad++) {
+        fmt_put_char(f, '0');
+    }
+    fmt_put_mem(f, digits, d);
+
+    if (f->overflow) {
+        fmt_rewind(f, mark);
+        f->overflow = true;
+    }
+}
+
+void fmt_put_i32(fmt_buf_t *f, int32_t v) {
+    if (v < 0) {
+        size_t mark = f->len;
+        fmt_put_char(f, '-');
+        fmt_put_u32(f, (uint32_t)0 - (uint32_t)v);
+        if (f->overflow) {
+            fmt_rewind(f, mark);
+            f->overflow = true;
+        }
+        return;
+    }
+    fmt_put_u32(f, (uint32_t)v);
+}
+
+void fmt_put_q16(fmt_buf_t *f, int32_t v, uint8_t decimals) {
+    static const uint32_t POW10[] = { 1, 10, 100, 1000, 10000 };
+    if (decimals > 4) {
+        decimals = 4;
+    }
+
+    size_t mark = f->len;
+    uint32_t mag = (v < 0) ? (uint32_t)0 - (uint32_t)v : (uint32_t)v;
+    uint32_t whole = mag >> 16;
+    uint32_t frac = (uint32_t)((((uint64_t)(mag & 0xFFFFu) * POW10[decimals]) + 0x8000u) >> 16);
+
+    if (frac >= POW10[decimals]) {   // rounding carried into the integer part
+        frac -= POW10[decimals];
+        whole++;
+    }
+
+    if (v < 0 && (whole != 0 || frac != 0)) {
+        fmt_put_char(f, '-');
+    }
+    fmt_put_u32(f, whole);
+
+    if (decimals > 0) {
+        char digits[10];
+        size_t n = fmt_u32_digits(digits, frac);
+        fmt_put_char(f, '.');
+        for (size_t pad = n; pad < decimals; pad++) {
+            fmt_put_char(f, '0');
+        }
+        fmt_put_mem(f, digits, n);
+    }
+
+    if (f->overflow) {
+        fmt_rewind(f, mark);
+        f->overflow = true;
+    }
+}
+
+void fmt_rewind(fmt_buf_t *f, size_t mark) {
+    if (f->buf == NULL || f->size == 0 || mark > f->len) {
+        return;
+    }
+    f->len = mark;
+    f->buf[mark] = '\0';
+    f->overflow = false;
+}
+
+size_t fmt_finish(const fmt_buf_t *f) {
+    return f->overflow ? 0 : f->len;
+}
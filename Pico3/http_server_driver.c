@@ -1,33 +1,55 @@
 #include "http_server_driver.h"
 #include "lwip/tcp.h"
-#include "ff.h"
 #include <stdio.h>
 #include <string.h>
+#include "log_buffer.h"
 #include "pico/time.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#include "storage_driver.h"
+
+// Requests waiting for the SD card; more than this get a 503
+#define HTTP_PENDING_MAX 4
 
 extern char latest_prediction[32];
-static SD_Manager *g_sd = NULL;
 static char buffer[8192];   // shared buffer for HTML or CSV
 
 /* ==========================================================
-   Helper: read CSV data from SD card (keep last 20 lines)
+   Pages read from the SD card
+   Core1 owns the card, so these requests are queued and answered
+   from http_server_poll() once the read has completed. Only the
+   oldest has a read in flight, since they share buffer. The queue
+   is touched from lwIP callbacks and under the lwIP lock only.
    ========================================================== */
-static const char *read_csv(char *buf, size_t maxlen) {
-    if (!g_sd || !g_sd->mounted)
-        return "SD card not mounted\n";
+typedef enum {
+    PAGE_CSV,
+    PAGE_HTML
+} page_t;
 
-    FIL f; UINT br;
-    if (f_open(&f, "sensor_log.csv", FA_READ) != FR_OK)
-        return "File not found\n";
+typedef struct {
+    struct tcp_pcb *pcb;        // NULL once the client has gone away
+    page_t          page;
+    uint64_t        received_us;
+} http_pending_t;
 
-    FSIZE_t sz = f_size(&f);
-    size_t start = (sz > maxlen) ? sz - maxlen : 0;
-    f_lseek(&f, start);
+static http_pending_t pending[HTTP_PENDING_MAX];
+static uint32_t pending_head = 0;
+static uint32_t pending_count = 0;
+static storage_req_t read_req;
+static bool read_active = false;
 
-    f_read(&f, buf, maxlen - 1, &br);
-    f_close(&f);
-    buf[br] = '\0';
+static struct {
+    uint32_t requests;
+    uint32_t card_reads;       // responses that needed the SD card
+    uint32_t busy;             // turned away with 503
+    uint32_t latency_max_us;   // request received -> response queued
+    uint64_t latency_total_us;
+} stats;
 
+/* ==========================================================
+   Helper: keep the last 20 lines of a CSV tail
+   ========================================================== */
+static const char *trim_csv(char *buf) {
     // skip partial first line if we started mid-file
     char *p = strchr(buf, '\n');
     if (p) memmove(buf, p + 1, strlen(p + 1) + 1);
@@ -45,77 +67,32 @@ static const char *read_csv(char *buf, size_t maxlen) {
     return buf;
 }
 
-/* ==========================================================
-   Helper: read HTML page from SD card
-   ========================================================== */
-static const char *read_html(char *buf, size_t maxlen) {
-    if (!g_sd || !g_sd->mounted)
-        return "SD card not mounted\n";
-
-    FIL f; UINT br;
-    FRESULT res = f_open(&f, "index.html", FA_READ);
-    if (res != FR_OK) {
-        printf("[HTML] open failed: %d\n", res);
-        return "File not found\n";
-    }
-
-    f_read(&f, buf, maxlen - 1, &br);
-    f_close(&f);
-    buf[br] = '\0';
-    printf("[HTML] read %u bytes from index.html\n", br);
-    return buf;
-}
-
 /* ==========================================================
    TCP send-complete callback
    ========================================================== */
 static err_t on_sent(void *arg, struct tcp_pcb *tpcb, u16_t len) {
     LWIP_UNUSED_ARG(arg);
-    printf("[on_sent] %u bytes acknowledged\n", len);
+    LOG_DEBUG("[on_sent] %u bytes acknowledged\n", len);
     if (tcp_sndbuf(tpcb) == TCP_SND_BUF) {
-        printf("[on_sent] all data sent, closing now\n");
+        LOG_DEBUG("[on_sent] all data sent, closing now\n");
         tcp_close(tpcb);
     }
     return ERR_OK;
 }
 
 /* ==========================================================
-   TCP receive callback
+   Send a complete response, closed once acknowledged
    ========================================================== */
-static err_t recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
-    LWIP_UNUSED_ARG(arg);
-    if (!p) {
-        tcp_close(tpcb);
-        return ERR_OK;
-    }
-
-    char *req = (char *)p->payload;
+static void send_response(struct tcp_pcb *tpcb, const char *status,
+                          const char *content_type, const char *body) {
     char header[160];
-    const char *body;
-    char content_type[32];
-
-    // --- NEW: Warning level endpoint ---
-    if (strncmp(req, "GET /warning", 12) == 0) {
-        body = latest_prediction;
-        strcpy(content_type, "text/plain");
-    }
-    // --- Existing CSV endpoint ---
-    else if (strncmp(req, "GET /data", 9) == 0) {
-        body = read_csv(buffer, sizeof(buffer));
-        strcpy(content_type, "text/plain");
-    }
-    // --- Default: serve index.html ---
-    else {
-        body = read_html(buffer, sizeof(buffer));
-        strcpy(content_type, "text/html");
-    }
 
     snprintf(header, sizeof(header),
-             "HTTP/1.1 200 OK\r\n"
+             "HTTP/1.1 %s\r\n"
              "Content-Type: %s\r\n"
              "Content-Length: %u\r\n"
              "Connection: close\r\n\r\n",
-             content_type, (unsigned)strlen(body));
+             status, content_type, (unsigned)strlen(body));
 
     tcp_write(tpcb, header, strlen(header), TCP_WRITE_FLAG_COPY);
     tcp_output(tpcb);
@@ -130,11 +107,130 @@ static err_t recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
     }
     tcp_output(tpcb);
 
-    printf("[recv_cb] queued %zu bytes at %u ms\n",
-           total, (unsigned)to_ms_since_boot(get_absolute_time()));
+    LOG_DEBUG("[send_response] queued %u bytes at %u ms\n",
+              (unsigned)total, (unsigned)to_ms_since_boot(get_absolute_time()));
 
-    pbuf_free(p);
     tcp_sent(tpcb, on_sent);
+}
+
+/* ==========================================================
+   SD read queue
+   ========================================================== */
+static void on_error(void *arg, err_t err) {
+    LWIP_UNUSED_ARG(err);
+    // lwIP has already freed the pcb
+    ((http_pending_t *)arg)->pcb = NULL;
+}
+
+static void start_next_read(void) {
+    while (!read_active && pending_count > 0) {
+        http_pending_t *entry = &pending[pending_head];
+        if (!entry->pcb) {
+            pending_head = (pending_head + 1) % HTTP_PENDING_MAX;
+            pending_count--;
+            continue;
+        }
+
+        read_req.op = (entry->page == PAGE_CSV) ? STORAGE_READ_LOG_TAIL : STORAGE_READ_FILE;
+        read_req.path = "index.html";
+        read_req.buf = buffer;
+        read_req.maxlen = sizeof(buffer);
+        read_active = storage_submit(&read_req);
+        if (!read_active) {
+            break;   // retried from http_server_poll()
+        }
+    }
+}
+
+static bool queue_page(struct tcp_pcb *tpcb, page_t page) {
+    if (pending_count == HTTP_PENDING_MAX) {
+        return false;
+    }
+
+    http_pending_t *entry = &pending[(pending_head + pending_count) % HTTP_PENDING_MAX];
+    entry->pcb = tpcb;
+    entry->page = page;
+    entry->received_us = time_us_64();
+    pending_count++;
+
+    tcp_arg(tpcb, entry);
+    tcp_err(tpcb, on_error);
+    start_next_read();
+    return true;
+}
+
+static void finish_read(void) {
+    http_pending_t *entry = &pending[pending_head];
+    pending_head = (pending_head + 1) % HTTP_PENDING_MAX;
+    pending_count--;
+    read_active = false;
+
+    if (!entry->pcb) {
+        return;   // client closed while we were reading
+    }
+
+    const char *content_type = (entry->page == PAGE_CSV) ? "text/plain" : "text/html";
+    const char *body;
+    if (read_req.result < 0) {
+        body = "File not found\n";
+    } else if (entry->page == PAGE_CSV) {
+        body = trim_csv(buffer);
+    } else {
+        LOG_DEBUG("[HTML] read %u bytes from index.html\n", (unsigned)read_req.result);
+        body = buffer;
+    }
+
+    tcp_arg(entry->pcb, NULL);
+    tcp_err(entry->pcb, NULL);
+    send_response(entry->pcb, "200 OK", content_type, body);
+
+    uint32_t latency_us = (uint32_t)(time_us_64() - entry->received_us);
+    stats.card_reads++;
+    stats.latency_total_us += latency_us;
+    if (latency_us > stats.latency_max_us) {
+        stats.latency_max_us = latency_us;
+    }
+}
+
+/* ==========================================================
+   TCP receive callback
+   ========================================================== */
+static err_t recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
+    if (!p) {
+        if (arg) {
+            ((http_pending_t *)arg)->pcb = NULL;
+            tcp_arg(tpcb, NULL);
+            tcp_err(tpcb, NULL);
+        }
+        tcp_close(tpcb);
+        return ERR_OK;
+    }
+    if (arg) {
+        // Already waiting for the card; one request per connection
+        pbuf_free(p);
+        return ERR_OK;
+    }
+
+    char *req = (char *)p->payload;
+    stats.requests++;
+
+    // --- NEW: Warning level endpoint ---
+    if (strncmp(req, "GET /warning", 12) == 0) {
+        send_response(tpcb, "200 OK", "text/plain", latest_prediction);
+    }
+    else if (!storage_is_mounted()) {
+        send_response(tpcb, "200 OK", "text/plain", "SD card not mounted\n");
+    }
+    // --- CSV endpoint, or default: serve index.html ---
+    else {
+        page_t page = (strncmp(req, "GET /data", 9) == 0) ? PAGE_CSV : PAGE_HTML;
+        if (!queue_page(tpcb, page)) {
+            stats.busy++;
+            send_response(tpcb, "503 Service Unavailable", "text/plain", "Busy, retry\n");
+        }
+    }
+
+    pbuf_free(p);
     return ERR_OK;
 }
 
@@ -151,9 +247,7 @@ static err_t accept_cb(void *arg, struct tcp_pcb *newpcb, err_t err) {
 /* ==========================================================
    Public API
    ========================================================== */
-void http_server_driver_start(SD_Manager *sd_ref) {
-    g_sd = sd_ref;
-
+void http_server_driver_start(void) {
     struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
     if (!pcb) {
         printf("Failed to create TCP PCB\n");
@@ -171,6 +265,40 @@ void http_server_driver_start(SD_Manager *sd_ref) {
     printf("HTTP server running. Access http://<pico_ip>/\n");
 }
 
+void http_server_poll(void) {
+    // Unlocked peek; both are checked again under the lock
+    if (read_active ? !read_req.done : pending_count == 0) {
+        return;
+    }
+
+    cyw43_arch_lwip_begin();
+    if (read_active && read_req.done) {
+        __mem_fence_acquire();   // done read before the buffer
+        finish_read();
+    }
+    start_next_read();
+    cyw43_arch_lwip_end();
+}
+
+void http_server_report(void) {
+    uint32_t avg_us = stats.card_reads ? (uint32_t)(stats.latency_total_us / stats.card_reads) : 0;
+    printf("[HTTP] requests=%lu card reads=%lu busy=%lu latency avg=%lu us max=%lu us\n",
+           (unsigned long)stats.requests, (unsigned long)stats.card_reads,
+           (unsigned long)stats.busy, (unsigned long)avg_us,
+           (unsigned long)stats.latency_max_us);
+}
+
 void http_server_driver_stop(void) {
-    g_sd = NULL;
+    // Close connections still waiting for the card
+    cyw43_arch_lwip_begin();
+    for (uint32_t i = 0; i < pending_count; i++) {
+        http_pending_t *entry = &pending[(pending_head + i) % HTTP_PENDING_MAX];
+        if (entry->pcb) {
+            tcp_arg(entry->pcb, NULL);
+            tcp_err(entry->pcb, NULL);
+            tcp_close(entry->pcb);
+            entry->pcb = NULL;
+        }
+    }
+    cyw43_arch_lwip_end();
 }
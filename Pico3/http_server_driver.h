@@ -1,10 +1,14 @@
 #ifndef HTTP_SERVER_DRIVER_H
 #define HTTP_SERVER_DRIVER_H
 
-#include "sd_driver.h"
+// Start HTTP server after WiFi + MQTT + storage initialization
+void http_server_driver_start(void);
 
-// Start HTTP server after WiFi + MQTT + SD initialization
-void http_server_driver_start(SD_Manager *sd_ref);
+// Call from the main loop: sends responses whose SD read has completed
+void http_server_poll(void);
+
+// Print request counts and SD-backed response latency
+void http_server_report(void);
 
 // Optional stop function (not used for Pico)
 void http_server_driver_stop(void);
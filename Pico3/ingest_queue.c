@@ -0,0 +1,124 @@
+#include "ingest_queue.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+_Static_assert((INGEST_QUEUE_LEN & (INGEST_QUEUE_LEN - 1)) == 0,
+               "INGEST_QUEUE_LEN must be a power of two");
+
+typedef struct {
+    uint16_t len;
+    char     row[INGEST_ROW_MAX];
+} ingest_entry_t;
+
+// The producer only writes q_tail, the consumer only writes q_head
+static ingest_entry_t queue[INGEST_QUEUE_LEN];
+static volatile uint32_t q_head = 0;
+static volatile uint32_t q_tail = 0;
+
+static ingest_stats_t stats;
+static uint32_t last_report_ms = 0;
+static uint32_t last_report_written = 0;
+
+void ingest_init(void) {
+    q_head = 0;
+    q_tail = 0;
+    memset(&stats, 0, sizeof(stats));
+    last_report_ms = to_ms_since_boot(get_absolute_time());
+    last_report_written = 0;
+}
+
+bool ingest_push(const char *row, size_t len) {
+    if (len == 0 || len > INGEST_ROW_MAX) {
+        stats.oversize++;
+        return false;
+    }
+
+    uint32_t tail = q_tail;
+    uint32_t depth = tail - q_head;
+    if (depth == INGEST_QUEUE_LEN) {
+        stats.dropped++;
+        return false;
+    }
+
+    ingest_entry_t *e = &queue[tail & (INGEST_QUEUE_LEN - 1)];
+    memcpy(e->row, row, len);
+    e->len = (uint16_t)len;
+    __mem_fence_release();   // row visible before the new tail
+    q_tail = tail + 1;
+
+    stats.enqueued++;
+    if (depth + 1 > stats.high_water) {
+        stats.high_water = depth + 1;
+    }
+    if (depth + 1 == INGEST_BATCH_WAKE) {
+        __sev();             // a full batch is waiting; wake the writer
+    }
+    return true;
+}
+
+const char *ingest_peek(size_t *len) {
+    uint32_t head = q_head;
+    if (head == q_tail) {
+        return NULL;
+    }
+    __mem_fence_acquire();   // tail read before the row
+    const ingest_entry_t *e = &queue[head & (INGEST_QUEUE_LEN - 1)];
+    *len = e->len;
+    return e->row;
+}
+
+void ingest_pop(void) {
+    uint32_t head = q_head;
+    if (head == q_tail) {
+        return;
+    }
+    __mem_fence_release();   // row consumed before the slot is handed back
+    q_head = head + 1;
+}
+
+uint32_t ingest_pending(void) {
+    return q_tail - q_head;
+}
+
+void ingest_note_batch(uint32_t rows, uint32_t us) {
+    stats.written += rows;
+    stats.batches++;
+    stats.write_us += us;
+    if (rows > stats.max_batch) {
+        stats.max_batch = rows;
+    }
+    if (us > stats.max_batch_us) {
+        stats.max_batch_us = us;
+    }
+}
+
+void ingest_get_stats(ingest_stats_t *out) {
+    *out = stats;
+}
+
+void ingest_report(void) {
+    ingest_stats_t s;
+    ingest_get_stats(&s);
+
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    uint32_t span_ms = now_ms - last_report_ms;
+    uint32_t rows = s.written - last_report_written;
+    last_report_ms = now_ms;
+    last_report_written = s.written;
+
+    // Rows per second with one decimal, without pulling in float printf
+    uint32_t rate_x10 = span_ms ? (uint32_t)((uint64_t)rows * 10000u / span_ms) : 0;
+    uint32_t avg_us = s.batches ? (uint32_t)(s.write_us / s.batches) : 0;
+
+    printf("[INGEST] in=%lu dropped=%lu oversize=%lu high=%lu/%u\n",
+           (unsigned long)s.enqueued, (unsigned long)s.dropped,
+           (unsigned long)s.oversize, (unsigned long)s.high_water,
+           INGEST_QUEUE_LEN);
+    printf("[INGEST] out=%lu batches=%lu max batch=%lu commit avg=%lu us max=%lu us rate=%lu.%lu rows/s\n",
+           (unsigned long)s.written, (unsigned long)s.batches,
+           (unsigned long)s.max_batch, (unsigned long)avg_us,
+           (unsigned long)s.max_batch_us,
+           (unsigned long)(rate_x10 / 10), (unsigned long)(rate_x10 % 10));
+}
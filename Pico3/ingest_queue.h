@@ -0,0 +1,59 @@
+#ifndef INGEST_QUEUE_H
+#define INGEST_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Ingest queue between the MQTT callbacks and the SD writer.
+//
+// The lwIP callbacks format a CSV row and push it here; the storage loop
+// on core1 pops rows in batches and hands each batch to the SD stream in
+// one go. One producer (lwIP callbacks, core0) and one consumer (core1),
+// so the ring needs no lock, only ordered head/tail updates.
+//
+// Overflow policy: drop-newest. A full queue rejects the row and counts
+// it in ingest_stats_t.dropped; rows already queued are never lost.
+
+#define INGEST_QUEUE_LEN   64     // rows, power of two
+#define INGEST_ROW_MAX     128    // bytes per row including the newline
+#define INGEST_BATCH_MAX   32     // most rows committed per batch
+#define INGEST_BATCH_WAKE  16     // queued rows that wake the writer early
+
+#ifndef INGEST_BENCHMARK
+#define INGEST_BENCHMARK   0      // >0: synthetic publisher at this many rows/s (pico3_driver.c)
+#endif
+
+typedef struct {
+    uint32_t enqueued;        // rows accepted
+    uint32_t dropped;         // rows rejected, queue full
+    uint32_t oversize;        // rows rejected, longer than INGEST_ROW_MAX
+    uint32_t high_water;      // most rows ever queued at once
+    uint32_t written;         // rows handed to storage
+    uint32_t batches;         // storage commits
+    uint32_t max_batch;       // most rows in one commit
+    uint32_t max_batch_us;    // slowest commit
+    uint64_t write_us;        // total time spent committing
+} ingest_stats_t;
+
+void ingest_init(void);
+
+// Producer side (lwIP callbacks). Returns false if the row was dropped.
+bool ingest_push(const char *row, size_t len);
+
+// Consumer side (main loop). Oldest queued row, or NULL if empty; the
+// row stays valid until ingest_pop().
+const char *ingest_peek(size_t *len);
+void ingest_pop(void);
+
+uint32_t ingest_pending(void);
+
+// Writer bookkeeping: one commit of rows took us microseconds
+void ingest_note_batch(uint32_t rows, uint32_t us);
+
+void ingest_get_stats(ingest_stats_t *out);
+
+// Print the counters and the row rate since the previous report
+void ingest_report(void);
+
+#endif
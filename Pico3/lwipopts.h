@@ -64,6 +64,7 @@
 #define LWIP_TIMEVAL_PRIVATE        0
 #define SO_REUSE                    1
 #define LWIP_MQTT                   1
+#define MQTT_VAR_HEADER_BUFFER_LEN  512   // deliver batched publishes unfragmented
 
 // ----------------------------------------------------
 // Checksums and statistics
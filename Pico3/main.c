@@ -1,11 +1,18 @@
 #include "pico3_driver.h"
 #include "pico/stdlib.h"
+#include "log_buffer.h"
+
+#define LOG_DRAIN_INTERVAL_MS 250
 
 int main(void) {
     if (pico3_driver_init() != 0) {
         return -1;
     }
+    // Network work runs from lwIP callbacks and core1 owns the SD card;
+    // core1 raises an event whenever a read for the HTTP server completes.
     while (true) {
-        sleep_ms(5000);
+        pico3_driver_poll();
+        log_drain(0);
+        best_effort_wfe_or_timeout(make_timeout_time_ms(LOG_DRAIN_INTERVAL_MS));
     }
 }
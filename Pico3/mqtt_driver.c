@@ -1,6 +1,7 @@
 #include "mqtt_driver.h"
 #include <stdio.h>
 #include <string.h>
+#include "log_buffer.h"
 #include "pico/stdlib.h"
 #include <secrets.h>
 
@@ -19,10 +20,10 @@ static char last_topic[128] = {0};
 // ==========================
 static void mqtt_connection_cb(mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
     if (status == MQTT_CONNECT_ACCEPTED) {
-        printf("MQTT connected\n");
+        LOG_INFO("MQTT connected\n");
         mqtt_status = MQTT_STATUS_CONNECTED;
     } else {
-        printf("MQTT connection failed (status=%d)\n", status);
+        LOG_ERROR("MQTT connection failed (status=%d)\n", status);
         mqtt_status = MQTT_STATUS_ERROR;
     }
 }
@@ -71,9 +72,9 @@ static void mqtt_incoming_data_cb(void *arg, const u8_t *data, u16_t len, u8_t f
 static void mqtt_sub_request_cb(void *arg, err_t result) {
     const char* topic = (const char*)arg;
     if (result == ERR_OK) {
-        printf("Subscribe to %s successful\n", topic);
+        LOG_INFO("Subscribe to %s successful\n", topic);
     } else {
-        printf("Subscribe to %s failed (err=%d)\n", topic, result);
+        LOG_WARN("Subscribe to %s failed (err=%d)\n", topic, result);
     }
 }
 
@@ -83,9 +84,9 @@ static void mqtt_sub_request_cb(void *arg, err_t result) {
 static void mqtt_pub_request_cb(void *arg, err_t result) {
     const char* topic = (const char*)arg;
     if (result == ERR_OK) {
-        printf("Publish to %s successful\n", topic);
+        LOG_DEBUG("Publish to %s successful\n", topic);
     } else {
-        printf("Publish to %s failed (err=%d)\n", topic, result);
+        LOG_WARN("Publish to %s failed (err=%d)\n", topic, result);
     }
 }
 
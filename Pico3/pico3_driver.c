@@ -1,35 +1,182 @@
 #include "pico3_driver.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
 
 #include "wifi_driver.h"
 #include "mqtt_driver.h"
-#include "sd_driver.h"
+#include "storage_driver.h"
 #include "timestamp_driver.h"
 #include "http_server_driver.h"
+#include "fmt_utils.h"
+#include "log_buffer.h"
+#include "sensor_record.h"
+#include "ingest_queue.h"
 #include "secrets.h"
 
 #include "lwip/netif.h"
 #include "lwip/ip4_addr.h"
 
-// Global SD card manager instance
-static SD_Manager sd_mgr;
-
 // NEW: stores latest ML prediction coming from pico4
 char latest_prediction[32] = "No data";
 
+// Pico4 publishes predictions retained, so the broker answers our
+// subscription with the current one; startup waits for it at most this long
+#define PREDICTION_RESYNC_TIMEOUT_MS 3000
+
+static volatile bool prediction_received = false;
+static uint32_t prediction_subscribed_ms = 0;
+
+/* ==========================================================
+   Binary sensor records (sensor_record.h)
+   Values are written with the precision the text payloads used,
+   so rows look the same whichever format the producer sends.
+   ========================================================== */
+static int32_t last_seq[SR_TYPE_CO2_SUMMARY + 1] = { -1, -1, -1, -1, -1 };
+
+// Backlog records arrive behind newer live ones, so they are not fed to
+// the sequence check (track_seq false)
+static void handle_sensor_record(const char* topic, const char* payload,
+                                 uint16_t payload_len, uint64_t timestamp, bool track_seq) {
+    sensor_record_t rec;
+    sr_status_t st = sr_decode((const uint8_t *)payload, payload_len, &rec);
+    if (st != SR_OK) {
+        LOG_WARN("Bad sensor record (status %d, %u bytes)\n", st, payload_len);
+        return;
+    }
+
+    if (track_seq && rec.type <= SR_TYPE_CO2_SUMMARY) {
+        uint16_t lost = sr_seq_gap(&last_seq[rec.type], rec.seq);
+        if (lost) {
+            LOG_WARN("Sensor record type %u: %u lost before seq %u\n",
+                     rec.type, lost, rec.seq);
+        }
+    }
+
+    // Summary rows: count,min,max,mean,stddev,slope_per_min,span_s
+    uint8_t decimals = (rec.type == SR_TYPE_CO2) ? 0 : 2;
+    char csv_entry[INGEST_ROW_MAX];
+    fmt_buf_t row;
+    fmt_init(&row, csv_entry, sizeof(csv_entry));
+    fmt_put_u64(&row, timestamp);
+    fmt_put_char(&row, ',');
+    fmt_put_str(&row, topic);
+    for (uint8_t i = 0; i < rec.count; i++) {
+        fmt_put_char(&row, ',');
+        fmt_put_q16(&row, rec.values[i], decimals);
+    }
+    fmt_put_char(&row, '\n');
+    size_t row_len = fmt_finish(&row);
+    if (row_len == 0) {
+        LOG_WARN("CSV row too long, dropped\n");
+        return;
+    }
+    ingest_push(csv_entry, row_len);
+}
+
 /* ==========================================================
    Sensor data handler
    ========================================================== */
+static void log_sensor_data(const char* topic, const char* payload, uint16_t payload_len,
+                            uint64_t timestamp, bool live) {
+    if (sr_is_binary(payload, payload_len)) {
+        handle_sensor_record(topic, payload, payload_len, timestamp, live);
+        return;
+    }
+
+    if (payload_len >= 256) {
+        LOG_WARN("Payload too large: %u bytes\n", payload_len);
+        return;
+    }
+
+    char message[256];
+    memcpy(message, payload, payload_len);
+    message[payload_len] = '\0';
+
+    LOG_DEBUG("Sensor data received: %u bytes\n", payload_len);
+
+    char csv_entry[INGEST_ROW_MAX];
+    fmt_buf_t row;
+    fmt_init(&row, csv_entry, sizeof(csv_entry));
+    fmt_put_u64(&row, timestamp);
+    fmt_put_char(&row, ',');
+    fmt_put_str(&row, topic);
+    fmt_put_char(&row, ',');
+    fmt_put_str(&row, message);
+    fmt_put_char(&row, '\n');
+    size_t row_len = fmt_finish(&row);
+    if (row_len == 0) {
+        LOG_WARN("CSV row too long, dropped\n");
+        return;
+    }
+    ingest_push(csv_entry, row_len);
+}
+
 static void handle_sensor_data(const char* topic, const char* payload, uint16_t payload_len) {
     if (!timestamp_is_synchronized()) {
-        printf("Warning: No timestamp received yet\n");
+        LOG_WARN("Warning: No timestamp received yet\n");
+        return;
+    }
+    log_sensor_data(topic, payload, payload_len, timestamp_get_synced_time(), true);
+}
+
+/* ==========================================================
+   Store-and-forward backlog handler
+   Pico 2 replays what it queued during an outage as
+   "age_ms:<payload>", after its live value and on a topic of
+   its own so Pico 4 never takes it for the current reading.
+   The row goes under the live topic, back-dated by the age. An
+   empty age (queued before Pico 2 rebooted) leaves the arrival
+   time under the backlog topic, so it isn't mistaken for one.
+   ========================================================== */
+static void handle_sensor_backlog(const char* topic, const char* live_topic,
+                                  const char* payload, uint16_t payload_len) {
+    if (!timestamp_is_synchronized()) {
+        LOG_WARN("Warning: No timestamp received yet\n");
+        return;
+    }
+
+    const char *colon = memchr(payload, ':', payload_len);
+    if (!colon) {
+        LOG_WARN("Bad backlog record (%u bytes)\n", payload_len);
+        return;
+    }
+
+    uint64_t age_ms = 0;
+    bool age_known = colon > payload;
+    for (const char *p = payload; p < colon; p++) {
+        if (*p < '0' || *p > '9' || age_ms > UINT32_MAX) {
+            LOG_WARN("Bad backlog record (%u bytes)\n", payload_len);
+            return;
+        }
+        age_ms = age_ms * 10 + (uint64_t)(*p - '0');
+    }
+
+    uint64_t current_timestamp = timestamp_get_synced_time();
+    uint64_t sample_ts = (age_ms < current_timestamp) ? current_timestamp - age_ms : 0;
+    uint16_t body_len = (uint16_t)(payload_len - (colon + 1 - payload));
+
+    log_sensor_data(age_known ? live_topic : topic, colon + 1, body_len, sample_ts, false);
+}
+
+/* ==========================================================
+   Batched sensor data handler
+   Pico 2 buffers samples with its radio off and publishes them
+   as "age_ms:ppm,..." (oldest first). Each entry is logged as
+   its own row on TOPIC_PICO2, back-dated by its age.
+   Pico 2 only sends values that left its deadband (plus a
+   periodic heartbeat), so a row's value holds until the next.
+   ========================================================== */
+static void handle_sensor_batch(const char* payload, uint16_t payload_len) {
+    if (!timestamp_is_synchronized()) {
+        LOG_WARN("Warning: No timestamp received yet\n");
         return;
     }
 
     if (payload_len >= 256) {
-        printf("Payload too large: %u bytes\n", payload_len);
+        LOG_WARN("Payload too large: %u bytes\n", payload_len);
         return;
     }
 
@@ -38,19 +185,42 @@ static void handle_sensor_data(const char* topic, const char* payload, uint16_t
     message[payload_len] = '\0';
 
     uint64_t current_timestamp = timestamp_get_synced_time();
-    printf("Sensor data received: %s\n", message);
+    unsigned rows = 0;
+    char *p = message;
+
+    while (*p) {
+        char *end;
+        unsigned long age_ms = strtoul(p, &end, 10);
+        if (end == p || *end != ':') break;
+
+        p = end + 1;
+        unsigned long ppm = strtoul(p, &end, 10);
+        if (end == p) break;
+
+        uint64_t sample_ts = (age_ms < current_timestamp) ? current_timestamp - age_ms : 0;
+
+        char csv_entry[64];
+        fmt_buf_t row;
+        fmt_init(&row, csv_entry, sizeof(csv_entry));
+        fmt_put_u64(&row, sample_ts);
+        fmt_put_str(&row, "," TOPIC_PICO2 ",");
+        fmt_put_u32(&row, (uint32_t)ppm);
+        fmt_put_char(&row, '\n');
+        size_t row_len = fmt_finish(&row);
+        if (row_len == 0 || !ingest_push(csv_entry, row_len)) break;
+        rows++;
+
+        p = (*end == ',') ? end + 1 : end;
+    }
 
-    char csv_entry[256];
-    snprintf(csv_entry, sizeof(csv_entry),
-             "%llu,%s,%s\n", current_timestamp, topic, message);
-    sd_write_data(&sd_mgr, "sensor_log.csv", csv_entry, true);
+    LOG_INFO("Sensor batch received: %u samples queued\n", rows);
 }
 
 /* ==========================================================
    Unified MQTT message handler
    ========================================================== */
 static void pico3_message_handler(const char* topic, const char* payload, uint16_t payload_len) {
-    printf("Received message on topic: %s, length: %u\n", topic, payload_len);
+    LOG_DEBUG("Received message, length: %u\n", payload_len);
 
     /* --- Timestamp reply --- */
     if (strcmp(topic, TOPIC_TIMESTAMP_REPLY) == 0) {
@@ -64,20 +234,166 @@ static void pico3_message_handler(const char* topic, const char* payload, uint16
         return;
     }
 
+    if (strcmp(topic, TOPIC_PICO2_BATCH) == 0) {
+        handle_sensor_batch(payload, payload_len);
+        return;
+    }
+
+    if (strcmp(topic, TOPIC_PICO2_BACKLOG) == 0) {
+        handle_sensor_backlog(topic, TOPIC_PICO2, payload, payload_len);
+        return;
+    }
+
+    if (strcmp(topic, TOPIC_PICO2_SUMMARY_BACKLOG) == 0) {
+        handle_sensor_backlog(topic, TOPIC_PICO2_SUMMARY, payload, payload_len);
+        return;
+    }
+
+    /* --- Pico 2 NORMAL-mode window summary: one row per window --- */
+    if (strcmp(topic, TOPIC_PICO2_SUMMARY) == 0) {
+        handle_sensor_data(topic, payload, payload_len);
+        return;
+    }
+
     /* --- NEW: ML Prediction from Pico 4 --- */
     if (strcmp(topic, TOPIC_PREDICTION) == 0) {
+        sensor_record_t rec;
+        int cls = -1;
+        if (sr_is_binary(payload, payload_len)) {
+            const char *label = NULL;
+            if (sr_decode((const uint8_t *)payload, payload_len, &rec) == SR_OK &&
+                rec.type == SR_TYPE_PREDICTION) {
+                cls = (int)(rec.values[0] >> 16);
+                label = sr_prediction_label(cls);
+            }
+            if (!label) {
+                LOG_WARN("Bad prediction record (%u bytes)\n", payload_len);
+                return;
+            }
+            payload = label;
+            payload_len = (uint16_t)strlen(label);
+        } else {
+            for (int i = 0; sr_prediction_label(i); i++) {
+                const char *label = sr_prediction_label(i);
+                if (strlen(label) == payload_len && memcmp(payload, label, payload_len) == 0) {
+                    cls = i;
+                    break;
+                }
+            }
+        }
+
         if (payload_len >= sizeof(latest_prediction))
             payload_len = sizeof(latest_prediction) - 1;
 
         memcpy(latest_prediction, payload, payload_len);
         latest_prediction[payload_len] = '\0';
 
-        printf("Updated prediction: %s\n", latest_prediction);
+        if (!prediction_received) {
+            prediction_received = true;
+            LOG_INFO("Prediction resync after %lu ms\n",
+                     to_ms_since_boot(get_absolute_time()) - prediction_subscribed_ms);
+        }
+
+        // The class index, not latest_prediction: the log is drained later
+        // and the buffer may hold a newer prediction by then (-1: unknown text)
+        LOG_INFO("Updated prediction: class %d\n", cls);
         return;
     }
 
     /* --- Unknown topic --- */
-    printf("Unknown topic: %s\n", topic);
+    LOG_WARN("Unknown topic (%u bytes)\n", payload_len);
+}
+
+/* ==========================================================
+   Synthetic publisher (INGEST_BENCHMARK)
+   An async_context worker runs in the same context as the MQTT
+   callbacks, so rows take the callback's path into the queue at
+   INGEST_BENCHMARK rows/s while core1 commits them as usual.
+   ========================================================== */
+#if INGEST_BENCHMARK
+#define INGEST_BENCH_TICK_MS   10
+#define INGEST_BENCH_SECONDS   30
+#define INGEST_BENCH_TOPIC     "bench/ingest"
+
+static uint32_t bench_start_ms = 0;
+static uint32_t bench_sent = 0;
+static volatile bool bench_finished = false;
+
+static void bench_publish(async_context_t *context, async_at_time_worker_t *worker) {
+    uint32_t elapsed_ms = to_ms_since_boot(get_absolute_time()) - bench_start_ms;
+    uint32_t due = (uint32_t)((uint64_t)INGEST_BENCHMARK * elapsed_ms / 1000);
+
+    while (bench_sent < due) {
+        char payload[12];
+        fmt_buf_t p;
+        fmt_init(&p, payload, sizeof(payload));
+        fmt_put_u32(&p, 400 + bench_sent % 1000);
+        handle_sensor_data(INGEST_BENCH_TOPIC, payload, (uint16_t)fmt_finish(&p));
+        bench_sent++;
+    }
+
+    if (elapsed_ms < INGEST_BENCH_SECONDS * 1000) {
+        async_context_add_at_time_worker_in_ms(context, worker, INGEST_BENCH_TICK_MS);
+    } else {
+        bench_finished = true;
+    }
+}
+
+static async_at_time_worker_t bench_worker = { .do_work = bench_publish };
+
+static void bench_start(void) {
+    printf("\nIngest benchmark: %u rows/s on " INGEST_BENCH_TOPIC " for %u s\n",
+           INGEST_BENCHMARK, INGEST_BENCH_SECONDS);
+    ingest_report();   // starts the rate window
+    bench_start_ms = to_ms_since_boot(get_absolute_time());
+    async_context_add_at_time_worker_in_ms(cyw43_arch_async_context(), &bench_worker,
+                                           INGEST_BENCH_TICK_MS);
+}
+#endif
+
+/* ==========================================================
+   Prediction resync: done as soon as the retained message lands
+   ========================================================== */
+static bool wait_for_prediction(uint32_t timeout_ms) {
+    uint32_t start_ms = to_ms_since_boot(get_absolute_time());
+
+    while (!prediction_received) {
+        if (to_ms_since_boot(get_absolute_time()) - start_ms > timeout_ms) {
+            return false;
+        }
+        sleep_ms(10);
+    }
+    return true;
+}
+
+/* ==========================================================
+   Main-loop work
+   Core1 commits the queued rows and serves SD reads; core0 only
+   sends the HTTP responses those reads complete, and reports.
+   ========================================================== */
+#define STATS_REPORT_INTERVAL_MS 60000
+
+static uint32_t last_report_ms = 0;
+
+void pico3_driver_poll(void) {
+    http_server_poll();
+
+#if INGEST_BENCHMARK
+    if (bench_finished) {
+        bench_finished = false;
+        printf("Ingest benchmark done: %lu rows offered\n", (unsigned long)bench_sent);
+        ingest_report();
+        storage_report();
+    }
+#endif
+
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    if (now_ms - last_report_ms >= STATS_REPORT_INTERVAL_MS) {
+        ingest_report();
+        storage_report();
+        http_server_report();
+        last_report_ms = now_ms;
+    }
 }
 
 /* ==========================================================
@@ -94,20 +410,18 @@ static bool is_system_ready(void) {
    ========================================================== */
 int pico3_driver_init(void) {
     stdio_init_all();
+    log_init();
     sleep_ms(2000);
 
     printf("=== Lutfi Pico Server - MQTT + SD Logger + HTTP ===\n");
 
-    /* --- Step 1: SD card --- */
-    if (!sd_init(&sd_mgr)) {
+    /* --- Step 1: SD card, owned by core1 from here on --- */
+    ingest_init();
+    if (!storage_start("logs")) {
         printf("FATAL: SD card initialization failed!\n");
         return -1;
     }
 
-    if (!sd_init_csv_log(&sd_mgr, "sensor_log.csv")) {
-        printf("Warning: Failed to initialize CSV log file\n");
-    }
-
     /* --- Step 2: Wi-Fi --- */
     printf("\n1. Connecting to WiFi...\n");
     if (wifi_init() != WIFI_OK) return -1;
@@ -161,12 +475,37 @@ int pico3_driver_init(void) {
         return -1;
     }
 
+    if (mqtt_subscribe_topic(TOPIC_PICO2_BATCH, 0) != MQTT_OK) {
+        printf("Failed to subscribe to %s\n", TOPIC_PICO2_BATCH);
+        return -1;
+    }
+
+    if (mqtt_subscribe_topic(TOPIC_PICO2_SUMMARY, 0) != MQTT_OK) {
+        printf("Failed to subscribe to %s\n", TOPIC_PICO2_SUMMARY);
+        return -1;
+    }
+
+    if (mqtt_subscribe_topic(TOPIC_PICO2_BACKLOG, 0) != MQTT_OK) {
+        printf("Failed to subscribe to %s\n", TOPIC_PICO2_BACKLOG);
+        return -1;
+    }
+
+    if (mqtt_subscribe_topic(TOPIC_PICO2_SUMMARY_BACKLOG, 0) != MQTT_OK) {
+        printf("Failed to subscribe to %s\n", TOPIC_PICO2_SUMMARY_BACKLOG);
+        return -1;
+    }
+
     /* --- NEW: Subscribe to Pico 4 prediction topic --- */
+    prediction_subscribed_ms = to_ms_since_boot(get_absolute_time());
     if (mqtt_subscribe_topic(TOPIC_PREDICTION, 0) != MQTT_OK) {
         printf("Failed to subscribe to %s\n", TOPIC_PREDICTION);
         return -1;
     }
 
+    if (!wait_for_prediction(PREDICTION_RESYNC_TIMEOUT_MS)) {
+        printf("No retained prediction yet, serving \"%s\"\n", latest_prediction);
+    }
+
     printf("\n6. System initialized and ready.\n");
     printf("Status: WiFi=%s, MQTT=%s, Timestamp=%s\n",
            wifi_is_connected() ? "Connected" : "Disconnected",
@@ -175,7 +514,11 @@ int pico3_driver_init(void) {
 
     /* --- Step 6: Start HTTP server --- */
     printf("\n7. Starting HTTP server...\n");
-    http_server_driver_start(&sd_mgr);
+    http_server_driver_start();
 
+#if INGEST_BENCHMARK
+    bench_start();
+    last_report_ms = to_ms_since_boot(get_absolute_time());   // no report mid-run
+#endif
     return 0;
 }
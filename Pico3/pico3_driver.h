@@ -6,4 +6,7 @@
 // Initialize and run the main Pico 3 server system
 int pico3_driver_init(void);
 
+// Main-loop work: finish HTTP responses waiting on SD reads, report
+void pico3_driver_poll(void);
+
 #endif
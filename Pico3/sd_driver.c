@@ -1,6 +1,23 @@
 #include "sd_driver.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include "log_buffer.h"
+#include "sensor_record.h"
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "diskio.h"
+
+#if !FF_USE_EXPAND
+#error "sd_driver.c allocates log segments with f_expand(): set FF_USE_EXPAND to 1 in ffconf.h"
+#endif
+
+_Static_assert(SD_PROBE_SECTORS * SD_SECTOR_SIZE <= SD_STREAM_BUF_SIZE,
+               "clock probe must fit io_buf");
+
+// Scratch for the clock probe and the benchmark, both run before the log
+// stream is opened, and for sd_seg_zeroed() on core1 afterwards
+static uint8_t io_buf[SD_STREAM_BUF_SIZE] __attribute__((aligned(4)));
 
 // Initialize the SD card
 bool sd_init(SD_Manager *sd) {
@@ -10,6 +27,7 @@ bool sd_init(SD_Manager *sd) {
     
     // Initialize structure
     sd->mounted = false;
+    sd->log.open = false;
     
     // Mount the SD card
     fr = f_mount(&sd->fs, "", 1);
@@ -28,6 +46,187 @@ bool sd_init(SD_Manager *sd) {
     return true;
 }
 
+/* ==========================================================
+   SPI clock negotiation
+   ========================================================== */
+// clk_peri / 2, 4, 6, 8 at 125 MHz: the rates the SPI divider can make
+// above the 12.5 MHz hw_config default. Those above SD_BAUD_MAX are
+// out of spec for the card and skipped.
+static const uint32_t SD_BAUD_CANDIDATES[] = {
+    62500000, 31250000, 20833333, 15625000
+};
+
+// Scratch area for the probe: SD_PROBE_FILE, allocated contiguously so
+// raw sector writes stay inside it
+static bool sd_probe_area(SD_Manager *sd, LBA_t *lba) {
+    FIL f;
+    FRESULT fr = f_open(&f, SD_PROBE_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr != FR_OK) {
+        printf("ERROR: Could not open %s (error code: %d)\n", SD_PROBE_FILE, fr);
+        return false;
+    }
+    fr = f_expand(&f, SD_PROBE_SECTORS * SD_SECTOR_SIZE, 1);
+    if (fr == FR_OK) {
+        *lba = sd->fs.database + (LBA_t)sd->fs.csize * (f.obj.sclust - 2);
+    }
+    FRESULT cr = f_close(&f);
+    return fr == FR_OK && cr == FR_OK;
+}
+
+// Set the clock to hz, then multi-block (CMD25) write a pattern that
+// changes every round and read it back (CMD18), SD_BAUD_TRIALS times.
+// *actual is the rate the divider made.
+static bool sd_probe_rate(SD_Manager *sd, uint32_t hz, LBA_t lba, uint32_t *actual) {
+    const size_t bytes = SD_PROBE_SECTORS * SD_SECTOR_SIZE;
+
+    *actual = spi_set_baudrate(sd_get_by_num(0)->spi->hw_inst, hz);
+    for (uint32_t t = 0; t < SD_BAUD_TRIALS; t++) {
+        uint32_t x = (t + 1) * 2654435761u;
+        for (size_t i = 0; i < bytes; i++) {
+            x = x * 1103515245u + 12345u;
+            io_buf[i] = (uint8_t)(x >> 16);
+        }
+        uint16_t crc = sr_crc16(io_buf, bytes);
+        if (disk_write(sd->fs.pdrv, io_buf, lba, SD_PROBE_SECTORS) != RES_OK) {
+            return false;
+        }
+        memset(io_buf, 0, bytes);
+        if (disk_read(sd->fs.pdrv, io_buf, lba, SD_PROBE_SECTORS) != RES_OK ||
+            sr_crc16(io_buf, bytes) != crc) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t sd_negotiate_baud(SD_Manager *sd) {
+    spi_t *spi = sd_get_by_num(0)->spi;
+    uint32_t base = spi->baud_rate;
+    uint32_t baud = base;
+    uint32_t got;
+    LBA_t lba;
+
+    if (!sd->mounted || !sd_probe_area(sd, &lba)) {
+        return base;
+    }
+
+    // Fastest candidate that passes; the configured rate has to pass
+    // first, or a failure says nothing about the clock
+    size_t fastest = count_of(SD_BAUD_CANDIDATES);
+    if (sd_probe_rate(sd, base, lba, &got)) {
+        for (size_t i = 0; i < count_of(SD_BAUD_CANDIDATES) && SD_BAUD_CANDIDATES[i] > base; i++) {
+            if (SD_BAUD_CANDIDATES[i] > SD_BAUD_MAX) {
+                continue;
+            }
+            if (sd_probe_rate(sd, SD_BAUD_CANDIDATES[i], lba, &got)) {
+                fastest = i;
+                break;
+            }
+            LOG_WARN("SD: %u kHz failed write+readback\n", got / 1000);
+        }
+    }
+
+    // Run one step below it, for margin against temperature and supply
+    if (fastest + 1 < count_of(SD_BAUD_CANDIDATES) &&
+        SD_BAUD_CANDIDATES[fastest + 1] > base &&
+        sd_probe_rate(sd, SD_BAUD_CANDIDATES[fastest + 1], lba, &got)) {
+        baud = got;
+    }
+    spi_set_baudrate(spi->hw_inst, baud);
+    // The driver reapplies spi->baud_rate whenever it re-inits the card
+    spi->baud_rate = baud;
+    f_unlink(SD_PROBE_FILE);
+
+    if (fastest < count_of(SD_BAUD_CANDIDATES)) {
+        printf("SD: SPI clock %lu kHz (configured %lu kHz, passed up to %lu kHz)\n",
+               (unsigned long)(baud / 1000), (unsigned long)(base / 1000),
+               (unsigned long)(SD_BAUD_CANDIDATES[fastest] / 1000));
+    } else {
+        printf("SD: SPI clock stays at %lu kHz\n", (unsigned long)(base / 1000));
+    }
+    return baud;
+}
+
+/* ==========================================================
+   Sequential I/O benchmark
+   ========================================================== */
+// Time SD_BENCH_BYTES through one file handle in chunk-byte calls.
+// Returns total microseconds (0 on error); *worst_us is the slowest call.
+static uint32_t sd_bench_io(bool write, UINT chunk, uint32_t *worst_us) {
+    FIL f;
+    UINT n;
+    FRESULT fr = f_open(&f, SD_BENCH_FILE, write ? (FA_WRITE | FA_CREATE_ALWAYS) : FA_READ);
+    if (fr != FR_OK) {
+        printf("ERROR: Could not open %s (error code: %d)\n", SD_BENCH_FILE, fr);
+        return 0;
+    }
+
+    *worst_us = 0;
+    uint64_t start_us = time_us_64();
+    for (uint32_t done = 0; done < SD_BENCH_BYTES && fr == FR_OK; done += chunk) {
+        uint64_t call_us = time_us_64();
+        fr = write ? f_write(&f, io_buf, chunk, &n) : f_read(&f, io_buf, chunk, &n);
+        if (n != chunk) {
+            fr = FR_DISK_ERR;
+        }
+        uint32_t took_us = (uint32_t)(time_us_64() - call_us);
+        if (took_us > *worst_us) {
+            *worst_us = took_us;
+        }
+    }
+    if (write && fr == FR_OK) {
+        fr = f_sync(&f);
+    }
+    uint32_t total_us = (uint32_t)(time_us_64() - start_us);
+    f_close(&f);
+
+    if (fr != FR_OK) {
+        printf("ERROR: Benchmark %s failed (error code: %d)\n", write ? "write" : "read", fr);
+        return 0;
+    }
+    return total_us ? total_us : 1;
+}
+
+static void sd_bench_print(const char *what, UINT chunk, uint32_t total_us, uint32_t worst_us) {
+    // MB/s with two decimals and per-sector time, integer math only
+    uint32_t mbps_x100 = (uint32_t)((uint64_t)SD_BENCH_BYTES * 100000000u /
+                                    ((uint64_t)total_us << 20));
+    uint32_t sector_us = total_us / (SD_BENCH_BYTES / SD_SECTOR_SIZE);
+
+    printf("SD bench: %-5s %4u B calls  %lu.%02lu MB/s  %lu us/sector  worst call %lu us\n",
+           what, chunk, (unsigned long)(mbps_x100 / 100), (unsigned long)(mbps_x100 % 100),
+           (unsigned long)sector_us, (unsigned long)worst_us);
+}
+
+void sd_benchmark(SD_Manager *sd) {
+    static const UINT CHUNKS[] = { SD_SECTOR_SIZE, SD_STREAM_BUF_SIZE };
+    spi_t *spi = sd_get_by_num(0)->spi;
+
+    if (!sd->mounted) {
+        return;
+    }
+
+    printf("SD bench: %u KB at %lu kHz SPI\n",
+           SD_BENCH_BYTES / 1024, (unsigned long)(spi->baud_rate / 1000));
+    for (size_t i = 0; i < count_of(CHUNKS); i++) {
+        uint32_t worst_us;
+        memset(io_buf, 'A' + (int)i, sizeof(io_buf));
+
+        uint32_t us = sd_bench_io(true, CHUNKS[i], &worst_us);
+        if (us == 0) {
+            break;
+        }
+        sd_bench_print("write", CHUNKS[i], us, worst_us);
+
+        us = sd_bench_io(false, CHUNKS[i], &worst_us);
+        if (us == 0) {
+            break;
+        }
+        sd_bench_print("read", CHUNKS[i], us, worst_us);
+    }
+    f_unlink(SD_BENCH_FILE);
+}
+
 // Read and print a file from the SD card
 bool sd_read_file(SD_Manager *sd, const char *filename) {
     FRESULT fr;
@@ -72,12 +271,10 @@ bool sd_write_data(SD_Manager *sd, const char *filename, const char *data, bool
     UINT bytes_written;
     
     if (!sd->mounted) {
-        printf("ERROR: SD card not mounted!\n");
+        LOG_ERROR("ERROR: SD card not mounted!\n");
         return false;
     }
     
-    printf("Writing to file: %s\n", filename);
-    
     // Open file for writing
     if (append) {
         // Append mode - add to end of file
@@ -88,22 +285,22 @@ bool sd_write_data(SD_Manager *sd, const char *filename, const char *data, bool
     }
     
     if (fr != FR_OK) {
-        printf("ERROR: Could not open file for writing (error code: %d)\n", fr);
+        LOG_ERROR("ERROR: Could not open file for writing (error code: %d)\n", fr);
         return false;
     }
     
     // Write data to file
     fr = f_write(&sd->fil, data, strlen(data), &bytes_written);
     if (fr != FR_OK) {
-        printf("ERROR: Write failed (error code: %d)\n", fr);
+        LOG_ERROR("ERROR: Write failed (error code: %d)\n", fr);
         f_close(&sd->fil);
         return false;
     }
     
     if (strlen(data) > 0) {
-        printf("Successfully wrote %d bytes: %s", bytes_written, data);
+        LOG_DEBUG("SD: wrote %u bytes\n", bytes_written);
     } else {
-        printf("File cleared successfully\n");
+        LOG_DEBUG("SD: file cleared\n");
     }
     
     // Close the file
@@ -112,16 +309,506 @@ bool sd_write_data(SD_Manager *sd, const char *filename, const char *data, bool
     return true;
 }
 
+/* ==========================================================
+   Append stream (segmented log)
+   ========================================================== */
+// Never written: the source for zero-filling new segments
+static uint8_t zero_sectors[SD_SEG_ZERO_SECTORS * SD_SECTOR_SIZE] __attribute__((aligned(4)));
+
+static void sd_seg_name(const SD_Stream *st, uint32_t seg, char *out, size_t size) {
+    snprintf(out, size, "%s/LOG%05lu.CSV", st->dir, (unsigned long)seg);
+}
+
+// Open segment seg, creating it with f_expand if missing, and return its
+// first sector. The file is closed again: appends bypass FatFs.
+static bool sd_seg_locate(SD_Manager *sd, uint32_t seg, LBA_t *lba) {
+    SD_Stream *st = &sd->log;
+    char name[32];
+    FIL f;
+
+    sd_seg_name(st, seg, name, sizeof(name));
+    FRESULT fr = f_open(&f, name, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+    if (fr != FR_OK) {
+        printf("ERROR: Could not open %s (error code: %d)\n", name, fr);
+        st->errors++;
+        return false;
+    }
+
+    bool fresh = false;
+    if (f_size(&f) != SD_SEG_SIZE) {
+        // New, or cut short by a power loss: one contiguous block
+        fr = f_truncate(&f);
+        if (fr == FR_OK) {
+            fr = f_expand(&f, SD_SEG_SIZE, 1);
+        }
+        fresh = true;
+    }
+    if (fr == FR_OK) {
+        *lba = sd->fs.database + (LBA_t)sd->fs.csize * (f.obj.sclust - 2);
+        // Before the directory entry is committed: zero sector 0, so a
+        // segment never looks written before it has been zero-filled, and
+        // fill the last sector with 0xFF, so it only reads zero once the
+        // zero fill has finished (sd_seg_zeroed)
+        if (fresh) {
+            memset(io_buf, 0xFF, SD_SECTOR_SIZE);
+            if (disk_write(sd->fs.pdrv, zero_sectors, *lba, 1) != RES_OK ||
+                disk_write(sd->fs.pdrv, io_buf, *lba + SD_SEG_SECTORS - 1, 1) != RES_OK) {
+                fr = FR_DISK_ERR;
+            }
+        }
+    }
+    if (fr != FR_OK) {
+        f_close(&f);
+        printf("ERROR: Could not allocate %s (error code: %d)\n", name, fr);
+        st->errors++;
+        return false;
+    }
+    return f_close(&f) == FR_OK;
+}
+
+// Make room for segment seg by deleting those beyond SD_SEG_KEEP
+static void sd_seg_prune(SD_Stream *st, uint32_t seg) {
+    char name[32];
+
+    while (seg - st->oldest + 1 > SD_SEG_KEEP) {
+        sd_seg_name(st, st->oldest, name, sizeof(name));
+        f_unlink(name);
+        st->oldest++;
+    }
+}
+
+// Sectors of the segment at lba already zero-filled: all of them if the
+// last one reads zero, else none known. The fill runs in order and
+// sd_seg_locate() leaves the last sector non-zero, so a prepared segment
+// found after a reboot is not zeroed again.
+static bool sd_seg_zeroed(SD_Manager *sd, LBA_t lba, uint32_t *zeroed) {
+    if (disk_read(sd->fs.pdrv, io_buf, lba + SD_SEG_SECTORS - 1, 1) != RES_OK) {
+        LOG_ERROR("ERROR: Segment check failed\n");
+        sd->log.errors++;
+        return false;
+    }
+    *zeroed = SD_SEG_SECTORS;
+    for (size_t i = 0; i < SD_SECTOR_SIZE; i++) {
+        if (io_buf[i] != 0) {
+            *zeroed = 0;
+            break;
+        }
+    }
+    return true;
+}
+
+// Zero up to max sectors of the next segment
+static bool sd_seg_zero_step(SD_Manager *sd, uint32_t max) {
+    SD_Stream *st = &sd->log;
+    uint32_t n = SD_SEG_SECTORS - st->next_zeroed;
+
+    if (n > max) {
+        n = max;
+    }
+    if (n > SD_SEG_ZERO_SECTORS) {
+        n = SD_SEG_ZERO_SECTORS;
+    }
+    if (disk_write(sd->fs.pdrv, zero_sectors, st->next_lba + st->next_zeroed, n) != RES_OK) {
+        LOG_ERROR("ERROR: Segment zero-fill failed at sector %u\n", st->next_zeroed);
+        st->errors++;
+        return false;
+    }
+    st->next_zeroed += n;
+    return true;
+}
+
+// Create the next segment if needed and zero it completely
+static bool sd_seg_prepare_now(SD_Manager *sd) {
+    SD_Stream *st = &sd->log;
+
+    if (st->next_lba == 0) {
+        sd_seg_prune(st, st->seg + 1);
+        if (!sd_seg_locate(sd, st->seg + 1, &st->next_lba) ||
+            !sd_seg_zeroed(sd, st->next_lba, &st->next_zeroed)) {
+            st->next_lba = 0;
+            return false;
+        }
+    }
+    while (st->next_zeroed < SD_SEG_SECTORS) {
+        if (!sd_seg_zero_step(sd, SD_SEG_SECTORS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write buf to the card. Whole sectors leave buf; with partial, a trailing
+// partial sector is written zero-padded and kept, to be rewritten as it
+// fills up.
+static bool sd_stream_flush(SD_Manager *sd, bool partial) {
+    SD_Stream *st = &sd->log;
+    size_t whole = st->fill / SD_SECTOR_SIZE;
+    size_t tail = st->fill % SD_SECTOR_SIZE;
+    size_t n = whole + ((partial && tail) ? 1 : 0);
+
+    if (n == 0) {
+        return true;
+    }
+    if (partial && tail) {
+        memset(st->buf + st->fill, 0, SD_SECTOR_SIZE - tail);
+    }
+
+    DRESULT dr = disk_write(sd->fs.pdrv, st->buf, st->seg_lba + st->base, (UINT)n);
+    st->writes++;
+    if (dr != RES_OK) {
+        LOG_ERROR("ERROR: Stream write failed (error code: %d)\n", dr);
+        st->errors++;
+        return false;
+    }
+    st->base += whole;
+    st->fill = tail;
+    memmove(st->buf, st->buf + whole * SD_SECTOR_SIZE, tail);
+    return true;
+}
+
+static bool sd_stream_sync_now(SD_Manager *sd) {
+    SD_Stream *st = &sd->log;
+
+    bool ok = sd_stream_flush(sd, true) &&
+              disk_ioctl(sd->fs.pdrv, CTRL_SYNC, NULL) == RES_OK;
+    st->syncs++;
+    st->unsynced = 0;
+    st->last_sync_ms = to_ms_since_boot(get_absolute_time());
+    if (!ok) {
+        LOG_ERROR("ERROR: Stream sync failed\n");
+        st->errors++;
+    }
+    return ok;
+}
+
+// Start segment seg at lba, already zeroed, with the CSV header
+static void sd_seg_begin(SD_Stream *st, uint32_t seg, LBA_t lba) {
+    st->seg = seg;
+    st->seg_lba = lba;
+    st->base = 0;
+    st->fill = strlen(SD_SEG_HEADER);
+    memcpy(st->buf, SD_SEG_HEADER, st->fill);
+    st->unsynced += st->fill;
+}
+
+static bool sd_stream_rollover(SD_Manager *sd) {
+    SD_Stream *st = &sd->log;
+
+    if (!sd_stream_sync_now(sd) || !sd_seg_prepare_now(sd)) {
+        return false;
+    }
+    sd_seg_begin(st, st->seg + 1, st->next_lba);
+    st->next_lba = 0;
+    st->next_failed = false;
+    st->rollovers++;
+    printf("SD: log continues in segment %lu\n", (unsigned long)st->seg);
+    return true;
+}
+
+// First sector of the segment at lba whose first byte is zero. Sectors
+// are written in order into a zeroed segment, so the written ones form a
+// prefix and a binary search finds the end. Sector 0 is checked first:
+// a segment still being zero-filled starts with zeros but may hold old
+// card contents further on.
+static bool sd_seg_find_end(SD_Manager *sd, LBA_t lba, uint32_t *end) {
+    SD_Stream *st = &sd->log;
+    uint32_t lo = 0, hi = SD_SEG_SECTORS;
+
+    if (disk_read(sd->fs.pdrv, st->buf, lba, 1) != RES_OK) {
+        return false;
+    }
+    if (st->buf[0] == 0) {
+        *end = 0;
+        return true;
+    }
+    lo = 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (disk_read(sd->fs.pdrv, st->buf, lba + mid, 1) != RES_OK) {
+            return false;
+        }
+        if (st->buf[0] != 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *end = lo;
+    return true;
+}
+
+// Scan dir for LOGnnnnn.CSV; false if there are none
+static bool sd_seg_scan(SD_Stream *st, uint32_t *lowest, uint32_t *highest) {
+    DIR dir;
+    FILINFO fno;
+    bool found = false;
+
+    if (f_opendir(&dir, st->dir) != FR_OK) {
+        return false;
+    }
+    while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0]) {
+        char *end;
+        if (strncmp(fno.fname, "LOG", 3) != 0 || strcmp(fno.fname + 8, ".CSV") != 0) {
+            continue;
+        }
+        uint32_t seg = (uint32_t)strtoul(fno.fname + 3, &end, 10);
+        if (end != fno.fname + 8) {
+            continue;
+        }
+        if (!found || seg < *lowest) {
+            *lowest = seg;
+        }
+        if (!found || seg > *highest) {
+            *highest = seg;
+        }
+        found = true;
+    }
+    f_closedir(&dir);
+    return found;
+}
+
+// Pick the segment to resume and find its write position
+static bool sd_stream_recover(SD_Manager *sd) {
+    SD_Stream *st = &sd->log;
+    uint32_t lowest = 0, highest = 0;
+    uint32_t end;
+    LBA_t lba;
+
+    if (!sd_seg_scan(st, &lowest, &highest)) {
+        // Empty card: segment 0 has to be zeroed before the first append
+        printf("SD: creating log segment 0 (%lu KB)...\n", (unsigned long)(SD_SEG_SIZE / 1024));
+        st->seg = (uint32_t)-1;
+        st->oldest = 0;
+        st->next_lba = 0;
+        if (!sd_seg_prepare_now(sd)) {
+            return false;
+        }
+        sd_seg_begin(st, 0, st->next_lba);
+        st->next_lba = 0;
+        return true;
+    }
+    st->oldest = lowest;
+
+    // The newest segment may be the unused "next" one (sector 0 still
+    // zero); if so, resume the one before, and finish its zero fill in
+    // the background unless that was done before the reboot
+    if (!sd_seg_locate(sd, highest, &lba) || !sd_seg_find_end(sd, lba, &end)) {
+        return false;
+    }
+    if (end == 0 && highest > lowest) {
+        st->seg = highest - 1;
+        st->next_lba = lba;
+        if (!sd_seg_zeroed(sd, lba, &st->next_zeroed) ||
+            !sd_seg_locate(sd, st->seg, &lba) || !sd_seg_find_end(sd, lba, &end)) {
+            return false;
+        }
+    } else {
+        st->seg = highest;
+        st->next_lba = 0;
+    }
+
+    if (end == 0) {
+        // Nothing in it: make sure it is zeroed, then start it afresh
+        st->next_lba = lba;
+        if (!sd_seg_zeroed(sd, lba, &st->next_zeroed)) {
+            return false;
+        }
+        st->seg--;
+        if (!sd_seg_prepare_now(sd)) {
+            return false;
+        }
+        sd_seg_begin(st, st->seg + 1, lba);
+        st->next_lba = 0;
+        return true;
+    }
+
+    // Resume inside the last written sector, after its text
+    st->seg_lba = lba;
+    st->base = end - 1;
+    if (disk_read(sd->fs.pdrv, st->buf, lba + st->base, 1) != RES_OK) {
+        return false;
+    }
+    st->fill = strnlen((const char *)st->buf, SD_SECTOR_SIZE);
+    bool torn = st->buf[st->fill - 1] != '\n';
+    if (st->fill == SD_SECTOR_SIZE) {
+        st->base = end;
+        st->fill = 0;
+    }
+    if (torn && st->base < SD_SEG_SECTORS) {
+        // A row cut short by the power loss keeps a line of its own
+        st->buf[st->fill++] = '\n';
+        st->unsynced++;
+    }
+    printf("SD: resuming segment %lu at byte %lu\n",
+           (unsigned long)st->seg, (unsigned long)(st->base * SD_SECTOR_SIZE + st->fill));
+    return true;
+}
+
+bool sd_stream_open(SD_Manager *sd, const char *dir,
+                    uint32_t sync_interval_ms, uint32_t sync_bytes) {
+    SD_Stream *st = &sd->log;
+
+    if (!sd->mounted) {
+        printf("ERROR: SD card not mounted!\n");
+        return false;
+    }
+
+    FRESULT fr = f_mkdir(dir);
+    if (fr != FR_OK && fr != FR_EXIST) {
+        printf("ERROR: Could not create '%s' (error code: %d)\n", dir, fr);
+        return false;
+    }
+
+    memset(st, 0, sizeof(*st));
+    snprintf(st->dir, sizeof(st->dir), "%s", dir);
+    if (!sd_stream_recover(sd)) {
+        printf("ERROR: Could not open the log in '%s'\n", dir);
+        return false;
+    }
+
+    st->open = true;
+    st->last_sync_ms = to_ms_since_boot(get_absolute_time());
+    st->sync_interval_ms = sync_interval_ms ? sync_interval_ms : SD_STREAM_SYNC_INTERVAL_MS;
+    st->sync_bytes = sync_bytes ? sync_bytes : SD_STREAM_SYNC_BYTES;
+    st->records = st->writes = st->syncs = st->errors = st->rollovers = 0;
+    st->max_append_us = 0;
+    return true;
+}
+
+bool sd_stream_append(SD_Manager *sd, const char *data, size_t len) {
+    SD_Stream *st = &sd->log;
+    uint64_t start_us = time_us_64();
+    bool ok = true;
+
+    if (!sd->mounted || !st->open) {
+        return false;
+    }
+
+    if ((size_t)st->base * SD_SECTOR_SIZE + st->fill + len > SD_SEG_SIZE) {
+        if (len > SD_SEG_SIZE - strlen(SD_SEG_HEADER) || !sd_stream_rollover(sd)) {
+            st->errors++;
+            return false;
+        }
+    }
+
+    st->unsynced += len;
+    while (len > 0 && ok) {
+        size_t n = SD_STREAM_BUF_SIZE - st->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(st->buf + st->fill, data, n);
+        st->fill += n;
+        data += n;
+        len -= n;
+
+        if (st->fill == SD_STREAM_BUF_SIZE) {
+            ok = sd_stream_flush(sd, false);
+        }
+    }
+    if (ok && st->unsynced >= st->sync_bytes) {
+        ok = sd_stream_sync_now(sd);
+    }
+
+    st->records++;
+    uint32_t took_us = (uint32_t)(time_us_64() - start_us);
+    if (took_us > st->max_append_us) {
+        st->max_append_us = took_us;
+    }
+    return ok;
+}
+
+bool sd_stream_poll(SD_Manager *sd) {
+    SD_Stream *st = &sd->log;
+
+    if (!sd->mounted || !st->open) {
+        return false;
+    }
+    if (st->unsynced > 0 &&
+        to_ms_since_boot(get_absolute_time()) - st->last_sync_ms >= st->sync_interval_ms) {
+        sd_stream_sync_now(sd);
+    }
+
+    // One step of next-segment preparation per call
+    if (st->next_failed) {
+        return false;
+    }
+    if (st->next_lba == 0) {
+        sd_seg_prune(st, st->seg + 1);
+        st->next_failed = !sd_seg_locate(sd, st->seg + 1, &st->next_lba) ||
+                          !sd_seg_zeroed(sd, st->next_lba, &st->next_zeroed);
+        if (st->next_failed) {
+            st->next_lba = 0;
+        }
+        return !st->next_failed;
+    }
+    if (st->next_zeroed < SD_SEG_SECTORS) {
+        st->next_failed = !sd_seg_zero_step(sd, SD_SEG_ZERO_SECTORS);
+        return !st->next_failed && st->next_zeroed < SD_SEG_SECTORS;
+    }
+    return false;
+}
+
+bool sd_stream_sync(SD_Manager *sd) {
+    if (!sd->mounted || !sd->log.open) {
+        return false;
+    }
+    return sd_stream_sync_now(sd);
+}
+
+size_t sd_stream_read_tail(SD_Manager *sd, char *buf, size_t maxlen) {
+    SD_Stream *st = &sd->log;
+
+    if (!sd->mounted || !st->open || maxlen == 0) {
+        return 0;
+    }
+
+    // Whole sectors from the card, then whatever is still in RAM
+    size_t want = maxlen - 1;
+    size_t ram = (st->fill < want) ? st->fill : want;
+    uint32_t sectors = (uint32_t)((want - ram) / SD_SECTOR_SIZE);
+    size_t n = 0;
+
+    if (sectors > st->base) {
+        sectors = st->base;
+    }
+    if (ram == st->fill && sectors > 0 &&
+        disk_read(sd->fs.pdrv, (BYTE *)buf, st->seg_lba + st->base - sectors, sectors) == RES_OK) {
+        n = (size_t)sectors * SD_SECTOR_SIZE;
+    }
+    memcpy(buf + n, st->buf + st->fill - ram, ram);
+    n += ram;
+
+    buf[n] = '\0';
+    return n;
+}
+
+void sd_stream_close(SD_Manager *sd) {
+    if (sd->log.open) {
+        sd_stream_sync_now(sd);
+        sd->log.open = false;
+    }
+}
+
+void sd_stream_report(const SD_Manager *sd) {
+    const SD_Stream *st = &sd->log;
+    printf("[SD] segment=%lu at %lu KB rollovers=%lu next zeroed=%lu/%u\n",
+           (unsigned long)st->seg,
+           (unsigned long)((st->base * SD_SECTOR_SIZE + st->fill) / 1024),
+           (unsigned long)st->rollovers, (unsigned long)st->next_zeroed,
+           SD_SEG_SECTORS);
+    printf("[SD] records=%lu writes=%lu syncs=%lu errors=%lu worst append=%lu us\n",
+           (unsigned long)st->records, (unsigned long)st->writes,
+           (unsigned long)st->syncs, (unsigned long)st->errors,
+           (unsigned long)st->max_append_us);
+}
+
 // Unmount the SD card
 void sd_unmount(SD_Manager *sd) {
+    sd_stream_close(sd);
     if (sd->mounted) {
         f_unmount("");
         sd->mounted = false;
         printf("SD card unmounted.\n");
     }
 }
-// Initialize CSV log file with header
-bool sd_init_csv_log(SD_Manager *sd, const char *filename) {
-    printf("Initializing CSV log file: %s\n", filename);
-    return sd_write_data(sd, filename, "timestamp,topic,sensor_data\n", false);
-}
@@ -2,14 +2,79 @@
 #define SD_DRIVER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "ff.h"
 #include "hw_config.h"
 
+#define SD_SECTOR_SIZE             512
+#define SD_STREAM_BUF_SIZE         (8 * SD_SECTOR_SIZE)   // multiple of SD_SECTOR_SIZE; a full
+                                                          // buffer goes out as one CMD25 write
+#define SD_STREAM_SYNC_INTERVAL_MS 5000   // default: flush to the card at least this often...
+#define SD_STREAM_SYNC_BYTES       4096   // ...or once this much has been appended unflushed
+
+#ifndef SD_SEG_SIZE
+#define SD_SEG_SIZE                (4u * 1024 * 1024)   // bytes per log segment
+#endif
+#define SD_SEG_SECTORS             (SD_SEG_SIZE / SD_SECTOR_SIZE)
+#define SD_SEG_KEEP                64     // older segments are deleted
+#define SD_SEG_ZERO_SECTORS        8      // next-segment sectors zeroed per poll
+#define SD_SEG_HEADER              "timestamp,topic,sensor_data\n"
+
+#define SD_PROBE_SECTORS           8      // sectors per multi-block transfer in the clock probe
+#define SD_BAUD_TRIALS             8      // write+readback rounds that must match per clock
+#define SD_PROBE_FILE              "baud.tmp"   // scratch area for the probe
+#ifndef SD_BAUD_MAX
+#define SD_BAUD_MAX                25000000   // SPI-mode default-speed limit; the FatFs_SPI
+                                              // driver never switches to high speed (CMD6)
+#endif
+
+#ifndef SD_BENCHMARK
+#define SD_BENCHMARK               0      // 1: time sequential I/O before and after the clock probe
+#endif
+#define SD_BENCH_FILE              "bench.tmp"
+#define SD_BENCH_BYTES             (256 * 1024)
+
+// Append stream over a segmented log: fixed-size files <dir>/LOG00000.CSV,
+// LOG00001.CSV, ... each allocated contiguously with f_expand and
+// zero-filled before first use, and never truncated. Records are gathered
+// in RAM and written as raw sectors at the segment's start sector, so
+// FatFs itself is only used when a segment is created. A segment holds
+// CSV text followed by zeros; after an unclean power-off the write
+// position is the first sector starting with a zero byte.
+typedef struct {
+    bool     open;
+    char     dir[16];
+    // Current segment
+    uint32_t seg;                // segment number
+    LBA_t    seg_lba;            // its first sector on the card
+    uint32_t base;               // segment sector that buf[0] belongs to
+    uint8_t  buf[SD_STREAM_BUF_SIZE] __attribute__((aligned(4)));
+    size_t   fill;               // bytes of log data in buf
+    // Next segment, created and zeroed in the background
+    LBA_t    next_lba;           // 0 until created
+    uint32_t next_zeroed;        // sectors zeroed so far
+    bool     next_failed;        // creation failed; retried at rollover
+    uint32_t oldest;             // lowest segment number still on the card
+    uint32_t unsynced;           // bytes appended since the last flush
+    uint32_t last_sync_ms;
+    uint32_t sync_interval_ms;
+    uint32_t sync_bytes;
+    // Statistics
+    uint32_t records;
+    uint32_t writes;
+    uint32_t syncs;
+    uint32_t errors;
+    uint32_t rollovers;
+    uint32_t max_append_us;      // worst sd_stream_append() call
+} SD_Stream;
+
 // SD Card Manager structure
 typedef struct {
     FATFS fs;           // FatFS file system object
     FIL fil;            // File object
     bool mounted;       // SD card mount status
+    SD_Stream log;      // append stream for the sensor log
 } SD_Manager;
 
 /**
@@ -19,10 +84,20 @@ typedef struct {
 bool sd_init(SD_Manager *sd);
 
 /**
- * Initialize CSV log file with header
- * Returns true on success, false on failure
+ * Raise the SPI clock, up to SD_BAUD_MAX. A rate passes when
+ * SD_BAUD_TRIALS multi-block writes of SD_PROBE_SECTORS sectors to
+ * SD_PROBE_FILE all read back intact; the card is then run one rate
+ * below the fastest that passed, for margin. Call right after sd_init().
+ * Returns the SPI clock in use afterwards, in Hz
  */
-bool sd_init_csv_log(SD_Manager *sd, const char *filename);
+uint32_t sd_negotiate_baud(SD_Manager *sd);
+
+/**
+ * Write, then read back, SD_BENCH_BYTES through SD_BENCH_FILE in
+ * single-sector and SD_STREAM_BUF_SIZE chunks and print MB/s and
+ * per-sector latency for each. The file is deleted afterwards.
+ */
+void sd_benchmark(SD_Manager *sd);
 
 /**
  * Read and print a file from the SD card
@@ -40,6 +115,47 @@ bool sd_read_file(SD_Manager *sd, const char *filename);
  */
 bool sd_write_data(SD_Manager *sd, const char *filename, const char *data, bool append);
 
+/**
+ * Open the segmented log in dir (created if needed) as the append stream.
+ * Resumes the newest segment at its first zero sector, so nothing is
+ * truncated; a fresh segment starts with SD_SEG_HEADER.
+ * sync_interval_ms / sync_bytes: flush thresholds (0 = defaults)
+ * Returns true on success, false on failure
+ */
+bool sd_stream_open(SD_Manager *sd, const char *dir,
+                    uint32_t sync_interval_ms, uint32_t sync_bytes);
+
+/**
+ * Append len bytes to the stream. Only touches the card when the buffer
+ * fills up or the byte threshold for a flush is reached. A record never
+ * straddles two segments.
+ * Returns true on success, false on failure
+ */
+bool sd_stream_append(SD_Manager *sd, const char *data, size_t len);
+
+/**
+ * Call periodically: flushes once SD_Stream.sync_interval_ms has passed
+ * with data outstanding, then prepares the next segment a step at a time.
+ * Returns true while that background work is unfinished
+ */
+bool sd_stream_poll(SD_Manager *sd);
+
+/**
+ * Write out everything buffered, the last sector zero-padded
+ */
+bool sd_stream_sync(SD_Manager *sd);
+
+/**
+ * Copy up to the last maxlen - 1 bytes of the current segment into buf
+ * (NUL terminated), including data still in the RAM buffer.
+ * Returns the number of bytes copied
+ */
+size_t sd_stream_read_tail(SD_Manager *sd, char *buf, size_t maxlen);
+
+void sd_stream_close(SD_Manager *sd);
+
+void sd_stream_report(const SD_Manager *sd);
+
 /**
  * Unmount the SD card
  */
@@ -17,6 +17,10 @@
 // MQTT Topics for picos
 #define TOPIC_PICO1 "pico1/sensor/data"
 #define TOPIC_PICO2 "pico2/sensor/data"
+#define TOPIC_PICO2_BATCH "pico2/sensor/batch"   // "age_ms:ppm,..." oldest first
+#define TOPIC_PICO2_SUMMARY "pico2/sensor/summary"   // one record per NORMAL window
+#define TOPIC_PICO2_BACKLOG "pico2/backlog/data"   // "age_ms:" + a TOPIC_PICO2 payload queued offline
+#define TOPIC_PICO2_SUMMARY_BACKLOG "pico2/backlog/summary"   // same for TOPIC_PICO2_SUMMARY
 #define TOPIC_PREDICTION "pico4/prediction"
 
 #endif
\ No newline at end of file
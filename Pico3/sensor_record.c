@@ -0,0 +1,117 @@
+#include "sensor_record.h"
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint16_t sr_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+size_t sr_encode(const sensor_record_t *rec, uint8_t *buf, size_t buf_len) {
+    if (!rec || !buf || rec->count == 0 || rec->count > SR_MAX_VALUES) {
+        return 0;
+    }
+
+    size_t len = SR_HEADER_LEN + 4u * rec->count + 2u;
+    if (buf_len < len) {
+        return 0;
+    }
+
+    buf[0] = SR_MAGIC;
+    buf[1] = SR_VERSION;
+    buf[2] = rec->type;
+    buf[3] = rec->count;
+    put_u16(&buf[4], rec->seq);
+    put_u32(&buf[6], rec->ts_ms);
+    for (uint8_t i = 0; i < rec->count; i++) {
+        put_u32(&buf[SR_HEADER_LEN + 4u * i], (uint32_t)rec->values[i]);
+    }
+    put_u16(&buf[len - 2], sr_crc16(buf, len - 2));
+
+    return len;
+}
+
+sr_status_t sr_decode(const uint8_t *buf, size_t len, sensor_record_t *out) {
+    if (!buf || !out) {
+        return SR_ERR_INVAL;
+    }
+    if (len < SR_HEADER_LEN + 4u + 2u) {
+        return SR_ERR_LENGTH;
+    }
+    if (buf[0] != SR_MAGIC) {
+        return SR_ERR_MAGIC;
+    }
+    if (buf[1] != SR_VERSION) {
+        return SR_ERR_VERSION;
+    }
+
+    uint8_t count = buf[3];
+    if (count == 0 || count > SR_MAX_VALUES ||
+        len != SR_HEADER_LEN + 4u * count + 2u) {
+        return SR_ERR_LENGTH;
+    }
+    if (get_u16(&buf[len - 2]) != sr_crc16(buf, len - 2)) {
+        return SR_ERR_CRC;
+    }
+
+    out->type = buf[2];
+    out->count = count;
+    out->seq = get_u16(&buf[4]);
+    out->ts_ms = get_u32(&buf[6]);
+    for (uint8_t i = 0; i < count; i++) {
+        out->values[i] = (int32_t)get_u32(&buf[SR_HEADER_LEN + 4u * i]);
+    }
+    return SR_OK;
+}
+
+const char *sr_prediction_label(int cls) {
+    static const char *const LABELS[] = { "NORMAL", "WARNING", "HIGH" };
+    if (cls < 0 || cls >= (int)(sizeof(LABELS) / sizeof(LABELS[0]))) {
+        return NULL;
+    }
+    return LABELS[cls];
+}
+
+bool sr_is_binary(const void *payload, size_t len) {
+    return payload && len > 0 && ((const uint8_t *)payload)[0] == SR_MAGIC;
+}
+
+uint16_t sr_seq_gap(int32_t *last, uint16_t seq) {
+    uint16_t gap = 0;
+
+    if (*last >= 0) {
+        // A seq that went backwards (producer reboot, duplicate) is not loss
+        uint16_t delta = (uint16_t)(seq - (uint16_t)*last);
+        if (delta != 0 && delta < 0x8000u) {
+            gap = (uint16_t)(delta - 1u);
+        }
+    }
+    *last = seq;
+    return gap;
+}
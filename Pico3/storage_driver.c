@@ -0,0 +1,215 @@
+#include "storage_driver.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+
+#include "sd_driver.h"
+#include "ingest_queue.h"
+#include "log_buffer.h"
+
+_Static_assert((STORAGE_REQ_QUEUE_LEN & (STORAGE_REQ_QUEUE_LEN - 1)) == 0,
+               "STORAGE_REQ_QUEUE_LEN must be a power of two");
+
+// Touched by core1 only once storage_start() has returned
+static SD_Manager sd_mgr;
+static const char *log_dir = NULL;
+static volatile bool mounted = false;
+
+// Request ring: core0 only writes req_tail, core1 only writes req_head
+static storage_req_t *req_queue[STORAGE_REQ_QUEUE_LEN];
+static volatile uint32_t req_head = 0;
+static volatile uint32_t req_tail = 0;
+
+static volatile storage_stats_t stats;
+
+/* ==========================================================
+   Core0 side
+   ========================================================== */
+bool storage_submit(storage_req_t *req) {
+    uint32_t tail = req_tail;
+    if (tail - req_head == STORAGE_REQ_QUEUE_LEN) {
+        stats.rejected++;
+        return false;
+    }
+
+    req->done = false;
+    req->result = -1;
+    req_queue[tail & (STORAGE_REQ_QUEUE_LEN - 1)] = req;
+    __mem_fence_release();   // request visible before the new tail
+    req_tail = tail + 1;
+    __sev();
+    return true;
+}
+
+bool storage_is_mounted(void) {
+    return mounted;
+}
+
+void storage_get_stats(storage_stats_t *out) {
+    out->reads         = stats.reads;
+    out->read_errors   = stats.read_errors;
+    out->rejected      = stats.rejected;
+    out->read_max_us   = stats.read_max_us;
+    out->read_total_us = stats.read_total_us;
+}
+
+void storage_report(void) {
+    storage_stats_t s;
+    storage_get_stats(&s);
+    uint32_t avg_us = s.reads ? (uint32_t)(s.read_total_us / s.reads) : 0;
+
+    printf("[STORAGE] reads=%lu errors=%lu rejected=%lu service avg=%lu us max=%lu us\n",
+           (unsigned long)s.reads, (unsigned long)s.read_errors,
+           (unsigned long)s.rejected, (unsigned long)avg_us,
+           (unsigned long)s.read_max_us);
+    sd_stream_report(&sd_mgr);
+}
+
+/* ==========================================================
+   Core1: reads
+   ========================================================== */
+static int32_t read_head(const char *path, char *buf, size_t maxlen) {
+    FIL f;
+    UINT br = 0;
+
+    FRESULT fr = f_open(&f, path, FA_READ);
+    if (fr != FR_OK) {
+        LOG_WARN("[STORAGE] open failed: %d\n", fr);
+        return -1;
+    }
+    f_read(&f, buf, (UINT)(maxlen - 1), &br);
+    f_close(&f);
+    buf[br] = '\0';
+    return (int32_t)br;
+}
+
+static int32_t read_log_tail(char *buf, size_t maxlen) {
+    if (!sd_mgr.log.open) {
+        return -1;
+    }
+    return (int32_t)sd_stream_read_tail(&sd_mgr, buf, maxlen);
+}
+
+static bool serve_request(void) {
+    uint32_t head = req_head;
+    if (head == req_tail) {
+        return false;
+    }
+    __mem_fence_acquire();   // tail read before the request
+    storage_req_t *req = req_queue[head & (STORAGE_REQ_QUEUE_LEN - 1)];
+    req_head = head + 1;
+
+    uint64_t start_us = time_us_64();
+    int32_t result = -1;
+    if (req->maxlen > 0) {
+        if (req->op == STORAGE_READ_LOG_TAIL) {
+            result = read_log_tail(req->buf, req->maxlen);
+        } else if (req->path) {
+            result = read_head(req->path, req->buf, req->maxlen);
+        }
+    }
+    uint32_t took_us = (uint32_t)(time_us_64() - start_us);
+
+    stats.reads++;
+    stats.read_total_us += took_us;
+    if (took_us > stats.read_max_us) {
+        stats.read_max_us = took_us;
+    }
+    if (result < 0) {
+        stats.read_errors++;
+    }
+
+    req->service_us = took_us;
+    req->result = result;
+    __mem_fence_release();   // buffer and result visible before done
+    req->done = true;
+    __sev();
+    return true;
+}
+
+/* ==========================================================
+   Core1: log commits
+   Rows are drained in batches of at most INGEST_BATCH_MAX, so a
+   pending read waits for one batch at most.
+   ========================================================== */
+static void commit_batch(void) {
+    uint64_t start_us = time_us_64();
+    uint32_t rows = 0;
+    const char *row;
+    size_t len;
+
+    while (rows < INGEST_BATCH_MAX && (row = ingest_peek(&len)) != NULL) {
+        sd_stream_append(&sd_mgr, row, len);
+        ingest_pop();
+        rows++;
+    }
+    if (rows > 0) {
+        ingest_note_batch(rows, (uint32_t)(time_us_64() - start_us));
+    }
+}
+
+static bool storage_mount(void) {
+    if (!sd_init(&sd_mgr)) {
+        printf("FATAL: SD card initialization failed!\n");
+        return false;
+    }
+
+    // SD_BENCHMARK: sequential I/O at the hw_config clock, then again
+    // after the clock probe has raised it
+#if SD_BENCHMARK
+    sd_benchmark(&sd_mgr);
+#endif
+    sd_negotiate_baud(&sd_mgr);
+#if SD_BENCHMARK
+    sd_benchmark(&sd_mgr);
+#endif
+
+    // Rows go to pre-allocated log segments, resumed where the last run
+    // stopped and flushed every few seconds
+    if (!sd_stream_open(&sd_mgr, log_dir, 0, 0)) {
+        printf("FATAL: Could not open CSV log for appending\n");
+        return false;
+    }
+    return true;
+}
+
+static void storage_core1_entry(void) {
+    mounted = storage_mount();
+    multicore_fifo_push_blocking(mounted ? 1u : 0u);
+
+    uint32_t last_commit_ms = to_ms_since_boot(get_absolute_time());
+    while (mounted) {
+        if (serve_request()) {
+            continue;
+        }
+
+        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+        uint32_t pending = ingest_pending();
+        if (pending >= INGEST_BATCH_WAKE ||
+            (pending > 0 && now_ms - last_commit_ms >= INGEST_COMMIT_INTERVAL_MS)) {
+            commit_batch();
+            last_commit_ms = now_ms;
+            continue;
+        }
+
+        // Keep going while the next log segment is being zero-filled;
+        // requests and commits still get a turn between steps
+        if (sd_stream_poll(&sd_mgr)) {
+            continue;
+        }
+        // ingest_push() and storage_submit() both raise an event
+        best_effort_wfe_or_timeout(make_timeout_time_ms(INGEST_COMMIT_INTERVAL_MS));
+    }
+
+    while (true) {
+        __wfe();
+    }
+}
+
+bool storage_start(const char *dir) {
+    log_dir = dir;
+    multicore_launch_core1(storage_core1_entry);
+    return multicore_fifo_pop_blocking() != 0;
+}
@@ -0,0 +1,58 @@
+#ifndef STORAGE_DRIVER_H
+#define STORAGE_DRIVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Core1 owns the SD card and FatFs; core0 never calls FatFs.
+// - Log rows reach core1 through the ingest queue (ingest_queue.h) and
+//   are committed in batches there.
+// - Reads are requests posted with storage_submit() and completed by
+//   core1 in the background. Core1 sets req->done and raises an event,
+//   so a core0 loop waiting in WFE sees it immediately.
+
+#define STORAGE_REQ_QUEUE_LEN      4      // requests in flight, power of two
+#define INGEST_COMMIT_INTERVAL_MS  250    // commit a part batch this often
+
+typedef enum {
+    STORAGE_READ_LOG_TAIL,   // up to maxlen - 1 bytes from the end of the sensor log
+    STORAGE_READ_FILE        // first maxlen - 1 bytes of path
+} storage_op_t;
+
+typedef struct {
+    storage_op_t op;
+    const char  *path;              // STORAGE_READ_FILE, must outlive the request
+    char        *buf;               // NUL-terminated on success
+    size_t       maxlen;
+    // Written by core1
+    volatile int32_t result;        // bytes read, or -1
+    volatile bool    done;
+    uint32_t     service_us;        // core1 time spent on the request
+} storage_req_t;
+
+typedef struct {
+    uint32_t reads;           // requests completed
+    uint32_t read_errors;     // completed with result -1
+    uint32_t rejected;        // storage_submit() found the queue full
+    uint32_t read_max_us;     // slowest request on core1
+    uint64_t read_total_us;
+} storage_stats_t;
+
+// Launch core1, which mounts the card and opens the segmented log in dir
+// as the append stream. Blocks until that is done; false if the card is
+// unusable.
+bool storage_start(const char *dir);
+
+bool storage_is_mounted(void);
+
+// Post a read. Core0 only, with the lwIP lock held or from an lwIP
+// callback (those are the only submitters). False if the queue is full.
+bool storage_submit(storage_req_t *req);
+
+void storage_get_stats(storage_stats_t *out);
+
+// Print the read counters and the append stream counters
+void storage_report(void);
+
+#endif
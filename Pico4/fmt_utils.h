@@ -0,0 +1,42 @@
+#ifndef FMT_UTILS_H
+#define FMT_UTILS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Small integer formatter for telemetry payloads and CSV rows. Avoids
+// snprintf on the publish path, which drags newlib's printf core (and its
+// float support) into the hot loop. Identical copies live in Pico2/3/4.
+
+typedef struct {
+    char   *buf;
+    size_t  size;       // capacity including the terminating NUL
+    size_t  len;        // characters written so far
+    bool    overflow;   // set once anything failed to fit
+} fmt_buf_t;
+
+// Start writing into buf (size >= 1). buf is kept NUL-terminated.
+void fmt_init(fmt_buf_t *f, char *buf, size_t size);
+
+// Append helpers. An item that does not fit is dropped whole and the
+// overflow flag is set; later appends become no-ops.
+void fmt_put_char(fmt_buf_t *f, char c);
+void fmt_put_str(fmt_buf_t *f, const char *s);
+void fmt_put_mem(fmt_buf_t *f, const char *s, size_t n);
+void fmt_put_u32(fmt_buf_t *f, uint32_t v);
+void fmt_put_u64(fmt_buf_t *f, uint64_t v);
+void fmt_put_i32(fmt_buf_t *f, int32_t v);
+// Signed Q16.16 with a fixed number of decimals (0..4), rounded half-up
+void fmt_put_q16(fmt_buf_t *f, int32_t v, uint8_t decimals);
+
+// Drop everything after mark (a previous f->len), clearing overflow
+void fmt_rewind(fmt_buf_t *f, size_t mark);
+
+// Length written, or 0 if the output overflowed
+size_t fmt_finish(const fmt_buf_t *f);
+
+// Decimal digits of v into out (no NUL); returns the digit count (1..10)
+size_t fmt_u32_digits(char out[10], uint32_t v);
+
+#endif
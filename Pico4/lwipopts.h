@@ -62,6 +62,7 @@
 
 // MQTT Application settings
 #define LWIP_MQTT                   1     // Enable MQTT
+#define MQTT_VAR_HEADER_BUFFER_LEN  512   // deliver batched publishes unfragmented
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
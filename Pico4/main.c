@@ -7,6 +7,9 @@
 #include "wifi_driver.h"
 #include "mqtt_driver.h"
 #include "ml_inference.h"
+#include "fmt_utils.h"
+#include "log_buffer.h"
+#include "sensor_record.h"
 #include "secrets.h"
 
 // -----------------------------------------------------------------------------
@@ -26,12 +29,30 @@ static bool g_has_pico2 = false;
 void mqtt_message_callback(const char* topic, const char* payload, uint16_t payload_len) {
     if (!topic || !payload) return;
     
-    printf("[MQTT] Topic: '%s', Payload: %.*s\n", topic, payload_len, payload);
+    // Binary records (sensor_record.h) carry Q16.16 values: no float parsing
+    sensor_record_t rec;
+    bool binary = sr_is_binary(payload, payload_len);
+    if (binary && sr_decode((const uint8_t *)payload, payload_len, &rec) != SR_OK) {
+        printf("[ERROR] Bad binary record on %s (%u bytes)\n", topic, payload_len);
+        return;
+    }
+
+    if (binary) {
+        printf("[MQTT] Topic: '%s', record type=%u seq=%u\n", topic, rec.type, rec.seq);
+    } else {
+        printf("[MQTT] Topic: '%s', Payload: %.*s\n", topic, payload_len, payload);
+    }
 
-    // pico1: "LPG,CO,NH3"
+    // pico1: "LPG,CO,NH3" or SR_TYPE_GAS
     if (strcmp(topic, "pico1/sensor/data") == 0) {
         float lpg, co, nh3;
-        if (sscanf(payload, "%f,%f,%f", &lpg, &co, &nh3) == 3) {
+        if (binary && rec.type == SR_TYPE_GAS && rec.count >= 3) {
+            g_LPG = rec.values[0] / 65536.0f;
+            g_CO  = rec.values[1] / 65536.0f;
+            g_NH3 = rec.values[2] / 65536.0f;
+            g_has_pico1 = true;
+            printf("[DATA] pico1 update: LPG=%.2f CO=%.2f NH3=%.2f\n", g_LPG, g_CO, g_NH3);
+        } else if (!binary && sscanf(payload, "%f,%f,%f", &lpg, &co, &nh3) == 3) {
             g_LPG = lpg;
             g_CO = co;
             g_NH3 = nh3;
@@ -41,10 +62,14 @@ void mqtt_message_callback(const char* topic, const char* payload, uint16_t payl
             printf("[ERROR] Failed to parse pico1 data: %.*s\n", payload_len, payload);
         }
     }
-    // pico2: "CO2"
+    // pico2: "CO2" or SR_TYPE_CO2
     else if (strcmp(topic, "pico2/sensor/data") == 0) {
         float co2;
-        if (sscanf(payload, "%f", &co2) == 1) {
+        if (binary && rec.type == SR_TYPE_CO2) {
+            g_CO2 = rec.values[0] / 65536.0f;
+            g_has_pico2 = true;
+            printf("[DATA] pico2 update: CO2=%.2f\n", g_CO2);
+        } else if (!binary && sscanf(payload, "%f", &co2) == 1) {
             g_CO2 = co2;
             g_has_pico2 = true;
             printf("[DATA] pico2 update: CO2=%.2f\n", co2);
@@ -52,6 +77,39 @@ void mqtt_message_callback(const char* topic, const char* payload, uint16_t payl
             printf("[ERROR] Failed to parse pico2 data: %.*s\n", payload_len, payload);
         }
     }
+    // pico2 batch: "age_ms:ppm,..." oldest first -> use the newest entry
+    else if (strcmp(topic, TOPIC_PICO2_BATCH) == 0) {
+        const char* last = strrchr(payload, ',');
+        const char* entry = last ? last + 1 : payload;
+        const char* colon = strchr(entry, ':');
+        float co2;
+        if (colon && sscanf(colon + 1, "%f", &co2) == 1) {
+            g_CO2 = co2;
+            g_has_pico2 = true;
+            printf("[DATA] pico2 batch update: CO2=%.2f\n", co2);
+        } else {
+            printf("[ERROR] Failed to parse pico2 batch: %.*s\n", payload_len, payload);
+        }
+    }
+    // pico2 window summary (NORMAL mode): classify on the window maximum so
+    // a spike between publishes isn't averaged away
+    else if (strcmp(topic, TOPIC_PICO2_SUMMARY) == 0) {
+        float co2_max;
+        if (binary && rec.type == SR_TYPE_CO2_SUMMARY && rec.count > SR_SUMMARY_MAX) {
+            g_CO2 = rec.values[SR_SUMMARY_MAX] / 65536.0f;
+            g_has_pico2 = true;
+            printf("[DATA] pico2 summary: n=%ld mean=%.1f max=%.1f slope=%.2f/min\n",
+                   (long)(rec.values[SR_SUMMARY_COUNT] >> 16),
+                   rec.values[SR_SUMMARY_MEAN] / 65536.0f, g_CO2,
+                   rec.values[SR_SUMMARY_SLOPE] / 65536.0f);
+        } else if (!binary && sscanf(payload, "%*u,%*f,%f", &co2_max) == 1) {
+            g_CO2 = co2_max;
+            g_has_pico2 = true;
+            printf("[DATA] pico2 summary: max=%.1f\n", co2_max);
+        } else {
+            printf("[ERROR] Failed to parse pico2 summary: %.*s\n", payload_len, payload);
+        }
+    }
     else {
         printf("[WARNING] Unknown topic: %s\n", topic);
     }
@@ -66,9 +124,28 @@ static void print_classification(int cls) {
         printf("[ML] Prediction: %s\n", levels[cls]);
         
         // Publish prediction to MQTT
+        // QoS1 so the broker queues it for Pico2's persistent session;
+        // retained so any (re)subscriber gets the current level right after
+        // SUBACK instead of waiting for the next prediction
+#if SR_PAYLOAD_BINARY
+        static uint16_t seq = 0;
+        uint8_t prediction_msg[SR_MAX_LEN];
+        sensor_record_t rec = {
+            .type   = SR_TYPE_PREDICTION,
+            .count  = 1,
+            .seq    = seq++,
+            .ts_ms  = to_ms_since_boot(get_absolute_time()),
+            .values = { cls * 65536 }
+        };
+        size_t len = sr_encode(&rec, prediction_msg, sizeof(prediction_msg));
+        mqtt_publish_data(TOPIC_PREDICTION, prediction_msg, (uint16_t)len, 1, 1);
+#else
         char prediction_msg[32];
-        snprintf(prediction_msg, sizeof(prediction_msg), "%s", levels[cls]);
-        mqtt_publish_message(TOPIC_PREDICTION, prediction_msg, 0, 0);
+        fmt_buf_t msg;
+        fmt_init(&msg, prediction_msg, sizeof(prediction_msg));
+        fmt_put_str(&msg, levels[cls]);
+        mqtt_publish_message(TOPIC_PREDICTION, prediction_msg, 1, 1);
+#endif
         printf("[MQTT] Published prediction: %s\n", levels[cls]);
     } else {
         printf("[ML] ERROR (code=%d)\n", cls);
@@ -89,6 +166,7 @@ static void test_ml_inference(void) {
 // -----------------------------------------------------------------------------
 int main() {
     stdio_init_all();
+    log_init();
     sleep_ms(2000);  // Wait for serial connection
     
     printf("\n=== Pico4 ML Inference Node ===\n");
@@ -148,7 +226,20 @@ int main() {
         printf("WARNING: Failed to subscribe to %s\n", TOPIC_PICO2);
     }
     
-    printf("Subscribed to topics:\n- %s\n- %s\n", TOPIC_PICO1, TOPIC_PICO2);
+    if (mqtt_subscribe_topic(TOPIC_PICO2_BATCH, 0) != MQTT_OK) {
+        printf("WARNING: Failed to subscribe to %s\n", TOPIC_PICO2_BATCH);
+    }
+    
+    if (mqtt_subscribe_topic(TOPIC_PICO2_SUMMARY, 0) != MQTT_OK) {
+        printf("WARNING: Failed to subscribe to %s\n", TOPIC_PICO2_SUMMARY);
+    }
+
+    // Not pico2/backlog/#: Pico2 replays readings it queued during an
+    // outage there, after the live value. g_CO2 takes whatever arrives
+    // last, so they would overwrite the current reading.
+    
+    printf("Subscribed to topics:\n- %s\n- %s\n- %s\n- %s\n",
+           TOPIC_PICO1, TOPIC_PICO2, TOPIC_PICO2_BATCH, TOPIC_PICO2_SUMMARY);
 
     // -------------------------------------------------------------------------
     // 3. Initialize ML Inference
@@ -198,6 +289,7 @@ int main() {
             printf("Waiting for new sensor data...\n");
         }
 
+        log_drain(0);
         sleep_ms(100);
     }
 
@@ -1,5 +1,6 @@
 #include "mqtt_driver.h"
 #include "secrets.h"
+#include "log_buffer.h"
 #include <stdio.h>
 #include <string.h>
 #include "pico/stdlib.h"
@@ -14,17 +15,17 @@ static char current_topic[64] = "";
 // MQTT connection callback
 static void mqtt_connection_cb(mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
     if (status == MQTT_CONNECT_ACCEPTED) {
-        printf("MQTT connected\n");
+        LOG_INFO("MQTT connected\n");
         mqtt_status = MQTT_STATUS_CONNECTED;
     } else {
-        printf("MQTT connection failed (status=%d)\n", status);
+        LOG_ERROR("MQTT connection failed (status=%d)\n", status);
         mqtt_status = MQTT_STATUS_ERROR;
     }
 }
 
 // MQTT incoming publish callback - store the topic
 static void mqtt_incoming_publish_cb(void *arg, const char *topic, u32_t tot_len) {
-    printf("[DEBUG] Incoming publish - Topic: '%s', Length: %lu\n", topic ? topic : "NULL", (unsigned long)tot_len);
+    LOG_DEBUG("[DEBUG] Incoming publish - Length: %lu\n", tot_len);
     
     // Store the topic for the data callback
     if (topic) {
@@ -43,13 +44,11 @@ static void mqtt_incoming_data_cb(void *arg, const u8_t *data, u16_t len, u8_t f
         memcpy(payload, data, len);
         payload[len] = '\0';
         
-        printf("[DEBUG] Data callback - Topic: '%s', Payload: %s\n", current_topic, payload);
+        LOG_DEBUG("[DEBUG] Data callback - %u bytes\n", len);
         
         if (user_callback && current_topic[0] != '\0') {
             user_callback(current_topic, payload, len);
         }
-        
-        printf("Received: %s\n", payload);
     }
     
     // Clear topic for next message
@@ -59,18 +58,18 @@ static void mqtt_incoming_data_cb(void *arg, const u8_t *data, u16_t len, u8_t f
 // MQTT subscribe callback
 static void mqtt_sub_request_cb(void *arg, err_t result) {
     if (result == ERR_OK) {
-        printf("Subscribe successful\n");
+        LOG_INFO("Subscribe successful\n");
     } else {
-        printf("Subscribe failed (err=%d)\n", result);
+        LOG_WARN("Subscribe failed (err=%d)\n", result);
     }
 }
 
 // MQTT publish callback
 static void mqtt_pub_request_cb(void *arg, err_t result) {
     if (result == ERR_OK) {
-        printf("Publish successful\n");
+        LOG_DEBUG("Publish successful\n");
     } else {
-        printf("Publish failed (err=%d)\n", result);
+        LOG_WARN("Publish failed (err=%d)\n", result);
     }
 }
 
@@ -135,7 +134,7 @@ int mqtt_connect(const char* broker_ip, uint16_t port, mqtt_message_callback_t c
     return MQTT_OK;
 }
 
-int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, uint8_t retain) {
+int mqtt_publish_data(const char* topic, const void* data, uint16_t len, uint8_t qos, uint8_t retain) {
     if (mqtt_status != MQTT_STATUS_CONNECTED) {
         printf("MQTT not connected\n");
         return MQTT_ERROR;
@@ -143,8 +142,8 @@ int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, ui
     
     err_t err = mqtt_publish(mqtt_client, 
                             topic, 
-                            payload, 
-                            strlen(payload), 
+                            data, 
+                            len, 
                             qos, 
                             retain, 
                             mqtt_pub_request_cb, 
@@ -158,6 +157,10 @@ int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, ui
     return MQTT_OK;
 }
 
+int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, uint8_t retain) {
+    return mqtt_publish_data(topic, payload, (uint16_t)strlen(payload), qos, retain);
+}
+
 int mqtt_subscribe_topic(const char* topic, uint8_t qos) {
     if (mqtt_status != MQTT_STATUS_CONNECTED) {
         printf("MQTT not connected\n");
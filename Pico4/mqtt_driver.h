@@ -28,6 +28,9 @@ int mqtt_connect(const char* broker_ip, uint16_t port, mqtt_message_callback_t c
 // Publish message (renamed to avoid conflict)
 int mqtt_publish_message(const char* topic, const char* payload, uint8_t qos, uint8_t retain);
 
+// Publish len raw bytes (binary payloads may contain NULs)
+int mqtt_publish_data(const char* topic, const void* data, uint16_t len, uint8_t qos, uint8_t retain);
+
 // Subscribe to topic (renamed to avoid conflict)
 int mqtt_subscribe_topic(const char* topic, uint8_t qos);
 
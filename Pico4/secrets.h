@@ -15,6 +15,8 @@
 //Each Pico should have its own unique topic to avoid message conflicts
 #define TOPIC_PICO1 "pico1/sensor/data"
 #define TOPIC_PICO2 "pico2/sensor/data"
+#define TOPIC_PICO2_BATCH "pico2/sensor/batch"   // "age_ms:ppm,..." oldest first
+#define TOPIC_PICO2_SUMMARY "pico2/sensor/summary"   // one record per NORMAL window
 #define TOPIC_PREDICTION "pico4/prediction"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,701 @@
+#include "fake_fatfs.h"
+#include "fake_pico.h"
+#include "diskio.h"
+#include "hw_config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SS              512u
+#define FAT_EOC         0x0FFFFFFFu
+#define DIR_SECTORS     8u
+#define DIR_ENTRY_SIZE  32u
+#define DIR_NAME_LEN    20u   // full path, NUL included
+#define DIR_PER_SECTOR  (SS / DIR_ENTRY_SIZE)
+#define VOL_MAGIC       0x46414B45u   // "FAKE"
+
+#define FA_MODIFIED     0x40
+#define FA_DIRTY        0x80
+
+fake_disk_stats_t fake_disk;
+jmp_buf fake_disk_cut_jmp;
+
+static uint8_t *card;
+static uint32_t card_sectors;
+static bool     cut_armed;
+static uint32_t cut_left;
+static uint32_t read_max_hz;
+static uint32_t write_max_hz;
+
+static FATFS *vol;   // mounted volume
+
+// SPI clock, hw_config.c's 12.5 MHz at start. spi_set_baudrate() changes
+// the clock in use, not spi_t.baud_rate, as on the board
+#define FAKE_SPI_DEFAULT_HZ  (12500 * 1000)
+
+static spi_t fake_spi = { .hw_inst = NULL, .baud_rate = FAKE_SPI_DEFAULT_HZ };
+static sd_card_t fake_card = { .pcName = "0:", .spi = &fake_spi };
+static uint32_t fake_spi_hz = FAKE_SPI_DEFAULT_HZ;
+
+/* ==========================================================
+   Card
+   ========================================================== */
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void card_time(uint32_t us) {
+    fake_disk.busy_us += us;
+    fake_pico_advance_us(us);
+}
+
+const uint8_t *fake_disk_sector(LBA_t sector) {
+    return &card[(size_t)sector * SS];
+}
+
+void fake_disk_arm_cut(uint32_t sector_writes) {
+    cut_armed = true;
+    cut_left = sector_writes;
+}
+
+void fake_disk_disarm(void) {
+    cut_armed = false;
+}
+
+void fake_disk_set_max_baud(uint32_t read_hz, uint32_t write_hz) {
+    read_max_hz = read_hz;
+    write_max_hz = write_hz;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (count == 0 || sector + count > card_sectors) {
+        return RES_PARERR;
+    }
+    memcpy(buff, &card[(size_t)sector * SS], (size_t)count * SS);
+    if (read_max_hz && fake_spi_hz > read_max_hz) {
+        buff[(size_t)count * SS / 2] ^= 0x10;
+    }
+    fake_disk.reads++;
+    fake_disk.read_sectors += count;
+    card_time(FAKE_DISK_CMD_US + count * FAKE_DISK_SECTOR_US);
+    return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    if (count == 0 || sector + count > card_sectors) {
+        return RES_PARERR;
+    }
+    fake_disk.writes++;
+    for (UINT i = 0; i < count; i++) {
+        if (cut_armed && cut_left-- == 0) {
+            cut_armed = false;
+            vol = NULL;
+            longjmp(fake_disk_cut_jmp, 1);
+        }
+        memcpy(&card[(size_t)(sector + i) * SS], &buff[(size_t)i * SS], SS);
+        if (write_max_hz && fake_spi_hz > write_max_hz) {
+            card[(size_t)(sector + i) * SS + SS / 2] ^= 0x10;
+        }
+        fake_disk.write_sectors++;
+    }
+    card_time(FAKE_DISK_CMD_US + count * FAKE_DISK_SECTOR_US + FAKE_DISK_WRITE_BUSY_US);
+    return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    if (cmd == CTRL_SYNC) {
+        fake_disk.syncs++;
+    }
+    return RES_OK;
+}
+
+/* ==========================================================
+   Volume layout: sector 0 describes it, then FAT, a flat
+   directory of full paths, and the clusters
+   ========================================================== */
+void fake_fatfs_format(uint32_t sectors, uint16_t csize) {
+    free(card);
+    card = malloc((size_t)sectors * SS);
+    card_sectors = sectors;
+    // Old card contents: never zero, so stale data can't pass for blank
+    uint32_t x = 1;
+    for (size_t i = 0; i < (size_t)sectors * SS; i++) {
+        x = x * 1103515245u + 12345u;
+        card[i] = (uint8_t)((x >> 16) | 1);
+    }
+
+    uint32_t fat_sectors = (sectors / csize + 2) * 4 / SS + 1;
+    LBA_t fatbase = 1;
+    LBA_t dirbase = fatbase + fat_sectors;
+    LBA_t database = dirbase + DIR_SECTORS;
+    uint32_t n_fatent = (sectors - database) / csize + 2;
+
+    memset(card, 0, (size_t)database * SS);
+    put_le32(&card[0], VOL_MAGIC);
+    put_le32(&card[4], csize);
+    put_le32(&card[8], n_fatent);
+    put_le32(&card[12], fatbase);
+    put_le32(&card[16], dirbase);
+    put_le32(&card[20], database);
+
+    memset(&fake_disk, 0, sizeof(fake_disk));
+    cut_armed = false;
+    read_max_hz = write_max_hz = 0;
+    vol = NULL;
+    fake_spi.baud_rate = FAKE_SPI_DEFAULT_HZ;
+    fake_spi_hz = FAKE_SPI_DEFAULT_HZ;
+}
+
+// FatFs's move_window(): one cached sector, written back before it moves
+static FRESULT move_window(LBA_t sect) {
+    if (sect == vol->winsect) {
+        return FR_OK;
+    }
+    if (vol->wflag) {
+        if (disk_write(vol->pdrv, vol->win, vol->winsect, 1) != RES_OK) {
+            return FR_DISK_ERR;
+        }
+        vol->wflag = 0;
+    }
+    if (disk_read(vol->pdrv, vol->win, sect, 1) != RES_OK) {
+        vol->winsect = (LBA_t)-1;
+        return FR_DISK_ERR;
+    }
+    vol->winsect = sect;
+    return FR_OK;
+}
+
+static FRESULT sync_fs(void) {
+    if (vol->wflag) {
+        if (disk_write(vol->pdrv, vol->win, vol->winsect, 1) != RES_OK) {
+            return FR_DISK_ERR;
+        }
+        vol->wflag = 0;
+    }
+    return disk_ioctl(vol->pdrv, CTRL_SYNC, NULL) == RES_OK ? FR_OK : FR_DISK_ERR;
+}
+
+static LBA_t clst2sect(DWORD clst) {
+    return vol->database + (LBA_t)vol->csize * (clst - 2);
+}
+
+static bool valid_clst(DWORD clst) {
+    return clst >= 2 && clst < vol->n_fatent;
+}
+
+static DWORD get_fat(DWORD clst) {
+    if (move_window(vol->fatbase + clst / (SS / 4)) != FR_OK) {
+        return 1;   // FatFs's "disk error" value
+    }
+    return get_le32(&vol->win[(clst % (SS / 4)) * 4]) & 0x0FFFFFFFu;
+}
+
+static FRESULT put_fat(DWORD clst, DWORD val) {
+    FRESULT fr = move_window(vol->fatbase + clst / (SS / 4));
+    if (fr == FR_OK) {
+        put_le32(&vol->win[(clst % (SS / 4)) * 4], val);
+        vol->wflag = 1;
+    }
+    return fr;
+}
+
+// Next cluster after prev, allocating one if the chain ends there.
+// prev 0 starts a new chain. Returns 0 when the disk is full, 1 on error.
+static DWORD create_chain(DWORD prev) {
+    if (prev) {
+        DWORD nxt = get_fat(prev);
+        if (nxt == 1 || valid_clst(nxt)) {
+            return nxt;
+        }
+    }
+    DWORD scl = valid_clst(vol->last_clst) ? vol->last_clst : 2;
+    DWORD clst = scl;
+    for (;;) {
+        clst = clst + 1 < vol->n_fatent ? clst + 1 : 2;
+        DWORD v = get_fat(clst);
+        if (v == 1) return 1;
+        if (v == 0) break;
+        if (clst == scl) return 0;
+    }
+    if (put_fat(clst, FAT_EOC) != FR_OK || (prev && put_fat(prev, clst) != FR_OK)) {
+        return 1;
+    }
+    vol->last_clst = clst;
+    return clst;
+}
+
+static FRESULT remove_chain(DWORD clst) {
+    while (valid_clst(clst)) {
+        DWORD nxt = get_fat(clst);
+        if (nxt == 1 || put_fat(clst, 0) != FR_OK) {
+            return FR_DISK_ERR;
+        }
+        clst = nxt;
+    }
+    return FR_OK;
+}
+
+/* ---- directory ---- */
+// Entry: name[20], attr, 3 spare, first cluster, size
+
+static FRESULT dir_find(const char *path, LBA_t *sect, BYTE **ent) {
+    for (LBA_t s = vol->dirbase; s < vol->dirbase + DIR_SECTORS; s++) {
+        if (move_window(s) != FR_OK) {
+            return FR_DISK_ERR;
+        }
+        for (uint32_t i = 0; i < DIR_PER_SECTOR; i++) {
+            BYTE *e = &vol->win[i * DIR_ENTRY_SIZE];
+            if (e[0] != 0 && strncmp((const char *)e, path, DIR_NAME_LEN) == 0) {
+                *sect = s;
+                *ent = e;
+                return FR_OK;
+            }
+        }
+    }
+    return FR_NO_FILE;
+}
+
+static FRESULT dir_register(const char *path, BYTE attr, LBA_t *sect, BYTE **ent) {
+    if (strlen(path) >= DIR_NAME_LEN) {
+        return FR_INVALID_NAME;
+    }
+    // Parent has to exist
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        char parent[DIR_NAME_LEN];
+        LBA_t ps;
+        BYTE *pe;
+        memcpy(parent, path, (size_t)(slash - path));
+        parent[slash - path] = '\0';
+        if (dir_find(parent, &ps, &pe) != FR_OK || !(pe[DIR_NAME_LEN] & AM_DIR)) {
+            return FR_NO_PATH;
+        }
+    }
+    for (LBA_t s = vol->dirbase; s < vol->dirbase + DIR_SECTORS; s++) {
+        if (move_window(s) != FR_OK) {
+            return FR_DISK_ERR;
+        }
+        for (uint32_t i = 0; i < DIR_PER_SECTOR; i++) {
+            BYTE *e = &vol->win[i * DIR_ENTRY_SIZE];
+            if (e[0] == 0) {
+                memset(e, 0, DIR_ENTRY_SIZE);
+                strcpy((char *)e, path);
+                e[DIR_NAME_LEN] = attr;
+                vol->wflag = 1;
+                *sect = s;
+                *ent = e;
+                return FR_OK;
+            }
+        }
+    }
+    return FR_DENIED;
+}
+
+bool fake_fatfs_stat(const char *path, uint32_t *size, LBA_t *first_sector) {
+    LBA_t dirbase = get_le32(&card[16]);
+    LBA_t database = get_le32(&card[20]);
+    uint32_t csize = get_le32(&card[4]);
+
+    for (LBA_t s = dirbase; s < dirbase + DIR_SECTORS; s++) {
+        for (uint32_t i = 0; i < DIR_PER_SECTOR; i++) {
+            const uint8_t *e = &card[(size_t)s * SS + i * DIR_ENTRY_SIZE];
+            if (e[0] != 0 && strncmp((const char *)e, path, DIR_NAME_LEN) == 0) {
+                DWORD clst = get_le32(&e[24]);
+                *size = get_le32(&e[28]);
+                *first_sector = clst >= 2 ? database + csize * (clst - 2) : 0;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* ==========================================================
+   FatFs API
+   ========================================================== */
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt) {
+    memset(fs, 0, sizeof(*fs));
+    vol = fs;
+    if (disk_read(0, fs->win, 0, 1) != RES_OK) {
+        vol = NULL;
+        return FR_DISK_ERR;
+    }
+    if (get_le32(&fs->win[0]) != VOL_MAGIC) {
+        vol = NULL;
+        return FR_NO_FILESYSTEM;
+    }
+    fs->fs_type = 3;
+    fs->csize = (WORD)get_le32(&fs->win[4]);
+    fs->n_fatent = get_le32(&fs->win[8]);
+    fs->fatbase = get_le32(&fs->win[12]);
+    fs->dirbase = get_le32(&fs->win[16]);
+    fs->database = get_le32(&fs->win[20]);
+    fs->winsect = 0;
+    fs->last_clst = 0;
+    return FR_OK;
+}
+
+FRESULT f_unmount(const TCHAR *path) {
+    vol = NULL;
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs) {
+    if (!vol || fp->obj.fs != vol) {
+        return FR_INVALID_OBJECT;
+    }
+    if (ofs > fp->obj.objsize && !(fp->flag & FA_WRITE)) {
+        ofs = fp->obj.objsize;
+    }
+    DWORD bcs = (DWORD)vol->csize * SS;
+    DWORD clst = fp->obj.sclust;
+    fp->fptr = 0;
+    if (ofs > 0 && clst) {
+        // Walk the chain to the cluster holding byte ofs - 1
+        FSIZE_t left = ofs;
+        while (left > bcs) {
+            DWORD nxt = (fp->flag & FA_WRITE) ? create_chain(clst) : get_fat(clst);
+            if (nxt == 1) return FR_DISK_ERR;
+            if (!valid_clst(nxt)) { ofs -= left - bcs; break; }
+            clst = nxt;
+            left -= bcs;
+        }
+        fp->clust = clst;
+        fp->fptr = ofs;
+        if (ofs > fp->obj.objsize) fp->obj.objsize = ofs;
+        if (ofs % SS) {
+            LBA_t sect = clst2sect(clst) + (LBA_t)((ofs - 1) / SS % vol->csize);
+            if (sect != fp->sect) {
+                if (fp->flag & FA_DIRTY) {
+                    if (disk_write(vol->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+                    fp->flag &= (BYTE)~FA_DIRTY;
+                }
+                if (disk_read(vol->pdrv, fp->buf, sect, 1) != RES_OK) return FR_DISK_ERR;
+                fp->sect = sect;
+            }
+        }
+    } else {
+        fp->clust = clst;
+    }
+    return FR_OK;
+}
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode) {
+    LBA_t sect;
+    BYTE *ent;
+
+    memset(fp, 0, sizeof(*fp));
+    if (!vol) {
+        return FR_NOT_ENABLED;
+    }
+    FRESULT fr = dir_find(path, &sect, &ent);
+    bool modified = false;
+    if (fr == FR_NO_FILE && (mode & (FA_CREATE_ALWAYS | FA_OPEN_ALWAYS | FA_CREATE_NEW))) {
+        fr = dir_register(path, 0, &sect, &ent);
+        modified = true;
+    } else if (fr == FR_OK) {
+        if (mode & FA_CREATE_NEW) return FR_EXIST;
+        if (ent[DIR_NAME_LEN] & AM_DIR) return FR_NO_FILE;
+        if (mode & FA_CREATE_ALWAYS) {
+            DWORD cl = get_le32(&ent[24]);
+            // Entry first, as FatFs does, then the chain
+            if ((fr = move_window(sect)) != FR_OK) return fr;
+            put_le32(&ent[24], 0);
+            put_le32(&ent[28], 0);
+            vol->wflag = 1;
+            if (cl && (fr = remove_chain(cl)) != FR_OK) return fr;
+            if ((fr = move_window(sect)) != FR_OK) return fr;
+            vol->last_clst = cl - 1;
+            modified = true;
+        }
+    }
+    if (fr != FR_OK) {
+        return fr;
+    }
+
+    fp->obj.fs = vol;
+    fp->obj.sclust = get_le32(&ent[24]);
+    fp->obj.objsize = get_le32(&ent[28]);
+    fp->dir_sect = sect;
+    fp->dir_ptr = ent;
+    fp->flag = (BYTE)(mode & (FA_READ | FA_WRITE)) | (modified ? FA_MODIFIED : 0);
+    fp->clust = fp->obj.sclust;
+    fp->sect = 0;
+    if ((mode & FA_OPEN_APPEND) == FA_OPEN_APPEND && fp->obj.objsize > 0) {
+        return f_lseek(fp, fp->obj.objsize);
+    }
+    return FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw) {
+    const BYTE *src = buff;
+    *bw = 0;
+    if (!vol || fp->obj.fs != vol) return FR_INVALID_OBJECT;
+    if (!(fp->flag & FA_WRITE)) return FR_DENIED;
+
+    while (btw > 0) {
+        if (fp->fptr % SS == 0) {
+            UINT csect = (UINT)(fp->fptr / SS % vol->csize);
+            if (csect == 0) {
+                DWORD clst;
+                if (fp->fptr == 0) {
+                    clst = fp->obj.sclust ? fp->obj.sclust : create_chain(0);
+                } else {
+                    clst = create_chain(fp->clust);
+                }
+                if (clst == 0) break;                       // disk full
+                if (clst == 1) return FR_DISK_ERR;
+                fp->clust = clst;
+                if (fp->obj.sclust == 0) fp->obj.sclust = clst;
+            }
+            if (fp->flag & FA_DIRTY) {
+                if (disk_write(vol->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+                fp->flag &= (BYTE)~FA_DIRTY;
+            }
+            LBA_t sect = clst2sect(fp->clust) + csect;
+            UINT cc = btw / SS;
+            if (cc > 0) {
+                // Whole sectors go straight to the card, up to the cluster end
+                if (csect + cc > vol->csize) cc = vol->csize - csect;
+                if (disk_write(vol->pdrv, src, sect, cc) != RES_OK) return FR_DISK_ERR;
+                if (fp->sect - sect < cc) {
+                    memcpy(fp->buf, src + (fp->sect - sect) * SS, SS);
+                }
+                UINT n = cc * SS;
+                fp->fptr += n; src += n; btw -= n; *bw += n;
+                if (fp->fptr > fp->obj.objsize) fp->obj.objsize = fp->fptr;
+                continue;
+            }
+            if (fp->sect != sect && fp->fptr < fp->obj.objsize &&
+                disk_read(vol->pdrv, fp->buf, sect, 1) != RES_OK) {
+                return FR_DISK_ERR;
+            }
+            fp->sect = sect;
+        }
+        UINT n = SS - (UINT)(fp->fptr % SS);
+        if (n > btw) n = btw;
+        memcpy(&fp->buf[fp->fptr % SS], src, n);
+        fp->flag |= FA_DIRTY;
+        fp->fptr += n; src += n; btw -= n; *bw += n;
+        if (fp->fptr > fp->obj.objsize) fp->obj.objsize = fp->fptr;
+    }
+    fp->flag |= FA_MODIFIED;
+    return FR_OK;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br) {
+    BYTE *dst = buff;
+    *br = 0;
+    if (!vol || fp->obj.fs != vol) return FR_INVALID_OBJECT;
+    if (!(fp->flag & FA_READ)) return FR_DENIED;
+    if (btr > fp->obj.objsize - fp->fptr) btr = (UINT)(fp->obj.objsize - fp->fptr);
+
+    while (btr > 0) {
+        if (fp->fptr % SS == 0) {
+            UINT csect = (UINT)(fp->fptr / SS % vol->csize);
+            if (csect == 0) {
+                DWORD clst = fp->fptr == 0 ? fp->obj.sclust : get_fat(fp->clust);
+                if (!valid_clst(clst)) return FR_INT_ERR;
+                fp->clust = clst;
+            }
+            LBA_t sect = clst2sect(fp->clust) + csect;
+            UINT cc = btr / SS;
+            if (cc > 0) {
+                if (csect + cc > vol->csize) cc = vol->csize - csect;
+                if (disk_read(vol->pdrv, dst, sect, cc) != RES_OK) return FR_DISK_ERR;
+                if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
+                    memcpy(dst + (fp->sect - sect) * SS, fp->buf, SS);
+                }
+                UINT n = cc * SS;
+                fp->fptr += n; dst += n; btr -= n; *br += n;
+                continue;
+            }
+            if (fp->sect != sect) {
+                if (fp->flag & FA_DIRTY) {
+                    if (disk_write(vol->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+                    fp->flag &= (BYTE)~FA_DIRTY;
+                }
+                if (disk_read(vol->pdrv, fp->buf, sect, 1) != RES_OK) return FR_DISK_ERR;
+            }
+            fp->sect = sect;
+        }
+        UINT n = SS - (UINT)(fp->fptr % SS);
+        if (n > btr) n = btr;
+        memcpy(dst, &fp->buf[fp->fptr % SS], n);
+        fp->fptr += n; dst += n; btr -= n; *br += n;
+    }
+    return FR_OK;
+}
+
+TCHAR *f_gets(TCHAR *buff, int len, FIL *fp) {
+    int n = 0;
+    UINT br;
+    while (n < len - 1) {
+        char c;
+        if (f_read(fp, &c, 1, &br) != FR_OK || br == 0) break;
+        buff[n++] = c;
+        if (c == '\n') break;
+    }
+    buff[n] = '\0';
+    return n ? buff : NULL;
+}
+
+FRESULT f_sync(FIL *fp) {
+    if (!vol || fp->obj.fs != vol) return FR_INVALID_OBJECT;
+    if (!(fp->flag & FA_MODIFIED)) return FR_OK;
+
+    if (fp->flag & FA_DIRTY) {
+        if (disk_write(vol->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+        fp->flag &= (BYTE)~FA_DIRTY;
+    }
+    FRESULT fr = move_window(fp->dir_sect);
+    if (fr != FR_OK) return fr;
+    put_le32(&fp->dir_ptr[24], fp->obj.sclust);
+    put_le32(&fp->dir_ptr[28], fp->obj.objsize);
+    vol->wflag = 1;
+    fr = sync_fs();
+    fp->flag &= (BYTE)~FA_MODIFIED;
+    return fr;
+}
+
+FRESULT f_close(FIL *fp) {
+    FRESULT fr = f_sync(fp);
+    if (fr == FR_OK) fp->obj.fs = NULL;
+    return fr;
+}
+
+FRESULT f_truncate(FIL *fp) {
+    if (!vol || fp->obj.fs != vol) return FR_INVALID_OBJECT;
+    if (!(fp->flag & FA_WRITE)) return FR_DENIED;
+    if (fp->fptr >= fp->obj.objsize) return FR_OK;
+
+    FRESULT fr;
+    if (fp->fptr == 0) {
+        fr = remove_chain(fp->obj.sclust);
+        fp->obj.sclust = 0;
+    } else {
+        DWORD nxt = get_fat(fp->clust);
+        fr = nxt == 1 ? FR_DISK_ERR : put_fat(fp->clust, FAT_EOC);
+        if (fr == FR_OK) fr = remove_chain(nxt);
+    }
+    fp->obj.objsize = fp->fptr;
+    fp->flag |= FA_MODIFIED;
+    return fr;
+}
+
+FRESULT f_expand(FIL *fp, FSIZE_t fsz, BYTE opt) {
+    if (!vol || fp->obj.fs != vol) return FR_INVALID_OBJECT;
+    if (fsz == 0 || fp->obj.objsize != 0 || !(fp->flag & FA_WRITE)) return FR_DENIED;
+
+    DWORD bcs = (DWORD)vol->csize * SS;
+    DWORD n = (DWORD)((fsz + bcs - 1) / bcs);
+    DWORD stcl = valid_clst(vol->last_clst) ? vol->last_clst : 2;
+    DWORD scl = stcl, clst = stcl, run = 0;
+
+    // First run of n free clusters, scanning the FAT from the last allocation
+    for (;;) {
+        DWORD v = get_fat(clst);
+        if (v == 1) return FR_DISK_ERR;
+        if (v == 0) {
+            if (run == 0) scl = clst;
+            if (++run == n) break;
+        } else {
+            run = 0;
+        }
+        clst++;
+        if (clst >= vol->n_fatent) { clst = 2; run = 0; }
+        if (clst == stcl) return FR_DENIED;
+    }
+    if (opt) {
+        for (DWORD c = scl; c < scl + n; c++) {
+            FRESULT fr = put_fat(c, c + 1 < scl + n ? c + 1 : FAT_EOC);
+            if (fr != FR_OK) return fr;
+        }
+        fp->obj.sclust = scl;
+        fp->obj.objsize = fsz;
+        fp->flag |= FA_MODIFIED;
+        vol->last_clst = scl + n - 1;
+    }
+    return FR_OK;
+}
+
+FRESULT f_unlink(const TCHAR *path) {
+    LBA_t sect;
+    BYTE *ent;
+    if (!vol) return FR_NOT_ENABLED;
+    FRESULT fr = dir_find(path, &sect, &ent);
+    if (fr != FR_OK) return fr;
+    DWORD cl = get_le32(&ent[24]);
+    ent[0] = 0;
+    vol->wflag = 1;
+    if (cl && (fr = remove_chain(cl)) != FR_OK) return fr;
+    return sync_fs();
+}
+
+FRESULT f_mkdir(const TCHAR *path) {
+    LBA_t sect;
+    BYTE *ent;
+    if (!vol) return FR_NOT_ENABLED;
+    if (dir_find(path, &sect, &ent) == FR_OK) return FR_EXIST;
+    FRESULT fr = dir_register(path, AM_DIR, &sect, &ent);
+    return fr == FR_OK ? sync_fs() : fr;
+}
+
+FRESULT f_opendir(DIR *dp, const TCHAR *path) {
+    LBA_t sect;
+    BYTE *ent;
+    if (!vol) return FR_NOT_ENABLED;
+    if (strlen(path) >= sizeof(dp->path)) return FR_INVALID_NAME;
+    if (path[0] && (dir_find(path, &sect, &ent) != FR_OK || !(ent[DIR_NAME_LEN] & AM_DIR))) {
+        return FR_NO_PATH;
+    }
+    memset(dp, 0, sizeof(*dp));
+    dp->obj.fs = vol;
+    strcpy(dp->path, path);
+    return FR_OK;
+}
+
+FRESULT f_closedir(DIR *dp) {
+    dp->obj.fs = NULL;
+    return FR_OK;
+}
+
+FRESULT f_readdir(DIR *dp, FILINFO *fno) {
+    size_t plen = strlen(dp->path);
+    fno->fname[0] = '\0';
+    while (dp->dptr < DIR_SECTORS * DIR_PER_SECTOR) {
+        if (move_window(vol->dirbase + dp->dptr / DIR_PER_SECTOR) != FR_OK) {
+            return FR_DISK_ERR;
+        }
+        const BYTE *e = &vol->win[(dp->dptr % DIR_PER_SECTOR) * DIR_ENTRY_SIZE];
+        dp->dptr++;
+        const char *name = (const char *)e;
+        if (e[0] == 0) continue;
+        if (plen) {
+            if (strncmp(name, dp->path, plen) != 0 || name[plen] != '/') continue;
+            name += plen + 1;
+        }
+        if (strchr(name, '/')) continue;
+        strcpy(fno->fname, name);
+        fno->fattrib = e[DIR_NAME_LEN];
+        fno->fsize = get_le32(&e[28]);
+        return FR_OK;
+    }
+    return FR_OK;
+}
+
+/* ==========================================================
+   FatFs_SPI glue
+   ========================================================== */
+sd_card_t *sd_get_by_num(size_t num) {
+    return num == 0 ? &fake_card : NULL;
+}
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate) {
+    fake_spi_hz = baudrate;
+    return baudrate;
+}
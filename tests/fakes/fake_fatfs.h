@@ -0,0 +1,69 @@
+#ifndef FAKE_FATFS_H
+#define FAKE_FATFS_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "ff.h"
+
+// RAM-disk SD card and a small FAT file system on it, for running
+// sd_driver.c on a host. The file system is not FatFs, but it moves
+// sectors the way FatFs R0.15 does for the calls the firmware makes: one
+// shared sector window for FAT and directory (written back when it
+// moves), a sector buffer per open file, the directory entry and window
+// written on f_sync()/f_close(), chains walked through the FAT on seeks.
+// So sector counts per operation, and the card time below, track what
+// the firmware would cause on a real card.
+//
+// Card time is a model, not a measurement: every command costs
+// FAKE_DISK_CMD_US, every sector FAKE_DISK_SECTOR_US, every write command
+// FAKE_DISK_WRITE_BUSY_US of busy time. The host clock (fakes/fake_pico.c)
+// advances by it, so time_us_64() around a driver call reads modelled
+// card time.
+
+#ifndef FAKE_DISK_CMD_US
+#define FAKE_DISK_CMD_US         40    // command, response and data token (assumed)
+#endif
+#ifndef FAKE_DISK_SECTOR_US
+#define FAKE_DISK_SECTOR_US      170   // 512 B + CRC at 25 MHz SPI
+#endif
+#ifndef FAKE_DISK_WRITE_BUSY_US
+#define FAKE_DISK_WRITE_BUSY_US  700   // programming after a write command (assumed)
+#endif
+
+typedef struct {
+    uint32_t reads;            // disk_read() calls
+    uint32_t read_sectors;
+    uint32_t writes;           // disk_write() calls
+    uint32_t write_sectors;
+    uint32_t syncs;            // CTRL_SYNC
+    uint64_t busy_us;          // modelled card time
+} fake_disk_stats_t;
+
+extern fake_disk_stats_t fake_disk;
+extern jmp_buf fake_disk_cut_jmp;
+
+// Fresh card of the given size, filled with non-zero garbage, formatted
+// with clusters of csize sectors. Nothing is mounted.
+void fake_fatfs_format(uint32_t sectors, uint16_t csize);
+
+// Direct view of the card, for checking contents
+const uint8_t *fake_disk_sector(LBA_t sector);
+
+// Cut power once sector_writes more sectors have been written: the write
+// in progress stops there (a multi-block write is torn) and control
+// longjmps to fake_disk_cut_jmp. All RAM state of the file system is
+// lost with it; f_mount() starts over from the card.
+void fake_disk_arm_cut(uint32_t sector_writes);
+void fake_disk_disarm(void);
+
+// Above read_hz (write_hz) of SPI clock, data read from (written to) the
+// card comes out with a flipped bit; 0 is no limit. Cleared by
+// fake_fatfs_format(), which also puts the clock back to 12.5 MHz.
+void fake_disk_set_max_baud(uint32_t read_hz, uint32_t write_hz);
+
+// Size and first sector of a file, or false if it doesn't exist, read
+// straight from the card (committed state only)
+bool fake_fatfs_stat(const char *path, uint32_t *size, LBA_t *first_sector);
+
+#endif
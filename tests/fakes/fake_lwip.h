@@ -0,0 +1,67 @@
+#ifndef FAKE_LWIP_H
+#define FAKE_LWIP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Counters and knobs for fake_lwip_mqtt.c: a broker that accepts every
+// connection and acknowledges every request on the next cyw43_arch_poll(),
+// publishes as set by fake_lwip_set_publish_outcome()
+
+typedef struct {
+    uint32_t mallocs;          // mem_malloc()/mem_calloc() calls
+    uint32_t frees;            // mem_free() calls
+    uint32_t pcbs_live;        // connections opened and not yet closed
+    uint32_t pcbs_opened;
+    uint32_t unlocked_calls;   // lwIP entered without cyw43_arch_lwip_begin()
+    uint32_t lock_depth;       // current nesting of the lwIP lock
+    uint32_t clean_session_sent;  // CONNECTs that still asked for a clean session
+    uint32_t stored_sent;      // session-stored QoS1 PUBLISHes sent after CONNACK
+    uint32_t pubacks;          // PUBACKs the client sent for them
+    uint32_t puback_bad_id;    // PUBACKs whose packet id matched no stored PUBLISH
+    uint32_t publishes;        // mqtt_publish() requests accepted
+} fake_lwip_stats_t;
+
+extern fake_lwip_stats_t fake_lwip;
+
+#define FAKE_PUBLISH_LOG 32
+
+typedef struct {
+    char     topic[64];
+    uint8_t  payload[80];
+    uint16_t len;
+    uint8_t  qos;
+} fake_publish_t;
+
+// The i-th publish accepted since the last reset (the first
+// FAKE_PUBLISH_LOG are kept), or NULL
+const fake_publish_t *fake_lwip_published(uint32_t i);
+
+typedef enum {
+    FAKE_PUB_ACK = 0,   // completed on the next cyw43_arch_poll() (default)
+    FAKE_PUB_HOLD,      // never answered; dropped on disconnect like the rest
+    FAKE_PUB_FAIL       // completed with ERR_TIMEOUT, as lwIP's request timer does
+} fake_pub_outcome_t;
+
+// How the broker answers publishes from now on, including held ones
+void fake_lwip_set_publish_outcome(fake_pub_outcome_t outcome);
+
+// After each SUBACK, deliver a retained publish on the subscribed topic
+void fake_lwip_set_retained(bool on, const void *payload, uint16_t len);
+
+// Queue a QoS1 PUBLISH in the broker's copy of our session. It is sent
+// right after the next CONNACK if that CONNECT asked for a persistent
+// session (session present); a clean-session CONNECT discards it.
+bool fake_lwip_store_publish(const char *topic, const void *payload, uint16_t len);
+
+// Stored publishes the client has not PUBACKed yet
+uint32_t fake_lwip_stored_pending(void);
+
+void fake_lwip_reset(void);
+
+// lwIP's heap, as the client would use it
+void *mem_malloc(uint16_t size);
+void *mem_calloc(uint16_t count, uint16_t size);
+void mem_free(void *mem);
+
+#endif
@@ -0,0 +1,359 @@
+#include "fake_lwip.h"
+#include "lwip/apps/mqtt_priv.h"
+#include "pico/cyw43_arch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Stand-in for lwIP's MQTT client and the cyw43 poll loop. It keeps the
+// parts of mqtt_client_t the firmware reaches into (output ring, rx
+// buffer) laid out and filled the way lwIP 2.2 does.
+
+#define ERR_ISCONN -10
+
+fake_lwip_stats_t fake_lwip;
+
+typedef struct {
+    mqtt_request_cb_t cb;
+    void *arg;
+    bool  subscribe;
+    bool  publish;
+    char  topic[64];
+} fake_req_t;
+
+static fake_req_t reqs[MQTT_REQ_MAX_IN_FLIGHT];
+static uint32_t   n_reqs;
+static bool       connecting;
+static mqtt_client_t *polled_client;   // the last client connected
+
+static fake_publish_t     published[FAKE_PUBLISH_LOG];
+static fake_pub_outcome_t pub_outcome;
+
+static bool        retained_on;
+static uint8_t     retained_payload[64];
+static uint16_t    retained_len;
+
+// Broker side of a persistent session: QoS1 messages kept for us
+#define FAKE_STORED_MAX 8
+
+typedef struct {
+    char     topic[64];
+    uint8_t  payload[64];
+    uint16_t len;
+    uint16_t pkt_id;
+    bool     acked;
+} fake_stored_t;
+
+static fake_stored_t stored[FAKE_STORED_MAX];
+static uint32_t      n_stored;
+static uint16_t      broker_pkt_id;
+
+void fake_lwip_set_retained(bool on, const void *payload, uint16_t len) {
+    retained_on = on;
+    retained_len = len < sizeof(retained_payload) ? len : sizeof(retained_payload);
+    memcpy(retained_payload, payload, retained_len);
+}
+
+bool fake_lwip_store_publish(const char *topic, const void *payload, uint16_t len) {
+    if (n_stored == FAKE_STORED_MAX || len > sizeof(stored[0].payload)) {
+        return false;
+    }
+    fake_stored_t *m = &stored[n_stored++];
+    strncpy(m->topic, topic, sizeof(m->topic) - 1);
+    m->topic[sizeof(m->topic) - 1] = '\0';
+    memcpy(m->payload, payload, len);
+    m->len = len;
+    m->pkt_id = ++broker_pkt_id;
+    m->acked = false;
+    return true;
+}
+
+const fake_publish_t *fake_lwip_published(uint32_t i) {
+    return (i < fake_lwip.publishes && i < FAKE_PUBLISH_LOG) ? &published[i] : NULL;
+}
+
+void fake_lwip_set_publish_outcome(fake_pub_outcome_t outcome) {
+    pub_outcome = outcome;
+}
+
+uint32_t fake_lwip_stored_pending(void) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < n_stored; i++) {
+        if (!stored[i].acked) n++;
+    }
+    return n;
+}
+
+void fake_lwip_reset(void) {
+    memset(&fake_lwip, 0, sizeof(fake_lwip));
+    n_reqs = 0;
+    connecting = false;
+    polled_client = NULL;
+    retained_on = false;
+    n_stored = 0;
+    pub_outcome = FAKE_PUB_ACK;
+}
+
+static void check_locked(void) {
+    if (fake_lwip.lock_depth == 0) {
+        fake_lwip.unlocked_calls++;
+    }
+}
+
+/* ---- heap ---- */
+
+void *mem_malloc(uint16_t size) {
+    fake_lwip.mallocs++;
+    return malloc(size);
+}
+
+void *mem_calloc(uint16_t count, uint16_t size) {
+    fake_lwip.mallocs++;
+    return calloc(count, size);
+}
+
+void mem_free(void *mem) {
+    if (mem) fake_lwip.frees++;
+    free(mem);
+}
+
+/* ---- lock ---- */
+
+void cyw43_arch_lwip_begin(void) { fake_lwip.lock_depth++; }
+void cyw43_arch_lwip_end(void)   { fake_lwip.lock_depth--; }
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr) {
+    unsigned a, b, c, d;
+    char tail;
+    if (sscanf(cp, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 ||
+        a > 255 || b > 255 || c > 255 || d > 255) {
+        return 0;
+    }
+    addr->addr = (u32_t)(a | b << 8 | c << 16 | d << 24);
+    return 1;
+}
+
+/* ---- client ---- */
+
+mqtt_client_t *mqtt_client_new(void) {
+    return (mqtt_client_t *)mem_calloc(1, sizeof(mqtt_client_t));
+}
+
+void mqtt_client_free(mqtt_client_t *client) {
+    mem_free(client);
+}
+
+static void ring_put(struct mqtt_ringbuf_t *rb, uint8_t b) {
+    rb->buf[rb->put] = b;
+    rb->put = (u16_t)((rb->put + 1) % MQTT_OUTPUT_RINGBUF_SIZE);
+}
+
+err_t mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ipaddr, u16_t port,
+                          mqtt_connection_cb_t cb, void *arg,
+                          const struct mqtt_connect_client_info_t *ci) {
+    check_locked();
+    if (client->conn_state != 0) {
+        return ERR_ISCONN;
+    }
+    // lwIP wipes the client from cyclic_tick on, keeping the inpub callbacks
+    mqtt_incoming_data_cb_t data_cb = client->data_cb;
+    mqtt_incoming_publish_cb_t pub_cb = client->pub_cb;
+    void *inpub_arg = client->inpub_arg;
+    memset(client, 0, sizeof(*client));
+    client->data_cb = data_cb;
+    client->pub_cb = pub_cb;
+    client->inpub_arg = inpub_arg;
+
+    client->conn = &fake_lwip;   // any non-NULL pcb
+    client->conn_state = 1;
+    client->connect_cb = cb;
+    client->connect_arg = arg;
+    client->keep_alive = ci->keep_alive;
+    fake_lwip.pcbs_live++;
+    fake_lwip.pcbs_opened++;
+
+    // CONNECT queued until the TCP handshake completes
+    size_t id_len = strlen(ci->client_id);
+    struct mqtt_ringbuf_t *rb = &client->output;
+    ring_put(rb, 0x10);
+    ring_put(rb, (uint8_t)(10 + 2 + id_len));
+    static const uint8_t var[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02};
+    for (size_t i = 0; i < sizeof(var); i++) ring_put(rb, var[i]);
+    ring_put(rb, (uint8_t)(ci->keep_alive >> 8));
+    ring_put(rb, (uint8_t)ci->keep_alive);
+    ring_put(rb, (uint8_t)(id_len >> 8));
+    ring_put(rb, (uint8_t)id_len);
+    for (size_t i = 0; i < id_len; i++) ring_put(rb, (uint8_t)ci->client_id[i]);
+
+    connecting = true;
+    polled_client = client;
+    return ERR_OK;
+}
+
+void mqtt_disconnect(mqtt_client_t *client) {
+    check_locked();
+    if (client->conn_state != 0) {
+        fake_lwip.pcbs_live--;
+        client->conn = NULL;
+        client->conn_state = 0;
+    }
+    // Requests still in flight are dropped without their callbacks
+    n_reqs = 0;
+    connecting = false;
+}
+
+u8_t mqtt_client_is_connected(mqtt_client_t *client) {
+    check_locked();
+    return client->conn_state == 3;
+}
+
+void mqtt_set_inpub_callback(mqtt_client_t *client, mqtt_incoming_publish_cb_t pub_cb,
+                             mqtt_incoming_data_cb_t data_cb, void *arg) {
+    check_locked();
+    client->pub_cb = pub_cb;
+    client->data_cb = data_cb;
+    client->inpub_arg = arg;
+}
+
+static err_t queue_request(mqtt_client_t *client, const char *topic,
+                           mqtt_request_cb_t cb, void *arg, bool subscribe, bool publish) {
+    if (client->conn_state != 3) {
+        return ERR_CONN;
+    }
+    if (n_reqs == MQTT_REQ_MAX_IN_FLIGHT) {
+        return ERR_MEM;
+    }
+    fake_req_t *r = &reqs[n_reqs++];
+    r->cb = cb;
+    r->arg = arg;
+    r->subscribe = subscribe;
+    r->publish = publish;
+    strncpy(r->topic, topic, sizeof(r->topic) - 1);
+    r->topic[sizeof(r->topic) - 1] = '\0';
+    return ERR_OK;
+}
+
+err_t mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos,
+                     mqtt_request_cb_t cb, void *arg, u8_t sub) {
+    check_locked();
+    return queue_request(client, topic, cb, arg, sub != 0, false);
+}
+
+err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload,
+                   u16_t payload_length, u8_t qos, u8_t retain,
+                   mqtt_request_cb_t cb, void *arg) {
+    check_locked();
+    err_t err = queue_request(client, topic, cb, arg, false, true);
+    if (err != ERR_OK) {
+        return err;
+    }
+    if (fake_lwip.publishes < FAKE_PUBLISH_LOG) {
+        fake_publish_t *p = &published[fake_lwip.publishes];
+        strncpy(p->topic, topic, sizeof(p->topic) - 1);
+        p->topic[sizeof(p->topic) - 1] = '\0';
+        p->len = payload_length < sizeof(p->payload) ? payload_length : sizeof(p->payload);
+        memcpy(p->payload, payload, p->len);
+        p->qos = qos;
+    }
+    fake_lwip.publishes++;
+    return ERR_OK;
+}
+
+/* ---- poll: the broker's side ---- */
+
+static void deliver(mqtt_client_t *client, const char *topic) {
+    client->rx_buffer[0] = 0x31;   // PUBLISH, QoS 0, retain
+    if (client->pub_cb) client->pub_cb(client->inpub_arg, topic, retained_len);
+    if (client->data_cb) client->data_cb(client->inpub_arg, retained_payload,
+                                         retained_len, MQTT_DATA_FLAG_LAST);
+    client->rx_buffer[0] = 0;
+}
+
+// A stored QoS1 PUBLISH, received as lwIP's mqtt.c does: the packet id
+// goes into inpub_pkt_id, the callbacks run, and once the last fragment
+// has been handed over the client queues the PUBACK
+static void deliver_stored(mqtt_client_t *client, fake_stored_t *m) {
+    client->rx_buffer[0] = 0x32;   // PUBLISH, QoS 1, not retained
+    client->inpub_pkt_id = m->pkt_id;
+    fake_lwip.stored_sent++;
+    if (client->pub_cb) client->pub_cb(client->inpub_arg, m->topic, m->len);
+    if (client->data_cb) client->data_cb(client->inpub_arg, m->payload, m->len,
+                                         MQTT_DATA_FLAG_LAST);
+    client->rx_buffer[0] = 0;
+
+    if (client->inpub_pkt_id != 0 && client->conn_state == 3) {
+        struct mqtt_ringbuf_t *rb = &client->output;
+        ring_put(rb, 0x40);
+        ring_put(rb, 0x02);
+        ring_put(rb, (uint8_t)(client->inpub_pkt_id >> 8));
+        ring_put(rb, (uint8_t)client->inpub_pkt_id);
+        client->inpub_pkt_id = 0;
+    }
+}
+
+// The broker reads what the client sent: PUBACKs for stored messages
+static void broker_read_output(mqtt_client_t *client) {
+    struct mqtt_ringbuf_t *rb = &client->output;
+    while (rb->get != rb->put) {
+        uint8_t type = rb->buf[rb->get];
+        uint8_t rem = rb->buf[(rb->get + 1) % MQTT_OUTPUT_RINGBUF_SIZE];
+        if (type == 0x40 && rem == 2) {
+            uint16_t id = (uint16_t)(rb->buf[(rb->get + 2) % MQTT_OUTPUT_RINGBUF_SIZE] << 8 |
+                                     rb->buf[(rb->get + 3) % MQTT_OUTPUT_RINGBUF_SIZE]);
+            bool found = false;
+            for (uint32_t i = 0; i < n_stored; i++) {
+                if (stored[i].pkt_id == id && !stored[i].acked) {
+                    stored[i].acked = found = true;
+                    break;
+                }
+            }
+            fake_lwip.pubacks++;
+            if (!found) fake_lwip.puback_bad_id++;
+        }
+        rb->get = (u16_t)((rb->get + 2 + rem) % MQTT_OUTPUT_RINGBUF_SIZE);
+    }
+}
+
+void cyw43_arch_poll(void) {
+    mqtt_client_t *client = polled_client;
+    if (!client) return;
+
+    cyw43_arch_lwip_begin();
+    if (connecting && client->conn_state == 1) {
+        struct mqtt_ringbuf_t *rb = &client->output;
+        uint8_t flags = rb->buf[(rb->get + 9) % MQTT_OUTPUT_RINGBUF_SIZE];
+        if (flags & 0x02) fake_lwip.clean_session_sent++;
+        rb->get = rb->put;
+        connecting = false;
+        client->conn_state = 3;
+        client->connect_cb(client, client->connect_arg, MQTT_CONNECT_ACCEPTED);
+
+        // Session present: the broker resends whatever is still unacked
+        if (flags & 0x02) {
+            n_stored = 0;
+        }
+        for (uint32_t i = 0; i < n_stored; i++) {
+            if (!stored[i].acked) deliver_stored(client, &stored[i]);
+        }
+    }
+
+    uint32_t n = n_reqs;
+    fake_req_t done[MQTT_REQ_MAX_IN_FLIGHT];
+    memcpy(done, reqs, n * sizeof(done[0]));
+    n_reqs = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (done[i].publish && pub_outcome == FAKE_PUB_HOLD) {
+            reqs[n_reqs++] = done[i];
+            continue;
+        }
+        err_t result = (done[i].publish && pub_outcome == FAKE_PUB_FAIL) ? ERR_TIMEOUT : ERR_OK;
+        if (done[i].cb) done[i].cb(done[i].arg, result);
+        if (done[i].subscribe && retained_on) {
+            deliver(client, done[i].topic);
+        }
+    }
+    if (client->conn_state == 3) {
+        broker_read_output(client);
+    }
+    cyw43_arch_lwip_end();
+}
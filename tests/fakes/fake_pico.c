@@ -0,0 +1,77 @@
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "fake_pico.h"
+
+// Simulated time: only sleeps and the test move it, so timeouts in the
+// code under test run instantly and deterministically
+static uint64_t now_us;
+
+// One-shot alarms, fired in due order as time passes
+#define FAKE_ALARMS 4
+
+static struct {
+    uint64_t at_us;
+    alarm_callback_t cb;
+    void *user_data;
+} alarms[FAKE_ALARMS];
+static alarm_id_t next_alarm_id = 1;
+static bool in_alarm;
+
+static void advance_to(uint64_t t) {
+    while (true) {
+        int due = -1;
+        for (int i = 0; i < FAKE_ALARMS; i++) {
+            if (alarms[i].cb && alarms[i].at_us <= t &&
+                (due < 0 || alarms[i].at_us < alarms[due].at_us)) {
+                due = i;
+            }
+        }
+        if (due < 0) {
+            break;
+        }
+        alarm_callback_t cb = alarms[due].cb;
+        alarms[due].cb = NULL;
+        if (alarms[due].at_us > now_us) now_us = alarms[due].at_us;
+        in_alarm = true;
+        cb(0, alarms[due].user_data);
+        in_alarm = false;
+    }
+    if (t > now_us) now_us = t;
+}
+
+void fake_pico_advance_us(uint64_t us) { advance_to(now_us + us); }
+bool fake_pico_in_alarm(void) { return in_alarm; }
+
+absolute_time_t get_absolute_time(void) { return now_us; }
+uint64_t time_us_64(void) { return now_us; }
+uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000u); }
+absolute_time_t make_timeout_time_ms(uint32_t ms) { return now_us + (uint64_t)ms * 1000u; }
+absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) { return t + (uint64_t)ms * 1000u; }
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) { return (int64_t)(to - from); }
+bool time_reached(absolute_time_t t) { return now_us >= t; }
+void sleep_ms(uint32_t ms) { advance_to(now_us + (uint64_t)ms * 1000u); }
+void sleep_us(uint64_t us) { advance_to(now_us + us); }
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout) {
+    advance_to(timeout);
+    return true;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data,
+                           bool fire_if_past) {
+    for (int i = 0; i < FAKE_ALARMS; i++) {
+        if (!alarms[i].cb) {
+            alarms[i].at_us = now_us + (uint64_t)ms * 1000u;
+            alarms[i].cb = callback;
+            alarms[i].user_data = user_data;
+            return next_alarm_id++;
+        }
+    }
+    return -1;   // no free slot, as with a full alarm pool
+}
+
+alarm_id_t alarm_pool_add_alarm_in_ms(alarm_pool_t *pool, uint32_t ms,
+                                      alarm_callback_t callback, void *user_data,
+                                      bool fire_if_past) {
+    return add_alarm_in_ms(ms, callback, user_data, fire_if_past);
+}
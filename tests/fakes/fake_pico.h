@@ -0,0 +1,13 @@
+#ifndef FAKE_PICO_H
+#define FAKE_PICO_H
+
+#include <stdint.h>
+
+#include <stdbool.h>
+
+void fake_pico_advance_us(uint64_t us);
+
+// True while an alarm callback runs (the host's interrupt context)
+bool fake_pico_in_alarm(void);
+
+#endif
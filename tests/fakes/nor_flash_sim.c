@@ -0,0 +1,108 @@
+#include "nor_flash_sim.h"
+#include <stdbool.h>
+#include <string.h>
+
+jmp_buf nor_sim_cut_jmp;
+nor_sim_stats_t nor_sim;
+
+static uint8_t  region[FQ_REGION_SIZE];
+static uint32_t ops_done;
+static bool     cut_armed;
+static uint32_t cut_ops_left;
+static uint32_t cut_at, cut_len;
+
+void nor_sim_reset(void) {
+    memset(region, 0xFF, sizeof(region));
+    memset(&nor_sim, 0, sizeof(nor_sim));
+    ops_done = 0;
+    cut_armed = false;
+}
+
+void nor_sim_arm_cut(uint32_t ops_left, uint32_t at, uint32_t len) {
+    cut_armed = true;
+    cut_ops_left = ops_left;
+    cut_at = at;
+    cut_len = len;
+}
+
+void nor_sim_disarm(void) {
+    cut_armed = false;
+}
+
+uint32_t nor_sim_ops_done(void) {
+    return ops_done;
+}
+
+// True if this operation is the one the power cut lands on
+static bool cut_now(void) {
+    ops_done++;
+    if (!cut_armed) {
+        return false;
+    }
+    if (cut_ops_left > 0) {
+        cut_ops_left--;
+        return false;
+    }
+    cut_armed = false;
+    return true;
+}
+
+static bool sim_erase(uint32_t offset) {
+    if (offset % FQ_SECTOR_SIZE != 0 || offset >= FQ_REGION_SIZE) {
+        return false;
+    }
+    nor_sim.erases[offset / FQ_SECTOR_SIZE]++;
+
+    uint32_t from = 0, to = FQ_SECTOR_SIZE;
+    bool cut = cut_now();
+    if (cut) {
+        from = cut_at % FQ_SECTOR_SIZE;
+        to = from + cut_len % (FQ_SECTOR_SIZE - from + 1);
+    }
+    memset(&region[offset + from], 0xFF, to - from);
+    if (cut) {
+        longjmp(nor_sim_cut_jmp, 1);
+    }
+    return true;
+}
+
+static bool sim_program(uint32_t offset, const uint8_t *page) {
+    if (offset % FQ_PAGE_SIZE != 0 || offset >= FQ_REGION_SIZE) {
+        return false;
+    }
+    nor_sim.programs++;
+
+    uint32_t from = 0, to = FQ_PAGE_SIZE;
+    bool cut = cut_now();
+    if (cut) {
+        from = cut_at % FQ_PAGE_SIZE;
+        to = from + cut_len % (FQ_PAGE_SIZE - from + 1);
+    }
+    bool bit_set = false;
+    for (uint32_t i = 0; i < FQ_PAGE_SIZE; i++) {
+        // 0xFF is "leave alone"; any other byte has to come out as written
+        if (page[i] != 0xFF && (region[offset + i] & page[i]) != page[i]) {
+            bit_set = true;
+        }
+        if (i >= from && i < to) {
+            region[offset + i] &= page[i];
+        }
+    }
+    if (bit_set) {
+        nor_sim.bit_sets++;
+    }
+    if (cut) {
+        longjmp(nor_sim_cut_jmp, 1);
+    }
+    return true;
+}
+
+static const uint8_t *sim_read(uint32_t offset) {
+    return &region[offset];
+}
+
+const fq_flash_ops_t nor_sim_ops = {
+    .erase   = sim_erase,
+    .program = sim_program,
+    .read    = sim_read,
+};
@@ -0,0 +1,37 @@
+#ifndef NOR_FLASH_SIM_H
+#define NOR_FLASH_SIM_H
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "flash_queue.h"
+
+// RAM model of the flash queue's NOR region behind fq_flash_ops_t. Erase
+// sets a sector to 0xFF, program can only clear bits (AND), and a power
+// cut can be armed to hit the Nth erase/program: that operation is only
+// partly applied and control longjmps to nor_sim_cut_jmp, after which the
+// test calls flash_queue_init() as the next boot would.
+
+typedef struct {
+    uint32_t erases[FQ_SECTORS];
+    uint32_t programs;
+    uint32_t bit_sets;     // programs whose data needed a 0 → 1 bit change
+} nor_sim_stats_t;
+
+extern jmp_buf nor_sim_cut_jmp;
+extern nor_sim_stats_t nor_sim;
+extern const fq_flash_ops_t nor_sim_ops;
+
+// Whole region blank, counters cleared, no cut armed
+void nor_sim_reset(void);
+
+// Cut power during the operation after ops_left more complete ones. Only
+// bytes [at, at + len) of the page (program) or sector (erase) change;
+// at and len are taken modulo the size of the operation.
+void nor_sim_arm_cut(uint32_t ops_left, uint32_t at, uint32_t len);
+void nor_sim_disarm(void);
+
+// Erase/program operations so far, to pick a cut point
+uint32_t nor_sim_ops_done(void);
+
+#endif
@@ -0,0 +1,47 @@
+#include "filter_pipeline.h"
+#include "test_common.h"
+
+// Cost per sample of each filter chain. On the host this only ranks the
+// chains against each other; the RP2040 figure has to come from SysTick
+// on the board (LOG_MEASURE_COST in log_buffer.h does the same for logs).
+
+#define BENCH_SAMPLES 1000000
+
+typedef struct {
+    const char     *name;
+    filter_config_t cfg;
+} chain_t;
+
+static const chain_t CHAINS[] = {
+    { "ema",             { FILTER_STAGE_EMA, 1, Q16_FROM_FRAC(1, 4), 0 } },
+    { "median3",         { FILTER_STAGE_MEDIAN, 3, 0, 0 } },
+    { "median7",         { FILTER_STAGE_MEDIAN, 7, 0, 0 } },
+    { "median3+ema+slew", { FILTER_STAGE_MEDIAN | FILTER_STAGE_EMA | FILTER_STAGE_SLEW,
+                           3, Q16_FROM_FRAC(1, 4), Q16_FROM_INT(500) } },
+};
+
+int main(void) {
+    static q16_t input[4096];
+    uint32_t x = 1;
+    for (size_t i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+        x = x * 1103515245u + 12345u;
+        input[i] = filter_from_uint(400 + (x >> 16) % 4600);
+    }
+
+    for (size_t c = 0; c < sizeof(CHAINS) / sizeof(CHAINS[0]); c++) {
+        filter_t f;
+        filter_init(&f, &CHAINS[c].cfg);
+
+        volatile q16_t sink = 0;
+        uint64_t start = bench_now();
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            sink = filter_process(&f, input[i & 4095]);
+        }
+        uint64_t took = bench_now() - start;
+        (void)sink;
+
+        printf("%-18s %6.1f %s/sample\n", CHAINS[c].name,
+               (double)took / BENCH_SAMPLES, BENCH_UNIT);
+    }
+    return 0;
+}
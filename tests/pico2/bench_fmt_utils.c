@@ -0,0 +1,118 @@
+#include "fmt_utils.h"
+#include "test_common.h"
+#include <inttypes.h>
+#include <string.h>
+
+// fmt_utils against snprintf on the payloads it replaced: the ppm value
+// (acd1100_format_ppm), a batch entry "age_ms:ppm," (sample_buffer) and a
+// Pico3 CSV row "epoch_ms,topic,value". Both paths must produce the same
+// bytes. On the host this only ranks the two; newlib's printf core on the
+// RP2040 is heavier than glibc's, and the flash saved has to come from
+// arm-none-eabi-size on the firmware ELF.
+
+#define BENCH_ROUNDS  200000
+#define BENCH_REPEATS 5
+
+static uint32_t inputs[4096];
+
+static size_t ppm_fmt(char *buf, size_t size, uint32_t i) {
+    fmt_buf_t f;
+    fmt_init(&f, buf, size);
+    fmt_put_u32(&f, inputs[i & 4095]);
+    return fmt_finish(&f);
+}
+
+static size_t ppm_snprintf(char *buf, size_t size, uint32_t i) {
+    return (size_t)snprintf(buf, size, "%" PRIu32, inputs[i & 4095]);
+}
+
+static size_t batch_fmt(char *buf, size_t size, uint32_t i) {
+    fmt_buf_t f;
+    fmt_init(&f, buf, size);
+    fmt_put_u32(&f, i * 30000u);
+    fmt_put_char(&f, ':');
+    fmt_put_u32(&f, inputs[i & 4095]);
+    fmt_put_char(&f, ',');
+    return fmt_finish(&f);
+}
+
+static size_t batch_snprintf(char *buf, size_t size, uint32_t i) {
+    return (size_t)snprintf(buf, size, "%" PRIu32 ":%" PRIu32 ",",
+                            i * 30000u, inputs[i & 4095]);
+}
+
+static size_t csv_fmt(char *buf, size_t size, uint32_t i) {
+    fmt_buf_t f;
+    fmt_init(&f, buf, size);
+    fmt_put_u64(&f, 1700000000000ull + i * 5000ull);
+    fmt_put_char(&f, ',');
+    fmt_put_str(&f, "pico2/sensor/data");
+    fmt_put_char(&f, ',');
+    fmt_put_u32(&f, inputs[i & 4095]);
+    fmt_put_char(&f, '\n');
+    return fmt_finish(&f);
+}
+
+static size_t csv_snprintf(char *buf, size_t size, uint32_t i) {
+    return (size_t)snprintf(buf, size, "%" PRIu64 ",%s,%" PRIu32 "\n",
+                            (uint64_t)(1700000000000ull + i * 5000ull), "pico2/sensor/data",
+                            inputs[i & 4095]);
+}
+
+typedef size_t (*format_fn_t)(char *buf, size_t size, uint32_t i);
+
+typedef struct {
+    const char *name;
+    format_fn_t fmt;
+    format_fn_t ref;
+} payload_t;
+
+static const payload_t PAYLOADS[] = {
+    { "ppm",         ppm_fmt,   ppm_snprintf },
+    { "batch entry", batch_fmt, batch_snprintf },
+    { "csv row",     csv_fmt,   csv_snprintf },
+};
+
+// Best of BENCH_REPEATS runs, to keep scheduler noise out of the ratio
+static double per_call(format_fn_t fn) {
+    char buf[64];
+    volatile size_t sink = 0;
+    uint64_t best = UINT64_MAX;
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        uint64_t start = bench_now();
+        for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+            sink += fn(buf, sizeof(buf), i);
+        }
+        uint64_t took = bench_now() - start;
+        if (took < best) best = took;
+    }
+    (void)sink;
+    return (double)best / BENCH_ROUNDS;
+}
+
+int main(void) {
+    uint32_t x = 1;
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        x = x * 1103515245u + 12345u;
+        inputs[i] = 400 + (x >> 16) % 4600;
+    }
+    inputs[0] = 0;
+    inputs[1] = UINT32_MAX;
+
+    for (size_t p = 0; p < sizeof(PAYLOADS) / sizeof(PAYLOADS[0]); p++) {
+        // Same output before comparing speed
+        for (uint32_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            char got[64], expect[64];
+            size_t n = PAYLOADS[p].fmt(got, sizeof(got), i);
+            size_t m = PAYLOADS[p].ref(expect, sizeof(expect), i);
+            CHECK_EQ(n, m);
+            CHECK(memcmp(got, expect, m) == 0);
+        }
+
+        double fmt = per_call(PAYLOADS[p].fmt);
+        double ref = per_call(PAYLOADS[p].ref);
+        printf("%-12s fmt_utils %6.1f %s  snprintf %6.1f %s  (%.1fx)\n",
+               PAYLOADS[p].name, fmt, BENCH_UNIT, ref, BENCH_UNIT, ref / fmt);
+    }
+    return TEST_RESULT();
+}
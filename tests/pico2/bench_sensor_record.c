@@ -0,0 +1,177 @@
+#include "sensor_record.h"
+#include "fmt_utils.h"
+#include "test_common.h"
+#include <string.h>
+
+// Binary records against the text payloads they replace, per message:
+// bytes on the wire, and the time from Pico2's encode to the CSV row
+// Pico3 logs. Text rows carry the payload as sent; binary ones are
+// decoded and printed with the text format's precision, as
+// handle_sensor_record() does. The summary is main.c's window record.
+// Host time only ranks the two formats; the binary record also carries
+// seq and ts_ms, which the text payloads have no room for.
+
+#define BENCH_ROUNDS  200000
+#define BENCH_REPEATS 5
+
+#define Q16(x) ((int32_t)((x) * 65536.0))
+
+typedef struct {
+    uint32_t count;
+    int32_t  min, max, mean, stddev, slope;
+    uint32_t span_s;
+} summary_t;
+
+static uint32_t ppm_in[1024];
+static summary_t sum_in[1024];
+
+// ---- Pico2 side ----
+
+static size_t co2_text(uint8_t *out, size_t size, uint32_t i) {
+    fmt_buf_t f;
+    fmt_init(&f, (char *)out, size);
+    fmt_put_u32(&f, ppm_in[i & 1023]);
+    return fmt_finish(&f);
+}
+
+static size_t co2_binary(uint8_t *out, size_t size, uint32_t i) {
+    sensor_record_t rec = { .type = SR_TYPE_CO2, .count = 1, .seq = (uint16_t)i,
+                            .ts_ms = i * 5000u,
+                            .values = { (int32_t)(ppm_in[i & 1023] << 16) } };
+    return sr_encode(&rec, out, size);
+}
+
+static size_t summary_text(uint8_t *out, size_t size, uint32_t i) {
+    const summary_t *s = &sum_in[i & 1023];
+    fmt_buf_t f;
+    fmt_init(&f, (char *)out, size);
+    fmt_put_u32(&f, s->count);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, s->min, 0);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, s->max, 0);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, s->mean, 1);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, s->stddev, 1);
+    fmt_put_char(&f, ',');
+    fmt_put_q16(&f, s->slope, 2);
+    fmt_put_char(&f, ',');
+    fmt_put_u32(&f, s->span_s);
+    return fmt_finish(&f);
+}
+
+static size_t summary_binary(uint8_t *out, size_t size, uint32_t i) {
+    const summary_t *s = &sum_in[i & 1023];
+    sensor_record_t rec = { .type = SR_TYPE_CO2_SUMMARY, .count = SR_SUMMARY_VALUES,
+                            .seq = (uint16_t)i, .ts_ms = i * 300000u };
+    rec.values[SR_SUMMARY_COUNT]  = (int32_t)(s->count << 16);
+    rec.values[SR_SUMMARY_MIN]    = s->min;
+    rec.values[SR_SUMMARY_MAX]    = s->max;
+    rec.values[SR_SUMMARY_MEAN]   = s->mean;
+    rec.values[SR_SUMMARY_STDDEV] = s->stddev;
+    rec.values[SR_SUMMARY_SLOPE]  = s->slope;
+    rec.values[SR_SUMMARY_SPAN_S] = (int32_t)(s->span_s << 16);
+    return sr_encode(&rec, out, size);
+}
+
+// ---- Pico3 side ----
+
+static size_t row_start(fmt_buf_t *f, char *row, uint32_t i) {
+    fmt_init(f, row, 128);
+    fmt_put_u64(f, 1700000000000ull + i * 5000ull);
+    fmt_put_char(f, ',');
+    fmt_put_str(f, "pico2/sensor/data");
+    return f->len;
+}
+
+static size_t row_text(char *row, const uint8_t *payload, size_t len, uint32_t i) {
+    fmt_buf_t f;
+    row_start(&f, row, i);
+    fmt_put_char(&f, ',');
+    fmt_put_mem(&f, (const char *)payload, len);
+    fmt_put_char(&f, '\n');
+    return fmt_finish(&f);
+}
+
+static size_t row_binary(char *row, const uint8_t *payload, size_t len, uint32_t i) {
+    sensor_record_t rec;
+    if (sr_decode(payload, len, &rec) != SR_OK) {
+        return 0;
+    }
+    uint8_t decimals = (rec.type == SR_TYPE_CO2) ? 0 : 2;
+    fmt_buf_t f;
+    row_start(&f, row, i);
+    for (uint8_t v = 0; v < rec.count; v++) {
+        fmt_put_char(&f, ',');
+        fmt_put_q16(&f, rec.values[v], decimals);
+    }
+    fmt_put_char(&f, '\n');
+    return fmt_finish(&f);
+}
+
+typedef size_t (*encode_fn_t)(uint8_t *out, size_t size, uint32_t i);
+typedef size_t (*row_fn_t)(char *row, const uint8_t *payload, size_t len, uint32_t i);
+
+// Best of BENCH_REPEATS runs; also returns the mean payload size
+static double per_message(encode_fn_t enc, row_fn_t row_fn, double *bytes) {
+    uint8_t payload[SR_MAX_LEN + 64];
+    char row[128];
+    volatile size_t sink = 0;
+    uint64_t best = UINT64_MAX, total_bytes = 0;
+
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        total_bytes = 0;
+        uint64_t start = bench_now();
+        for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+            size_t n = enc(payload, sizeof(payload), i);
+            total_bytes += n;
+            sink += row_fn(row, payload, n, i);
+        }
+        uint64_t took = bench_now() - start;
+        if (took < best) best = took;
+    }
+    (void)sink;
+    *bytes = (double)total_bytes / BENCH_ROUNDS;
+    return (double)best / BENCH_ROUNDS;
+}
+
+static void compare(const char *name, encode_fn_t text, encode_fn_t binary) {
+    double text_bytes, bin_bytes;
+    double text_t = per_message(text, row_text, &text_bytes);
+    double bin_t = per_message(binary, row_binary, &bin_bytes);
+    printf("%-8s text %5.1f B %6.1f %s   binary %5.1f B %6.1f %s\n",
+           name, text_bytes, text_t, BENCH_UNIT, bin_bytes, bin_t, BENCH_UNIT);
+    CHECK(bin_bytes > 0 && text_bytes > 0);
+}
+
+int main(void) {
+    uint32_t x = 1;
+    for (size_t i = 0; i < 1024; i++) {
+        x = x * 1103515245u + 12345u;
+        ppm_in[i] = 400 + (x >> 16) % 4600;
+        sum_in[i] = (summary_t){
+            .count  = 60,
+            .min    = (int32_t)(ppm_in[i] - 20) << 16,
+            .max    = (int32_t)(ppm_in[i] + 35) << 16,
+            .mean   = Q16(ppm_in[i] + 0.4),
+            .stddev = Q16(11.25),
+            .slope  = Q16(((int32_t)(x >> 24) - 128) / 16.0),
+            .span_s = 295
+        };
+    }
+
+    // Both formats must log the same numbers for the CO2 value
+    uint8_t p[SR_MAX_LEN];
+    char a[128], b[128];
+    for (uint32_t i = 0; i < 1024; i++) {
+        size_t na = row_text(a, p, co2_text(p, sizeof(p), i), i);
+        size_t nb = row_binary(b, p, co2_binary(p, sizeof(p), i), i);
+        CHECK_EQ(na, nb);
+        CHECK(memcmp(a, b, na) == 0);
+    }
+
+    compare("co2", co2_text, co2_binary);
+    compare("summary", summary_text, summary_binary);
+    return TEST_RESULT();
+}
@@ -0,0 +1,326 @@
+#include "acd1100.h"
+#include "power_manager.h"
+#include "store_forward.h"
+#include "i2c_dma.h"
+#include "fake_pico.h"
+#include "test_common.h"
+#include <string.h>
+
+// The non-blocking measurement state machine, driven through a fake
+// acd1100_port_t. The fake port only records each request; the test
+// completes it, the way the I2C and alarm interrupts would, and checks
+// the state after every step.
+
+// Deferred log records are not under test
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {}
+
+// Linked in through acd1100.c's publish path, which is not under test
+uint32_t power_uptime_ms(void) { return 0; }
+sf_result_t sf_publish(const char *topic, const void *data, uint16_t len) {
+    return SF_FAILED;
+}
+bool i2c_dma_init(i2c_inst_t *i2c) { return false; }
+i2c_dma_result_t i2c_dma_write(i2c_inst_t *i2c, uint8_t address, const uint8_t *src,
+                               size_t len, i2c_dma_callback_t cb, void *user_data) {
+    return I2C_DMA_ERR_INVAL;
+}
+i2c_dma_result_t i2c_dma_read(i2c_inst_t *i2c, uint8_t address, uint8_t *dst,
+                              size_t len, i2c_dma_callback_t cb, void *user_data) {
+    return I2C_DMA_ERR_INVAL;
+}
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) { return baudrate; }
+
+// Bus behind acd1100_blocking_port
+static struct {
+    uint32_t writes, reads;
+    uint32_t reads_in_irq;   // transfers run from an alarm callback
+    uint8_t frame[9];
+} bus_sim;
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len,
+                       bool nostop) {
+    bus_sim.writes++;
+    return (int)len;
+}
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len,
+                      bool nostop) {
+    bus_sim.reads++;
+    if (fake_pico_in_alarm()) bus_sim.reads_in_irq++;
+    memcpy(dst, bus_sim.frame, len < 9 ? len : 9);
+    return (int)len;
+}
+
+static struct i2c_inst { int unused; } bus;
+i2c_inst_t *const fake_i2c1 = &bus;
+
+// ----------------------------------------------------------------------
+// Fake port
+// ----------------------------------------------------------------------
+static struct {
+    bool write_ok, read_ok, timer_ok;   // whether each request can start
+    uint32_t writes, reads, timers;
+    uint8_t cmd[2];
+    uint8_t *dst;
+    size_t dst_len;
+    uint32_t delay_ms;
+    acd1100_done_cb_t done;            // pending transfer or timer
+} port;
+
+static bool fake_write(i2c_inst_t *i2c, uint8_t address, const uint8_t *src,
+                       size_t len, acd1100_done_cb_t done) {
+    port.writes++;
+    if (!port.write_ok) return false;
+    memcpy(port.cmd, src, len < 2 ? len : 2);
+    port.done = done;
+    return true;
+}
+
+static bool fake_read(i2c_inst_t *i2c, uint8_t address, uint8_t *dst, size_t len,
+                      acd1100_done_cb_t done) {
+    port.reads++;
+    if (!port.read_ok) return false;
+    port.dst = dst;
+    port.dst_len = len;
+    port.done = done;
+    return true;
+}
+
+static bool fake_start_timer(uint32_t delay_ms, acd1100_done_cb_t expired) {
+    port.timers++;
+    if (!port.timer_ok) return false;
+    port.delay_ms = delay_ms;
+    port.done = expired;
+    return true;
+}
+
+static const acd1100_port_t fake_port = {
+    .write = fake_write,
+    .read = fake_read,
+    .start_timer = fake_start_timer,
+};
+
+// Complete whatever the state machine is waiting for
+static void finish(bool ok) {
+    acd1100_done_cb_t done = port.done;
+    port.done = NULL;
+    CHECK(done != NULL);
+    if (done) done(ok);
+}
+
+static void reset(void) {
+    // Leave any failed measurement behind before the next case
+    while (acd1100_is_busy()) finish(false);
+    acd1100_complete_measurement(NULL, NULL);
+    memset(&port, 0, sizeof(port));
+    port.write_ok = port.read_ok = port.timer_ok = true;
+    acd1100_set_port(&fake_port);
+}
+
+// Reference CRC-8 (poly 0x31, init 0xFF) from the datasheet
+static uint8_t crc8(uint8_t a, uint8_t b) {
+    uint8_t crc = 0xFF, data[2] = { a, b };
+    for (int i = 0; i < 2; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void make_frame(uint8_t f[9], uint32_t ppm, uint16_t t_raw) {
+    f[0] = (uint8_t)(ppm >> 24);  f[1] = (uint8_t)(ppm >> 16);  f[2] = crc8(f[0], f[1]);
+    f[3] = (uint8_t)(ppm >> 8);   f[4] = (uint8_t)ppm;          f[5] = crc8(f[3], f[4]);
+    f[6] = (uint8_t)(t_raw >> 8); f[7] = (uint8_t)t_raw;        f[8] = crc8(f[6], f[7]);
+}
+
+// Run a measurement up to the frame read, checking each transition
+static void run_to_reading(void) {
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_OK);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_WRITING);
+    CHECK_EQ(port.writes, 1);
+    CHECK_EQ(port.cmd[0], 0x03);
+    CHECK_EQ(port.cmd[1], 0x00);
+    CHECK(!acd1100_poll_measurement());
+
+    finish(true);   // command written
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_CONVERTING);
+    CHECK_EQ(port.timers, 1);
+    CHECK_EQ(port.delay_ms, ACD1100_REQUEST_DELAY_MS);
+    CHECK(!acd1100_poll_measurement());
+
+    finish(true);   // conversion alarm
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_READING);
+    CHECK_EQ(port.reads, 1);
+    CHECK_EQ(port.dst_len, 9);
+    CHECK(!acd1100_poll_measurement());
+}
+
+static void test_success(void) {
+    reset();
+    fake_pico_advance_us(12345);
+    run_to_reading();
+    CHECK_EQ(acd1100_last_command_us(), 12345);
+
+    make_frame(port.dst, 1234, 0x1a2b);
+    finish(true);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_READY);
+    CHECK(acd1100_poll_measurement());
+
+    uint32_t ppm = 0;
+    uint16_t t_raw = 0;
+    CHECK_EQ(acd1100_complete_measurement(&ppm, &t_raw), ACD1100_OK);
+    CHECK_EQ(ppm, 1234);
+    CHECK_EQ(t_raw, 0x1a2b);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_IDLE);
+
+    // Nothing left to complete
+    CHECK_EQ(acd1100_complete_measurement(&ppm, &t_raw), ACD1100_ERR_INVAL);
+}
+
+static void test_write_failure(void) {
+    // Transfer could not start: reported at once, back to IDLE
+    reset();
+    port.write_ok = false;
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_ERR_I2C);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_IDLE);
+    CHECK_EQ(port.timers, 0);
+
+    // Transfer started but NACKed
+    reset();
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_OK);
+    finish(false);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_ERROR);
+    CHECK(acd1100_poll_measurement());
+    CHECK_EQ(port.timers, 0);
+    CHECK_EQ(acd1100_complete_measurement(NULL, NULL), ACD1100_ERR_I2C);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_IDLE);
+
+    // No alarm available for the conversion wait
+    reset();
+    port.timer_ok = false;
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_OK);
+    finish(true);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_ERROR);
+    CHECK_EQ(acd1100_complete_measurement(NULL, NULL), ACD1100_ERR_I2C);
+}
+
+static void test_read_failure(void) {
+    reset();
+    run_to_reading();
+    finish(false);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_ERROR);
+    CHECK(acd1100_poll_measurement());
+    CHECK_EQ(acd1100_complete_measurement(NULL, NULL), ACD1100_ERR_I2C);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_IDLE);
+
+    // Read could not start from the alarm callback
+    reset();
+    port.read_ok = false;
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_OK);
+    finish(true);
+    finish(true);
+    CHECK_EQ(port.reads, 1);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_ERROR);
+    CHECK_EQ(acd1100_complete_measurement(NULL, NULL), ACD1100_ERR_I2C);
+}
+
+static void test_crc_error(void) {
+    static const int corrupt[] = { 2, 4, 7 };   // each of the three CRC words
+
+    for (size_t i = 0; i < count_of(corrupt); i++) {
+        reset();
+        run_to_reading();
+        make_frame(port.dst, 800, 0x0100);
+        port.dst[corrupt[i]] ^= 0x01;
+        finish(true);
+        CHECK_EQ(acd1100_get_state(), ACD1100_STATE_READY);
+
+        uint32_t ppm = 7;
+        CHECK_EQ(acd1100_complete_measurement(&ppm, NULL), ACD1100_ERR_CRC);
+        CHECK_EQ(ppm, 7);   // untouched on error
+        CHECK_EQ(acd1100_get_state(), ACD1100_STATE_IDLE);
+    }
+
+    // Valid CRCs, but a reading the filter cannot hold
+    reset();
+    run_to_reading();
+    make_frame(port.dst, 0, 0);
+    finish(true);
+    CHECK_EQ(acd1100_complete_measurement(NULL, NULL), ACD1100_ERR_RANGE);
+}
+
+static void test_start_while_busy(void) {
+    static const acd1100_port_t other_port = {
+        .write = fake_write, .read = fake_read, .start_timer = fake_start_timer,
+    };
+
+    reset();
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_OK);
+    finish(true);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_CONVERTING);
+
+    // A second start is refused without touching the bus or the state
+    uint64_t cmd_us = acd1100_last_command_us();
+    fake_pico_advance_us(5000);
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_ERR_BUSY);
+    CHECK_EQ(port.writes, 1);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_CONVERTING);
+    CHECK_EQ(acd1100_last_command_us(), cmd_us);
+    CHECK_EQ(acd1100_complete_measurement(NULL, NULL), ACD1100_ERR_BUSY);
+
+    // So is switching ports mid-measurement: the read still goes to fake_port
+    acd1100_set_port(&other_port);
+    finish(true);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_READING);
+    make_frame(port.dst, 420, 0);
+    finish(true);
+    uint32_t ppm = 0;
+    CHECK_EQ(acd1100_complete_measurement(&ppm, NULL), ACD1100_OK);
+    CHECK_EQ(ppm, 420);
+
+    // Once idle, a new measurement starts normally
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_OK);
+    CHECK_EQ(port.writes, 2);
+}
+
+static void test_blocking_port_reads_outside_irq(void) {
+    reset();
+    acd1100_set_port(&acd1100_blocking_port);
+    memset(&bus_sim, 0, sizeof(bus_sim));
+    make_frame(bus_sim.frame, 950, 0x0200);
+
+    // The command goes out from the caller, the alarm is armed
+    CHECK_EQ(acd1100_start_measurement(i2c1, ACD1100_I2C_ADDR), ACD1100_OK);
+    CHECK_EQ(bus_sim.writes, 1);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_CONVERTING);
+
+    // The alarm only requests the read
+    fake_pico_advance_us(ACD1100_REQUEST_DELAY_MS * 1000u);
+    CHECK_EQ(acd1100_get_state(), ACD1100_STATE_READING);
+    CHECK_EQ(bus_sim.reads, 0);
+
+    // The wait loop's poll runs it
+    CHECK(acd1100_poll_measurement());
+    CHECK_EQ(bus_sim.reads, 1);
+    CHECK_EQ(bus_sim.reads_in_irq, 0);
+
+    uint32_t ppm = 0;
+    CHECK_EQ(acd1100_complete_measurement(&ppm, NULL), ACD1100_OK);
+    CHECK_EQ(ppm, 950);
+
+    // Polling while idle touches nothing
+    CHECK(acd1100_poll_measurement());
+    CHECK_EQ(bus_sim.reads, 1);
+}
+
+int main(void) {
+    test_success();
+    test_write_failure();
+    test_read_failure();
+    test_crc_error();
+    test_start_while_busy();
+    test_blocking_port_reads_outside_irq();
+    return TEST_RESULT();
+}
@@ -0,0 +1,130 @@
+#include "deadband.h"
+#include "test_common.h"
+
+// Report-by-exception with main.c's CO2 settings: a change is reported
+// once it exceeds 25 ppm or 3 % of the last reported value, whichever is
+// smaller, and a steady value still goes out every 5 minutes.
+
+static const deadband_config_t CO2_DEADBAND = {
+    .abs_delta    = 25,
+    .rel_permille = 30,
+    .heartbeat_ms = 5 * 60 * 1000
+};
+
+// Reference value set at t=0, then one check at t=1 s
+static bool reported_after(uint32_t ref, uint32_t value) {
+    deadband_t db;
+    deadband_init(&db, &CO2_DEADBAND);
+    CHECK(deadband_check(&db, 0, ref));   // first value always goes out
+    return deadband_check(&db, 1000, value);
+}
+
+static void test_relative_threshold_at_low_ppm(void) {
+    // 3 % of 400 is 12 ppm, tighter than the 25 ppm bound
+    CHECK(!reported_after(400, 412));
+    CHECK(reported_after(400, 413));
+    CHECK(!reported_after(400, 388));
+    CHECK(reported_after(400, 387));
+    CHECK(reported_after(400, 420));   // under 25 ppm, over 3 %
+}
+
+static void test_absolute_threshold_at_high_ppm(void) {
+    // 3 % of 2000 is 60 ppm, so the 25 ppm bound decides
+    CHECK(!reported_after(2000, 2025));
+    CHECK(reported_after(2000, 2026));
+    CHECK(!reported_after(2000, 1975));
+    CHECK(reported_after(2000, 1974));
+    CHECK(reported_after(2000, 2050));   // under 3 %, over 25 ppm
+}
+
+static void test_crossover(void) {
+    // 3 % of 833 is 24.99 ppm: a 25 ppm step already exceeds it
+    CHECK(!reported_after(833, 857));
+    CHECK(reported_after(833, 858));
+    // Large readings must not wrap the widened relative test
+    CHECK(!reported_after(4000000000u, 4000000000u + 25));
+    CHECK(reported_after(4000000000u, 4000000000u + 26));
+}
+
+static void test_reference_moves_only_on_report(void) {
+    deadband_t db;
+    deadband_init(&db, &CO2_DEADBAND);
+    CHECK(deadband_check(&db, 0, 1000));
+
+    // A slow drift of 10 ppm per sample is measured against the last
+    // reported value, not the last sample, so it cannot creep through
+    uint32_t t = 0, v = 1000, reports = 0;
+    for (int i = 0; i < 10; i++) {
+        t += 5000;
+        v += 10;
+        if (deadband_check(&db, t, v)) {
+            reports++;
+        }
+    }
+    CHECK_EQ(reports, 3);   // 1030, 1060 and 1090
+    CHECK_EQ(db.last_value, 1090);
+    CHECK_EQ(db.reported, 4);
+    CHECK_EQ(db.suppressed, 7);
+}
+
+static void test_heartbeat(void) {
+    deadband_t db;
+    deadband_init(&db, &CO2_DEADBAND);
+    CHECK(deadband_check(&db, 10000, 600));
+
+    // Steady readings every 30 s are held back until 5 minutes have passed
+    uint32_t t = 10000;
+    for (int i = 1; i < 10; i++) {
+        t += 30000;
+        CHECK(!deadband_check(&db, t, 600 + (i & 1)));
+    }
+    CHECK_EQ(t - 10000, 270000);
+    CHECK(!deadband_check(&db, 10000 + 299999, 600));
+    CHECK(deadband_check(&db, 10000 + 300000, 601));
+    CHECK_EQ(db.last_value, 601);
+
+    // The heartbeat restarts from that report, and from any other one
+    CHECK(!deadband_check(&db, 10000 + 300000 + 299999, 600));
+    CHECK(deadband_check(&db, 10000 + 600000, 600));
+    CHECK(deadband_check(&db, 10000 + 660000, 700));
+    CHECK(!deadband_check(&db, 10000 + 660000 + 299999, 700));
+    CHECK(deadband_check(&db, 10000 + 960000, 700));
+
+    // Across the 32-bit ms wrap (~49.7 days of uptime)
+    deadband_init(&db, &CO2_DEADBAND);
+    CHECK(deadband_check(&db, UINT32_MAX - 1000, 600));
+    CHECK(!deadband_check(&db, 298000, 600));
+    CHECK(deadband_check(&db, 299000, 600));
+}
+
+static void test_force_next(void) {
+    deadband_t db;
+    deadband_init(&db, &CO2_DEADBAND);
+    CHECK(deadband_check(&db, 0, 500));
+    CHECK(!deadband_check(&db, 1000, 500));
+
+    // After a mode change the next value goes out even if unchanged, once
+    deadband_force_next(&db);
+    CHECK(deadband_check(&db, 2000, 500));
+    CHECK(!deadband_check(&db, 3000, 500));
+}
+
+static void test_no_thresholds_reports_all(void) {
+    static const deadband_config_t every = { 0, 0, 0 };
+    deadband_t db;
+    deadband_init(&db, &every);
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(deadband_check(&db, i * 1000, 500));
+    }
+}
+
+int main(void) {
+    test_relative_threshold_at_low_ppm();
+    test_absolute_threshold_at_high_ppm();
+    test_crossover();
+    test_reference_moves_only_on_report();
+    test_heartbeat();
+    test_force_next();
+    test_no_thresholds_reports_all();
+    return TEST_RESULT();
+}
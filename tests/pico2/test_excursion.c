@@ -0,0 +1,149 @@
+#include "excursion.h"
+#include "test_common.h"
+
+// Local excursion detector with main.c's CO2 settings: start at 1000 ppm
+// or on a rise of 150 ppm within 45 s, clear once below 900 ppm and no
+// longer rising. Samples come every 5 s, as in edge mode.
+
+static const excursion_config_t CO2_EXCURSION = {
+    .level_ppm      = 1000,
+    .clear_ppm      = 900,
+    .rise_ppm       = 150,
+    .rise_window_ms = 45 * 1000
+};
+
+#define SAMPLE_MS 5000
+
+static void test_level_entry(void) {
+    excursion_t ex;
+    excursion_init(&ex, &CO2_EXCURSION);
+
+    // A slow climb (10 ppm per sample, 90 ppm per window) never counts as
+    // rising, so only the level starts it
+    uint32_t t = 0;
+    for (uint32_t v = 900; v < 1000; v += 10, t += SAMPLE_MS) {
+        CHECK_EQ(excursion_check(&ex, t, v), EXCURSION_NONE);
+    }
+    CHECK(!excursion_active(&ex));
+    CHECK_EQ(excursion_check(&ex, t, 999), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, t + SAMPLE_MS, 1000), EXCURSION_START);
+    CHECK(excursion_active(&ex));
+    CHECK_EQ(ex.trips, 1);
+
+    // Staying high is not a new excursion
+    CHECK_EQ(excursion_check(&ex, t + 2 * SAMPLE_MS, 1400), EXCURSION_NONE);
+    CHECK_EQ(ex.trips, 1);
+}
+
+static void test_hysteresis(void) {
+    excursion_t ex;
+    excursion_init(&ex, &CO2_EXCURSION);
+    CHECK_EQ(excursion_check(&ex, 0, 1000), EXCURSION_START);
+
+    // Falling back under the start level is not enough
+    uint32_t t = SAMPLE_MS;
+    static const uint32_t falling[] = { 999, 950, 901, 900 };
+    for (size_t i = 0; i < sizeof(falling) / sizeof(falling[0]); i++, t += SAMPLE_MS) {
+        CHECK_EQ(excursion_check(&ex, t, falling[i]), EXCURSION_NONE);
+        CHECK(excursion_active(&ex));
+    }
+    CHECK_EQ(excursion_check(&ex, t, 899), EXCURSION_CLEAR);
+    CHECK(!excursion_active(&ex));
+
+    // Between the two thresholds a cleared detector stays cleared
+    CHECK_EQ(excursion_check(&ex, t + SAMPLE_MS, 950), EXCURSION_NONE);
+    CHECK(!excursion_active(&ex));
+}
+
+static void test_rise_threshold(void) {
+    excursion_t ex;
+    excursion_init(&ex, &CO2_EXCURSION);
+    CHECK_EQ(excursion_check(&ex, 0, 600), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, SAMPLE_MS, 749), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, 2 * SAMPLE_MS, 750), EXCURSION_START);
+
+    // The same step over more than 45 s is not a rise
+    excursion_init(&ex, &CO2_EXCURSION);
+    CHECK_EQ(excursion_check(&ex, 0, 600), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, 45001, 800), EXCURSION_NONE);
+    CHECK(!excursion_active(&ex));
+}
+
+static void test_rise_holds_until_it_ages_out(void) {
+    excursion_t ex;
+    excursion_init(&ex, &CO2_EXCURSION);
+
+    // Steady at 700 up to t=20 s, then +160 ppm: a rise, well under 1000
+    uint32_t t = 0;
+    for (; t <= 20000; t += SAMPLE_MS) {
+        CHECK_EQ(excursion_check(&ex, t, 700), EXCURSION_NONE);
+    }
+    CHECK_EQ(excursion_check(&ex, t, 860), EXCURSION_START);
+
+    // 860 is already below the clear level, but the 700 at t=20 s keeps
+    // it "rising" for the whole 45 s window...
+    for (t += SAMPLE_MS; t <= 20000 + 45000; t += SAMPLE_MS) {
+        CHECK_EQ(excursion_check(&ex, t, 860), EXCURSION_NONE);
+        CHECK(excursion_active(&ex));
+    }
+
+    // ...and it clears on the first sample after that reading ages out
+    CHECK_EQ(excursion_check(&ex, 20000 + 45000 + 1, 860), EXCURSION_CLEAR);
+    CHECK_EQ(ex.trips, 1);
+}
+
+static void test_reentry(void) {
+    excursion_t ex;
+    excursion_init(&ex, &CO2_EXCURSION);
+    CHECK_EQ(excursion_check(&ex, 0, 1100), EXCURSION_START);
+    CHECK_EQ(excursion_check(&ex, SAMPLE_MS, 850), EXCURSION_CLEAR);
+
+    // Back over the level
+    CHECK_EQ(excursion_check(&ex, 2 * SAMPLE_MS, 1000), EXCURSION_START);
+    CHECK_EQ(ex.trips, 2);
+    CHECK_EQ(excursion_check(&ex, 3 * SAMPLE_MS, 800), EXCURSION_CLEAR);
+
+    // A fresh rise from the new minimum starts a third one below the level
+    CHECK_EQ(excursion_check(&ex, 4 * SAMPLE_MS, 950), EXCURSION_START);
+    CHECK_EQ(ex.trips, 3);
+}
+
+static void test_clock_wrap(void) {
+    excursion_t ex;
+    excursion_init(&ex, &CO2_EXCURSION);
+
+    // The rise window is measured across the 32-bit ms wrap
+    uint32_t t = UINT32_MAX - 2000;
+    CHECK_EQ(excursion_check(&ex, t, 600), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, t + SAMPLE_MS, 760), EXCURSION_START);
+    CHECK_EQ(excursion_check(&ex, t + 45000, 760), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, t + 45001, 760), EXCURSION_CLEAR);
+}
+
+static void test_unused_thresholds(void) {
+    // Level only: no rise can start it
+    static const excursion_config_t level_only = { 1000, 900, 0, 45000 };
+    excursion_t ex;
+    excursion_init(&ex, &level_only);
+    CHECK_EQ(excursion_check(&ex, 0, 400), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, SAMPLE_MS, 990), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, 2 * SAMPLE_MS, 1000), EXCURSION_START);
+
+    // Rise only: no level can start it
+    static const excursion_config_t rise_only = { 0, 900, 150, 45000 };
+    excursion_init(&ex, &rise_only);
+    CHECK_EQ(excursion_check(&ex, 0, 5000), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, SAMPLE_MS, 5100), EXCURSION_NONE);
+    CHECK_EQ(excursion_check(&ex, 2 * SAMPLE_MS, 5150), EXCURSION_START);
+}
+
+int main(void) {
+    test_level_entry();
+    test_hysteresis();
+    test_rise_threshold();
+    test_rise_holds_until_it_ages_out();
+    test_reentry();
+    test_clock_wrap();
+    test_unused_thresholds();
+    return TEST_RESULT();
+}
@@ -0,0 +1,177 @@
+#include "filter_pipeline.h"
+#include "test_common.h"
+#include <stdlib.h>
+
+/* ==========================================================
+   Float reference: the ema_filter.c this pipeline replaced
+   ========================================================== */
+static float ema_alpha = 0.25f;
+static float ema_prev = 0.0f;
+static bool ema_started = false;
+
+static float ema_process(float new_value) {
+    if (!ema_started) {
+        ema_prev = new_value;
+        ema_started = true;
+        return ema_prev;
+    }
+    ema_prev = (ema_alpha * new_value) + ((1.0f - ema_alpha) * ema_prev);
+    return ema_prev;
+}
+
+static double q16_to_double(q16_t v) {
+    return v / 65536.0;
+}
+
+/* ==========================================================
+   Tests
+   ========================================================== */
+static void test_ema_matches_float(void) {
+    filter_config_t cfg = { FILTER_STAGE_EMA, 1, Q16_FROM_FRAC(1, 4), 0 };
+    filter_t f;
+    filter_init(&f, &cfg);
+
+    // Random walk across the whole accepted range, plus some large jumps
+    double max_err = 0;
+    uint32_t x = 400;
+    srand(1);
+    for (int i = 0; i < 200000; i++) {
+        if (i % 1000 == 0) {
+            x = 400 + (uint32_t)rand() % (FILTER_UINT_MAX - 400);
+        } else {
+            x = (uint32_t)((int32_t)x + rand() % 41 - 20);
+            if (x < 1) x = 1;
+            if (x > FILTER_UINT_MAX) x = FILTER_UINT_MAX;
+        }
+        double expect = ema_process((float)x);
+        double got = q16_to_double(filter_process(&f, filter_from_uint(x)));
+        double err = got > expect ? got - expect : expect - got;
+        if (err > max_err) max_err = err;
+    }
+    printf("EMA vs float: max abs error %.5f ppm\n", max_err);
+    // float itself carries ~0.002 ppm at 32767; Q16 truncation adds less
+    CHECK(max_err < 0.01);
+}
+
+static void test_median_rejects_spike(void) {
+    filter_config_t cfg = { FILTER_STAGE_MEDIAN, 3, 0, 0 };
+    filter_t f;
+    filter_init(&f, &cfg);
+
+    const uint32_t in[]  = { 400, 410, 5000, 420, 430, 3000, 3000, 3000 };
+    const uint32_t out[] = { 400, 410,  410, 420, 430,  430, 3000, 3000 };
+    for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+        CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(in[i]))), out[i]);
+    }
+}
+
+static void test_slew_limit(void) {
+    filter_config_t cfg = { FILTER_STAGE_SLEW, 1, 0, Q16_FROM_INT(500) };
+    filter_t f;
+    filter_init(&f, &cfg);
+
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(1000))), 1000);
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(2600))), 1500);
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(2600))), 2000);
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(2600))), 2500);
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(2600))), 2600);
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(0))), 2100);
+}
+
+static void test_full_chain(void) {
+    // The chain main.c installs for the CO2 channel
+    filter_config_t cfg = {
+        FILTER_STAGE_MEDIAN | FILTER_STAGE_EMA | FILTER_STAGE_SLEW,
+        3, Q16_FROM_FRAC(1, 4), Q16_FROM_INT(500)
+    };
+    filter_t f;
+    filter_init(&f, &cfg);
+
+    // Steady input settles on the input, a lone spike leaves no trace
+    for (int i = 0; i < 50; i++) {
+        filter_process(&f, filter_from_uint(800));
+    }
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(20000))), 800);
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(800))), 800);
+
+    // A sustained step is followed, never faster than the slew limit
+    uint32_t prev = 800;
+    for (int i = 0; i < 100; i++) {
+        uint32_t v = filter_to_uint_round(filter_process(&f, filter_from_uint(6000)));
+        CHECK(v >= prev && v - prev <= 500);
+        prev = v;
+    }
+    CHECK(prev >= 5999 && prev <= 6000);
+}
+
+static void test_range_edges(void) {
+    CHECK_EQ(filter_to_uint_round(filter_from_uint(0)), 0);
+    CHECK_EQ(filter_to_uint_round(filter_from_uint(FILTER_UINT_MAX)), FILTER_UINT_MAX);
+    CHECK_EQ(filter_from_uint(FILTER_UINT_MAX), Q16_FROM_INT(FILTER_UINT_MAX));
+
+    // Above FILTER_UINT_MAX the value saturates, which is why acd1100.c
+    // rejects such readings rather than passing them in
+    CHECK_EQ(filter_from_uint(FILTER_UINT_MAX + 1), Q16_MAX);
+    CHECK_EQ(filter_from_uint(50000), Q16_MAX);
+
+    // The full chain stays exact at the top of the range
+    filter_config_t cfg = {
+        FILTER_STAGE_MEDIAN | FILTER_STAGE_EMA | FILTER_STAGE_SLEW,
+        5, Q16_FROM_FRAC(1, 4), Q16_FROM_INT(500)
+    };
+    filter_t f;
+    filter_init(&f, &cfg);
+    for (int i = 0; i < 200; i++) {
+        filter_process(&f, filter_from_uint(FILTER_UINT_MAX));
+    }
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(FILTER_UINT_MAX))),
+             FILTER_UINT_MAX);
+    CHECK_EQ(filter_to_uint_round(Q16_MIN), 0);
+}
+
+static void test_config_clamping(void) {
+    filter_t f;
+
+    filter_config_t even = { FILTER_STAGE_MEDIAN, 4, 0, 0 };
+    filter_init(&f, &even);
+    CHECK_EQ(f.cfg.median_n, 3);
+
+    filter_config_t wide = { FILTER_STAGE_MEDIAN, 20, 0, 0 };
+    filter_init(&f, &wide);
+    CHECK_EQ(f.cfg.median_n, FILTER_MEDIAN_MAX);
+
+    filter_config_t zero = { FILTER_STAGE_MEDIAN, 0, 0, 0 };
+    filter_init(&f, &zero);
+    CHECK_EQ(f.cfg.median_n, 1);
+
+    filter_config_t alpha = { FILTER_STAGE_EMA, 1, Q16_FROM_INT(3), 0 };
+    filter_init(&f, &alpha);
+    CHECK_EQ(f.cfg.ema_alpha, Q16_ONE);
+
+    filter_config_t slew = { FILTER_STAGE_SLEW, 1, 0, 0 };
+    filter_init(&f, &slew);
+    CHECK_EQ(f.cfg.stages & FILTER_STAGE_SLEW, 0);
+}
+
+static void test_reset(void) {
+    filter_config_t cfg = { FILTER_STAGE_EMA | FILTER_STAGE_SLEW, 1, Q16_FROM_FRAC(1, 4), Q16_FROM_INT(10) };
+    filter_t f;
+    filter_init(&f, &cfg);
+
+    filter_process(&f, filter_from_uint(400));
+    filter_process(&f, filter_from_uint(4000));
+    filter_reset(&f);
+    // First sample after a reset passes straight through
+    CHECK_EQ(filter_to_uint_round(filter_process(&f, filter_from_uint(4000))), 4000);
+}
+
+int main(void) {
+    test_ema_matches_float();
+    test_median_rejects_spike();
+    test_slew_limit();
+    test_full_chain();
+    test_range_edges();
+    test_config_clamping();
+    test_reset();
+    return TEST_RESULT();
+}
@@ -0,0 +1,71 @@
+#include "fmt_utils.h"
+#include "test_common.h"
+#include <inttypes.h>
+#include <string.h>
+
+static void check_u64(uint64_t v) {
+    char got[32], expect[32];
+    fmt_buf_t f;
+    fmt_init(&f, got, sizeof(got));
+    fmt_put_u64(&f, v);
+    snprintf(expect, sizeof(expect), "%" PRIu64, v);
+    if (strcmp(got, expect) != 0) {
+        printf("u64 %s formatted as %s\n", expect, got);
+        test_failures++;
+    }
+}
+
+static void test_u64(void) {
+    const uint64_t edges[] = {
+        0, 9, 10, UINT32_MAX, (uint64_t)UINT32_MAX + 1,
+        999999999u, 1000000000u, 1000000001u,
+        1700000000000ull,            // epoch ms
+        1700000000000000ull,         // epoch us
+        4294967295999999999ull,      // largest with a 32-bit upper part
+        4294967296000000000ull,      // first needing a second divide
+        UINT64_MAX
+    };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        check_u64(edges[i]);
+        if (edges[i] > 0) check_u64(edges[i] - 1);
+    }
+
+    uint64_t x = 88172645463325252ull;
+    for (int i = 0; i < 100000; i++) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        check_u64(x >> (i % 64));
+    }
+}
+
+static void test_u64_overflow_drops_whole(void) {
+    char buf[16];
+    fmt_buf_t f;
+    fmt_init(&f, buf, sizeof(buf));
+    fmt_put_str(&f, "ts=");
+    fmt_put_u64(&f, 1700000000000000ull);   // 16 digits, doesn't fit
+    CHECK(f.overflow);
+    CHECK_EQ(fmt_finish(&f), 0);
+    CHECK(strcmp(buf, "ts=") == 0);
+}
+
+static void test_q16(void) {
+    char buf[32];
+    fmt_buf_t f;
+
+    fmt_init(&f, buf, sizeof(buf));
+    fmt_put_q16(&f, 800 << 16, 0);
+    fmt_put_char(&f, ' ');
+    fmt_put_q16(&f, -(3 << 15), 1);          // -1.5
+    fmt_put_char(&f, ' ');
+    fmt_put_q16(&f, (1 << 16) - 1, 2);       // 0.99998 rounds up to 1.00
+    fmt_put_char(&f, ' ');
+    fmt_put_q16(&f, -1, 2);                  // tiny negative prints as 0.00
+    CHECK(strcmp(buf, "800 -1.5 1.00 0.00") == 0);
+}
+
+int main(void) {
+    test_u64();
+    test_u64_overflow_drops_whole();
+    test_q16();
+    return TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+#include "mqtt_driver.h"
+#include "sample_schedule.h"
+#include "log_buffer.h"
+#include "sensor_record.h"
+#include "fake_lwip.h"
+#include "test_common.h"
+#include "pico/cyw43_arch.h"
+#include <string.h>
+#include <unistd.h>
+
+// Persistent session: level changes published while the node was offline
+// are kept by the broker and sent as QoS1 PUBLISHes right after CONNACK,
+// before anything is resubscribed. Each one has to reach the safety-level
+// handler and be PUBACKed, or the broker keeps resending it.
+
+volatile int safety_level = 0;
+
+#define MAX_CHANGES 8
+static int changes[MAX_CHANGES];
+static uint32_t n_changes;
+
+void sched_level_changed(void) {
+    if (n_changes < MAX_CHANGES) changes[n_changes] = safety_level;
+    n_changes++;
+}
+
+// Deferred log records are not under test
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {}
+
+// main.c's handler for the safety-level topic
+void mqtt_message_received(const char *topic, const char *payload, uint16_t len);
+
+static int saved_stdout = -1;
+static void quiet(bool on) {
+    fflush(stdout);
+    if (on) {
+        saved_stdout = dup(STDOUT_FILENO);
+        if (!freopen("/dev/null", "w", stdout)) saved_stdout = -1;
+    } else if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+// Connect and resubscribe as power_radio_wake() and main.c's radio_up() do
+static bool reconnect(void) {
+    quiet(true);
+    bool ok = mqtt_init("pico2") == MQTT_OK &&
+              mqtt_connect("192.168.1.10", 1883, mqtt_message_received) == MQTT_OK;
+    for (int t = 0; ok && t < 10 && mqtt_get_status() != MQTT_STATUS_CONNECTED; t++) {
+        cyw43_arch_poll();
+    }
+    ok = ok && mqtt_get_status() == MQTT_STATUS_CONNECTED &&
+         mqtt_subscribe_topic("pico4/prediction", 1) == MQTT_OK;
+    if (ok) {
+        mqtt_drain_updates(2000, MQTT_DRAIN_IDLE_MS);
+    }
+    quiet(false);
+    return ok;
+}
+
+static void reset(void) {
+    fake_lwip_reset();
+    safety_level = 0;
+    n_changes = 0;
+}
+
+static void test_stored_publishes_delivered_and_acked(void) {
+    reset();
+    mqtt_set_clean_session(false);
+
+    // Broker kept three changes for us; the retained value is the newest
+    CHECK(fake_lwip_store_publish("pico4/prediction", "WARNING", 7));
+    CHECK(fake_lwip_store_publish("pico4/prediction", "HIGH", 4));
+    CHECK(fake_lwip_store_publish("pico4/prediction", "NORMAL", 6));
+    fake_lwip_set_retained(true, "NORMAL", 6);
+
+    CHECK(reconnect());
+    CHECK_EQ(fake_lwip.clean_session_sent, 0);
+    CHECK_EQ(fake_lwip.stored_sent, 3);
+
+    // Handled in order...
+    CHECK_EQ(n_changes, 3);
+    CHECK_EQ(changes[0], 1);
+    CHECK_EQ(changes[1], 2);
+    CHECK_EQ(changes[2], 0);
+    CHECK_EQ(safety_level, 0);
+
+    // ...and each one acknowledged with its own packet id
+    CHECK_EQ(fake_lwip.pubacks, 3);
+    CHECK_EQ(fake_lwip.puback_bad_id, 0);
+    CHECK_EQ(fake_lwip_stored_pending(), 0);
+
+    // Nothing is resent on the next wake
+    mqtt_disconnect_client();
+    CHECK(reconnect());
+    CHECK_EQ(fake_lwip.stored_sent, 3);
+    CHECK_EQ(n_changes, 3);
+    mqtt_disconnect_client();
+    CHECK_EQ(fake_lwip.unlocked_calls, 0);
+}
+
+static void test_binary_records_acked(void) {
+    // Pico4 may publish the prediction as a binary record instead
+    sensor_record_t high = {
+        .type = SR_TYPE_PREDICTION, .count = 1, .seq = 7, .ts_ms = 10000,
+        .values = { 2 << 16 }
+    };
+    uint8_t rec[SR_MAX_LEN];
+    size_t len = sr_encode(&high, rec, sizeof(rec));
+    CHECK(len > 0);
+
+    reset();
+    mqtt_set_clean_session(false);
+    CHECK(fake_lwip_store_publish("pico4/prediction", rec, (uint16_t)len));
+    fake_lwip_set_retained(true, rec, (uint16_t)len);
+
+    CHECK(reconnect());
+    CHECK_EQ(safety_level, 2);
+    CHECK_EQ(fake_lwip.pubacks, 1);
+    CHECK_EQ(fake_lwip_stored_pending(), 0);
+    mqtt_disconnect_client();
+}
+
+static void test_clean_session_loses_them(void) {
+    // Without the persistent session the broker drops what it kept, so
+    // only the retained value arrives: the case the session exists for
+    reset();
+    mqtt_set_clean_session(true);
+    CHECK(fake_lwip_store_publish("pico4/prediction", "HIGH", 4));
+    fake_lwip_set_retained(true, "WARNING", 7);
+
+    CHECK(reconnect());
+    CHECK_EQ(fake_lwip.clean_session_sent, 1);
+    CHECK_EQ(fake_lwip.stored_sent, 0);
+    CHECK_EQ(n_changes, 1);
+    CHECK_EQ(safety_level, 1);
+    mqtt_disconnect_client();
+}
+
+int main(void) {
+    test_stored_publishes_delivered_and_acked();
+    test_binary_records_acked();
+    test_clean_session_loses_them();
+    return TEST_RESULT();
+}
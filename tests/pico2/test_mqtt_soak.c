@@ -0,0 +1,112 @@
+#include "mqtt_driver.h"
+#include "sample_schedule.h"
+#include "log_buffer.h"
+#include "fake_lwip.h"
+#include "test_common.h"
+#include "pico/cyw43_arch.h"
+#include <string.h>
+#include <unistd.h>
+
+// Soak test for the wake-cycle MQTT path: mqtt_init()/mqtt_connect()/
+// mqtt_disconnect_client() run over and over against a fake lwIP whose
+// heap counts every mem_malloc(). The client is reused, so after the
+// first cycle nothing may be allocated, no connection may be left open
+// and lwIP may never be entered without its lock.
+
+#define SOAK_CYCLES 20000
+
+volatile int safety_level = 0;
+static uint32_t level_changes;
+
+void sched_level_changed(void) { level_changes++; }
+
+// Deferred log records are not under test
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {}
+
+// main.c's handler for the safety-level topic
+void mqtt_message_received(const char *topic, const char *payload, uint16_t len);
+
+// One wake cycle as main.c runs it; returns false if the broker never answered
+static bool wake_cycle(uint32_t i) {
+    if (mqtt_init("pico2") != MQTT_OK) return false;
+    if (mqtt_connect("192.168.1.10", 1883, mqtt_message_received) != MQTT_OK) return false;
+    for (int t = 0; t < 10 && mqtt_get_status() != MQTT_STATUS_CONNECTED; t++) {
+        cyw43_arch_poll();
+    }
+    if (mqtt_get_status() != MQTT_STATUS_CONNECTED) return false;
+
+    if (mqtt_subscribe_topic("safety/level", 1) != MQTT_OK) return false;
+    if (mqtt_publish_message("sensor/co2", "812", 1, 0) != MQTT_OK) return false;
+    mqtt_drain_updates(2000, MQTT_DRAIN_IDLE_MS);
+
+    // Odd cycles drop the connection, even ones leave it for the next
+    // mqtt_init() to close, as a wake without radio_down() would
+    if (i & 1) {
+        mqtt_disconnect_client();
+    }
+    return true;
+}
+
+static void test_soak(void) {
+    fake_lwip_reset();
+    fake_lwip_set_retained(true, "WARNING", 7);
+    mqtt_set_clean_session(false);
+
+    // The driver prints on every cycle; keep ctest's log readable
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    FILE *null = freopen("/dev/null", "w", stdout);
+
+    uint32_t failed_cycles = 0;
+    uint32_t first_cycle_mallocs = 0;
+    uint32_t worst_cycle_mallocs = 0;
+    for (uint32_t i = 0; i < SOAK_CYCLES; i++) {
+        uint32_t before = fake_lwip.mallocs;
+        if (!wake_cycle(i)) failed_cycles++;
+        uint32_t used = fake_lwip.mallocs - before;
+        if (i == 0) {
+            first_cycle_mallocs = used;
+        } else if (used > worst_cycle_mallocs) {
+            worst_cycle_mallocs = used;
+        }
+    }
+    mqtt_disconnect_client();
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    (void)null;
+
+    printf("%d cycles: %lu allocation(s) in cycle 1, worst %lu per cycle after, "
+           "%lu connection(s) opened, %lu left open\n",
+           SOAK_CYCLES, (unsigned long)first_cycle_mallocs,
+           (unsigned long)worst_cycle_mallocs,
+           (unsigned long)fake_lwip.pcbs_opened, (unsigned long)fake_lwip.pcbs_live);
+
+    CHECK_EQ(failed_cycles, 0);
+    CHECK_EQ(first_cycle_mallocs, 0);
+    CHECK_EQ(worst_cycle_mallocs, 0);
+    CHECK_EQ(fake_lwip.mallocs - fake_lwip.frees, 0);
+    CHECK_EQ(fake_lwip.pcbs_opened, SOAK_CYCLES);
+    CHECK_EQ(fake_lwip.pcbs_live, 0);
+    CHECK_EQ(fake_lwip.unlocked_calls, 0);
+    CHECK_EQ(fake_lwip.lock_depth, 0);
+
+    // Persistent session requested on every CONNECT
+    CHECK_EQ(fake_lwip.clean_session_sent, 0);
+
+    // Every drain ended on the retained message, well inside max_ms
+    mqtt_resync_stats_t rs;
+    mqtt_get_resync_stats(&rs);
+    CHECK_EQ(rs.drains, SOAK_CYCLES);
+    CHECK_EQ(rs.by_retained, SOAK_CYCLES);
+    CHECK(rs.saved_ms > (uint64_t)SOAK_CYCLES * 1900);
+    CHECK_EQ(safety_level, 1);
+    CHECK_EQ(level_changes, 1);
+}
+
+int main(void) {
+    test_soak();
+    return TEST_RESULT();
+}
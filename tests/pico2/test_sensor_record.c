@@ -0,0 +1,187 @@
+#include "sensor_record.h"
+#include "test_common.h"
+#include <string.h>
+
+// The binary record shared by Pico2/3/4 (identical copies; this builds
+// Pico2's). Every field has to survive a round trip, and any damaged or
+// foreign payload has to be rejected rather than decoded into values.
+
+static sensor_record_t make_record(uint8_t type, uint8_t count) {
+    sensor_record_t rec = { .type = type, .count = count, .seq = 0xBEEF,
+                            .ts_ms = 0xFEDCBA98u };
+    for (uint8_t i = 0; i < count; i++) {
+        rec.values[i] = (int32_t)(0x01020304u * (i + 1)) ^ (i & 1 ? INT32_MIN : 0);
+    }
+    return rec;
+}
+
+static void test_round_trip(void) {
+    for (uint8_t n = 1; n <= SR_MAX_VALUES; n++) {
+        sensor_record_t rec = make_record(SR_TYPE_CO2_SUMMARY, n);
+        uint8_t buf[SR_MAX_LEN];
+        size_t len = sr_encode(&rec, buf, sizeof(buf));
+        CHECK_EQ(len, SR_HEADER_LEN + 4u * n + 2u);
+        CHECK_EQ(buf[0], SR_MAGIC);
+        CHECK_EQ(buf[1], SR_VERSION);
+        CHECK(sr_is_binary(buf, len));
+
+        sensor_record_t out;
+        memset(&out, 0x55, sizeof(out));
+        CHECK_EQ(sr_decode(buf, len, &out), SR_OK);
+        CHECK_EQ(out.type, rec.type);
+        CHECK_EQ(out.count, n);
+        CHECK_EQ(out.seq, rec.seq);
+        CHECK_EQ(out.ts_ms, rec.ts_ms);
+        for (uint8_t i = 0; i < n; i++) {
+            CHECK_EQ(out.values[i], rec.values[i]);
+        }
+    }
+
+    // Extremes of each field
+    sensor_record_t rec = { .type = SR_TYPE_CO2, .count = 2, .seq = 0xFFFF,
+                            .ts_ms = UINT32_MAX, .values = { INT32_MIN, INT32_MAX } };
+    uint8_t buf[SR_MAX_LEN];
+    size_t len = sr_encode(&rec, buf, sizeof(buf));
+    sensor_record_t out;
+    CHECK_EQ(sr_decode(buf, len, &out), SR_OK);
+    CHECK_EQ(out.seq, 0xFFFF);
+    CHECK_EQ(out.ts_ms, UINT32_MAX);
+    CHECK_EQ(out.values[0], INT32_MIN);
+    CHECK_EQ(out.values[1], INT32_MAX);
+
+    // Little-endian on the wire whatever the host order
+    CHECK_EQ(buf[4], 0xFF);
+    CHECK_EQ(buf[6], 0xFF);
+    CHECK_EQ(buf[SR_HEADER_LEN + 3], 0x80);
+}
+
+static void test_crc_mismatch(void) {
+    sensor_record_t rec = make_record(SR_TYPE_CO2_SUMMARY, SR_SUMMARY_VALUES);
+    uint8_t good[SR_MAX_LEN];
+    size_t len = sr_encode(&rec, good, sizeof(good));
+
+    // Every single-bit error is rejected; outside the magic, version and
+    // count bytes (checked first) it is the CRC that catches it
+    uint32_t accepted = 0, not_crc = 0;
+    for (size_t byte = 0; byte < len; byte++) {
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t buf[SR_MAX_LEN];
+            memcpy(buf, good, len);
+            buf[byte] ^= (uint8_t)(1u << bit);
+            sensor_record_t out;
+            sr_status_t st = sr_decode(buf, len, &out);
+            if (st == SR_OK) accepted++;
+            if (byte != 0 && byte != 1 && byte != 3 && st != SR_ERR_CRC) not_crc++;
+        }
+    }
+    CHECK_EQ(accepted, 0);
+    CHECK_EQ(not_crc, 0);
+
+    // Two swapped values with the header untouched
+    uint8_t buf[SR_MAX_LEN];
+    memcpy(buf, good, len);
+    for (int i = 0; i < 4; i++) {
+        uint8_t t = buf[SR_HEADER_LEN + i];
+        buf[SR_HEADER_LEN + i] = buf[SR_HEADER_LEN + 4 + i];
+        buf[SR_HEADER_LEN + 4 + i] = t;
+    }
+    sensor_record_t out;
+    CHECK_EQ(sr_decode(buf, len, &out), SR_ERR_CRC);
+}
+
+static void test_max_values_bound(void) {
+    uint8_t buf[SR_MAX_LEN + 8];
+    sensor_record_t out;
+
+    // Encoder: 1..SR_MAX_VALUES values, and the buffer must hold them
+    sensor_record_t rec = make_record(SR_TYPE_CO2, SR_MAX_VALUES);
+    CHECK_EQ(sr_encode(&rec, buf, SR_MAX_LEN), SR_MAX_LEN);
+    CHECK_EQ(sr_encode(&rec, buf, SR_MAX_LEN - 1), 0);
+    rec.count = SR_MAX_VALUES + 1;
+    CHECK_EQ(sr_encode(&rec, buf, sizeof(buf)), 0);
+    rec.count = 0;
+    CHECK_EQ(sr_encode(&rec, buf, sizeof(buf)), 0);
+    CHECK_EQ(sr_encode(NULL, buf, sizeof(buf)), 0);
+
+    // Decoder: a count above the bound is refused even with a length and
+    // CRC to match, so values[] can never be overrun
+    rec = make_record(SR_TYPE_CO2, SR_MAX_VALUES);
+    size_t len = sr_encode(&rec, buf, sizeof(buf));
+    uint8_t big[SR_MAX_LEN + 4];
+    memcpy(big, buf, len - 2);
+    big[3] = SR_MAX_VALUES + 1;
+    memset(&big[len - 2], 0, 4);
+    uint16_t crc = sr_crc16(big, len + 2);
+    big[len + 2] = (uint8_t)crc;
+    big[len + 3] = (uint8_t)(crc >> 8);
+    CHECK_EQ(sr_decode(big, len + 4, &out), SR_ERR_LENGTH);
+
+    // Length must match the count exactly
+    CHECK_EQ(sr_decode(buf, len - 1, &out), SR_ERR_LENGTH);
+    CHECK_EQ(sr_decode(buf, len + 1, &out), SR_ERR_LENGTH);
+    CHECK_EQ(sr_decode(buf, SR_HEADER_LEN + 5, &out), SR_ERR_LENGTH);
+    CHECK_EQ(sr_decode(buf, 0, &out), SR_ERR_LENGTH);
+    CHECK_EQ(sr_decode(NULL, len, &out), SR_ERR_INVAL);
+    CHECK_EQ(sr_decode(buf, len, NULL), SR_ERR_INVAL);
+}
+
+static void test_version_and_magic(void) {
+    sensor_record_t rec = make_record(SR_TYPE_CO2, 1);
+    uint8_t buf[SR_MAX_LEN];
+    size_t len = sr_encode(&rec, buf, sizeof(buf));
+    sensor_record_t out;
+
+    // A record from a build before SR_MAX_VALUES and the summary type
+    // changed is refused, not misread
+    buf[1] = 1;
+    CHECK_EQ(sr_decode(buf, len, &out), SR_ERR_VERSION);
+    CHECK(SR_VERSION != 1);
+
+    // Text payloads never look binary
+    static const char *const TEXT[] = { "812", "NORMAL", "-3.5", "1000:812," };
+    for (size_t i = 0; i < sizeof(TEXT) / sizeof(TEXT[0]); i++) {
+        CHECK(!sr_is_binary(TEXT[i], strlen(TEXT[i])));
+        CHECK_EQ(sr_decode((const uint8_t *)TEXT[i], strlen(TEXT[i]), &out) == SR_OK, 0);
+    }
+    CHECK(!sr_is_binary(buf, 0));
+    CHECK(!sr_is_binary(NULL, 4));
+}
+
+static void test_unknown_type(void) {
+    // The decoder does not judge the type; it hands it back intact so each
+    // receiver can ignore what it does not know
+    sensor_record_t rec = make_record(0xEE, 3);
+    uint8_t buf[SR_MAX_LEN];
+    size_t len = sr_encode(&rec, buf, sizeof(buf));
+    CHECK(len > 0);
+    sensor_record_t out;
+    CHECK_EQ(sr_decode(buf, len, &out), SR_OK);
+    CHECK_EQ(out.type, 0xEE);
+    CHECK_EQ(out.count, 3);
+
+    // Prediction classes outside the known three have no label
+    CHECK(sr_prediction_label(-1) == NULL);
+    CHECK(sr_prediction_label(3) == NULL);
+    CHECK(strcmp(sr_prediction_label(2), "HIGH") == 0);
+}
+
+static void test_seq_gap(void) {
+    int32_t last = -1;
+    CHECK_EQ(sr_seq_gap(&last, 10), 0);       // first record
+    CHECK_EQ(sr_seq_gap(&last, 11), 0);
+    CHECK_EQ(sr_seq_gap(&last, 14), 2);
+    CHECK_EQ(sr_seq_gap(&last, 14), 0);       // duplicate
+    CHECK_EQ(sr_seq_gap(&last, 3), 0);        // producer rebooted
+    last = 0xFFFE;
+    CHECK_EQ(sr_seq_gap(&last, 1), 2);        // across the wrap
+}
+
+int main(void) {
+    test_round_trip();
+    test_crc_mismatch();
+    test_max_values_bound();
+    test_version_and_magic();
+    test_unknown_type();
+    test_seq_gap();
+    return TEST_RESULT();
+}
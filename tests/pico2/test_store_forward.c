@@ -0,0 +1,325 @@
+#include "store_forward.h"
+#include "flash_queue.h"
+#include "mqtt_driver.h"
+#include "nor_flash_sim.h"
+#include "fake_lwip.h"
+#include "fake_pico.h"
+#include "secrets.h"
+#include "test_common.h"
+#include "pico/cyw43_arch.h"
+#include "pico/stdlib.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Store-and-forward against the fake broker and a simulated flash queue:
+// records queued while offline replay on the backlog topics as
+// "age_ms:<payload>", after the live value, one QoS1 publish at a time,
+// and only leave flash once the broker has acknowledged them.
+
+volatile int safety_level = 0;
+void sched_level_changed(void) {}
+
+// Deferred log records are not under test
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {}
+
+uint32_t power_uptime_ms(void) {
+    return (uint32_t)(time_us_64() / 1000);
+}
+
+static int saved_stdout = -1;
+static void quiet(bool on) {
+    fflush(stdout);
+    if (on) {
+        saved_stdout = dup(STDOUT_FILENO);
+        if (!freopen("/dev/null", "w", stdout)) saved_stdout = -1;
+    } else if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static bool reconnect(void) {
+    quiet(true);
+    bool ok = mqtt_init("pico2") == MQTT_OK &&
+              mqtt_connect("192.168.1.10", 1883, NULL) == MQTT_OK;
+    for (int t = 0; ok && t < 10 && mqtt_get_status() != MQTT_STATUS_CONNECTED; t++) {
+        cyw43_arch_poll();
+    }
+    quiet(false);
+    return ok && mqtt_get_status() == MQTT_STATUS_CONNECTED;
+}
+
+static void offline(void) {
+    quiet(true);
+    mqtt_disconnect_client();
+    quiet(false);
+}
+
+// Empty flash, fresh boot, no connection
+static void boot_empty(void) {
+    offline();
+    fake_lwip_reset();
+    nor_sim_reset();
+    flash_queue_set_ops(&nor_sim_ops);
+    store_forward_init();
+}
+
+static sf_result_t publish_text(const char *topic, const char *text) {
+    return sf_publish(topic, text, (uint16_t)strlen(text));
+}
+
+// Split a backlog payload; age -1 if it was sent empty
+static bool backlog_parts(const fake_publish_t *p, long *age, char *body, size_t size) {
+    const uint8_t *colon = memchr(p->payload, ':', p->len);
+    if (!colon) return false;
+    size_t digits = (size_t)(colon - p->payload);
+    size_t n = p->len - digits - 1;
+    if (n >= size) return false;
+
+    char num[12] = "";
+    if (digits >= sizeof(num)) return false;
+    memcpy(num, p->payload, digits);
+    *age = digits ? strtol(num, NULL, 10) : -1;
+    memcpy(body, colon + 1, n);
+    body[n] = '\0';
+    return true;
+}
+
+static uint32_t count_on(const char *topic) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; fake_lwip_published(i); i++) {
+        if (strcmp(fake_lwip_published(i)->topic, topic) == 0) n++;
+    }
+    return n;
+}
+
+// The i-th publish on topic
+static const fake_publish_t *nth_on(const char *topic, uint32_t nth) {
+    for (uint32_t i = 0; fake_lwip_published(i); i++) {
+        const fake_publish_t *p = fake_lwip_published(i);
+        if (strcmp(p->topic, topic) == 0 && nth-- == 0) return p;
+    }
+    return NULL;
+}
+
+static void check_backlog(const char *topic, uint32_t nth, const char *body, long age_min) {
+    const fake_publish_t *p = nth_on(topic, nth);
+    CHECK(p != NULL);
+    if (!p) return;
+
+    long age = -2;
+    char got[FQ_PAYLOAD_MAX + 1];
+    CHECK(backlog_parts(p, &age, got, sizeof(got)));
+    CHECK(strcmp(got, body) == 0);
+    CHECK_EQ(p->qos, 1);
+    if (age_min < 0) {
+        CHECK_EQ(age, -1);
+    } else {
+        CHECK(age >= age_min && age < age_min + 5000);   // plus ack waits
+    }
+}
+
+static void test_backlog_replays_on_its_own_topics(void) {
+    boot_empty();
+
+    CHECK_EQ(publish_text(TOPIC_CO2, "812"), SF_QUEUED);
+    fake_pico_advance_us(30 * 1000000ull);
+    CHECK_EQ(publish_text(TOPIC_CO2_SUMMARY, "10,800,820,810.0,5.0,0.50,300"), SF_QUEUED);
+    fake_pico_advance_us(30 * 1000000ull);
+    CHECK_EQ(flash_queue_pending(), 2);
+
+    // Back online: the live value goes straight out on the live topic...
+    CHECK(reconnect());
+    CHECK_EQ(publish_text(TOPIC_CO2, "1450"), SF_PUBLISHED);
+    CHECK_EQ(count_on(TOPIC_CO2), 1);
+    CHECK_EQ(fake_lwip_published(0)->qos, 0);
+
+    // ...and the backlog follows on its own, dated by its age
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 2);
+    CHECK_EQ(count_on(TOPIC_CO2), 1);
+    CHECK_EQ(count_on(TOPIC_CO2_SUMMARY), 0);
+    check_backlog(TOPIC_CO2_BACKLOG, 0, "812", 60000);
+    check_backlog(TOPIC_CO2_SUMMARY_BACKLOG, 0, "10,800,820,810.0,5.0,0.50,300", 30000);
+    CHECK_EQ(flash_queue_pending(), 0);
+
+    // Nothing left to send
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    CHECK_EQ(fake_lwip.publishes, 3);
+}
+
+static void test_pop_only_on_ack(void) {
+    boot_empty();
+    publish_text(TOPIC_CO2, "801");
+    publish_text(TOPIC_CO2, "802");
+    publish_text(TOPIC_CO2, "803");
+    CHECK(reconnect());
+
+    // No PUBACK: one record goes out and stays queued, nothing behind it
+    fake_lwip_set_publish_outcome(FAKE_PUB_HOLD);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    CHECK_EQ(count_on(TOPIC_CO2_BACKLOG), 1);
+    CHECK_EQ(flash_queue_pending(), 3);
+
+    // Still waiting on the next cycle: not sent twice
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    CHECK_EQ(count_on(TOPIC_CO2_BACKLOG), 1);
+    CHECK_EQ(flash_queue_pending(), 3);
+
+    // The late PUBACK is what releases it
+    fake_lwip_set_publish_outcome(FAKE_PUB_ACK);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 3);
+    CHECK_EQ(count_on(TOPIC_CO2_BACKLOG), 3);
+    check_backlog(TOPIC_CO2_BACKLOG, 0, "801", 0);
+    check_backlog(TOPIC_CO2_BACKLOG, 1, "802", 0);
+    check_backlog(TOPIC_CO2_BACKLOG, 2, "803", 0);
+    CHECK_EQ(flash_queue_pending(), 0);
+}
+
+static void test_failure_leaves_head(void) {
+    boot_empty();
+    publish_text(TOPIC_CO2, "901");
+    publish_text(TOPIC_CO2, "902");
+    CHECK(reconnect());
+
+    // lwIP's request timer gave up on it
+    fake_lwip_set_publish_outcome(FAKE_PUB_FAIL);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    CHECK_EQ(count_on(TOPIC_CO2_BACKLOG), 1);
+    CHECK_EQ(flash_queue_pending(), 2);
+
+    // Sent again from the head, in order
+    fake_lwip_set_publish_outcome(FAKE_PUB_ACK);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 2);
+    check_backlog(TOPIC_CO2_BACKLOG, 0, "901", 0);
+    check_backlog(TOPIC_CO2_BACKLOG, 1, "901", 0);
+    check_backlog(TOPIC_CO2_BACKLOG, 2, "902", 0);
+    CHECK_EQ(flash_queue_pending(), 0);
+}
+
+static void test_connection_lost_in_flight(void) {
+    boot_empty();
+    publish_text(TOPIC_CO2, "701");
+    CHECK(reconnect());
+
+    fake_lwip_set_publish_outcome(FAKE_PUB_HOLD);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+
+    // lwIP drops the request without its callback; the record stays
+    offline();
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    CHECK_EQ(flash_queue_pending(), 1);
+
+    fake_lwip_set_publish_outcome(FAKE_PUB_ACK);
+    CHECK(reconnect());
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 1);
+    CHECK_EQ(count_on(TOPIC_CO2_BACKLOG), 2);
+    check_backlog(TOPIC_CO2_BACKLOG, 1, "701", 0);
+    CHECK_EQ(flash_queue_pending(), 0);
+}
+
+static void test_ack_timeout(void) {
+    boot_empty();
+    publish_text(TOPIC_CO2, "601");
+    CHECK(reconnect());
+
+    // Neither PUBACK nor lwIP's timeout ever comes: resent after
+    // SF_ACK_TIMEOUT_MS, the stale request's late ack ignored
+    fake_lwip_set_publish_outcome(FAKE_PUB_HOLD);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    fake_pico_advance_us((uint64_t)SF_ACK_TIMEOUT_MS * 1000);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    CHECK_EQ(flash_queue_pending(), 1);
+
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    CHECK_EQ(count_on(TOPIC_CO2_BACKLOG), 2);
+
+    fake_lwip_set_publish_outcome(FAKE_PUB_ACK);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 1);
+    CHECK_EQ(flash_queue_pending(), 0);
+    offline();
+}
+
+static void test_age_unknown_after_reboot(void) {
+    boot_empty();
+    publish_text(TOPIC_CO2, "501");
+    publish_text(TOPIC_CO2, "502");
+
+    // Reboot: the two stamps are from the previous uptime
+    store_forward_init();
+    fake_pico_advance_us(20 * 1000000ull);
+    publish_text(TOPIC_CO2, "503");
+    fake_pico_advance_us(10 * 1000000ull);
+
+    // Records written by an older build: unstamped, and an unknown tag
+    CHECK_EQ(flash_queue_append(0, "504", 3), FQ_OK);
+    CHECK_EQ(flash_queue_append(0x7F, "x", 1), FQ_OK);
+
+    CHECK(reconnect());
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 4);
+    check_backlog(TOPIC_CO2_BACKLOG, 0, "501", -1);
+    check_backlog(TOPIC_CO2_BACKLOG, 1, "502", -1);
+    check_backlog(TOPIC_CO2_BACKLOG, 2, "503", 10000);
+    check_backlog(TOPIC_CO2_BACKLOG, 3, "504", -1);
+    CHECK_EQ(count_on(TOPIC_CO2_BACKLOG), 4);
+    CHECK_EQ(flash_queue_pending(), 0);
+}
+
+static void test_head_dropped_in_flight(void) {
+    char text[12];
+    boot_empty();
+
+    // Fill the ring while offline
+    quiet(true);
+    uint32_t ring = 0;
+    fq_stats_t st;
+    do {
+        snprintf(text, sizeof(text), "%lu", (unsigned long)ring++);
+        CHECK_EQ(publish_text(TOPIC_CO2, text), SF_QUEUED);
+        flash_queue_get_stats(&st);
+    } while (st.dropped == 0 && ring < 1000);
+    quiet(false);
+    CHECK(st.dropped > 0);
+
+    // Record ring - 1 started the next trip round the ring and dropped the
+    // oldest sector; queue one more, then send the new head
+    uint32_t first = st.dropped;
+    CHECK(reconnect());
+    fake_lwip_set_publish_outcome(FAKE_PUB_HOLD);
+    CHECK_EQ(sf_forward(SF_FORWARD_PER_CALL), 0);
+    snprintf(text, sizeof(text), "%lu", (unsigned long)first);
+    check_backlog(TOPIC_CO2_BACKLOG, 0, text, 0);
+
+    // While it waits for its ack the ring wraps again and drops it
+    quiet(true);
+    uint32_t dropped = st.dropped;
+    while (st.dropped == dropped && ring < 2000) {
+        uint8_t rec[8] = { 0 };
+        CHECK_EQ(flash_queue_append(0x80, rec, 5), FQ_OK);
+        ring++;
+        flash_queue_get_stats(&st);
+    }
+    quiet(false);
+    uint32_t pending = flash_queue_pending();
+
+    // The ack must not pop the record that is now at the head
+    fake_lwip_set_publish_outcome(FAKE_PUB_ACK);
+    CHECK_EQ(sf_forward(1), 0);
+    CHECK_EQ(flash_queue_pending(), pending);
+    CHECK_EQ(sf_forward(1), 1);
+    CHECK_EQ(flash_queue_pending(), pending - 1);
+    offline();
+}
+
+int main(void) {
+    test_backlog_replays_on_its_own_topics();
+    test_pop_only_on_ack();
+    test_failure_leaves_head();
+    test_connection_lost_in_flight();
+    test_ack_timeout();
+    test_age_unknown_after_reboot();
+    test_head_dropped_in_flight();
+    return TEST_RESULT();
+}
@@ -0,0 +1,170 @@
+#include "window_stats.h"
+#include <math.h>
+#include <stdlib.h>
+#include "test_common.h"
+
+// window_stats against a double-precision reference, including the
+// window sizes the overflow comments in window_stats.c promise to handle.
+
+#define Q16_TOL (2.0 / 65536)   // output rounding plus the isqrt step
+// The slope is divided out per second in Q16 and only then scaled by 60
+#define SLOPE_TOL (61.0 / 65536)
+
+typedef struct {
+    double mean, stddev, slope_per_min;
+} reference_t;
+
+static uint32_t rng = 12345;
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245u + 12345u;
+    return rng >> 1;
+}
+
+// Two-pass mean, variance and least-squares slope, t in whole seconds as
+// window_stats_add() takes it
+static reference_t reference(const uint32_t *ms, const uint32_t *v, size_t n) {
+    reference_t r = { 0 };
+    double mt = 0, mv = 0;
+    for (size_t i = 0; i < n; i++) {
+        mt += (double)((ms[i] - ms[0]) / 1000u);
+        mv += v[i];
+    }
+    mt /= n;
+    mv /= n;
+
+    double svv = 0, stt = 0, stv = 0;
+    for (size_t i = 0; i < n; i++) {
+        double dt = (double)((ms[i] - ms[0]) / 1000u) - mt;
+        double dv = v[i] - mv;
+        svv += dv * dv;
+        stt += dt * dt;
+        stv += dt * dv;
+    }
+    r.mean = mv;
+    r.stddev = sqrt(svv / n);
+    r.slope_per_min = stt > 0 ? stv / stt * 60 : 0;
+    return r;
+}
+
+static double q16_to_double(q16_t v) {
+    return v / 65536.0;
+}
+
+static double worst_err;
+
+static void check_close(double got, double expect, double abs_tol, double rel,
+                        const char *what, size_t n) {
+    double err = fabs(got - expect);
+    double tol = abs_tol + fabs(expect) * rel;
+    if (err > tol) {
+        printf("n=%zu %s: got %.6f expected %.6f\n", n, what, got, expect);
+        test_failures++;
+    }
+    if (err > worst_err) worst_err = err;
+}
+
+static void check_window(const uint32_t *ms, const uint32_t *v, size_t n) {
+    window_stats_t w;
+    window_stats_reset(&w);
+    uint32_t lo = v[0], hi = v[0];
+    for (size_t i = 0; i < n; i++) {
+        window_stats_add(&w, ms[i], v[i]);
+        if (v[i] < lo) lo = v[i];
+        if (v[i] > hi) hi = v[i];
+    }
+
+    window_summary_t s;
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.count, n);
+    CHECK_EQ(s.span_ms, ms[n - 1] - ms[0]);
+    CHECK_EQ(s.min, filter_from_uint(lo));
+    CHECK_EQ(s.max, filter_from_uint(hi));
+
+    reference_t r = reference(ms, v, n);
+    check_close(q16_to_double(s.mean), r.mean, Q16_TOL, 0, "mean", n);
+    check_close(q16_to_double(s.stddev), r.stddev, Q16_TOL, 1e-6, "stddev", n);
+    check_close(q16_to_double(s.slope_per_min), r.slope_per_min, SLOPE_TOL, 1e-6, "slope", n);
+}
+
+static uint32_t ms_buf[20000];
+static uint32_t v_buf[20000];
+
+static void test_random_windows(void) {
+    for (int round = 0; round < 2000; round++) {
+        size_t n = 1 + next_rand() % 200;
+        uint32_t step = 500 + next_rand() % 60000;
+        uint32_t base = 300 + next_rand() % 30000;
+        uint32_t t = next_rand();     // includes windows across the ms wrap
+        for (size_t i = 0; i < n; i++) {
+            ms_buf[i] = t;
+            t += step + next_rand() % 1000;
+            uint32_t v = base + next_rand() % 2000;
+            v_buf[i] = v > FILTER_UINT_MAX ? FILTER_UINT_MAX : v;
+        }
+        check_window(ms_buf, v_buf, n);
+    }
+}
+
+// Largest spread and covariance for n samples: the first half at 0, the
+// second at FILTER_UINT_MAX
+static void check_worst_case(size_t n, uint32_t interval_ms) {
+    for (size_t i = 0; i < n; i++) {
+        ms_buf[i] = (uint32_t)(i * interval_ms);
+        v_buf[i] = i < n / 2 ? 0 : FILTER_UINT_MAX;
+    }
+    check_window(ms_buf, v_buf, n);
+}
+
+static void test_overflow_bounds(void) {
+    check_worst_case(720, 5000);      // an hour at 5 s
+    check_worst_case(17280, 5000);    // a day at 5 s, the bound in window_stats.c
+    check_worst_case(2, 120000);      // fewest samples with a slope
+
+    // Steady rise at the top of the range over a day
+    for (size_t i = 0; i < 17280; i++) {
+        ms_buf[i] = (uint32_t)(i * 5000);
+        v_buf[i] = FILTER_UINT_MAX - 17280 + (uint32_t)i;
+    }
+    check_window(ms_buf, v_buf, 17280);
+}
+
+static void test_edges(void) {
+    window_stats_t w;
+    window_summary_t s;
+    window_stats_reset(&w);
+    CHECK(!window_stats_summary(&w, &s));
+    CHECK_EQ(window_stats_age_ms(&w, 1234), 0);
+
+    // One sample, or several within the same second: no slope
+    window_stats_add(&w, 1000, 800);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.stddev, 0);
+    CHECK_EQ(s.slope_per_min, 0);
+    window_stats_add(&w, 1999, 900);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.slope_per_min, 0);
+    CHECK_EQ(s.stddev, Q16_FROM_INT(50));
+    CHECK_EQ(window_stats_age_ms(&w, 6000), 5000);
+
+    // A slope beyond the Q16 range saturates
+    window_stats_reset(&w);
+    window_stats_add(&w, 0, 0);
+    window_stats_add(&w, 1000, FILTER_UINT_MAX);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.slope_per_min, Q16_MAX);
+
+    // Falling trend comes out negative
+    window_stats_reset(&w);
+    window_stats_add(&w, 0, 1000);
+    window_stats_add(&w, 60000, 940);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.slope_per_min, Q16_FROM_INT(-60));
+}
+
+int main(void) {
+    test_random_windows();
+    test_overflow_bounds();
+    test_edges();
+    printf("worst abs error vs double: %.6f\n", worst_err);
+    return TEST_RESULT();
+}
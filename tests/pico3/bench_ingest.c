@@ -0,0 +1,147 @@
+#include "ingest_queue.h"
+#include "sd_driver.h"
+#include "storage_driver.h"
+#include "fake_fatfs.h"
+#include "fake_pico.h"
+#include "test_common.h"
+#include <string.h>
+#include <unistd.h>
+
+// Synthetic publisher against the ingest queue and the segmented log on
+// the RAM-disk card, in modelled card time (fakes/fake_fatfs.h). Rows
+// arrive in bursts, as several publishes in one TCP segment do, and are
+// pushed while the writer is mid-commit, as the lwIP callbacks on core0
+// do while core1 writes. The writer follows storage_core1_entry(): a
+// batch at INGEST_BATCH_WAKE rows or after INGEST_COMMIT_INTERVAL_MS,
+// segment preparation in between. On the board, INGEST_BENCHMARK does
+// the same through the real MQTT callback path.
+
+#define RUN_SECONDS   10
+#define BURST_ROWS    8
+#define CARD_SECTORS  (64u * 2048)   // 64 MB
+#define CARD_CSIZE    64
+
+static const uint32_t RATES[] = { 50, 500, 2000, 8000, 20000 };   // rows/s
+
+// Deferred log records are not under test
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {}
+
+static SD_Manager sd;
+
+// Publisher state
+static uint64_t next_burst_us;
+static uint64_t burst_period_us;
+static uint32_t offered;
+static uint32_t to_offer;
+
+static int saved_stdout = -1;
+static void quiet(bool on) {
+    fflush(stdout);
+    if (on) {
+        saved_stdout = dup(STDOUT_FILENO);
+        if (!freopen("/dev/null", "w", stdout)) saved_stdout = -1;
+    } else if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+// Every burst due by now, as the lwIP callbacks would have pushed it
+static void publish_until(uint64_t now_us) {
+    while (offered < to_offer && next_burst_us <= now_us) {
+        for (int i = 0; i < BURST_ROWS && offered < to_offer; i++) {
+            char row[64];
+            int len = snprintf(row, sizeof(row), "%llu,bench/ingest,%lu\n",
+                               1700000000000ull + next_burst_us / 1000,
+                               (unsigned long)(400 + offered % 1000));
+            ingest_push(row, (size_t)len);
+            offered++;
+        }
+        next_burst_us += burst_period_us;
+    }
+}
+
+static void commit_batch(void) {
+    uint64_t start_us = time_us_64();
+    uint32_t rows = 0;
+    const char *row;
+    size_t len;
+
+    while (rows < INGEST_BATCH_MAX && (row = ingest_peek(&len)) != NULL) {
+        sd_stream_append(&sd, row, len);
+        ingest_pop();
+        rows++;
+        publish_until(time_us_64());
+    }
+    if (rows > 0) {
+        ingest_note_batch(rows, (uint32_t)(time_us_64() - start_us));
+    }
+}
+
+static bool run(uint32_t rate, ingest_stats_t *s, uint64_t *span_us) {
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    quiet(true);
+    bool ok = sd_init(&sd) && sd_stream_open(&sd, "log", 0, 0);
+
+    ingest_init();
+    uint64_t start_us = time_us_64();
+    burst_period_us = 1000000ull * BURST_ROWS / rate;
+    next_burst_us = start_us;
+    offered = 0;
+    to_offer = rate * RUN_SECONDS;
+
+    uint32_t last_commit_ms = to_ms_since_boot(get_absolute_time());
+    while (ok && (offered < to_offer || ingest_pending() > 0)) {
+        publish_until(time_us_64());
+
+        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+        uint32_t pending = ingest_pending();
+        if (pending >= INGEST_BATCH_WAKE ||
+            (pending > 0 && now_ms - last_commit_ms >= INGEST_COMMIT_INTERVAL_MS)) {
+            commit_batch();
+            last_commit_ms = now_ms;
+            continue;
+        }
+        if (sd_stream_poll(&sd)) {
+            continue;
+        }
+        // Idle until the next burst or the commit interval
+        uint64_t now_us = time_us_64();
+        uint64_t wake_us = (uint64_t)(last_commit_ms + INGEST_COMMIT_INTERVAL_MS) * 1000;
+        if (offered < to_offer && next_burst_us < wake_us) wake_us = next_burst_us;
+        fake_pico_advance_us(wake_us > now_us ? wake_us - now_us : 1);
+    }
+    ok = ok && sd_stream_sync(&sd);
+    quiet(false);
+    *span_us = time_us_64() - start_us;
+    ingest_get_stats(s);
+    return ok && sd.log.errors == 0;
+}
+
+int main(void) {
+    printf("%u s per rate, bursts of %u rows, modelled card time "
+           "(cmd %u us, sector %u us, write busy %u us)\n",
+           RUN_SECONDS, BURST_ROWS, FAKE_DISK_CMD_US, FAKE_DISK_SECTOR_US,
+           FAKE_DISK_WRITE_BUSY_US);
+    printf("%8s %9s %9s %8s %6s %9s %11s\n",
+           "offered", "written", "rows/s", "dropped", "high", "avg batch", "worst commit");
+    for (size_t i = 0; i < count_of(RATES); i++) {
+        ingest_stats_t s;
+        uint64_t span_us = 1;
+        CHECK(run(RATES[i], &s, &span_us));
+        printf("%6lu/s %9lu %9.0f %8lu %3lu/%u %9.1f %8lu us\n",
+               (unsigned long)RATES[i], (unsigned long)s.written,
+               s.written * 1e6 / (double)span_us, (unsigned long)s.dropped,
+               (unsigned long)s.high_water, INGEST_QUEUE_LEN,
+               s.batches ? (double)s.written / s.batches : 0.0,
+               (unsigned long)s.max_batch_us);
+
+        // Everything offered is either written or counted as dropped
+        CHECK_EQ(s.enqueued + s.dropped, RATES[i] * RUN_SECONDS);
+        CHECK_EQ(s.written, s.enqueued);
+        CHECK_EQ(sd.log.records, s.written);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,112 @@
+#include "sd_driver.h"
+#include "fake_fatfs.h"
+#include "test_common.h"
+#include <string.h>
+#include <unistd.h>
+
+// Log rows through the segmented stream (sd_stream_append, with
+// sd_stream_poll after each as storage_driver.c's loop does) against the
+// old path (sd_write_data append: f_open, f_write, f_close per row), on
+// the RAM-disk card. Times are modelled card time from fakes/fake_fatfs.h,
+// not measurements: they rank the two paths by the card traffic they
+// cause. The board figures come from SD_BENCHMARK and sd_stream_report().
+
+#define BENCH_ROWS    200000         // ~5.6 MB: one segment rollover
+#define CARD_SECTORS  (64u * 2048)   // 64 MB
+#define CARD_CSIZE    64             // 32 KB clusters, the FAT32 default at this size
+
+// Deferred log records are not under test
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {}
+
+static SD_Manager sd;
+
+typedef struct {
+    uint64_t card_us;
+    uint32_t worst_us;
+    uint32_t read_sectors;
+    uint32_t write_sectors;
+    uint32_t writes;
+} result_t;
+
+static int saved_stdout = -1;
+static void quiet(bool on) {
+    fflush(stdout);
+    if (on) {
+        saved_stdout = dup(STDOUT_FILENO);
+        if (!freopen("/dev/null", "w", stdout)) saved_stdout = -1;
+    } else if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static size_t make_row(char *row, uint32_t i) {
+    return (size_t)snprintf(row, 64, "%llu,pico2/co2,%lu\n",
+                            1700000000000ull + i * 5000ull, (unsigned long)(400 + i % 4600));
+}
+
+static bool run(bool stream, result_t *r) {
+    char row[64];
+    bool ok = true;
+
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    quiet(true);
+    ok = sd_init(&sd) && (!stream || sd_stream_open(&sd, "log", 0, 0));
+    // Setup (the first segment's zero fill) is not part of the run
+    memset(&fake_disk, 0, sizeof(fake_disk));
+    memset(r, 0, sizeof(*r));
+
+    for (uint32_t i = 0; i < BENCH_ROWS && ok; i++) {
+        size_t len = make_row(row, i);
+        uint64_t start = fake_disk.busy_us;
+        if (stream) {
+            ok = sd_stream_append(&sd, row, len);
+        } else {
+            ok = sd_write_data(&sd, "old.csv", row, true);
+        }
+        uint32_t took = (uint32_t)(fake_disk.busy_us - start);
+        if (took > r->worst_us) r->worst_us = took;
+        if (stream) {
+            sd_stream_poll(&sd);
+        }
+    }
+    if (stream && ok) {
+        ok = sd_stream_sync(&sd);
+    }
+    quiet(false);
+
+    r->card_us = fake_disk.busy_us;
+    r->read_sectors = fake_disk.read_sectors;
+    r->write_sectors = fake_disk.write_sectors;
+    r->writes = fake_disk.writes;
+    return ok;
+}
+
+static void print(const char *name, const result_t *r) {
+    printf("%-22s %8.0f rec/s  worst %6u us  per record: %5.2f sectors read, "
+           "%5.2f written, %5.3f write commands\n",
+           name, BENCH_ROWS * 1e6 / (double)r->card_us, r->worst_us,
+           (double)r->read_sectors / BENCH_ROWS, (double)r->write_sectors / BENCH_ROWS,
+           (double)r->writes / BENCH_ROWS);
+}
+
+int main(void) {
+    result_t old_path, new_path;
+
+    printf("%d rows, modelled card time (cmd %u us, sector %u us, write busy %u us)\n",
+           BENCH_ROWS, FAKE_DISK_CMD_US, FAKE_DISK_SECTOR_US, FAKE_DISK_WRITE_BUSY_US);
+    CHECK(run(false, &old_path));
+    print("open/append/close", &old_path);
+    CHECK(run(true, &new_path));
+    print("segmented stream", &new_path);
+    CHECK_EQ(sd.log.rollovers, 1);
+    // Includes the background zero fill of the next segment
+    printf("stream: %.1fx the records/s, %.2fx the worst call\n",
+           (double)old_path.card_us / (double)new_path.card_us,
+           (double)new_path.worst_us / (double)old_path.worst_us);
+
+    CHECK(new_path.card_us < old_path.card_us);
+    return TEST_RESULT();
+}
@@ -0,0 +1,342 @@
+#include "sd_driver.h"
+#include "fake_fatfs.h"
+#include "fake_pico.h"
+#include "test_common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+// sd_driver.c's segmented log on the RAM-disk card. Built with
+// SD_SEG_SIZE at 64 KB so rollovers come quickly.
+
+#define CARD_SECTORS  16384   // 8 MB
+#define CARD_CSIZE    8       // 4 KB clusters
+#define LOG_DIR       "log"
+
+// Deferred log records are not under test
+void log_write(uint8_t level, const char *fmt, uint8_t nargs,
+               uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {}
+
+static SD_Manager sd;
+
+// What each segment should hold, header included
+static char expect[3][SD_SEG_SIZE + 1];
+
+static int saved_stdout = -1;
+static void quiet(bool on) {
+    fflush(stdout);
+    if (on) {
+        saved_stdout = dup(STDOUT_FILENO);
+        if (!freopen("/dev/null", "w", stdout)) saved_stdout = -1;
+    } else if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static bool boot(void) {
+    quiet(true);
+    bool ok = sd_init(&sd) && sd_stream_open(&sd, LOG_DIR, 0, 0);
+    quiet(false);
+    return ok;
+}
+
+static size_t make_row(char *row, uint32_t i) {
+    return (size_t)snprintf(row, 64, "%llu,pico2/co2,%lu\n",
+                            1700000000000ull + i * 5000ull, (unsigned long)(400 + i % 4600));
+}
+
+static bool append_row(uint32_t i) {
+    char row[64];
+    size_t len = make_row(row, i);
+    return sd_stream_append(&sd, row, len);
+}
+
+// Text of segment seg as it is on the card: up to the first zero byte
+static const char *card_text(uint32_t seg, size_t *len) {
+    static char text[SD_SEG_SIZE + 1];
+    char name[32];
+    uint32_t size;
+    LBA_t lba;
+
+    snprintf(name, sizeof(name), LOG_DIR "/LOG%05u.CSV", seg);
+    if (!fake_fatfs_stat(name, &size, &lba) || size != SD_SEG_SIZE) {
+        *len = 0;
+        return NULL;
+    }
+    for (uint32_t s = 0; s < SD_SEG_SECTORS; s++) {
+        memcpy(&text[s * SD_SECTOR_SIZE], fake_disk_sector(lba + s), SD_SECTOR_SIZE);
+    }
+    text[SD_SEG_SIZE] = '\0';
+    *len = strlen(text);
+    return text;
+}
+
+static void check_segment(uint32_t seg) {
+    size_t len;
+    const char *text = card_text(seg, &len);
+    CHECK(text != NULL);
+    if (!text) return;
+    CHECK_EQ(len, strlen(expect[seg]));
+    CHECK(memcmp(text, expect[seg], len) == 0);
+    // Everything after the text is zero, so a reboot finds the end
+    if (len < SD_SEG_SIZE) {
+        const uint8_t *last = fake_disk_sector(sd.log.seg_lba + SD_SEG_SECTORS - 1);
+        CHECK(seg != sd.log.seg || last[SD_SECTOR_SIZE - 1] == 0);
+    }
+}
+
+static void test_append_and_resume(void) {
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    CHECK(boot());
+    CHECK_EQ(sd.log.seg, 0);
+
+    strcpy(expect[0], SD_SEG_HEADER);
+    char row[64];
+    for (uint32_t i = 0; i < 300; i++) {
+        CHECK(append_row(i));
+        make_row(row, i);
+        strcat(expect[0], row);
+    }
+    CHECK(sd_stream_sync(&sd));
+    check_segment(0);
+
+    // Power off without closing: whatever was synced is resumed after it
+    CHECK(boot());
+    CHECK_EQ(sd.log.seg, 0);
+    for (uint32_t i = 300; i < 600; i++) {
+        CHECK(append_row(i));
+        make_row(row, i);
+        strcat(expect[0], row);
+    }
+    CHECK(sd_stream_sync(&sd));
+    check_segment(0);
+    CHECK_EQ(sd.log.errors, 0);
+}
+
+static void test_rollover(void) {
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    CHECK(boot());
+
+    strcpy(expect[0], SD_SEG_HEADER);
+    strcpy(expect[1], SD_SEG_HEADER);
+    uint32_t seg = 0;
+    char row[64];
+    quiet(true);
+    for (uint32_t i = 0; sd.log.seg < 2 || i % 100; i++) {
+        // Rows go to the next segment once they don't fit whole
+        size_t len = make_row(row, i);
+        if (strlen(expect[seg]) + len > SD_SEG_SIZE) {
+            seg++;
+            if (seg < 3) strcpy(expect[seg], SD_SEG_HEADER);
+        }
+        CHECK(append_row(i));
+        if (seg < 3) strcat(expect[seg], row);
+        sd_stream_poll(&sd);
+        fake_pico_advance_us(1000);
+    }
+    quiet(false);
+    CHECK(sd_stream_sync(&sd));
+    CHECK_EQ(sd.log.seg, 2);
+    CHECK_EQ(sd.log.rollovers, 2);
+    check_segment(0);
+    check_segment(1);
+    check_segment(2);
+    CHECK_EQ(sd.log.errors, 0);
+}
+
+// read_tail only reads the card: it must not write or flush the buffer
+static void test_read_tail_is_read_only(void) {
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    CHECK(boot());
+
+    strcpy(expect[0], SD_SEG_HEADER);
+    char row[64];
+    for (uint32_t i = 0; i < 500; i++) {
+        CHECK(append_row(i));
+        make_row(row, i);
+        strcat(expect[0], row);
+    }
+    CHECK(sd.log.fill > 0);    // some of it only in RAM
+
+    static const size_t MAXLENS[] = { 1, 2, 100, 513, 1024, 3000, 8192, 20000 };
+    static char tail[20000];
+    size_t total = strlen(expect[0]);
+    for (size_t i = 0; i < count_of(MAXLENS); i++) {
+        fake_disk_stats_t before = fake_disk;
+        size_t fill = sd.log.fill;
+        uint32_t base = sd.log.base, unsynced = sd.log.unsynced;
+
+        size_t n = sd_stream_read_tail(&sd, tail, MAXLENS[i]);
+
+        CHECK_EQ(fake_disk.writes, before.writes);
+        CHECK_EQ(fake_disk.syncs, before.syncs);
+        CHECK_EQ(sd.log.fill, fill);
+        CHECK_EQ(sd.log.base, base);
+        CHECK_EQ(sd.log.unsynced, unsynced);
+
+        // A suffix of the log, short of maxlen - 1 by under a sector
+        CHECK(n < MAXLENS[i]);
+        CHECK(n + SD_SECTOR_SIZE > MAXLENS[i] - 1 || n == total);
+        CHECK_EQ(strlen(tail), n);
+        CHECK(memcmp(tail, expect[0] + total - n, n) == 0);
+    }
+    CHECK_EQ(sd.log.errors, 0);
+}
+
+// A prepared next segment survives a reboot: it is not zero-filled again
+static void test_reboot_keeps_prepared_segment(void) {
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    CHECK(boot());
+    for (uint32_t i = 0; i < 100; i++) CHECK(append_row(i));
+    while (sd_stream_poll(&sd)) { }
+    CHECK_EQ(sd.log.next_zeroed, SD_SEG_SECTORS);
+    CHECK(sd_stream_sync(&sd));
+
+    CHECK(boot());
+    CHECK_EQ(sd.log.seg, 0);
+    CHECK(sd.log.next_lba != 0);
+    CHECK_EQ(sd.log.next_zeroed, SD_SEG_SECTORS);
+    uint32_t written = fake_disk.write_sectors;
+    while (sd_stream_poll(&sd)) { }
+    CHECK_EQ(fake_disk.write_sectors, written);
+
+    // Cut off part way through preparing segment 1 after a rollover: its
+    // last sector still holds the marker, so the fill starts over
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    CHECK(boot());
+    quiet(true);
+    for (uint32_t i = 0; sd.log.seg == 0; i++) CHECK(append_row(i));
+    quiet(false);
+    for (int k = 0; k < 3; k++) sd_stream_poll(&sd);    // create segment 2, zero a little
+    CHECK(sd.log.next_zeroed > 0 && sd.log.next_zeroed < SD_SEG_SECTORS);
+    CHECK(sd_stream_sync(&sd));
+    CHECK(boot());
+    CHECK_EQ(sd.log.seg, 1);
+    CHECK_EQ(sd.log.next_zeroed, 0);
+    while (sd_stream_poll(&sd)) { }
+    CHECK_EQ(sd.log.next_zeroed, SD_SEG_SECTORS);
+    CHECK_EQ(sd.log.errors, 0);
+}
+
+// All segments' text on the card, headers stripped, oldest first
+static size_t dump(char *out) {
+    size_t n = 0;
+    for (uint32_t seg = 0; seg < SD_SEG_KEEP; seg++) {
+        size_t len;
+        const char *text = card_text(seg, &len);
+        if (!text || len == 0) continue;
+        size_t hlen = strlen(SD_SEG_HEADER);
+        CHECK(len >= hlen && memcmp(text, SD_SEG_HEADER, hlen) == 0);
+        memcpy(out + n, text + hlen, len - hlen);
+        n += len - hlen;
+    }
+    return n;
+}
+
+// Power cuts at random sector writes: within stream writes, syncs,
+// rollovers, segment creation and zero fill. After each, the log on the
+// card must be a prefix of what was appended and hold everything synced.
+#define CUT_TRIALS  60
+
+static void test_power_cuts(void) {
+    static char appended[4u << 20], got[4u << 20];
+    static volatile size_t alen;
+    static volatile size_t synced;
+    static volatile uint32_t next_row;
+    static volatile uint32_t mid_fill;
+    static volatile uint32_t torn;
+    static uint32_t trials, x;
+
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    CHECK(boot());
+    alen = synced = 0;
+    next_row = 0;
+    mid_fill = torn = 0;
+    x = 12345;
+
+    for (trials = 0; trials < CUT_TRIALS; trials++) {
+        x = x * 1103515245u + 12345u;
+        fake_disk_arm_cut((x >> 16) % 300);
+        quiet(true);
+        if (setjmp(fake_disk_cut_jmp) == 0) {
+            for (int k = 0; k < 4000; k++) {
+                char row[64];
+                size_t len = make_row(row, next_row++);
+                sd_stream_append(&sd, row, len);
+                memcpy(appended + alen, row, len);
+                alen += len;
+                if (k % 7 == 0) sd_stream_poll(&sd);
+                if (sd.log.unsynced == 0) synced = alen;
+                fake_pico_advance_us(50000);
+            }
+        }
+        quiet(false);
+        fake_disk_disarm();
+        if (sd.log.next_lba && sd.log.next_zeroed < SD_SEG_SECTORS) mid_fill++;
+
+        CHECK(boot());
+        if (sd.log.oldest > 0) break;   // pruning: the dump no longer starts at row 0
+        size_t glen = dump(got);
+        if (glen < synced || glen > alen || memcmp(got, appended, glen) != 0) {
+            printf("trial %u: recovered %zu bytes, synced %zu, appended %zu\n",
+                   trials, glen, (size_t)synced, (size_t)alen);
+            test_failures++;
+            break;
+        }
+        // Rows after the cut are gone; a torn one is ended with a newline
+        // that is only on the card after the next sync
+        alen = synced = glen;
+        if (alen && appended[alen - 1] != '\n') {
+            appended[alen++] = '\n';
+            torn++;
+        }
+    }
+    printf("power cuts: %u trials, %u during a zero fill, %u torn rows, %lu segments\n",
+           trials, mid_fill, torn, (unsigned long)sd.log.seg + 1);
+    CHECK_EQ(trials, CUT_TRIALS);
+    CHECK(mid_fill > 0);
+    CHECK(torn > 0);
+    CHECK(sd.log.seg > 2);
+}
+
+static uint32_t negotiate(void) {
+    quiet(true);
+    uint32_t hz = sd_init(&sd) ? sd_negotiate_baud(&sd) : 0;
+    quiet(false);
+    uint32_t size;
+    LBA_t lba;
+    CHECK(!fake_fatfs_stat(SD_PROBE_FILE, &size, &lba));   // scratch file removed
+    CHECK_EQ(sd_get_by_num(0)->spi->baud_rate, hz);
+    return hz;
+}
+
+static void test_negotiate_baud(void) {
+    // Fine up to the 25 MHz limit: 20.8 MHz passes, 15.6 MHz is kept
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    fake_disk_set_max_baud(SD_BAUD_MAX, SD_BAUD_MAX);
+    CHECK_EQ(negotiate(), 15625000);
+
+    // Reads hold at 20.8 MHz but writes don't: a read-only probe would
+    // take it. 15.6 MHz passes, and one step below that is the default.
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    fake_disk_set_max_baud(0, 16000000);
+    CHECK_EQ(negotiate(), 12500000);
+
+    // Not even the configured rate passes: leave it alone
+    fake_fatfs_format(CARD_SECTORS, CARD_CSIZE);
+    fake_disk_set_max_baud(10000000, 10000000);
+    CHECK_EQ(negotiate(), 12500000);
+}
+
+int main(void) {
+    test_append_and_resume();
+    test_rollover();
+    test_read_tail_is_read_only();
+    test_reboot_keeps_prepared_segment();
+    test_power_cuts();
+    test_negotiate_baud();
+    return TEST_RESULT();
+}
@@ -0,0 +1,109 @@
+#ifndef FF_H
+#define FF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ffconf.h"
+
+// FatFs API as the firmware uses it. The objects keep the member names of
+// FatFs R0.15 that the firmware and fakes/fake_fatfs.c touch.
+
+typedef unsigned int UINT;
+typedef uint8_t  BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef unsigned long long QWORD;
+#if FF_FS_EXFAT
+typedef QWORD    FSIZE_t;
+#else
+typedef DWORD    FSIZE_t;
+#endif
+typedef DWORD    LBA_t;
+typedef char     TCHAR;
+
+typedef struct {
+    BYTE  fs_type;
+    BYTE  pdrv;
+    WORD  csize;         // sectors per cluster
+    DWORD n_fatent;      // clusters + 2
+    LBA_t fatbase;
+    LBA_t dirbase;
+    LBA_t database;      // first sector of cluster 2
+    LBA_t winsect;       // sector in win[]
+    BYTE  wflag;         // win[] dirty
+    DWORD last_clst;
+    BYTE  win[FF_MAX_SS];
+} FATFS;
+
+typedef struct {
+    FATFS  *fs;
+    WORD    id;
+    BYTE    attr;
+    BYTE    stat;
+    DWORD   sclust;      // first cluster
+    FSIZE_t objsize;
+} FFOBJID;
+
+typedef struct {
+    FFOBJID obj;
+    BYTE    flag;
+    BYTE    err;
+    FSIZE_t fptr;
+    DWORD   clust;       // cluster of fptr
+    LBA_t   sect;        // sector in buf[]
+    LBA_t   dir_sect;    // sector holding the directory entry
+    BYTE   *dir_ptr;     // the entry, inside fs->win
+    BYTE    buf[FF_MAX_SS];
+} FIL;
+
+typedef struct {
+    FFOBJID obj;
+    DWORD   dptr;        // next entry to read
+    TCHAR   path[16];
+} DIR;
+
+typedef struct {
+    FSIZE_t fsize;
+    BYTE    fattrib;
+    TCHAR   fname[256];
+} FILINFO;
+
+typedef enum {
+    FR_OK = 0, FR_DISK_ERR, FR_INT_ERR, FR_NOT_READY, FR_NO_FILE, FR_NO_PATH,
+    FR_INVALID_NAME, FR_DENIED, FR_EXIST, FR_INVALID_OBJECT, FR_WRITE_PROTECTED,
+    FR_INVALID_DRIVE, FR_NOT_ENABLED, FR_NO_FILESYSTEM, FR_MKFS_ABORTED,
+    FR_TIMEOUT, FR_LOCKED, FR_NOT_ENOUGH_CORE, FR_TOO_MANY_OPEN_FILES,
+    FR_INVALID_PARAMETER
+} FRESULT;
+
+#define FA_READ          0x01
+#define FA_WRITE         0x02
+#define FA_OPEN_EXISTING 0x00
+#define FA_CREATE_NEW    0x04
+#define FA_CREATE_ALWAYS 0x08
+#define FA_OPEN_ALWAYS   0x10
+#define FA_OPEN_APPEND   0x30
+
+#define AM_DIR           0x10
+
+#define f_size(fp)  ((fp)->obj.objsize)
+#define f_tell(fp)  ((fp)->fptr)
+
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt);
+FRESULT f_unmount(const TCHAR *path);
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+FRESULT f_truncate(FIL *fp);
+FRESULT f_sync(FIL *fp);
+FRESULT f_expand(FIL *fp, FSIZE_t fsz, BYTE opt);
+FRESULT f_unlink(const TCHAR *path);
+FRESULT f_mkdir(const TCHAR *path);
+FRESULT f_opendir(DIR *dp, const TCHAR *path);
+FRESULT f_closedir(DIR *dp);
+FRESULT f_readdir(DIR *dp, FILINFO *fno);
+TCHAR *f_gets(TCHAR *buff, int len, FIL *fp);
+
+#endif
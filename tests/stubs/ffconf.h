@@ -0,0 +1,10 @@
+#ifndef FFCONF_H
+#define FFCONF_H
+
+// The options of the FatFs build the firmware uses that matter here
+#define FF_MAX_SS      512
+#define FF_USE_EXPAND  1
+#define FF_FS_TINY     0
+#define FF_FS_EXFAT    1     // 64-bit file sizes
+
+#endif
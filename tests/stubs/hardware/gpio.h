@@ -0,0 +1,10 @@
+#ifndef HARDWARE_GPIO_H
+#define HARDWARE_GPIO_H
+
+enum gpio_function { GPIO_FUNC_I2C = 3 };
+
+// Pin setup has no effect on the host
+static inline void gpio_set_function(uint gpio, enum gpio_function fn) {}
+static inline void gpio_pull_up(uint gpio) {}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HARDWARE_SPI_H
+#define HARDWARE_SPI_H
+
+#include "hw_config.h"
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HARDWARE_SYNC_H
+#define HARDWARE_SYNC_H
+
+// Single-threaded host tests: barriers and events are no-ops
+static inline void __sev(void) {}
+static inline void __wfe(void) {}
+static inline void __mem_fence_acquire(void) { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+static inline void __mem_fence_release(void) { __atomic_thread_fence(__ATOMIC_RELEASE); }
+
+#endif
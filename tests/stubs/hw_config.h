@@ -0,0 +1,23 @@
+#ifndef HW_CONFIG_H
+#define HW_CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "pico/stdlib.h"
+
+// The parts of the FatFs_SPI driver's spi_t / sd_card_t the firmware uses
+typedef struct spi_inst spi_inst_t;
+
+typedef struct {
+    spi_inst_t *hw_inst;
+    uint        baud_rate;
+} spi_t;
+
+typedef struct {
+    const char *pcName;
+    spi_t      *spi;
+} sd_card_t;
+
+sd_card_t *sd_get_by_num(size_t num);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef LWIP_MQTT_PRIV_H
+#define LWIP_MQTT_PRIV_H
+
+#include "lwip/apps/mqtt.h"
+
+// Same members the firmware touches, same sizes as lwIP 2.2
+struct mqtt_ringbuf_t {
+    u16_t put;
+    u16_t get;
+    u8_t  buf[MQTT_OUTPUT_RINGBUF_SIZE];
+};
+
+struct mqtt_client_s {
+    u16_t cyclic_tick;
+    u16_t keep_alive;
+    u16_t server_watchdog;
+    u16_t pkt_id_seq;
+    u16_t inpub_pkt_id;
+    u8_t  conn_state;
+    void *conn;                        // struct tcp_pcb *
+    void *connect_arg;
+    mqtt_connection_cb_t connect_cb;
+    void *pend_req_queue;
+    void *req_list[MQTT_REQ_MAX_IN_FLIGHT];
+    void *inpub_arg;
+    mqtt_incoming_data_cb_t data_cb;
+    mqtt_incoming_publish_cb_t pub_cb;
+    u32_t msg_idx;
+    u8_t  rx_buffer[MQTT_VAR_HEADER_BUFFER_LEN];
+    struct mqtt_ringbuf_t output;
+};
+
+#endif
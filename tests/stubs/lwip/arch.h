@@ -0,0 +1,23 @@
+#ifndef LWIP_ARCH_H
+#define LWIP_ARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t  u8_t;
+typedef int8_t   s8_t;
+typedef uint16_t u16_t;
+typedef int16_t  s16_t;
+typedef uint32_t u32_t;
+typedef int32_t  s32_t;
+typedef s8_t     err_t;
+
+#define ERR_OK    0
+#define ERR_MEM  -1
+#define ERR_BUF  -2
+#define ERR_TIMEOUT -3
+#define ERR_CONN -11
+
+#define LWIP_UNUSED_ARG(x) (void)(x)
+
+#endif
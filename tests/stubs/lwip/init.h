@@ -0,0 +1,9 @@
+#ifndef LWIP_INIT_H
+#define LWIP_INIT_H
+
+// The lwIP release bundled with Pico SDK 2.x
+#define LWIP_VERSION_MAJOR     2
+#define LWIP_VERSION_MINOR     2
+#define LWIP_VERSION_REVISION  0
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef LWIP_IP_ADDR_H
+#define LWIP_IP_ADDR_H
+
+#include "lwip/arch.h"
+
+typedef struct { u32_t addr; } ip4_addr_t;
+typedef ip4_addr_t ip_addr_t;
+
+int ip4addr_aton(const char *cp, ip4_addr_t *addr);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef PICO_CYW43_ARCH_H
+#define PICO_CYW43_ARCH_H
+
+#include "pico/stdlib.h"
+
+void cyw43_arch_poll(void);
+void cyw43_arch_lwip_begin(void);
+void cyw43_arch_lwip_end(void);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef PICO_TIME_H
+#define PICO_TIME_H
+
+#include "pico/stdlib.h"
+
+// Alarms fire from fake_pico_advance_us() (and the sleeps), the host's
+// stand-in for the timer IRQ
+typedef int32_t alarm_id_t;
+typedef struct alarm_pool alarm_pool_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data,
+                           bool fire_if_past);
+alarm_id_t alarm_pool_add_alarm_in_ms(alarm_pool_t *pool, uint32_t ms,
+                                      alarm_callback_t callback, void *user_data,
+                                      bool fire_if_past);
+
+#endif
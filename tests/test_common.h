@@ -0,0 +1,48 @@
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+// Minimal check macros and a timer for the host tests. Each test is its
+// own executable: CHECK() records a failure and carries on, and main()
+// returns TEST_RESULT() so ctest sees the outcome.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static int test_failures __attribute__((unused)) = 0;
+
+#define CHECK(cond) do {                                              \
+        if (!(cond)) {                                                \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                          \
+        }                                                             \
+    } while (0)
+
+#define CHECK_EQ(a, b) do {                                           \
+        long long a_ = (long long)(a), b_ = (long long)(b);           \
+        if (a_ != b_) {                                               \
+            printf("%s:%d: CHECK failed: %s == %s (%lld != %lld)\n",  \
+                   __FILE__, __LINE__, #a, #b, a_, b_);               \
+            test_failures++;                                          \
+        }                                                             \
+    } while (0)
+
+#define TEST_RESULT() \
+    (test_failures ? (printf("FAILED: %d check(s)\n", test_failures), 1) \
+                   : (printf("PASSED\n"), 0))
+
+// Benchmark clock: TSC cycles on x86, nanoseconds elsewhere
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+static inline uint64_t bench_now(void) { return __rdtsc(); }
+#else
+#define BENCH_UNIT "ns"
+static inline uint64_t bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#endif